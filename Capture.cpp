@@ -0,0 +1,637 @@
+// Capture.cpp
+// Implementation of sample capture and capture reading
+
+#include "Capture.h"
+#include "Latency.h"
+
+#include <ace/Guard_T.h>
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_string.h>
+#include <ace/OS_NS_sys_time.h>
+
+namespace DirShare {
+
+namespace {
+
+const char CAPTURE_MAGIC[8] = { 'D', 'S', 'C', 'A', 'P', 'T', 'U', 'R' };
+const uint32_t CAPTURE_VERSION = 3;  // 3: chunks carry filename and file size
+const size_t HEADER_SIZE = sizeof(CAPTURE_MAGIC) + 4 + 8 + 4;
+const size_t RECORD_HEADER_SIZE = 1 + 8 + 4;
+
+// Largest payload accepted when reading (FileContent of the largest
+// file sent whole, with room to spare)
+const uint32_t MAX_PAYLOAD = 1024u * 1024u * 1024u;
+
+/**
+ * Little-endian encoding into a byte buffer
+ */
+class Encoder {
+public:
+  explicit Encoder(std::vector<unsigned char>& out) : out_(out) { out_.clear(); }
+
+  void u8(unsigned int value) { out_.push_back(static_cast<unsigned char>(value)); }
+
+  void u16(unsigned int value)
+  {
+    u8(value & 0xFF);
+    u8((value >> 8) & 0xFF);
+  }
+
+  void u32(uint32_t value)
+  {
+    for (int i = 0; i < 4; ++i) {
+      u8((value >> (8 * i)) & 0xFF);
+    }
+  }
+
+  void u64(uint64_t value)
+  {
+    for (int i = 0; i < 8; ++i) {
+      u8(static_cast<unsigned int>((value >> (8 * i)) & 0xFF));
+    }
+  }
+
+  void bytes(const unsigned char* data, uint32_t length)
+  {
+    u32(length);
+    out_.insert(out_.end(), data, data + length);
+  }
+
+  void string(const char* text)
+  {
+    const size_t length = text ? ACE_OS::strlen(text) : 0;
+    bytes(reinterpret_cast<const unsigned char*>(text), static_cast<uint32_t>(length));
+  }
+
+  template <typename Sequence>
+  void octets(const Sequence& data)
+  {
+    bytes(data.get_buffer(), data.length());
+  }
+
+  void metadata(const FileMetadata& metadata)
+  {
+    string(metadata.filename.in());
+    u64(metadata.size);
+    u64(metadata.timestamp_sec);
+    u32(metadata.timestamp_nsec);
+    u32(metadata.checksum);
+  }
+
+  void origin(const ChangeOrigin& origin)
+  {
+    u64(origin.event_id);
+    u64(origin.detect_sec);
+    u32(origin.detect_nsec);
+    u32(origin.scan_delay_usec);
+    u32(origin.queue_usec);
+  }
+
+private:
+  std::vector<unsigned char>& out_;
+};
+
+/**
+ * Little-endian decoding with bounds checks; once a read runs past the
+ * end, every later read fails too
+ */
+class Decoder {
+public:
+  Decoder(const unsigned char* data, size_t length)
+    : data_(data), length_(length), position_(0), ok_(true)
+  {
+  }
+
+  bool ok() const { return ok_; }
+
+  // All the payload was consumed, and nothing more
+  bool done() const { return ok_ && position_ == length_; }
+
+  size_t remaining() const { return length_ - position_; }
+
+  uint64_t uint(size_t size)
+  {
+    if (!take(size)) {
+      return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value |= static_cast<uint64_t>(data_[position_ - size + i]) << (8 * i);
+    }
+    return value;
+  }
+
+  uint32_t u32() { return static_cast<uint32_t>(uint(4)); }
+  uint64_t u64() { return uint(8); }
+
+  // Start of a length-prefixed run of length bytes, or 0
+  const unsigned char* bytes(uint32_t& length)
+  {
+    length = u32();
+    if (!take(length)) {
+      length = 0;
+      return 0;
+    }
+    return data_ + position_ - length;
+  }
+
+  std::string string()
+  {
+    uint32_t length;
+    const unsigned char* data = bytes(length);
+    return data ? std::string(reinterpret_cast<const char*>(data), length) : std::string();
+  }
+
+  template <typename Sequence>
+  void octets(Sequence& out)
+  {
+    uint32_t length;
+    const unsigned char* data = bytes(length);
+    out.length(length);
+    if (length > 0) {
+      ACE_OS::memcpy(out.get_buffer(), data, length);
+    }
+  }
+
+  void metadata(FileMetadata& metadata)
+  {
+    metadata.filename = string().c_str();
+    metadata.size = u64();
+    metadata.timestamp_sec = u64();
+    metadata.timestamp_nsec = u32();
+    metadata.checksum = u32();
+  }
+
+  void origin(ChangeOrigin& origin)
+  {
+    origin.event_id = u64();
+    origin.detect_sec = u64();
+    origin.detect_nsec = u32();
+    origin.scan_delay_usec = u32();
+    origin.queue_usec = u32();
+  }
+
+private:
+  bool take(size_t size)
+  {
+    if (!ok_ || size > length_ - position_) {
+      ok_ = false;
+      return false;
+    }
+    position_ += size;
+    return true;
+  }
+
+  const unsigned char* data_;
+  size_t length_;
+  size_t position_;
+  bool ok_;
+};
+
+void encode_open(Encoder& out, const TransferOpen& open)
+{
+  out.u64(open.session_id);
+  out.string(open.filename.in());
+  out.u64(open.file_size);
+  out.u32(open.file_checksum);
+  out.u32(open.chunk_size);
+  out.u32(open.total_chunks);
+  out.u64(open.timestamp_sec);
+  out.u32(open.timestamp_nsec);
+  out.u32(open.holes.length());
+  for (CORBA::ULong i = 0; i < open.holes.length(); ++i) {
+    out.u32(open.holes[i].first_chunk);
+    out.u32(open.holes[i].count);
+  }
+  out.u16(open.fec_data_chunks);
+  out.u16(open.fec_repair_chunks);
+  out.origin(open.origin);
+}
+
+bool decode_open(Decoder& in, TransferOpen& open)
+{
+  open.session_id = in.u64();
+  open.filename = in.string().c_str();
+  open.file_size = in.u64();
+  open.file_checksum = in.u32();
+  open.chunk_size = in.u32();
+  open.total_chunks = in.u32();
+  open.timestamp_sec = in.u64();
+  open.timestamp_nsec = in.u32();
+  const uint32_t holes = in.u32();
+  // Each hole takes 8 bytes: a longer count is malformed (and fails below)
+  open.holes.length(holes <= in.remaining() / 8 ? holes : 0);
+  if (open.holes.length() != holes) {
+    return false;
+  }
+  for (CORBA::ULong i = 0; i < open.holes.length() && in.ok(); ++i) {
+    open.holes[i].first_chunk = in.u32();
+    open.holes[i].count = in.u32();
+  }
+  open.fec_data_chunks = static_cast<CORBA::UShort>(in.uint(2));
+  open.fec_repair_chunks = static_cast<CORBA::UShort>(in.uint(2));
+  in.origin(open.origin);
+  return true;
+}
+
+// Decode the payload of a record into its member of record
+bool decode(CaptureRecord& record, const unsigned char* data, size_t length)
+{
+  Decoder in(data, length);
+  switch (record.type) {
+  case CAPTURE_FILE_EVENT:
+    record.event.filename = in.string().c_str();
+    record.event.operation = static_cast<OperationType>(in.u32());
+    record.event.timestamp_sec = in.u64();
+    record.event.timestamp_nsec = in.u32();
+    in.metadata(record.event.metadata);
+    in.origin(record.event.origin);
+    break;
+
+  case CAPTURE_FILE_CONTENT:
+    record.content.filename = in.string().c_str();
+    in.octets(record.content.data);
+    record.content.size = in.u64();
+    record.content.checksum = in.u32();
+    record.content.timestamp_sec = in.u64();
+    record.content.timestamp_nsec = in.u32();
+    in.origin(record.content.origin);
+    break;
+
+  case CAPTURE_TRANSFER_OPEN:
+  case CAPTURE_PULL_OPEN:
+    if (!decode_open(in, record.open)) {
+      return false;
+    }
+    break;
+
+  case CAPTURE_FILE_CHUNK:
+    record.chunk.session_id = in.u64();
+    record.chunk.filename = in.string().c_str();
+    record.chunk.file_size = in.u64();
+    record.chunk.offset = in.u64();
+    in.octets(record.chunk.data);
+    record.chunk.chunk_checksum = in.u32();
+    break;
+
+  case CAPTURE_FEC_CHUNK:
+    record.fec_chunk.session_id = in.u64();
+    record.fec_chunk.filename = in.string().c_str();
+    record.fec_chunk.file_size = in.u64();
+    record.fec_chunk.group = in.u32();
+    record.fec_chunk.index = static_cast<CORBA::UShort>(in.uint(2));
+    in.octets(record.fec_chunk.data);
+    record.fec_chunk.chunk_checksum = in.u32();
+    break;
+
+  case CAPTURE_CHUNKS_ENDED:
+  case CAPTURE_OPEN_DISPOSED:
+    record.session_id = in.u64();
+    break;
+
+  case CAPTURE_DIRECTORY_SNAPSHOT: {
+    record.snapshot.participant_id = in.string().c_str();
+    const uint32_t files = in.u32();
+    // Each entry takes at least 28 bytes: a longer count is malformed
+    if (files > in.remaining() / 28) {
+      return false;
+    }
+    record.snapshot.files.length(files);
+    for (CORBA::ULong i = 0; i < record.snapshot.files.length() && in.ok(); ++i) {
+      in.metadata(record.snapshot.files[i]);
+    }
+    record.snapshot.snapshot_time_sec = in.u64();
+    record.snapshot.snapshot_time_nsec = in.u32();
+    record.snapshot.file_count = in.u32();
+    break;
+  }
+
+  default:
+    return false;
+  }
+  return in.done();
+}
+
+} // namespace
+
+const char* capture_record_name(CaptureRecordType type)
+{
+  switch (type) {
+  case CAPTURE_FILE_EVENT: return "FileEvent";
+  case CAPTURE_FILE_CONTENT: return "FileContent";
+  case CAPTURE_TRANSFER_OPEN: return "TransferOpen";
+  case CAPTURE_PULL_OPEN: return "PullOpen";
+  case CAPTURE_FILE_CHUNK: return "FileChunk";
+  case CAPTURE_FEC_CHUNK: return "FecChunk";
+  case CAPTURE_CHUNKS_ENDED: return "ChunksEnded";
+  case CAPTURE_OPEN_DISPOSED: return "OpenDisposed";
+  case CAPTURE_DIRECTORY_SNAPSHOT: return "DirectorySnapshot";
+  }
+  return "unknown";
+}
+
+SampleCapture::SampleCapture()
+  : file_(0)
+  , records_(0)
+{
+}
+
+SampleCapture::~SampleCapture()
+{
+  close();
+}
+
+SampleCapture& SampleCapture::instance()
+{
+  static SampleCapture capture;
+  return capture;
+}
+
+bool SampleCapture::open(const std::string& path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  if (file_) {
+    ACE_OS::fclose(file_);
+    file_ = 0;
+  }
+
+  FILE* file = ACE_OS::fopen(path.c_str(), ACE_TEXT("wb"));
+  if (!file) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot create capture file %C: %m\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  std::vector<unsigned char> header;
+  Encoder out(header);
+  for (size_t i = 0; i < sizeof(CAPTURE_MAGIC); ++i) {
+    out.u8(static_cast<unsigned char>(CAPTURE_MAGIC[i]));
+  }
+  out.u32(CAPTURE_VERSION);
+  out.u64(static_cast<uint64_t>(now.sec()));
+  out.u32(static_cast<uint32_t>(now.usec()));
+  if (ACE_OS::fwrite(&header[0], 1, header.size(), file) != header.size()) {
+    ACE_OS::fclose(file);
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot write capture file %C: %m\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  epoch_ = monotonic_now();
+  records_ = 0;
+  file_ = file;
+  return true;
+}
+
+void SampleCapture::close()
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  if (file_) {
+    ACE_OS::fclose(file_);
+    file_ = 0;
+  }
+}
+
+void SampleCapture::write(CaptureRecordType type, const std::vector<unsigned char>& payload)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  if (!file_) {
+    return;
+  }
+
+  const ACE_Time_Value elapsed = monotonic_now() - epoch_;
+  const uint64_t time_usec =
+    static_cast<uint64_t>(elapsed.sec()) * 1000000 + static_cast<uint64_t>(elapsed.usec());
+
+  std::vector<unsigned char> header;
+  Encoder out(header);
+  out.u8(type);
+  out.u64(time_usec);
+  out.u32(static_cast<uint32_t>(payload.size()));
+
+  if (ACE_OS::fwrite(&header[0], 1, header.size(), file_) != header.size() ||
+      (!payload.empty() &&
+       ACE_OS::fwrite(&payload[0], 1, payload.size(), file_) != payload.size())) {
+    // Stop rather than leave a gap in the middle of the capture
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Cannot write capture record, capture stopped: %m\n")));
+    ACE_OS::fclose(file_);
+    file_ = 0;
+    return;
+  }
+  ++records_;
+}
+
+void SampleCapture::record(const FileEvent& event)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  Encoder out(payload);
+  out.string(event.filename.in());
+  out.u32(static_cast<uint32_t>(event.operation));
+  out.u64(event.timestamp_sec);
+  out.u32(event.timestamp_nsec);
+  out.metadata(event.metadata);
+  out.origin(event.origin);
+  write(CAPTURE_FILE_EVENT, payload);
+}
+
+void SampleCapture::record(const FileContent& content)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  payload.reserve(content.data.length() + 128);
+  Encoder out(payload);
+  out.string(content.filename.in());
+  out.octets(content.data);
+  out.u64(content.size);
+  out.u32(content.checksum);
+  out.u64(content.timestamp_sec);
+  out.u32(content.timestamp_nsec);
+  out.origin(content.origin);
+  write(CAPTURE_FILE_CONTENT, payload);
+}
+
+void SampleCapture::record(const FileChunk& chunk)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  payload.reserve(chunk.data.length() + 64);
+  Encoder out(payload);
+  out.u64(chunk.session_id);
+  out.string(chunk.filename.in());
+  out.u64(chunk.file_size);
+  out.u64(chunk.offset);
+  out.octets(chunk.data);
+  out.u32(chunk.chunk_checksum);
+  write(CAPTURE_FILE_CHUNK, payload);
+}
+
+void SampleCapture::record(const FecChunk& chunk)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  payload.reserve(chunk.data.length() + 64);
+  Encoder out(payload);
+  out.u64(chunk.session_id);
+  out.string(chunk.filename.in());
+  out.u64(chunk.file_size);
+  out.u32(chunk.group);
+  out.u16(chunk.index);
+  out.octets(chunk.data);
+  out.u32(chunk.chunk_checksum);
+  write(CAPTURE_FEC_CHUNK, payload);
+}
+
+void SampleCapture::record(const DirectorySnapshot& snapshot)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  Encoder out(payload);
+  out.string(snapshot.participant_id.in());
+  out.u32(snapshot.files.length());
+  for (CORBA::ULong i = 0; i < snapshot.files.length(); ++i) {
+    out.metadata(snapshot.files[i]);
+  }
+  out.u64(snapshot.snapshot_time_sec);
+  out.u32(snapshot.snapshot_time_nsec);
+  out.u32(snapshot.file_count);
+  write(CAPTURE_DIRECTORY_SNAPSHOT, payload);
+}
+
+void SampleCapture::record_open(const TransferOpen& open, bool pulled)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  Encoder out(payload);
+  encode_open(out, open);
+  write(pulled ? CAPTURE_PULL_OPEN : CAPTURE_TRANSFER_OPEN, payload);
+}
+
+void SampleCapture::record_session_end(CaptureRecordType type, uint64_t session_id)
+{
+  if (!enabled()) {
+    return;
+  }
+  std::vector<unsigned char> payload;
+  Encoder out(payload);
+  out.u64(session_id);
+  write(type, payload);
+}
+
+CaptureReader::CaptureReader()
+  : file_(0)
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+  if (file_) {
+    ACE_OS::fclose(file_);
+  }
+}
+
+bool CaptureReader::open(const std::string& path)
+{
+  if (file_) {
+    ACE_OS::fclose(file_);
+  }
+  path_ = path;
+  file_ = ACE_OS::fopen(path.c_str(), ACE_TEXT("rb"));
+  if (!file_) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot open capture file %C: %m\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  unsigned char header[HEADER_SIZE];
+  Decoder in(header, sizeof(header));
+  if (ACE_OS::fread(header, 1, sizeof(header), file_) != sizeof(header) ||
+      ACE_OS::memcmp(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: %C is not a DirShare capture\n"),
+                     path.c_str()),
+                    false);
+  }
+  in.uint(sizeof(CAPTURE_MAGIC));
+  const uint32_t version = in.u32();
+  if (version != CAPTURE_VERSION) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: %C: unsupported capture version %u\n"),
+                     path.c_str(),
+                     version),
+                    false);
+  }
+  const uint64_t start_sec = in.u64();
+  const uint32_t start_usec = in.u32();
+  start_time_.set(static_cast<time_t>(start_sec), static_cast<suseconds_t>(start_usec));
+  return true;
+}
+
+int CaptureReader::next(CaptureRecord& record)
+{
+  if (!file_) {
+    return 0;
+  }
+
+  unsigned char header[RECORD_HEADER_SIZE];
+  const size_t got = ACE_OS::fread(header, 1, sizeof(header), file_);
+  if (got == 0) {
+    return 0;
+  }
+
+  Decoder in(header, got);
+  record.type = static_cast<CaptureRecordType>(in.uint(1));
+  record.time_usec = in.u64();
+  const uint32_t length = in.u32();
+  if (!in.ok() || length > MAX_PAYLOAD) {
+    if (in.ok()) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: %C: malformed record (%u bytes)\n"),
+                       path_.c_str(),
+                       length),
+                      -1);
+    }
+    ACE_DEBUG((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: %C ends with a truncated record\n"),
+               path_.c_str()));
+    return 0;
+  }
+
+  payload_.resize(length);
+  if (length > 0 && ACE_OS::fread(&payload_[0], 1, length, file_) != length) {
+    ACE_DEBUG((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: %C ends with a truncated record\n"),
+               path_.c_str()));
+    return 0;
+  }
+
+  record.size = RECORD_HEADER_SIZE + length;
+  if (!decode(record, length > 0 ? &payload_[0] : 0, length)) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: %C: malformed %C record\n"),
+                     path_.c_str(),
+                     capture_record_name(record.type)),
+                    -1);
+  }
+  return 1;
+}
+
+} // namespace DirShare
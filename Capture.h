@@ -0,0 +1,155 @@
+// Capture.h
+// Recording of the samples reaching the receive path, for deterministic
+// replay into the listeners (dirshare-replay)
+
+#ifndef DIRSHARE_CAPTURE_H
+#define DIRSHARE_CAPTURE_H
+
+#include "DirShareTypeSupportImpl.h"
+
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * Kinds of capture records
+ *
+ * Besides the samples themselves the capture holds the calls that start
+ * and end chunked sessions, since chunks are only applied to an open one.
+ */
+enum CaptureRecordType {
+  CAPTURE_FILE_EVENT = 1,
+  CAPTURE_FILE_CONTENT = 2,
+  CAPTURE_TRANSFER_OPEN = 3,     // TransferOpen sample
+  CAPTURE_PULL_OPEN = 4,         // Session opened locally (swarm download)
+  CAPTURE_FILE_CHUNK = 5,        // FileChunk or ChunkReply sample
+  CAPTURE_FEC_CHUNK = 6,
+  CAPTURE_CHUNKS_ENDED = 7,      // Chunk instance of a session ended
+  CAPTURE_OPEN_DISPOSED = 8,     // TransferOpen instance of a session disposed
+  CAPTURE_DIRECTORY_SNAPSHOT = 9
+};
+
+/// Name of a record type ("FileEvent", ...)
+const char* capture_record_name(CaptureRecordType type);
+
+/**
+ * One record read back from a capture; only the member matching type is set
+ */
+struct CaptureRecord {
+  CaptureRecordType type;
+  unsigned long long time_usec;  // Monotonic, relative to the start of the capture
+  size_t size;                   // Encoded size (bytes)
+  FileEvent event;
+  FileContent content;
+  TransferOpen open;             // CAPTURE_TRANSFER_OPEN, CAPTURE_PULL_OPEN
+  FileChunk chunk;
+  FecChunk fec_chunk;
+  DirectorySnapshot snapshot;
+  uint64_t session_id;           // CAPTURE_CHUNKS_ENDED, CAPTURE_OPEN_DISPOSED
+};
+
+/**
+ * @class SampleCapture
+ * @brief Process-wide recorder of received samples (off by default)
+ *
+ * The listeners report every sample at the entry of their receive path;
+ * once opened, each one is appended to the capture file with its arrival
+ * time. Records are little-endian and self-delimiting:
+ *
+ *   header: "DSCAPTUR" version(u32) start_sec(u64) start_usec(u32)
+ *   record: type(u8) time_usec(u64) length(u32) payload(length bytes)
+ *
+ * Strings and sequences are a u32 length followed by their elements.
+ * Samples arrive on several reader threads, so writes are serialized;
+ * while closed, recording costs one test of a flag.
+ */
+class SampleCapture {
+public:
+  /// The capture of the process
+  static SampleCapture& instance();
+
+  /**
+   * Start recording to a file
+   * @param path Capture file (replaced)
+   * @return true on success (failures are logged)
+   */
+  bool open(const std::string& path);
+
+  /// Flush and close the capture file
+  void close();
+
+  bool enabled() const { return file_ != 0; }
+
+  /// Records written since open()
+  unsigned long long records() const { return records_; }
+
+  void record(const FileEvent& event);
+  void record(const FileContent& content);
+  void record(const FileChunk& chunk);
+  void record(const FecChunk& chunk);
+  void record(const DirectorySnapshot& snapshot);
+  void record_open(const TransferOpen& open, bool pulled);
+  void record_session_end(CaptureRecordType type, uint64_t session_id);
+
+private:
+  SampleCapture();
+  ~SampleCapture();
+
+  // Append one encoded record
+  void write(CaptureRecordType type, const std::vector<unsigned char>& payload);
+
+  FILE* file_;
+  ACE_Time_Value epoch_;  // Monotonic time of open()
+  unsigned long long records_;
+  ACE_Thread_Mutex lock_;
+
+  SampleCapture(const SampleCapture&);
+  SampleCapture& operator=(const SampleCapture&);
+};
+
+/**
+ * @class CaptureReader
+ * @brief Reads the records of a capture file in order
+ */
+class CaptureReader {
+public:
+  CaptureReader();
+  ~CaptureReader();
+
+  /**
+   * Open a capture file and check its header
+   * @param path Capture file
+   * @return true on success (failures are logged)
+   */
+  bool open(const std::string& path);
+
+  /**
+   * Read the next record
+   * A record cut short (capture of a process that did not exit cleanly)
+   * ends the capture with a warning
+   * @param record Output: record read
+   * @return 1 if a record was read, 0 at the end, -1 on a malformed record
+   */
+  int next(CaptureRecord& record);
+
+  /// Wall clock time the capture was started
+  const ACE_Time_Value& start_time() const { return start_time_; }
+
+private:
+  FILE* file_;
+  std::string path_;
+  ACE_Time_Value start_time_;
+  std::vector<unsigned char> payload_;
+
+  CaptureReader(const CaptureReader&);
+  CaptureReader& operator=(const CaptureReader&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_CAPTURE_H
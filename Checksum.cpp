@@ -1,4 +1,5 @@
 #include "Checksum.h"
+#include "FileSystem.h"
 #include <fstream>
 #include <vector>
 
@@ -71,6 +72,76 @@ unsigned long calculate_crc32_incremental(const unsigned char* data,
   return crc;
 }
 
+namespace {
+
+// GF(2) 32x32 matrix helpers: the CRC register update for a zero input is
+// linear, so appending 2^k zero bits is a matrix power (as in zlib's
+// crc32_combine)
+unsigned long gf2_matrix_times(const unsigned long* mat, unsigned long vec)
+{
+  unsigned long sum = 0;
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    ++mat;
+  }
+  return sum;
+}
+
+void gf2_matrix_square(unsigned long* square, const unsigned long* mat)
+{
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+} // namespace
+
+unsigned long calculate_crc32_zeros(unsigned long long length,
+                                    unsigned long previous_crc)
+{
+  unsigned long crc = previous_crc & 0xFFFFFFFFUL;
+  if (length == 0) {
+    return crc;
+  }
+
+  unsigned long even[32]; // Operator for an even power of two zero bits
+  unsigned long odd[32];  // Operator for an odd power of two zero bits
+
+  // Operator for one zero bit
+  odd[0] = 0xEDB88320UL;
+  unsigned long row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  gf2_matrix_square(even, odd); // Two zero bits
+  gf2_matrix_square(odd, even); // Four zero bits
+
+  // Apply length zero bytes, starting with the one-byte operator
+  do {
+    gf2_matrix_square(even, odd);
+    if (length & 1) {
+      crc = gf2_matrix_times(even, crc);
+    }
+    length >>= 1;
+    if (length == 0) {
+      break;
+    }
+
+    gf2_matrix_square(odd, even);
+    if (length & 1) {
+      crc = gf2_matrix_times(odd, crc);
+    }
+    length >>= 1;
+  } while (length != 0);
+
+  return crc;
+}
+
 unsigned long finalize_crc32(unsigned long crc)
 {
   return crc ^ 0xFFFFFFFF;
@@ -78,6 +149,15 @@ unsigned long finalize_crc32(unsigned long crc)
 
 bool calculate_file_crc32(const char* file_path, unsigned long& checksum)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    std::vector<unsigned char> data;
+    if (!file_system->read_file(file_path, data)) {
+      return false;
+    }
+    checksum = calculate_crc32(data.empty() ? 0 : &data[0], data.size());
+    return true;
+  }
+
   std::ifstream file(file_path, std::ios::binary);
   if (!file.is_open()) {
     return false;
@@ -31,6 +31,17 @@ unsigned long calculate_crc32_incremental(const unsigned char* data,
                                          size_t length,
                                          unsigned long previous_crc);
 
+/**
+ * Extend an incremental CRC32 calculation by a run of zero bytes
+ * Runs in O(log length), so holes in sparse files can be checksummed
+ * without materializing them
+ * @param length Number of zero bytes
+ * @param previous_crc Previous CRC value (use 0xFFFFFFFF for first chunk)
+ * @return Updated CRC32 value
+ */
+unsigned long calculate_crc32_zeros(unsigned long long length,
+                                    unsigned long previous_crc);
+
 /**
  * Finalize incremental CRC32 calculation
  * @param crc CRC value from incremental calculations
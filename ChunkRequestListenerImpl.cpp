@@ -0,0 +1,99 @@
+#include "ChunkRequestListenerImpl.h"
+#include "ChunkServer.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+
+namespace DirShare {
+
+ChunkRequestListenerImpl::ChunkRequestListenerImpl(ChunkServer& server)
+  : server_(server)
+  , received_("received", "DirShare_ChunkRequests")
+{
+}
+
+ChunkRequestListenerImpl::~ChunkRequestListenerImpl()
+{
+}
+
+void ChunkRequestListenerImpl::on_requested_deadline_missed(
+  DDS::DataReader_ptr,
+  const DDS::RequestedDeadlineMissedStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_requested_incompatible_qos(
+  DDS::DataReader_ptr,
+  const DDS::RequestedIncompatibleQosStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_sample_rejected(
+  DDS::DataReader_ptr,
+  const DDS::SampleRejectedStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_liveliness_changed(
+  DDS::DataReader_ptr,
+  const DDS::LivelinessChangedStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_subscription_matched(
+  DDS::DataReader_ptr,
+  const DDS::SubscriptionMatchedStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_sample_lost(
+  DDS::DataReader_ptr,
+  const DDS::SampleLostStatus&)
+{
+}
+
+void ChunkRequestListenerImpl::on_data_available(DDS::DataReader_ptr reader)
+{
+  ChunkRequestDataReader_var request_reader =
+    ChunkRequestDataReader::_narrow(reader);
+
+  if (!request_reader) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: ChunkRequestListenerImpl::on_data_available() - ")
+               ACE_TEXT("failed to narrow DataReader!\n")));
+    return;
+  }
+
+  for (;;) {
+    ChunkRequest request;
+    DDS::SampleInfo info;
+
+    DDS::ReturnCode_t status = request_reader->take_next_sample(request, info);
+
+    if (status == DDS::RETCODE_NO_DATA) {
+      break;
+    }
+
+    if (status != DDS::RETCODE_OK) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: ChunkRequestListenerImpl::on_data_available() - ")
+                 ACE_TEXT("take_next_sample failed: %d\n"),
+                 status));
+      break;
+    }
+
+    if (info.valid_data) {
+      DIRSHARE_DEBUG_EVERY(request.filename.in(),
+                           ("Received ChunkRequest: %s chunks %u+%u (session %llu)\n",
+                            request.filename.in(),
+                            static_cast<unsigned int>(request.first_chunk),
+                            static_cast<unsigned int>(request.count),
+                            static_cast<unsigned long long>(request.session_id)));
+
+      received_.sample();
+      server_.enqueue(request);
+    }
+  }
+}
+
+} // namespace DirShare
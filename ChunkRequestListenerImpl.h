@@ -0,0 +1,57 @@
+#ifndef DIRSHARE_CHUNK_REQUEST_LISTENER_IMPL_H
+#define DIRSHARE_CHUNK_REQUEST_LISTENER_IMPL_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
+
+#include <dds/DCPS/LocalObject.h>
+#include <dds/DdsDcpsSubscriptionC.h>
+
+namespace DirShare {
+
+class ChunkServer;
+
+// Receives ChunkRequests addressed to this participant (the reader uses a
+// content filter on source_id) and queues them on the chunk server
+class ChunkRequestListenerImpl
+  : public virtual OpenDDS::DCPS::LocalObject<DDS::DataReaderListener>
+{
+public:
+  explicit ChunkRequestListenerImpl(ChunkServer& server);
+
+  virtual ~ChunkRequestListenerImpl();
+
+  virtual void on_requested_deadline_missed(
+    DDS::DataReader_ptr reader,
+    const DDS::RequestedDeadlineMissedStatus& status);
+
+  virtual void on_requested_incompatible_qos(
+    DDS::DataReader_ptr reader,
+    const DDS::RequestedIncompatibleQosStatus& status);
+
+  virtual void on_sample_rejected(
+    DDS::DataReader_ptr reader,
+    const DDS::SampleRejectedStatus& status);
+
+  virtual void on_liveliness_changed(
+    DDS::DataReader_ptr reader,
+    const DDS::LivelinessChangedStatus& status);
+
+  virtual void on_data_available(DDS::DataReader_ptr reader);
+
+  virtual void on_subscription_matched(
+    DDS::DataReader_ptr reader,
+    const DDS::SubscriptionMatchedStatus& status);
+
+  virtual void on_sample_lost(
+    DDS::DataReader_ptr reader,
+    const DDS::SampleLostStatus& status);
+
+private:
+  ChunkServer& server_;  // Serves the requests on its own thread
+  TopicCounters received_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_CHUNK_REQUEST_LISTENER_IMPL_H
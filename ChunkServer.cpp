@@ -0,0 +1,205 @@
+// ChunkServer.cpp
+// Implementation of the chunk request server
+
+#include "ChunkServer.h"
+#include "FilePublisher.h"
+#include "FileUtils.h"
+#include "Checksum.h"
+#include "Trace.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_sys_time.h>
+
+#include <cstring>
+
+namespace DirShare {
+
+namespace {
+
+// Requests beyond this are dropped (the requesters time out and retry)
+const size_t MAX_QUEUED_REQUESTS = 256;
+
+// Attempts for a write that times out on a full reliable history
+const int MAX_BLOCKED_WRITE_ATTEMPTS = 50;
+
+} // namespace
+
+ChunkServer::ChunkServer(const std::string& shared_directory,
+                         ContentIndex& content_index,
+                         DDS::DataWriter_ptr reply_writer)
+  : shared_directory_(shared_directory)
+  , content_index_(content_index)
+  , reply_writer_(FileChunkDataWriter::_narrow(reply_writer))
+  , stopping_(false)
+  , queued_(lock_)
+  , replies_sent_("sent", "DirShare_ChunkReplies")
+  , requests_dropped_(MetricsRegistry::instance().counter(
+      "dirshare_chunk_requests_dropped_total",
+      "Chunk requests dropped because the serving queue was full"))
+  , requests_queued_(MetricsRegistry::instance().gauge(
+      "dirshare_chunk_requests_queued", "Chunk requests waiting to be served"))
+{
+}
+
+ChunkServer::~ChunkServer()
+{
+}
+
+bool ChunkServer::start()
+{
+  if (activate(THR_NEW_LWP | THR_JOINABLE, 1) != 0) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: ChunkServer::start() - activate failed\n")));
+    return false;
+  }
+  return true;
+}
+
+void ChunkServer::stop()
+{
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    stopping_ = true;
+    requests_queued_.sub(static_cast<long>(queue_.size()));
+    queue_.clear();
+    queued_.broadcast();
+  }
+  wait();
+}
+
+void ChunkServer::enqueue(const ChunkRequest& request)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  if (queue_.size() >= MAX_QUEUED_REQUESTS) {
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Chunk request queue full, dropping request for %C\n"),
+               request.filename.in()));
+    requests_dropped_.increment();
+    return;
+  }
+
+  queue_.push_back(request);
+  requests_queued_.add(1);
+  queued_.signal();
+}
+
+int ChunkServer::svc()
+{
+  for (;;) {
+    ChunkRequest request;
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      while (queue_.empty() && !stopping_) {
+        queued_.wait();
+      }
+      if (stopping_) {
+        return 0;
+      }
+      request = queue_.front();
+      queue_.pop_front();
+      requests_queued_.sub(1);
+    }
+
+    serve(request);
+  }
+}
+
+bool ChunkServer::serve(const ChunkRequest& request)
+{
+  const std::string filename = request.filename.in();
+  TraceSpan span("serve", "serve_chunk_request", filename.c_str());
+  const uint64_t chunk_size = request.chunk_size;
+
+  if (chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE ||
+      request.count == 0 ||
+      request.first_chunk * chunk_size >= request.file_size ||
+      !is_valid_filename(filename)) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Invalid chunk request for %C (chunk %u +%u of %u bytes)\n"),
+               filename.c_str(),
+               request.first_chunk,
+               request.count,
+               request.chunk_size));
+    return false;
+  }
+
+  // Only serve the exact content that was advertised, and not a local
+  // copy still waiting for its own transfer to confirm it
+  if (!content_index_.contains(filename, request.file_size, request.file_checksum) ||
+      content_index_.unverified(filename)) {
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("Requested content of %s is not held locally, ignoring request\n",
+                         filename.c_str()));
+    return false;
+  }
+
+  DIRSHARE_DEBUG_EVERY(filename.c_str(),
+                       ("Serving %s chunks %u+%u for session %llu\n",
+                        filename.c_str(),
+                        static_cast<unsigned int>(request.first_chunk),
+                        static_cast<unsigned int>(request.count),
+                        static_cast<unsigned long long>(request.session_id)));
+
+  const std::string full_path = shared_directory_ + "/" + filename;
+  FileChunk chunk;
+  chunk.session_id = request.session_id;
+  chunk.filename = "";  // Replies are addressed; only pushed chunks are filtered
+  chunk.file_size = 0;
+  std::vector<unsigned char> buffer;
+  bool ok = true;
+
+  for (uint32_t c = 0; c < request.count; ++c) {
+    uint64_t offset = (static_cast<uint64_t>(request.first_chunk) + c) * chunk_size;
+    if (offset >= request.file_size) {
+      break;
+    }
+    size_t length = static_cast<size_t>(
+      offset + chunk_size > request.file_size ? request.file_size - offset : chunk_size);
+
+    if (!read_file_range(full_path, offset, length, buffer)) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: Failed to read %C at offset %Q\n"),
+                 full_path.c_str(),
+                 offset));
+      ok = false;
+      break;
+    }
+
+    chunk.offset = offset;
+    chunk.data.length(static_cast<CORBA::ULong>(length));
+    if (length > 0) {
+      std::memcpy(chunk.data.get_buffer(), &buffer[0], length);
+    }
+    chunk.chunk_checksum = compute_checksum(&buffer[0], length);
+
+    // A full reliable history makes write() time out; give the reader's
+    // acknowledgements a chance to free it
+    DDS::ReturnCode_t ret = DDS::RETCODE_TIMEOUT;
+    for (int attempt = 0;
+         attempt < MAX_BLOCKED_WRITE_ATTEMPTS && ret == DDS::RETCODE_TIMEOUT;
+         ++attempt) {
+      ret = reply_writer_->write(chunk, DDS::HANDLE_NIL);
+    }
+    if (ret != DDS::RETCODE_OK) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: write chunk reply failed: %d\n"),
+                 ret));
+      ok = false;
+      break;
+    }
+    replies_sent_.sample(length);
+
+    // Small delay to avoid overwhelming UDP send buffer
+    ACE_OS::sleep(ACE_Time_Value(0, 10000)); // 10ms
+  }
+
+  // The requester tracks its session itself; nothing is kept per requester
+  reply_writer_->unregister_instance(chunk, DDS::HANDLE_NIL);
+  return ok;
+}
+
+} // namespace DirShare
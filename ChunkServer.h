@@ -0,0 +1,84 @@
+// ChunkServer.h
+// Serves ChunkRequests from peers that pull a file this participant holds
+
+#ifndef DIRSHARE_CHUNK_SERVER_H
+#define DIRSHARE_CHUNK_SERVER_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "ContentIndex.h"
+#include "Metrics.h"
+
+#include <ace/Task.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Condition_Thread_Mutex.h>
+
+#include <string>
+#include <deque>
+
+namespace DirShare {
+
+/**
+ * @class ChunkServer
+ * @brief Answers chunk requests with FileChunks read from the local file
+ *
+ * Requests are queued by ChunkRequestListenerImpl and served in arrival
+ * order by a worker thread, so a blocked reliable write never holds up the
+ * DDS thread that delivers acknowledgements. A request is only served if
+ * the local file still holds the requested content (ContentIndex);
+ * otherwise it is dropped and the requester times out and asks another peer.
+ *
+ * Replies carry the requester's session id. The instance is unregistered
+ * after each request so the writer keeps no state per requester.
+ */
+class ChunkServer : public ACE_Task_Base {
+public:
+  /**
+   * Constructor
+   * @param shared_directory Path to the shared directory
+   * @param content_index Local content index (checked before serving)
+   * @param reply_writer DataWriter for the ChunkReplies topic
+   */
+  ChunkServer(const std::string& shared_directory,
+              ContentIndex& content_index,
+              DDS::DataWriter_ptr reply_writer);
+
+  virtual ~ChunkServer();
+
+  /**
+   * Start the worker thread
+   * @return true on success
+   */
+  bool start();
+
+  /**
+   * Stop the worker thread (queued requests are dropped)
+   */
+  void stop();
+
+  /**
+   * Queue a request addressed to this participant
+   * @param request Received request
+   */
+  void enqueue(const ChunkRequest& request);
+
+  virtual int svc();
+
+private:
+  // Read and send the chunks of one request
+  bool serve(const ChunkRequest& request);
+
+  std::string shared_directory_;
+  ContentIndex& content_index_;
+  FileChunkDataWriter_var reply_writer_;
+  std::deque<ChunkRequest> queue_;
+  bool stopping_;
+  ACE_Thread_Mutex lock_;
+  ACE_Condition_Thread_Mutex queued_;
+  TopicCounters replies_sent_;
+  Counter& requests_dropped_;
+  Gauge& requests_queued_;  // Shared by the servers of a relay
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_CHUNK_SERVER_H
@@ -0,0 +1,137 @@
+// ChunkSizeTuner.cpp
+// Implementation of the chunk size controller
+
+#include "ChunkSizeTuner.h"
+
+namespace DirShare {
+
+namespace {
+
+// Writes per observation window
+const unsigned long WINDOW_WRITES = 16;
+
+// Shrink when more than this fraction of a window's writes were blocked
+const double MAX_BLOCKED_RATIO = 0.1;
+
+// Throughput changes within this band are treated as noise
+const double THROUGHPUT_TOLERANCE = 0.05;
+
+uint32_t round_to_power_of_two(uint32_t size)
+{
+  uint32_t result = 1;
+  while (result < size && result < 0x80000000U) {
+    result <<= 1;
+  }
+  return result;
+}
+
+} // namespace
+
+ChunkSizeTuner::ChunkSizeTuner(uint32_t initial_size,
+                               uint32_t min_size,
+                               uint32_t max_size)
+  : chunk_size_(0)
+  , min_size_(round_to_power_of_two(min_size))
+  , max_size_(round_to_power_of_two(max_size))
+  , direction_(1)
+  , window_writes_(0)
+  , window_blocked_(0)
+  , window_bytes_(0)
+  , window_time_(ACE_Time_Value::zero)
+  , last_throughput_(0.0)
+  , adjustments_(0)
+{
+  if (max_size_ < min_size_) {
+    max_size_ = min_size_;
+  }
+
+  chunk_size_ = round_to_power_of_two(initial_size);
+  if (chunk_size_ < min_size_) {
+    chunk_size_ = min_size_;
+  } else if (chunk_size_ > max_size_) {
+    chunk_size_ = max_size_;
+  }
+}
+
+ChunkSizeTuner::~ChunkSizeTuner()
+{
+}
+
+uint32_t ChunkSizeTuner::chunk_size() const
+{
+  return chunk_size_;
+}
+
+unsigned long ChunkSizeTuner::adjustments() const
+{
+  return adjustments_;
+}
+
+void ChunkSizeTuner::record_write(uint32_t chunk_size,
+                                  uint32_t bytes,
+                                  const ACE_Time_Value& elapsed,
+                                  bool blocked)
+{
+  if (chunk_size != chunk_size_) {
+    return; // Transfer started before the last adjustment
+  }
+
+  ++window_writes_;
+  if (blocked) {
+    ++window_blocked_;
+  }
+  window_bytes_ += bytes;
+  window_time_ += elapsed;
+
+  if (window_writes_ >= WINDOW_WRITES) {
+    adjust();
+  }
+}
+
+void ChunkSizeTuner::adjust()
+{
+  double seconds = window_time_.sec() + window_time_.usec() / 1000000.0;
+  double throughput = seconds > 0.0 ? window_bytes_ / seconds : 0.0;
+  double blocked_ratio = static_cast<double>(window_blocked_) / window_writes_;
+
+  window_writes_ = 0;
+  window_blocked_ = 0;
+  window_bytes_ = 0;
+  window_time_ = ACE_Time_Value::zero;
+
+  int step = 0;
+  if (blocked_ratio > MAX_BLOCKED_RATIO) {
+    // Transport is struggling (retransmits, full history): back off
+    direction_ = -1;
+    step = -1;
+  } else if (last_throughput_ == 0.0 ||
+             throughput > last_throughput_ * (1.0 + THROUGHPUT_TOLERANCE)) {
+    step = direction_;
+  } else if (throughput < last_throughput_ * (1.0 - THROUGHPUT_TOLERANCE)) {
+    // Last move made things worse: go back the other way
+    direction_ = -direction_;
+    step = direction_;
+  }
+  last_throughput_ = throughput;
+
+  uint32_t new_size = chunk_size_;
+  if (step > 0 && chunk_size_ < max_size_) {
+    new_size = chunk_size_ << 1;
+  } else if (step < 0 && chunk_size_ > min_size_) {
+    new_size = chunk_size_ >> 1;
+  }
+
+  // At a bound, probe the other way next time
+  if (new_size == max_size_) {
+    direction_ = -1;
+  } else if (new_size == min_size_) {
+    direction_ = 1;
+  }
+
+  if (new_size != chunk_size_) {
+    chunk_size_ = new_size;
+    ++adjustments_;
+  }
+}
+
+} // namespace DirShare
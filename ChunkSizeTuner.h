@@ -0,0 +1,90 @@
+// ChunkSizeTuner.h
+// Adjusts the FileChunk size from what the sender observes while writing:
+// throughput of recent chunk writes and how often the writer was blocked
+// by the reliable transport (retransmissions keep the send history full).
+
+#ifndef DIRSHARE_CHUNK_SIZE_TUNER_H
+#define DIRSHARE_CHUNK_SIZE_TUNER_H
+
+#include <stdint.h>
+#include <ace/Time_Value.h>
+
+namespace DirShare {
+
+/**
+ * @class ChunkSizeTuner
+ * @brief Hill-climbing chunk size controller for one chunk writer (link)
+ *
+ * Writes are observed in windows. At the end of each window the chunk size
+ * is halved if too many writes were blocked, otherwise it keeps moving
+ * (doubling or halving) in the direction that last improved throughput,
+ * and reverses when throughput drops. The size stays a power of two
+ * between the configured bounds.
+ *
+ * The chunk size is only read at the start of a transfer, so every chunk
+ * of one file has the same size; observations made with a size other than
+ * the current one are ignored.
+ *
+ * Thread Safety: Not thread-safe; owned by a single FilePublisher.
+ */
+class ChunkSizeTuner {
+public:
+  /**
+   * @brief Constructor
+   *
+   * @param initial_size Starting chunk size in bytes (rounded to a power of two)
+   * @param min_size Smallest chunk size in bytes
+   * @param max_size Largest chunk size in bytes
+   */
+  ChunkSizeTuner(uint32_t initial_size, uint32_t min_size, uint32_t max_size);
+  ~ChunkSizeTuner();
+
+  /**
+   * @brief Chunk size to use for the next transfer
+   *
+   * @return Chunk size in bytes
+   */
+  uint32_t chunk_size() const;
+
+  /**
+   * @brief Record one chunk write
+   *
+   * @param chunk_size Chunk size of the transfer the write belongs to
+   * @param bytes Bytes written (may be less than chunk_size for the last chunk)
+   * @param elapsed Time spent on this chunk, including pacing
+   * @param blocked true if the write timed out or was held up by the transport
+   */
+  void record_write(uint32_t chunk_size,
+                    uint32_t bytes,
+                    const ACE_Time_Value& elapsed,
+                    bool blocked);
+
+  /**
+   * @brief Number of chunk size changes made so far
+   *
+   * @return Adjustment count
+   */
+  unsigned long adjustments() const;
+
+private:
+  // Evaluate the finished window and possibly change chunk_size_
+  void adjust();
+
+  uint32_t chunk_size_;
+  uint32_t min_size_;
+  uint32_t max_size_;
+  int direction_;               // +1: growing, -1: shrinking
+
+  // Current observation window
+  unsigned long window_writes_;
+  unsigned long window_blocked_;
+  uint64_t window_bytes_;
+  ACE_Time_Value window_time_;
+
+  double last_throughput_;      // Bytes/second of the previous window (0: none)
+  unsigned long adjustments_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_CHUNK_SIZE_TUNER_H
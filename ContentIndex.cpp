@@ -0,0 +1,125 @@
+// ContentIndex.cpp
+// Implementation of the local content-hash index
+
+#include "ContentIndex.h"
+#include <ace/Guard_T.h>
+
+namespace DirShare {
+
+ContentIndex::ContentIndex()
+{
+}
+
+ContentIndex::~ContentIndex()
+{
+}
+
+void ContentIndex::update(const std::string& filename,
+                          unsigned long long size,
+                          unsigned long checksum)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+
+  const ContentKey key(size, checksum);
+
+  std::map<std::string, ContentKey>::iterator it = by_name_.find(filename);
+  if (it != by_name_.end()) {
+    if (it->second == key) {
+      return;
+    }
+    unlink_content(filename, it->second);
+    it->second = key;
+  } else {
+    by_name_.insert(std::make_pair(filename, key));
+  }
+
+  by_content_[key].insert(filename);
+}
+
+void ContentIndex::remove(const std::string& filename)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  unverified_.erase(filename);
+
+  std::map<std::string, ContentKey>::iterator it = by_name_.find(filename);
+  if (it == by_name_.end()) {
+    return;
+  }
+
+  unlink_content(filename, it->second);
+  by_name_.erase(it);
+}
+
+bool ContentIndex::find(unsigned long long size,
+                        unsigned long checksum,
+                        const std::string& exclude,
+                        std::string& filename) const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+
+  std::map<ContentKey, std::set<std::string> >::const_iterator it =
+    by_content_.find(ContentKey(size, checksum));
+  if (it == by_content_.end()) {
+    return false;
+  }
+
+  for (std::set<std::string>::const_iterator name = it->second.begin();
+       name != it->second.end(); ++name) {
+    if (*name != exclude && unverified_.find(*name) == unverified_.end()) {
+      filename = *name;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ContentIndex::contains(const std::string& filename,
+                            unsigned long long size,
+                            unsigned long checksum) const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+
+  std::map<std::string, ContentKey>::const_iterator it = by_name_.find(filename);
+  return it != by_name_.end() && it->second == ContentKey(size, checksum);
+}
+
+void ContentIndex::mark_unverified(const std::string& filename)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  unverified_.insert(filename);
+}
+
+void ContentIndex::verified(const std::string& filename)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  unverified_.erase(filename);
+}
+
+bool ContentIndex::unverified(const std::string& filename) const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  return unverified_.find(filename) != unverified_.end();
+}
+
+size_t ContentIndex::size() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  return by_name_.size();
+}
+
+void ContentIndex::unlink_content(const std::string& filename,
+                                  const ContentKey& key)
+{
+  std::map<ContentKey, std::set<std::string> >::iterator it = by_content_.find(key);
+  if (it == by_content_.end()) {
+    return;
+  }
+
+  it->second.erase(filename);
+  if (it->second.empty()) {
+    by_content_.erase(it);
+  }
+}
+
+} // namespace DirShare
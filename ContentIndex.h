@@ -0,0 +1,122 @@
+// ContentIndex.h
+// Local content-hash index: maps (size, checksum) to files already present
+// in the shared directory, so that incoming transfers of content we already
+// hold under another name can be materialized locally instead of written
+// from network data.
+
+#ifndef DIRSHARE_CONTENT_INDEX_H
+#define DIRSHARE_CONTENT_INDEX_H
+
+#include <string>
+#include <map>
+#include <set>
+#include <utility>
+#include <ace/Thread_Mutex.h>
+
+namespace DirShare {
+
+/**
+ * @class ContentIndex
+ * @brief Thread-safe index of local file content by (size, CRC32)
+ *
+ * Kept up to date by FileMonitor scans and by the listeners after they
+ * apply remote changes. Lookups are used by the receive path to find a
+ * local source for content it is about to receive.
+ *
+ * Thread Safety: All methods are thread-safe using ACE_Thread_Mutex.
+ */
+class ContentIndex {
+public:
+  ContentIndex();
+  ~ContentIndex();
+
+  /**
+   * @brief Record (or refresh) the content of a local file
+   *
+   * @param filename Relative file path within shared directory
+   * @param size File size in bytes
+   * @param checksum CRC32 checksum of the file content
+   */
+  void update(const std::string& filename,
+              unsigned long long size,
+              unsigned long checksum);
+
+  /**
+   * @brief Forget a local file (deleted or about to be overwritten)
+   *
+   * @param filename Relative file path within shared directory
+   */
+  void remove(const std::string& filename);
+
+  /**
+   * @brief Find a local file holding the given content
+   *
+   * @param size File size in bytes
+   * @param checksum CRC32 checksum of the content
+   * @param exclude Filename to skip (normally the transfer target itself)
+   * @param filename Output: a local file with matching size and checksum,
+   *                 never one marked unverified
+   * @return true if a candidate was found, false otherwise
+   */
+  bool find(unsigned long long size,
+            unsigned long checksum,
+            const std::string& exclude,
+            std::string& filename) const;
+
+  /**
+   * @brief Check whether a local file already holds the given content
+   *
+   * @param filename Relative file path within shared directory
+   * @param size Expected file size in bytes
+   * @param checksum Expected CRC32 checksum
+   * @return true if the index records filename with this size and checksum
+   */
+  bool contains(const std::string& filename,
+                unsigned long long size,
+                unsigned long checksum) const;
+
+  /**
+   * @brief Note that a file was copied from local content ahead of its transfer
+   *
+   * Its (size, CRC32) entry is only a claim until the listener compares the
+   * file with the received bytes. Cleared by verified() and remove().
+   *
+   * @param filename Relative file path within shared directory
+   */
+  void mark_unverified(const std::string& filename);
+
+  /**
+   * @brief The received bytes of a file were compared with it (or written)
+   *
+   * @param filename Relative file path within shared directory
+   */
+  void verified(const std::string& filename);
+
+  /**
+   * @brief Check whether a file is a local copy awaiting its transfer
+   *
+   * @param filename Relative file path within shared directory
+   * @return true between mark_unverified() and verified() or remove()
+   */
+  bool unverified(const std::string& filename) const;
+
+  /**
+   * @brief Number of indexed files (for testing/debugging)
+   */
+  size_t size() const;
+
+private:
+  typedef std::pair<unsigned long long, unsigned long> ContentKey;
+
+  mutable ACE_Thread_Mutex mutex_;
+  std::map<std::string, ContentKey> by_name_;
+  std::map<ContentKey, std::set<std::string> > by_content_;
+  std::set<std::string> unverified_;
+
+  // Remove filename from by_content_ (mutex_ must be held)
+  void unlink_content(const std::string& filename, const ContentKey& key);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_CONTENT_INDEX_H
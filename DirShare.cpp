@@ -1,23 +1,33 @@
 #include "DirShareTypeSupportImpl.h"
 #include "FileMonitor.h"
 #include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "FilePublisher.h"
 #include "FileUtils.h"
-#include "Checksum.h"
-#include "SnapshotListenerImpl.h"
-#include "FileContentListenerImpl.h"
-#include "FileChunkListenerImpl.h"
-#include "FileEventListenerImpl.h"
+#include "ReedSolomon.h"
+#include "SyncNode.h"
+#include "SyncFilter.h"
+#include "IgnoreMatcher.h"
+#include "MetricsServer.h"
+#include "Latency.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Log.h"
+#include "MainLoop.h"
+#include "RemoteChangeObserver.h"
 
 #include <dds/DCPS/Marked_Default_Qos.h>
 #include <dds/DCPS/Service_Participant.h>
-#include <dds/DCPS/WaitSet.h>
 #include <dds/DCPS/StaticIncludes.h>
 
 #include <ace/Log_Msg.h>
 #include <ace/OS_NS_unistd.h>
 #include <ace/Get_Opt.h>
-#include <ace/UUID.h>
 #include <ace/Time_Value.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_signal.h>
+#include <ace/Guard_T.h>
+#include <ace/Thread_Mutex.h>
 
 #if OPENDDS_DO_MANUAL_STATIC_INCLUDES
 #  include <dds/DCPS/RTPS/RtpsDiscovery.h>
@@ -25,15 +35,346 @@
 #endif
 
 #include <string>
+#include <vector>
 #include <iostream>
 
 // Configuration constants
 const int DEFAULT_DOMAIN_ID = 42;
-const int POLL_INTERVAL_SEC = 2; // 2 second polling interval
+const int MAX_DOMAIN_ID = 231; // Highest id with valid RTPS port numbers
+const int POLL_INTERVAL_SEC = 2; // Scan at least every 2 seconds
+const int SETTLE_DELAY_USEC = 200000; // Scan 200 ms after a change notification
+
+// Transport config used for bulk data topics when defined in the
+// configuration file (otherwise they share the global config)
+const char* const BULK_TRANSPORT_CONFIG = "dirshare_bulk";
+
+// Transport configs of a relay's downstream participant, when defined in
+// the configuration file (see rtps_relay.ini)
+const char* const RELAY_TRANSPORT_CONFIG = "dirshare_downstream";
+const char* const RELAY_BULK_TRANSPORT_CONFIG = "dirshare_downstream_bulk";
 
 // Global shared directory path
 std::string g_shared_directory;
 
+// Parse a byte count with an optional K or M suffix (e.g. "256K", "4M")
+static bool parse_size(const ACE_TCHAR* arg, unsigned long long& size)
+{
+  const std::string text = ACE_TEXT_ALWAYS_CHAR(arg);
+  char* end = 0;
+  unsigned long long value = ACE_OS::strtoull(text.c_str(), &end, 10);
+  if (end == text.c_str()) {
+    return false;
+  }
+  if (*end == 'K' || *end == 'k') {
+    value *= 1024;
+    ++end;
+  } else if (*end == 'M' || *end == 'm') {
+    value *= 1024 * 1024;
+    ++end;
+  }
+  if (*end != '\0') {
+    return false;
+  }
+  size = value;
+  return true;
+}
+
+// Parse FEC parameters "k:m" (data chunks : repair chunks per group)
+static bool parse_fec(const ACE_TCHAR* arg, unsigned long& data_chunks, unsigned long& repair_chunks)
+{
+  const std::string text = ACE_TEXT_ALWAYS_CHAR(arg);
+  char* end = 0;
+  unsigned long k = ACE_OS::strtoul(text.c_str(), &end, 10);
+  if (end == text.c_str() || *end != ':') {
+    return false;
+  }
+  const char* repair = end + 1;
+  unsigned long m = ACE_OS::strtoul(repair, &end, 10);
+  if (end == repair || *end != '\0' ||
+      !DirShare::ReedSolomonCode(k, m).valid()) {
+    return false;
+  }
+  data_chunks = k;
+  repair_chunks = m;
+  return true;
+}
+
+// Parse a DDS domain id
+static bool parse_domain(const ACE_TCHAR* arg, DDS::DomainId_t& domain_id)
+{
+  const std::string text = ACE_TEXT_ALWAYS_CHAR(arg);
+  char* end = 0;
+  long value = ACE_OS::strtol(text.c_str(), &end, 10);
+  if (end == text.c_str() || *end != '\0' || value < 0 || value > MAX_DOMAIN_ID) {
+    return false;
+  }
+  domain_id = static_cast<DDS::DomainId_t>(value);
+  return true;
+}
+
+// A peer's change applied by one node, to be published by the others
+struct AppliedChange {
+  size_t node;                      // Node whose listener applied it
+  DirShare::OperationType operation;
+  DirShare::FileMetadata metadata;  // As written (only the filename for DELETE)
+  DirShare::LocalChange change;     // Origin stamp the change arrived with
+};
+
+// Follows the peers' changes the nodes' listeners apply. Each is recorded
+// in the FileMonitor before its notifications resume, so that no scan takes
+// it for a local change and sends it back. In relay mode it is also queued
+// to be published by the other node, explicitly rather than through the
+// scan. The main loop is woken either way, so that this and the statistics
+// follow at once; changes before the loop is attached wait for its first
+// scan.
+class RemoteChanges {
+public:
+  RemoteChanges(DirShare::FileMonitor& monitor, size_t nodes)
+    : monitor_(monitor)
+    , relay_(nodes > 1)
+    , loop_(0)
+  {
+    for (size_t n = 0; n < nodes; ++n) {
+      observers_.push_back(new NodeObserver(*this, n));
+    }
+  }
+
+  ~RemoteChanges()
+  {
+    for (size_t n = 0; n < observers_.size(); ++n) {
+      delete observers_[n];
+    }
+  }
+
+  // Observer to give the listeners of a node
+  DirShare::RemoteChangeObserver* observer(size_t node)
+  {
+    return observers_[node];
+  }
+
+  void attach(DirShare::MainLoop* loop)
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    loop_ = loop;
+  }
+
+  // Take the changes queued for forwarding, oldest first
+  void take(std::vector<AppliedChange>& changes)
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    changes.swap(pending_);
+    pending_.clear();
+  }
+
+private:
+  class NodeObserver : public DirShare::RemoteChangeObserver {
+  public:
+    NodeObserver(RemoteChanges& owner, size_t node)
+      : owner_(owner)
+      , node_(node)
+    {
+    }
+
+    virtual void remote_change_applied(DirShare::OperationType operation,
+                                       const std::string& filename,
+                                       const DirShare::ChangeOrigin& origin)
+    {
+      owner_.applied(node_, operation, filename, origin);
+    }
+
+  private:
+    RemoteChanges& owner_;
+    size_t node_;
+  };
+
+  void applied(size_t node,
+               DirShare::OperationType operation,
+               const std::string& filename,
+               const DirShare::ChangeOrigin& origin)
+  {
+    AppliedChange applied;
+    applied.node = node;
+    applied.operation = operation;
+    applied.metadata.filename = filename.c_str();
+    applied.metadata.size = 0;
+    applied.metadata.timestamp_sec = 0;
+    applied.metadata.timestamp_nsec = 0;
+    applied.metadata.checksum = 0;
+    const bool exists = monitor_.record_remote_change(filename, applied.metadata);
+
+    if (!exists) {
+      applied.operation = DirShare::DELETE;
+    } else if (operation == DirShare::DELETE) {
+      applied.operation = DirShare::CREATE;  // Written again since
+    }
+
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    if (relay_) {
+      // Sent on under the origin's event id, so that end-to-end latency
+      // spans the relay; queue_usec becomes the time held here
+      if (origin.event_id != 0) {
+        applied.change.origin = origin;
+        applied.change.detected = DirShare::monotonic_now();
+      } else {
+        applied.change = DirShare::stamp_local_change(applied.metadata);
+      }
+      pending_.push_back(applied);
+    }
+    if (loop_) {
+      loop_->request_scan();
+    }
+  }
+
+  DirShare::FileMonitor& monitor_;
+  const bool relay_;
+  std::vector<NodeObserver*> observers_;
+  ACE_Thread_Mutex lock_;
+  DirShare::MainLoop* loop_;
+  std::vector<AppliedChange> pending_;  // Relay only
+};
+
+// Scans the shared directory and publishes its changes, for the main loop
+class ShareScanner : public DirShare::MainLoopHandler {
+public:
+  ShareScanner(DirShare::FileMonitor& monitor,
+               DirShare::FileChangeTracker& change_tracker,
+               RemoteChanges& remote_changes,
+               const std::vector<DirShare::SyncNode*>& nodes,
+               const std::string& trace_file)
+    : monitor_(monitor)
+    , change_tracker_(change_tracker)
+    , remote_changes_(remote_changes)
+    , nodes_(nodes)
+    , trace_file_(trace_file)
+  {
+  }
+
+  virtual void scan()
+  {
+    // Relay: forward what one node applied through the other
+    std::vector<AppliedChange> applied;
+    remote_changes_.take(applied);
+    for (size_t i = 0; i < applied.size(); ++i) {
+      forward(applied[i]);
+    }
+
+    // Phase 4: Detect file changes and publish FileEvents
+    std::vector<std::string> created_files;
+    std::vector<std::string> modified_files;
+    std::vector<std::string> deleted_files;
+
+    if (monitor_.scan_for_changes(created_files, modified_files, deleted_files)) {
+      // Handle created (Phase 4) and modified (Phase 5) files
+      for (size_t i = 0; i < created_files.size() + modified_files.size(); ++i) {
+        const bool created = i < created_files.size();
+        const std::string& filename =
+          created ? created_files[i] : modified_files[i - created_files.size()];
+
+        ACE_DEBUG((LM_INFO,
+                   ACE_TEXT("(%P|%t) File %C detected: %C\n"),
+                   created ? "CREATE" : "MODIFY",
+                   filename.c_str()));
+
+        // Get file metadata
+        DirShare::FileMetadata metadata;
+        if (!monitor_.get_file_metadata(filename, metadata)) {
+          ACE_ERROR((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Failed to get metadata for: %C\n"),
+                     filename.c_str()));
+          continue;
+        }
+
+        // Stamped once: every node sends the change under the same event id
+        const DirShare::LocalChange change = DirShare::stamp_local_change(metadata);
+
+        // Read a stable view of the file once; every node sends the same bytes
+        DirShare::FileImage image;
+        if (!nodes_[0]->load_file(metadata, image)) {
+          continue;
+        }
+
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+          nodes_[n]->publish_change(created ? DirShare::CREATE : DirShare::MODIFY,
+                                   metadata, &image, &change);
+        }
+      }
+
+      // Handle deleted files (Phase 6)
+      for (size_t i = 0; i < deleted_files.size(); ++i) {
+        const std::string& filename = deleted_files[i];
+
+        ACE_DEBUG((LM_INFO,
+                   ACE_TEXT("(%P|%t) File DELETE detected: %C\n"),
+                   filename.c_str()));
+
+        // SC-011: Check if notifications are suppressed for this file
+        if (change_tracker_.is_suppressed(filename)) {
+          ACE_DEBUG((LM_DEBUG,
+                     ACE_TEXT("Skipping DELETE publication for suppressed file '%C' (remote update)\n"),
+                     filename.c_str()));
+          continue;
+        }
+
+        DirShare::FileMetadata metadata;
+        metadata.filename = filename.c_str();
+        metadata.size = 0;
+        metadata.timestamp_sec = 0;
+        metadata.timestamp_nsec = 0;
+        metadata.checksum = 0;
+        const DirShare::LocalChange change = DirShare::stamp_local_change(metadata);
+        for (size_t n = 0; n < nodes_.size(); ++n) {
+          nodes_[n]->publish_change(DirShare::DELETE, metadata, 0, &change);
+        }
+      }
+    }
+
+    // Statistics for fleet monitors (dirshare-top), once per scan
+    DirShare::DirectorySummary directory;
+    monitor_.summarize(directory);
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+      nodes_[n]->expire_transfers();
+      nodes_[n]->publish_stats(directory);
+    }
+  }
+
+  virtual void dump()
+  {
+    DirShare::Tracer::instance().write_chrome_trace(trace_file_);
+  }
+
+private:
+  // Publish a change applied by one node through every other node; never
+  // back through the node it came from
+  void forward(AppliedChange& applied)
+  {
+    DIRSHARE_DEBUG(("Forwarding %s of '%s' from node %u\n",
+                    applied.operation == DirShare::DELETE ? "DELETE" : "change",
+                    applied.metadata.filename.in(),
+                    static_cast<unsigned>(applied.node)));
+
+    DirShare::FileImage image;
+    const size_t reader = applied.node == 0 ? 1 : 0;
+    if (applied.operation != DirShare::DELETE &&
+        !nodes_[reader]->load_file(applied.metadata, image)) {
+      return;
+    }
+
+    for (size_t n = 0; n < nodes_.size(); ++n) {
+      if (n != applied.node) {
+        nodes_[n]->publish_change(applied.operation, applied.metadata,
+                                  applied.operation == DirShare::DELETE ? 0 : &image,
+                                  &applied.change);
+      }
+    }
+  }
+
+  DirShare::FileMonitor& monitor_;
+  DirShare::FileChangeTracker& change_tracker_;
+  RemoteChanges& remote_changes_;
+  const std::vector<DirShare::SyncNode*>& nodes_;
+  const std::string& trace_file_;
+};
+
 int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
 {
   int return_code = 0;
@@ -44,16 +385,138 @@ int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
       TheParticipantFactoryWithArgs(argc, argv);
 
     // Parse remaining command-line arguments (after DDS options are processed)
-    ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("h"));
+    unsigned long long chunk_size = DirShare::DEFAULT_CHUNK_SIZE;
+    unsigned long long chunk_threshold = DirShare::DEFAULT_CHUNK_THRESHOLD;
+    bool auto_tune_chunks = false;
+    unsigned long fec_data_chunks = 0;
+    unsigned long fec_repair_chunks = 0;
+    bool swarm = false;
+    DDS::DomainId_t domain_id = DEFAULT_DOMAIN_ID;
+    DDS::DomainId_t relay_domain_id = -1;
+    DirShare::SyncFilter sync_filter;
+    unsigned long long max_size = 0;
+    std::string metrics_address;
+    std::string trace_file;
+    std::string capture_file;
+
+    ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hc:t:aF:sd:R:i:m:M:T:r:"));
+    get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("chunk-size"), 'c', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("chunk-threshold"), 't', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("auto-tune-chunks"), 'a', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("fec"), 'F', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("swarm"), 's', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("domain"), 'd', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("relay"), 'R', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("include"), 'i', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("max-size"), 'm', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("metrics"), 'M', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("trace"), 'T', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("record"), 'r', ACE_Get_Opt::ARG_REQUIRED);
     int option;
     while ((option = get_opts()) != EOF) {
       switch (option) {
+      case 'c':
+        if (!parse_size(get_opts.opt_arg(), chunk_size) ||
+            chunk_size < DirShare::MIN_CHUNK_SIZE ||
+            chunk_size > DirShare::MAX_CHUNK_SIZE) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid chunk size: %s (allowed %u..%u bytes)\n"),
+                           get_opts.opt_arg(),
+                           DirShare::MIN_CHUNK_SIZE,
+                           DirShare::MAX_CHUNK_SIZE),
+                          1);
+        }
+        break;
+      case 't':
+        if (!parse_size(get_opts.opt_arg(), chunk_threshold)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid chunk threshold: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'a':
+        auto_tune_chunks = true;
+        break;
+      case 'F':
+        if (!parse_fec(get_opts.opt_arg(), fec_data_chunks, fec_repair_chunks)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid FEC parameters: %s (expected k:m, k + m <= %u)\n"),
+                           get_opts.opt_arg(),
+                           DirShare::ReedSolomonCode::MAX_BLOCKS),
+                          1);
+        }
+        break;
+      case 's':
+        swarm = true;
+        break;
+      case 'd':
+        if (!parse_domain(get_opts.opt_arg(), domain_id)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid domain id: %s (allowed 0..%d)\n"),
+                           get_opts.opt_arg(),
+                           MAX_DOMAIN_ID),
+                          1);
+        }
+        break;
+      case 'R':
+        if (!parse_domain(get_opts.opt_arg(), relay_domain_id)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid relay domain id: %s (allowed 0..%d)\n"),
+                           get_opts.opt_arg(),
+                           MAX_DOMAIN_ID),
+                          1);
+        }
+        break;
+      case 'i':
+        if (!sync_filter.add_pattern(ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()))) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid include pattern: %s (must not contain ')\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'm':
+        if (!parse_size(get_opts.opt_arg(), max_size) || max_size == 0) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid maximum file size: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        sync_filter.set_max_size(max_size);
+        break;
+      case 'M':
+        metrics_address = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 'T':
+        trace_file = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 'r':
+        capture_file = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
       case 'h':
       default:
         ACE_ERROR_RETURN((LM_ERROR,
-                         ACE_TEXT("Usage: %C [DDS options] <shared_directory>\n")
+                         ACE_TEXT("Usage: %C [DDS options] [options] <shared_directory>\n")
                          ACE_TEXT("Options:\n")
-                         ACE_TEXT("  -h                  Show this help message\n")
+                         ACE_TEXT("  -h, --help                Show this help message\n")
+                         ACE_TEXT("  -d, --domain <id>         DDS domain to join (default 42)\n")
+                         ACE_TEXT("  -R, --relay <id>          Also serve downstream peers in domain <id> and\n")
+                         ACE_TEXT("                            forward changes between the two domains\n")
+                         ACE_TEXT("  -c, --chunk-size <n>      Chunk size for large files (default 1M; K/M suffix)\n")
+                         ACE_TEXT("  -t, --chunk-threshold <n> Send files of at least n bytes as chunks (default 10M)\n")
+                         ACE_TEXT("  -a, --auto-tune-chunks    Adjust chunk size from observed throughput\n")
+                         ACE_TEXT("  -F, --fec <k:m>           Send chunks best-effort with m Reed-Solomon repair\n")
+                         ACE_TEXT("                            chunks per k data chunks (e.g. 16:2 for ~1-2%% loss)\n")
+                         ACE_TEXT("  -s, --swarm               Pull missing files from every peer that holds them\n")
+                         ACE_TEXT("  -i, --include <glob>      Only receive files matching the glob (repeatable)\n")
+                         ACE_TEXT("  -m, --max-size <n>        Only receive files of at most n bytes (K/M suffix)\n")
+                         ACE_TEXT("  -M, --metrics <addr>      Serve Prometheus metrics at http://<addr>/metrics\n")
+                         ACE_TEXT("                            (<addr>: port on 127.0.0.1, or host:port)\n")
+                         ACE_TEXT("  -T, --trace <file>        Record pipeline spans; write them as a Chrome trace\n")
+                         ACE_TEXT("                            on SIGUSR1 and at exit\n")
+                         ACE_TEXT("  -r, --record <file>       Record every received sample for dirshare-replay\n")
                          ACE_TEXT("  -DCPSConfigFile <file> Specify DDS configuration file (e.g., rtps.ini)\n")
                          ACE_TEXT("  -DCPSInfoRepo <ior>    Specify DCPSInfoRepo IOR (InfoRepo mode)\n")
                          ACE_TEXT("\n")
@@ -61,12 +524,22 @@ int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
                          ACE_TEXT("  %C -DCPSInfoRepo file://repo.ior /path/to/shared_dir\n")
                          ACE_TEXT("\n")
                          ACE_TEXT("Example (RTPS mode):\n")
-                         ACE_TEXT("  %C -DCPSConfigFile rtps.ini /path/to/shared_dir\n"),
-                         argv[0], argv[0], argv[0]),
+                         ACE_TEXT("  %C -DCPSConfigFile rtps.ini /path/to/shared_dir\n")
+                         ACE_TEXT("\n")
+                         ACE_TEXT("Example (relay from domain 42 to domain 43):\n")
+                         ACE_TEXT("  %C -DCPSConfigFile rtps_relay.ini -d 42 --relay 43 /path/to/cache_dir\n"),
+                         argv[0], argv[0], argv[0], argv[0]),
                         1);
       }
     }
 
+    if (relay_domain_id == domain_id) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Relay domain must differ from the upstream domain (%d)\n"),
+                       domain_id),
+                      1);
+    }
+
     // Get shared directory path from remaining arguments
     if (get_opts.opt_ind() >= argc) {
       ACE_ERROR_RETURN((LM_ERROR,
@@ -86,481 +559,131 @@ int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
                       1);
     }
 
+    // Build artifacts, editor swap files and the like (.dirshareignore)
+    DirShare::IgnoreMatcher ignore_matcher;
+    ignore_matcher.load_file(g_shared_directory + "/" + DirShare::IGNORE_FILE_NAME);
+
     ACE_DEBUG((LM_INFO,
                ACE_TEXT("(%P|%t) DirShare starting...\n")
                ACE_TEXT("  Monitoring directory: %C\n")
-               ACE_TEXT("  Poll interval: %d seconds\n"),
+               ACE_TEXT("  Poll interval: %d seconds\n")
+               ACE_TEXT("  Chunk size: %Q bytes%C, threshold: %Q bytes\n")
+               ACE_TEXT("  FEC: %u data + %u repair chunks per group%C\n")
+               ACE_TEXT("  Swarm download: %C\n")
+               ACE_TEXT("  Selective sync: %C\n")
+               ACE_TEXT("  Ignore patterns: %B\n"),
                g_shared_directory.c_str(),
-               POLL_INTERVAL_SEC));
-
-    // Create DomainParticipant
-    DDS::DomainParticipant_var participant =
-      dpf->create_participant(DEFAULT_DOMAIN_ID,
-                             PARTICIPANT_QOS_DEFAULT,
-                             0,
-                             OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!participant) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_participant failed!\n")),
-                      1);
-    }
-
-    // Register TypeSupport for FileEvent
-    DirShare::FileEventTypeSupport_var ts_event =
-      new DirShare::FileEventTypeSupportImpl;
-
-    if (ts_event->register_type(participant, "") != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: register_type FileEvent failed!\n")),
-                      1);
-    }
-
-    // Register TypeSupport for FileContent
-    DirShare::FileContentTypeSupport_var ts_content =
-      new DirShare::FileContentTypeSupportImpl;
-
-    if (ts_content->register_type(participant, "") != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: register_type FileContent failed!\n")),
-                      1);
-    }
-
-    // Register TypeSupport for FileChunk
-    DirShare::FileChunkTypeSupport_var ts_chunk =
-      new DirShare::FileChunkTypeSupportImpl;
-
-    if (ts_chunk->register_type(participant, "") != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: register_type FileChunk failed!\n")),
-                      1);
-    }
-
-    // Register TypeSupport for DirectorySnapshot
-    DirShare::DirectorySnapshotTypeSupport_var ts_snapshot =
-      new DirShare::DirectorySnapshotTypeSupportImpl;
-
-    if (ts_snapshot->register_type(participant, "") != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: register_type DirectorySnapshot failed!\n")),
-                      1);
+               POLL_INTERVAL_SEC,
+               chunk_size,
+               auto_tune_chunks ? " (auto-tuned)" : "",
+               chunk_threshold,
+               fec_data_chunks,
+               fec_repair_chunks,
+               fec_data_chunks ? "" : " (off)",
+               swarm ? "on" : "off",
+               sync_filter.active() ? "on" : "off (all files)",
+               ignore_matcher.size()));
+
+    DirShare::SyncNodeOptions options;
+    options.chunk_size = static_cast<uint32_t>(chunk_size);
+    options.chunk_threshold = chunk_threshold;
+    options.auto_tune_chunks = auto_tune_chunks;
+    options.fec_data_chunks = static_cast<uint16_t>(fec_data_chunks);
+    options.fec_repair_chunks = static_cast<uint16_t>(fec_repair_chunks);
+    options.swarm = swarm;
+    options.filter = &sync_filter;
+    options.ignore = &ignore_matcher;
+    options.bulk_transport_config = BULK_TRANSPORT_CONFIG;
+
+    // Prometheus endpoint (--metrics)
+    DirShare::MetricsServer metrics_server(DirShare::MetricsRegistry::instance());
+    if (!metrics_address.empty() && !metrics_server.start(metrics_address)) {
+      return 1;
     }
 
-    // Get type names
-    CORBA::String_var type_name_event = ts_event->get_type_name();
-    CORBA::String_var type_name_content = ts_content->get_type_name();
-    CORBA::String_var type_name_chunk = ts_chunk->get_type_name();
-    CORBA::String_var type_name_snapshot = ts_snapshot->get_type_name();
-
-    // Set QoS for RELIABLE and TRANSIENT_LOCAL for FileEvents topic
-    DDS::TopicQos topic_qos_events;
-    participant->get_default_topic_qos(topic_qos_events);
-    topic_qos_events.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
-    topic_qos_events.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
-    topic_qos_events.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
-    topic_qos_events.history.depth = 100;
-
-    // Create FileEvents Topic
-    DDS::Topic_var topic_events =
-      participant->create_topic("DirShare_FileEvents",
-                               type_name_event,
-                               topic_qos_events,
-                               0,
-                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!topic_events) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_topic FileEvents failed!\n")),
-                      1);
-    }
-
-    // Set QoS for RELIABLE and VOLATILE for FileContent topic
-    DDS::TopicQos topic_qos_content;
-    participant->get_default_topic_qos(topic_qos_content);
-    topic_qos_content.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
-    topic_qos_content.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
-    topic_qos_content.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
-    topic_qos_content.history.depth = 1;
-
-    // Create FileContent Topic
-    DDS::Topic_var topic_content =
-      participant->create_topic("DirShare_FileContent",
-                               type_name_content,
-                               topic_qos_content,
-                               0,
-                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!topic_content) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_topic FileContent failed!\n")),
-                      1);
-    }
-
-    // Set QoS for RELIABLE and VOLATILE with KEEP_ALL for FileChunks topic
-    DDS::TopicQos topic_qos_chunks;
-    participant->get_default_topic_qos(topic_qos_chunks);
-    topic_qos_chunks.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
-    topic_qos_chunks.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
-    topic_qos_chunks.history.kind = DDS::KEEP_ALL_HISTORY_QOS;
-    topic_qos_chunks.resource_limits.max_samples = 1000;
-    topic_qos_chunks.resource_limits.max_instances = 100;
-    topic_qos_chunks.resource_limits.max_samples_per_instance = 1000;
-
-    // Create FileChunks Topic
-    DDS::Topic_var topic_chunks =
-      participant->create_topic("DirShare_FileChunks",
-                               type_name_chunk,
-                               topic_qos_chunks,
-                               0,
-                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!topic_chunks) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_topic FileChunks failed!\n")),
-                      1);
-    }
-
-    // Set QoS for RELIABLE and TRANSIENT_LOCAL for DirectorySnapshot topic
-    DDS::TopicQos topic_qos_snapshot;
-    participant->get_default_topic_qos(topic_qos_snapshot);
-    topic_qos_snapshot.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
-    topic_qos_snapshot.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
-    topic_qos_snapshot.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
-    topic_qos_snapshot.history.depth = 1;
-
-    // Create DirectorySnapshot Topic
-    DDS::Topic_var topic_snapshot =
-      participant->create_topic("DirShare_DirectorySnapshot",
-                               type_name_snapshot,
-                               topic_qos_snapshot,
-                               0,
-                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!topic_snapshot) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_topic DirectorySnapshot failed!\n")),
-                      1);
-    }
-
-    // Create Publisher
-    DDS::Publisher_var publisher =
-      participant->create_publisher(PUBLISHER_QOS_DEFAULT,
-                                   0,
-                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!publisher) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_publisher failed!\n")),
-                      1);
-    }
-
-    // Create Subscriber
-    DDS::Subscriber_var subscriber =
-      participant->create_subscriber(SUBSCRIBER_QOS_DEFAULT,
-                                    0,
-                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!subscriber) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_subscriber failed!\n")),
-                      1);
-    }
-
-    // Create WaitSet for synchronization
-    DDS::WaitSet_var ws = new DDS::WaitSet;
-
-    // Attach StatusCondition for Publisher to detect publication matched
-    DDS::StatusCondition_var condition = publisher->get_statuscondition();
-    condition->set_enabled_statuses(DDS::PUBLICATION_MATCHED_STATUS);
-    ws->attach_condition(condition);
-
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) DDS infrastructure initialized successfully\n")
-               ACE_TEXT("  Domain ID: %d\n")
-               ACE_TEXT("  Topics created: FileEvents, FileContent, FileChunks, DirectorySnapshot\n"),
-               DEFAULT_DOMAIN_ID));
-
-    // Create DataWriters for publishing
-    DDS::DataWriter_var event_writer =
-      publisher->create_datawriter(topic_events,
-                                   DATAWRITER_QOS_DEFAULT,
-                                   0,
-                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!event_writer) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datawriter FileEvent failed!\n")),
-                      1);
-    }
-
-    DDS::DataWriter_var snapshot_writer =
-      publisher->create_datawriter(topic_snapshot,
-                                   DATAWRITER_QOS_DEFAULT,
-                                   0,
-                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!snapshot_writer) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datawriter DirectorySnapshot failed!\n")),
-                      1);
+    // Span tracing (--trace), enabled before any node thread starts
+    if (!trace_file.empty()) {
+      DirShare::Tracer::instance().enable();
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Tracing enabled; kill -USR1 %d writes %C\n"),
+                 static_cast<int>(ACE_OS::getpid()),
+                 trace_file.c_str()));
     }
 
-    DDS::DataWriter_var content_writer =
-      publisher->create_datawriter(topic_content,
-                                   DATAWRITER_QOS_DEFAULT,
-                                   0,
-                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!content_writer) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datawriter FileContent failed!\n")),
-                      1);
+    // Sample capture (--record), opened before any reader exists
+    if (!capture_file.empty()) {
+      if (!DirShare::SampleCapture::instance().open(capture_file)) {
+        return 1;
+      }
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Recording received samples to %C\n"),
+                 capture_file.c_str()));
     }
 
-    DDS::DataWriter_var chunk_writer =
-      publisher->create_datawriter(topic_chunks,
-                                   DATAWRITER_QOS_DEFAULT,
-                                   0,
-                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!chunk_writer) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datawriter FileChunk failed!\n")),
-                      1);
+    // Per-file and per-chunk messages are written by a thread of their own
+    if (!DirShare::AsyncLog::instance().start()) {
+      return 1;
     }
 
-    // Narrow to typed writers
-    DirShare::FileEventDataWriter_var typed_event_writer =
-      DirShare::FileEventDataWriter::_narrow(event_writer);
-    DirShare::DirectorySnapshotDataWriter_var typed_snapshot_writer =
-      DirShare::DirectorySnapshotDataWriter::_narrow(snapshot_writer);
-    DirShare::FileContentDataWriter_var typed_content_writer =
-      DirShare::FileContentDataWriter::_narrow(content_writer);
-    DirShare::FileChunkDataWriter_var typed_chunk_writer =
-      DirShare::FileChunkDataWriter::_narrow(chunk_writer);
-
     // Create FileChangeTracker for notification loop prevention (SC-011)
     DirShare::FileChangeTracker change_tracker;
 
-    // Create listeners for receiving data
-    DDS::DataReaderListener_var event_listener =
-      new DirShare::FileEventListenerImpl(g_shared_directory, content_writer, chunk_writer, change_tracker);
-    DDS::DataReaderListener_var snapshot_listener =
-      new DirShare::SnapshotListenerImpl(g_shared_directory, content_writer, chunk_writer);
-    DDS::DataReaderListener_var content_listener =
-      new DirShare::FileContentListenerImpl(g_shared_directory, change_tracker);
-    DDS::DataReaderListener_var chunk_listener =
-      new DirShare::FileChunkListenerImpl(g_shared_directory, change_tracker);
-
-    // Create DataReaders with listeners
-    DDS::DataReader_var event_reader =
-      subscriber->create_datareader(topic_events,
-                                    DATAREADER_QOS_DEFAULT,
-                                    event_listener,
-                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!event_reader) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datareader FileEvent failed!\n")),
-                      1);
-    }
-
-    DDS::DataReader_var snapshot_reader =
-      subscriber->create_datareader(topic_snapshot,
-                                    DATAREADER_QOS_DEFAULT,
-                                    snapshot_listener,
-                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!snapshot_reader) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datareader DirectorySnapshot failed!\n")),
-                      1);
-    }
+    // Create ContentIndex so content already held locally is not rewritten
+    DirShare::ContentIndex content_index;
 
-    DDS::DataReader_var content_reader =
-      subscriber->create_datareader(topic_content,
-                                    DATAREADER_QOS_DEFAULT,
-                                    content_listener,
-                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    // Create FileMonitor for directory scanning (before the nodes: their
+    // listeners record the changes they apply in it)
+    DirShare::FileMonitor monitor(g_shared_directory, change_tracker);
+    monitor.set_content_index(&content_index);
+    monitor.set_ignore_matcher(&ignore_matcher);
+
+    // One node per domain over the same directory: the upstream (or only)
+    // domain, and in relay mode the domain of the downstream peers
+    std::vector<DirShare::SyncNode*> nodes;
+    nodes.push_back(new DirShare::SyncNode(dpf, domain_id, g_shared_directory,
+                                           change_tracker, content_index, options));
+    if (relay_domain_id >= 0) {
+      DirShare::SyncNodeOptions downstream_options = options;
+      downstream_options.transport_config = RELAY_TRANSPORT_CONFIG;
+      downstream_options.bulk_transport_config = RELAY_BULK_TRANSPORT_CONFIG;
+      nodes.push_back(new DirShare::SyncNode(dpf, relay_domain_id, g_shared_directory,
+                                             change_tracker, content_index,
+                                             downstream_options));
 
-    if (!content_reader) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datareader FileContent failed!\n")),
-                      1);
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Relay mode: upstream domain %d, downstream domain %d\n"),
+                 domain_id,
+                 relay_domain_id));
     }
 
-    DDS::DataReader_var chunk_reader =
-      subscriber->create_datareader(topic_chunks,
-                                    DATAREADER_QOS_DEFAULT,
-                                    chunk_listener,
-                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
-
-    if (!chunk_reader) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: create_datareader FileChunk failed!\n")),
-                      1);
+    RemoteChanges remote_changes(monitor, nodes.size());
+    bool ok = true;
+    for (size_t n = 0; ok && n < nodes.size(); ++n) {
+      nodes[n]->set_remote_change_observer(remote_changes.observer(n));
+      ok = nodes[n]->init();
     }
 
     // Wait for discovery - wait for publication/subscription matching
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Waiting for participant discovery...\n")));
-
     DDS::Duration_t timeout = {30, 0}; // 30 second timeout
-    DDS::ConditionSeq conditions;
-    DDS::ReturnCode_t ret = ws->wait(conditions, timeout);
-
-    if (ret == DDS::RETCODE_TIMEOUT) {
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) No other participants discovered yet, continuing...\n")));
-    } else if (ret != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: WaitSet wait failed: %d\n"),
-                       ret),
-                      1);
+    for (size_t n = 0; ok && n < nodes.size(); ++n) {
+      ok = nodes[n]->wait_for_discovery(timeout);
     }
 
-    // Create FileMonitor for directory scanning
-    DirShare::FileMonitor monitor(g_shared_directory, change_tracker);
-
-    // Generate and publish initial directory snapshot
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Publishing initial directory snapshot...\n")));
-
-    DirShare::DirectorySnapshot snapshot;
-
-    // Generate unique participant ID using UUID
-    ACE_Utils::UUID uuid;
-    ACE_Utils::UUID_GENERATOR::instance()->generate_UUID(uuid);
-    snapshot.participant_id = uuid.to_string()->c_str();
-
-    // Get all files in directory
-    std::vector<DirShare::FileMetadata> file_list = monitor.get_all_files();
-    snapshot.files.length(static_cast<CORBA::ULong>(file_list.size()));
-    for (size_t i = 0; i < file_list.size(); ++i) {
-      snapshot.files[static_cast<CORBA::ULong>(i)] = file_list[i];
+    // Publish the initial directory snapshot and file contents
+    std::vector<DirShare::FileMetadata> file_list;
+    if (ok) {
+      file_list = monitor.get_all_files();
     }
-
-    // Set timestamp
-    ACE_Time_Value now = ACE_OS::gettimeofday();
-    snapshot.snapshot_time_sec = static_cast<CORBA::ULongLong>(now.sec());
-    snapshot.snapshot_time_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
-    snapshot.file_count = static_cast<CORBA::ULong>(file_list.size());
-
-    // Publish snapshot
-    ret = typed_snapshot_writer->write(snapshot, DDS::HANDLE_NIL);
-    if (ret != DDS::RETCODE_OK) {
-      ACE_ERROR_RETURN((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: write DirectorySnapshot failed: %d\n"),
-                       ret),
-                      1);
+    for (size_t n = 0; ok && n < nodes.size(); ++n) {
+      ok = nodes[n]->start(file_list);
     }
 
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Initial snapshot published: %u files\n"),
-               snapshot.file_count));
-
-    // Publish initial file contents
-    for (size_t i = 0; i < file_list.size(); ++i) {
-      const DirShare::FileMetadata& metadata = file_list[i];
-      std::string filename = metadata.filename.in();
-      std::string full_path = g_shared_directory + "/" + filename;
-
-      // Determine if file should be sent as chunks or content
-      const uint64_t CHUNK_THRESHOLD = 10 * 1024 * 1024; // 10MB
-
-      if (metadata.size < CHUNK_THRESHOLD) {
-        // Send as FileContent (small file)
-        DirShare::FileContent content;
-        content.filename = metadata.filename;
-        content.size = metadata.size;
-        content.checksum = metadata.checksum;
-        content.timestamp_sec = metadata.timestamp_sec;
-        content.timestamp_nsec = metadata.timestamp_nsec;
-
-        // Read file data
-        std::vector<uint8_t> data;
-        if (!DirShare::read_file(full_path, data)) {
-          ACE_ERROR((LM_ERROR,
-                     ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                     full_path.c_str()));
-          continue;
-        }
-
-        content.data.length(static_cast<CORBA::ULong>(data.size()));
-        std::memcpy(content.data.get_buffer(), &data[0], data.size());
-
-        ret = typed_content_writer->write(content, DDS::HANDLE_NIL);
-        if (ret != DDS::RETCODE_OK) {
-          ACE_ERROR((LM_ERROR,
-                     ACE_TEXT("ERROR: %N:%l: write FileContent failed: %d\n"),
-                     ret));
-        } else {
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) Published FileContent: %C (%Q bytes)\n"),
-                     filename.c_str(),
-                     metadata.size));
-        }
-      } else {
-        // Send as FileChunks (large file)
-        const uint32_t CHUNK_SIZE = 1024 * 1024; // 1MB
-        uint32_t total_chunks = static_cast<uint32_t>((metadata.size + CHUNK_SIZE - 1) / CHUNK_SIZE);
-
-        ACE_DEBUG((LM_INFO,
-                   ACE_TEXT("(%P|%t) Publishing FileChunks for: %C (%Q bytes, %u chunks)\n"),
-                   filename.c_str(),
-                   metadata.size,
-                   total_chunks));
-
-        // Read entire file
-        std::vector<uint8_t> file_data;
-        if (!DirShare::read_file(full_path, file_data)) {
-          ACE_ERROR((LM_ERROR,
-                     ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                     full_path.c_str()));
-          continue;
-        }
-
-        // Send chunks
-        for (uint32_t chunk_id = 0; chunk_id < total_chunks; ++chunk_id) {
-          DirShare::FileChunk chunk;
-          chunk.filename = metadata.filename;
-          chunk.chunk_id = chunk_id;
-          chunk.total_chunks = total_chunks;
-          chunk.file_size = metadata.size;
-          chunk.file_checksum = metadata.checksum;
-          chunk.timestamp_sec = metadata.timestamp_sec;
-          chunk.timestamp_nsec = metadata.timestamp_nsec;
-
-          // Calculate chunk data
-          uint64_t offset = static_cast<uint64_t>(chunk_id) * CHUNK_SIZE;
-          uint32_t this_chunk_size = static_cast<uint32_t>(
-            (offset + CHUNK_SIZE > metadata.size) ?
-            (metadata.size - offset) : CHUNK_SIZE);
-
-          chunk.data.length(this_chunk_size);
-          std::memcpy(chunk.data.get_buffer(), &file_data[offset], this_chunk_size);
-
-          // Calculate chunk checksum
-          chunk.chunk_checksum = DirShare::compute_checksum(
-            &file_data[offset], this_chunk_size);
-
-          ret = typed_chunk_writer->write(chunk, DDS::HANDLE_NIL);
-          if (ret != DDS::RETCODE_OK) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: write FileChunk failed: %d\n"),
-                       ret));
-            break;
-          }
-
-          // Small delay to avoid overwhelming UDP send buffer
-          ACE_Time_Value delay(0, 10000); // 10ms
-          ACE_OS::sleep(delay);
-        }
-
-        ACE_DEBUG((LM_INFO,
-                   ACE_TEXT("(%P|%t) Completed publishing chunks for: %C\n"),
-                   filename.c_str()));
+    if (!ok) {
+      for (size_t n = 0; n < nodes.size(); ++n) {
+        delete nodes[n];
       }
+      DirShare::AsyncLog::instance().stop();
+      return 1;
     }
 
     ACE_DEBUG((LM_INFO,
@@ -568,344 +691,46 @@ int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
                ACE_TEXT("  Press Ctrl+C to exit.\n"),
                g_shared_directory.c_str()));
 
-    // Main monitoring loop
-    while (true) {
-      ACE_OS::sleep(POLL_INTERVAL_SEC);
-
-      // Phase 4: Detect file changes and publish FileEvents
-      std::vector<std::string> created_files;
-      std::vector<std::string> modified_files;
-      std::vector<std::string> deleted_files;
-
-      if (monitor.scan_for_changes(created_files, modified_files, deleted_files)) {
-        // Handle created files (Phase 4)
-        for (size_t i = 0; i < created_files.size(); ++i) {
-          const std::string& filename = created_files[i];
-          std::string full_path = g_shared_directory + "/" + filename;
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) File CREATE detected: %C\n"),
-                     filename.c_str()));
-
-          // Get file metadata
-          DirShare::FileMetadata metadata;
-          if (!monitor.get_file_metadata(filename, metadata)) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: Failed to get metadata for: %C\n"),
-                       filename.c_str()));
-            continue;
-          }
-
-          // Create and publish FileEvent(CREATE)
-          DirShare::FileEvent event;
-          event.filename = metadata.filename;
-          event.operation = DirShare::CREATE;
-          ACE_Time_Value now = ACE_OS::gettimeofday();
-          event.timestamp_sec = static_cast<CORBA::ULongLong>(now.sec());
-          event.timestamp_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
-          event.metadata = metadata;
-
-          ret = typed_event_writer->write(event, DDS::HANDLE_NIL);
-          if (ret != DDS::RETCODE_OK) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: Failed to publish FileEvent(CREATE): %d\n"),
-                       ret));
-            continue;
-          }
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) Published FileEvent(CREATE) for: %C\n"),
-                     filename.c_str()));
-
-          // Publish file content
-          const uint64_t CHUNK_THRESHOLD = 10 * 1024 * 1024; // 10MB
-
-          if (metadata.size < CHUNK_THRESHOLD) {
-            // Send as FileContent (small file)
-            DirShare::FileContent content;
-            content.filename = metadata.filename;
-            content.size = metadata.size;
-            content.checksum = metadata.checksum;
-            content.timestamp_sec = metadata.timestamp_sec;
-            content.timestamp_nsec = metadata.timestamp_nsec;
-
-            // Read file data
-            std::vector<uint8_t> data;
-            if (!DirShare::read_file(full_path, data)) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                         full_path.c_str()));
-              continue;
-            }
-
-            content.data.length(static_cast<CORBA::ULong>(data.size()));
-            std::memcpy(content.data.get_buffer(), &data[0], data.size());
-
-            ret = typed_content_writer->write(content, DDS::HANDLE_NIL);
-            if (ret != DDS::RETCODE_OK) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: write FileContent failed: %d\n"),
-                         ret));
-            } else {
-              ACE_DEBUG((LM_INFO,
-                         ACE_TEXT("(%P|%t) Published FileContent for: %C (%Q bytes)\n"),
-                         filename.c_str(),
-                         metadata.size));
-            }
-          } else {
-            // Send as FileChunks (large file)
-            const uint32_t CHUNK_SIZE = 1024 * 1024; // 1MB
-            uint32_t total_chunks = static_cast<uint32_t>((metadata.size + CHUNK_SIZE - 1) / CHUNK_SIZE);
-
-            ACE_DEBUG((LM_INFO,
-                       ACE_TEXT("(%P|%t) Publishing FileChunks for: %C (%Q bytes, %u chunks)\n"),
-                       filename.c_str(),
-                       metadata.size,
-                       total_chunks));
-
-            // Read entire file
-            std::vector<uint8_t> file_data;
-            if (!DirShare::read_file(full_path, file_data)) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                         full_path.c_str()));
-              continue;
-            }
-
-            // Send chunks
-            for (uint32_t chunk_id = 0; chunk_id < total_chunks; ++chunk_id) {
-              DirShare::FileChunk chunk;
-              chunk.filename = metadata.filename;
-              chunk.chunk_id = chunk_id;
-              chunk.total_chunks = total_chunks;
-              chunk.file_size = metadata.size;
-              chunk.file_checksum = metadata.checksum;
-              chunk.timestamp_sec = metadata.timestamp_sec;
-              chunk.timestamp_nsec = metadata.timestamp_nsec;
-
-              // Calculate chunk data
-              uint64_t offset = static_cast<uint64_t>(chunk_id) * CHUNK_SIZE;
-              uint32_t this_chunk_size = static_cast<uint32_t>(
-                (offset + CHUNK_SIZE > metadata.size) ?
-                (metadata.size - offset) : CHUNK_SIZE);
-
-              chunk.data.length(this_chunk_size);
-              std::memcpy(chunk.data.get_buffer(), &file_data[offset], this_chunk_size);
-
-              // Calculate chunk checksum
-              chunk.chunk_checksum = DirShare::compute_checksum(
-                &file_data[offset], this_chunk_size);
-
-              ret = typed_chunk_writer->write(chunk, DDS::HANDLE_NIL);
-              if (ret != DDS::RETCODE_OK) {
-                ACE_ERROR((LM_ERROR,
-                           ACE_TEXT("ERROR: %N:%l: write FileChunk failed: %d\n"),
-                           ret));
-                break;
-              }
-
-              // Small delay to avoid overwhelming UDP send buffer
-              ACE_Time_Value delay(0, 10000); // 10ms
-              ACE_OS::sleep(delay);
-            }
-
-            ACE_DEBUG((LM_INFO,
-                       ACE_TEXT("(%P|%t) Completed publishing chunks for: %C\n"),
-                       filename.c_str()));
-          }
-        }
-
-        // Handle modified files (Phase 5)
-        for (size_t i = 0; i < modified_files.size(); ++i) {
-          const std::string& filename = modified_files[i];
-          std::string full_path = g_shared_directory + "/" + filename;
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) File MODIFY detected: %C\n"),
-                     filename.c_str()));
-
-          // Get file metadata
-          DirShare::FileMetadata metadata;
-          if (!monitor.get_file_metadata(filename, metadata)) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: Failed to get metadata for: %C\n"),
-                       filename.c_str()));
-            continue;
-          }
-
-          // Create and publish FileEvent(MODIFY)
-          DirShare::FileEvent event;
-          event.filename = metadata.filename;
-          event.operation = DirShare::MODIFY;
-          ACE_Time_Value now = ACE_OS::gettimeofday();
-          event.timestamp_sec = static_cast<CORBA::ULongLong>(now.sec());
-          event.timestamp_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
-          event.metadata = metadata;
-
-          ret = typed_event_writer->write(event, DDS::HANDLE_NIL);
-          if (ret != DDS::RETCODE_OK) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: Failed to publish FileEvent(MODIFY): %d\n"),
-                       ret));
-            continue;
-          }
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) Published FileEvent(MODIFY) for: %C\n"),
-                     filename.c_str()));
-
-          // Publish updated file content
-          const uint64_t CHUNK_THRESHOLD = 10 * 1024 * 1024; // 10MB
-
-          if (metadata.size < CHUNK_THRESHOLD) {
-            // Send as FileContent (small file)
-            DirShare::FileContent content;
-            content.filename = metadata.filename;
-            content.size = metadata.size;
-            content.checksum = metadata.checksum;
-            content.timestamp_sec = metadata.timestamp_sec;
-            content.timestamp_nsec = metadata.timestamp_nsec;
-
-            // Read file data
-            std::vector<uint8_t> data;
-            if (!DirShare::read_file(full_path, data)) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                         full_path.c_str()));
-              continue;
-            }
-
-            content.data.length(static_cast<CORBA::ULong>(data.size()));
-            std::memcpy(content.data.get_buffer(), &data[0], data.size());
-
-            ret = typed_content_writer->write(content, DDS::HANDLE_NIL);
-            if (ret != DDS::RETCODE_OK) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: write FileContent failed: %d\n"),
-                         ret));
-            } else {
-              ACE_DEBUG((LM_INFO,
-                         ACE_TEXT("(%P|%t) Published FileContent for MODIFY: %C (%Q bytes)\n"),
-                         filename.c_str(),
-                         metadata.size));
-            }
-          } else {
-            // Send as FileChunks (large file)
-            const uint32_t CHUNK_SIZE = 1024 * 1024; // 1MB
-            uint32_t total_chunks = static_cast<uint32_t>((metadata.size + CHUNK_SIZE - 1) / CHUNK_SIZE);
-
-            ACE_DEBUG((LM_INFO,
-                       ACE_TEXT("(%P|%t) Publishing FileChunks for MODIFY: %C (%Q bytes, %u chunks)\n"),
-                       filename.c_str(),
-                       metadata.size,
-                       total_chunks));
-
-            // Read entire file
-            std::vector<uint8_t> file_data;
-            if (!DirShare::read_file(full_path, file_data)) {
-              ACE_ERROR((LM_ERROR,
-                         ACE_TEXT("ERROR: %N:%l: Failed to read file: %C\n"),
-                         full_path.c_str()));
-              continue;
-            }
-
-            // Send chunks
-            for (uint32_t chunk_id = 0; chunk_id < total_chunks; ++chunk_id) {
-              DirShare::FileChunk chunk;
-              chunk.filename = metadata.filename;
-              chunk.chunk_id = chunk_id;
-              chunk.total_chunks = total_chunks;
-              chunk.file_size = metadata.size;
-              chunk.file_checksum = metadata.checksum;
-              chunk.timestamp_sec = metadata.timestamp_sec;
-              chunk.timestamp_nsec = metadata.timestamp_nsec;
-
-              // Calculate chunk data
-              uint64_t offset = static_cast<uint64_t>(chunk_id) * CHUNK_SIZE;
-              uint32_t this_chunk_size = static_cast<uint32_t>(
-                (offset + CHUNK_SIZE > metadata.size) ?
-                (metadata.size - offset) : CHUNK_SIZE);
-
-              chunk.data.length(this_chunk_size);
-              std::memcpy(chunk.data.get_buffer(), &file_data[offset], this_chunk_size);
-
-              // Calculate chunk checksum
-              chunk.chunk_checksum = DirShare::compute_checksum(
-                &file_data[offset], this_chunk_size);
-
-              ret = typed_chunk_writer->write(chunk, DDS::HANDLE_NIL);
-              if (ret != DDS::RETCODE_OK) {
-                ACE_ERROR((LM_ERROR,
-                           ACE_TEXT("ERROR: %N:%l: write FileChunk failed: %d\n"),
-                           ret));
-                break;
-              }
-
-              // Small delay to avoid overwhelming UDP send buffer
-              ACE_Time_Value delay(0, 10000); // 10ms
-              ACE_OS::sleep(delay);
-            }
-
-            ACE_DEBUG((LM_INFO,
-                       ACE_TEXT("(%P|%t) Completed publishing chunks for MODIFY: %C\n"),
-                       filename.c_str()));
-          }
-        }
-
-        // Handle deleted files (Phase 6)
-        for (size_t i = 0; i < deleted_files.size(); ++i) {
-          const std::string& filename = deleted_files[i];
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) File DELETE detected: %C\n"),
-                     filename.c_str()));
-
-          // SC-011: Check if notifications are suppressed for this file
-          if (change_tracker.is_suppressed(filename)) {
-            ACE_DEBUG((LM_DEBUG,
-                       ACE_TEXT("Skipping DELETE publication for suppressed file '%C' (remote update)\n"),
-                       filename.c_str()));
-            continue;
-          }
-
-          // Create and publish FileEvent(DELETE)
-          DirShare::FileEvent event;
-          event.filename = filename.c_str();
-          event.operation = DirShare::DELETE;
-          ACE_Time_Value now = ACE_OS::gettimeofday();
-          event.timestamp_sec = static_cast<CORBA::ULongLong>(now.sec());
-          event.timestamp_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
-
-          // For DELETE, metadata is not applicable (file no longer exists)
-          // Set metadata fields to zero/empty
-          event.metadata.filename = filename.c_str();
-          event.metadata.size = 0;
-          event.metadata.timestamp_sec = 0;
-          event.metadata.timestamp_nsec = 0;
-          event.metadata.checksum = 0;
-
-          ret = typed_event_writer->write(event, DDS::HANDLE_NIL);
-          if (ret != DDS::RETCODE_OK) {
-            ACE_ERROR((LM_ERROR,
-                       ACE_TEXT("ERROR: %N:%l: Failed to publish FileEvent(DELETE): %d\n"),
-                       ret));
-            continue;
-          }
-
-          ACE_DEBUG((LM_INFO,
-                     ACE_TEXT("(%P|%t) Published FileEvent(DELETE) for: %C\n"),
-                     filename.c_str()));
-        }
+    // Scans on change notifications and every poll interval; Ctrl+C /
+    // SIGTERM end run() so that the cleanup below runs
+    ShareScanner scanner(monitor, change_tracker, remote_changes, nodes, trace_file);
+    DirShare::MainLoop loop(scanner);
+    if (!loop.open(g_shared_directory,
+                   ACE_Time_Value(POLL_INTERVAL_SEC),
+                   ACE_Time_Value(0, SETTLE_DELAY_USEC),
+                   trace_file.empty() ? 0 : SIGUSR1)) {
+      return_code = 1;
+    } else {
+      remote_changes.attach(&loop);
+      if (loop.run() != 0) {
+        ACE_ERROR((LM_ERROR,
+                   ACE_TEXT("ERROR: %N:%l: Main loop failed (%m)\n")));
+        return_code = 1;
       }
+      remote_changes.attach(0);
     }
 
-    // Cleanup (will be reached via signal handler or when loop exits)
+    // Cleanup (reached on SIGINT or SIGTERM, or when the main loop fails)
     ACE_DEBUG((LM_INFO, ACE_TEXT("(%P|%t) Shutting down DirShare...\n")));
 
-    ws->detach_condition(condition);
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      nodes[n]->shutdown();
+      delete nodes[n];
+    }
+    metrics_server.stop();
+    DirShare::AsyncLog::instance().stop();
 
-    participant->delete_contained_entities();
-    dpf->delete_participant(participant);
+    if (!trace_file.empty()) {
+      DirShare::Tracer::instance().write_chrome_trace(trace_file);
+    }
+
+    if (!capture_file.empty()) {
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Recorded %Q samples to %C\n"),
+                 DirShare::SampleCapture::instance().records(),
+                 capture_file.c_str()));
+      DirShare::SampleCapture::instance().close();
+    }
 
     TheServiceParticipant->shutdown();
 
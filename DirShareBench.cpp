@@ -0,0 +1,1116 @@
+// DirShareBench.cpp
+// dirshare-bench: throughput and propagation latency of N local DirShare
+// participants on synthetic shares, reported as JSON
+
+#include "DirShareTypeSupportImpl.h"
+#include "Checksum.h"
+#include "FaultInjection.h"
+#include "FileUtils.h"
+#include "Stats.h"
+
+#include <dds/DCPS/Marked_Default_Qos.h>
+#include <dds/DCPS/Service_Participant.h>
+#include <dds/DCPS/StaticIncludes.h>
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/High_Res_Timer.h>
+#include <ace/Process.h>
+#include <ace/Dirent.h>
+#include <ace/OS_NS_fcntl.h>
+#include <ace/OS_NS_signal.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+#if OPENDDS_DO_MANUAL_STATIC_INCLUDES
+#  include <dds/DCPS/RTPS/RtpsDiscovery.h>
+#  include <dds/DCPS/transport/rtps_udp/RtpsUdp.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int DEFAULT_DOMAIN_ID = 99;  // Away from the default share (42)
+const int MAX_DOMAIN_ID = 231;
+const long DEFAULT_PARTICIPANTS = 3;
+const long DEFAULT_TIMEOUT_SEC = 300;
+const long DEFAULT_SETTLE_SEC = 3;
+
+// Fault proxy ports for --netem, as rtps_netem.ini expects them
+const char* const NETEM_HOST = "127.0.0.1";
+const unsigned short NETEM_PORT = 7600;
+
+// Participants must show up on DirShare_Stats within this time
+const int STARTUP_TIMEOUT_SEC = 60;
+
+// Receiver directories are checked this often (ms); the latency of a file
+// is measured to the check that finds it complete
+const long POLL_INTERVAL_MSEC = 20;
+
+const size_t KIB = 1024;
+const size_t MIB = 1024 * 1024;
+
+volatile sig_atomic_t g_shutdown = 0;
+
+extern "C" void on_shutdown_signal(int)
+{
+  g_shutdown = 1;
+}
+
+struct Options {
+  std::string dirshare;         // Executable of the participants
+  std::string config;           // DDS configuration file
+  std::string work;             // Directory of the shares and logs
+  std::string output;           // JSON report ("" for stdout)
+  std::string netem;            // Impairments of the fault proxy ("" for none)
+  DDS::DomainId_t domain_id;
+  long participants;
+  long timeout;
+  long settle;
+  double scale;
+  bool keep;
+  std::vector<std::string> scenarios;
+  std::vector<std::string> dirshare_args;  // After "--"
+};
+
+/**
+ * A synthetic share
+ * Files are written to a staging directory and moved into the sending
+ * participant's share, so the sender never sees a partial file. The
+ * append scenario instead seeds every share with the same files before the
+ * participants start, then appends to the sender's copies in place.
+ */
+struct Scenario {
+  const char* name;
+  const char* description;
+  size_t small_files;     // 4 KiB each
+  size_t medium_files;    // 1 MiB each
+  size_t large_files;     // 64 MiB each
+  size_t huge_files;      // 256 MiB each
+  size_t sparse_files;    // 256 MiB logical, 1 MiB of data every 32 MiB
+  size_t append_files;    // 64 KiB seeded, 16 KiB appended
+};
+
+const Scenario SCENARIOS[] = {
+  { "small", "many small files", 2000, 0, 0, 0, 0, 0 },
+  { "large", "few huge files", 0, 0, 0, 2, 0, 0 },
+  { "mixed", "small, medium and large files", 1000, 50, 2, 0, 0, 0 },
+  { "sparse", "sparse files", 0, 0, 0, 0, 4, 0 },
+  { "append", "appends to synchronized files", 0, 0, 0, 0, 0, 200 }
+};
+const size_t SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+// A file of a scenario as the receivers must end up holding it
+struct Expected {
+  std::string name;
+  unsigned long long size;
+  unsigned long long mtime_sec;
+  unsigned long checksum;
+  ACE_Time_Value changed;  // Monotonic time of the change at the sender
+};
+
+struct Result {
+  std::string name;
+  size_t files;
+  unsigned long long bytes;
+  bool completed;
+  size_t pending;             // (File, receiver) pairs left at the end
+  double seconds;             // First change to the last file complete everywhere
+  std::vector<double> latencies;  // Seconds, one per (file, receiver)
+  double cpu_seconds;         // All participants (-1: unavailable)
+  long peak_rss_kb;           // Largest participant (-1: unavailable)
+};
+
+ACE_Time_Value monotonic_now()
+{
+  return ACE_High_Res_Timer::gettimeofday_hr();
+}
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+std::string join_path(const std::string& directory, const std::string& name)
+{
+  return directory + "/" + name;
+}
+
+bool parse_number(const ACE_TCHAR* arg, long max, long& value)
+{
+  const std::string text = ACE_TEXT_ALWAYS_CHAR(arg);
+  char* end = 0;
+  value = ACE_OS::strtol(text.c_str(), &end, 10);
+  return end != text.c_str() && *end == '\0' && value >= 0 && value <= max;
+}
+
+// Scale a file count, keeping at least one file of each kind used
+size_t scaled(size_t count, double scale)
+{
+  if (count == 0) {
+    return 0;
+  }
+  const size_t n = static_cast<size_t>(static_cast<double>(count) * scale + 0.5);
+  return n > 0 ? n : 1;
+}
+
+// Incompressible, reproducible content (xorshift64)
+void fill_random(std::vector<char>& buffer, uint64_t& state)
+{
+  for (size_t i = 0; i + 8 <= buffer.size(); i += 8) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    ACE_OS::memcpy(&buffer[i], &state, 8);
+  }
+}
+
+bool write_random(const std::string& path, unsigned long long size, uint64_t seed,
+                  std::ios::openmode mode = std::ios::trunc)
+{
+  std::ofstream file(path.c_str(), std::ios::binary | mode);
+  if (!file) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot create %C\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  std::vector<char> buffer(static_cast<size_t>(std::min<unsigned long long>(size, MIB)) + 8);
+  for (unsigned long long written = 0; written < size;) {
+    const size_t n = static_cast<size_t>(std::min<unsigned long long>(size - written, MIB));
+    fill_random(buffer, state);
+    file.write(&buffer[0], static_cast<std::streamsize>(n));
+    written += n;
+  }
+  return static_cast<bool>(file);
+}
+
+// Logical size with a data extent at the start of every stride
+bool write_sparse(const std::string& path, unsigned long long size,
+                  size_t extent, unsigned long long stride, uint64_t seed)
+{
+  ACE_HANDLE handle = ACE_OS::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (handle == ACE_INVALID_HANDLE) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot create %C\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  bool ok = ACE_OS::ftruncate(handle, static_cast<ACE_OFF_T>(size)) == 0;
+  uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  std::vector<char> buffer(extent + 8);
+  for (unsigned long long offset = 0; ok && offset < size; offset += stride) {
+    fill_random(buffer, state);
+    const size_t n = static_cast<size_t>(std::min<unsigned long long>(extent, size - offset));
+    ok = ACE_OS::pwrite(handle, &buffer[0], n, static_cast<ACE_OFF_T>(offset)) ==
+      static_cast<ssize_t>(n);
+  }
+  ACE_OS::close(handle);
+  return ok;
+}
+
+// Size, modification time and checksum of a file about to change hands
+bool describe(const std::string& path, const std::string& name, Expected& expected)
+{
+  expected.name = name;
+  unsigned long nsec = 0;
+  return DirShare::get_file_size(path, expected.size) &&
+    DirShare::get_file_mtime(path, expected.mtime_sec, nsec) &&
+    DirShare::calculate_file_crc32(path.c_str(), expected.checksum);
+}
+
+// Remove a directory and the files in it (the shares are flat)
+void remove_tree(const std::string& directory)
+{
+  std::vector<std::string> entries;
+  {
+    ACE_Dirent dir(directory.c_str());
+    for (ACE_DIRENT* entry = dir.read(); entry != 0; entry = dir.read()) {
+      const std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        entries.push_back(name);
+      }
+    }
+  }
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const std::string path = join_path(directory, entries[i]);
+    if (DirShare::is_directory(path)) {
+      remove_tree(path);
+    } else {
+      ACE_OS::unlink(path.c_str());
+    }
+  }
+  ACE_OS::rmdir(directory.c_str());
+}
+
+/**
+ * One DirShare process sharing a directory
+ * Output goes to a log file next to the share.
+ */
+class Participant {
+public:
+  Participant() : started_(false), cpu_base_(0.0) {}
+
+  ~Participant()
+  {
+    stop();
+  }
+
+  bool start(const Options& options, const std::string& directory, const std::string& log)
+  {
+    std::vector<std::string> args;
+    args.push_back(options.dirshare);
+    args.push_back("-DCPSConfigFile");
+    args.push_back(options.config);
+    args.push_back("-d");
+    std::ostringstream domain;
+    domain << options.domain_id;
+    args.push_back(domain.str());
+    args.insert(args.end(), options.dirshare_args.begin(), options.dirshare_args.end());
+    args.push_back(directory);
+
+    std::vector<const ACE_TCHAR*> argv;
+    for (size_t i = 0; i < args.size(); ++i) {
+      argv.push_back(ACE_TEXT_CHAR_TO_TCHAR(args[i].c_str()));
+    }
+    argv.push_back(0);
+
+    ACE_HANDLE output = ACE_OS::open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (output == ACE_INVALID_HANDLE) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Cannot create %C\n"),
+                       log.c_str()),
+                      false);
+    }
+
+    ACE_Process_Options process_options;
+    process_options.command_line(&argv[0]);
+    process_options.set_handles(ACE_INVALID_HANDLE, output, output);
+    const pid_t pid = process_.spawn(process_options);
+    process_options.release_handles();
+    ACE_OS::close(output);
+
+    if (pid == ACE_INVALID_PID) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Cannot start %C\n"),
+                       options.dirshare.c_str()),
+                      false);
+    }
+    started_ = true;
+    return true;
+  }
+
+  bool running()
+  {
+    return started_ && process_.running();
+  }
+
+  /// Count CPU time from now on
+  void reset_cpu()
+  {
+    long rss = 0;
+    usage(cpu_base_, rss);
+  }
+
+  /**
+   * Resources used since reset_cpu()
+   * @return false where /proc is not available
+   */
+  bool resources(double& cpu_seconds, long& peak_rss_kb) const
+  {
+    double cpu = 0.0;
+    if (!usage(cpu, peak_rss_kb)) {
+      return false;
+    }
+    cpu_seconds = cpu - cpu_base_;
+    return true;
+  }
+
+  /// Ask the participant to exit (SIGTERM), then kill it if it does not
+  void stop()
+  {
+    if (!running()) {
+      started_ = false;
+      return;
+    }
+    process_.kill(SIGTERM);
+    if (process_.wait(ACE_Time_Value(10)) == 0) {
+      ACE_ERROR((LM_WARNING,
+                 ACE_TEXT("WARNING: %N:%l: Participant %d did not exit, killing it\n"),
+                 static_cast<int>(process_.getpid())));
+      process_.terminate();
+      process_.wait();
+    }
+    started_ = false;
+  }
+
+private:
+  // Total CPU time and peak resident set of the running process
+  bool usage(double& cpu_seconds, long& peak_rss_kb) const
+  {
+#if defined (__linux__)
+    const pid_t pid = const_cast<ACE_Process&>(process_).getpid();
+    std::ostringstream base;
+    base << "/proc/" << pid;
+
+    // utime and stime are fields 14 and 15, after the parenthesized name
+    std::ifstream stat((base.str() + "/stat").c_str());
+    std::string line;
+    if (!std::getline(stat, line)) {
+      return false;
+    }
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long long ticks = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+      if (i >= 14) {
+        ticks += ACE_OS::strtoull(field.c_str(), 0, 10);
+      }
+    }
+    cpu_seconds = static_cast<double>(ticks) / static_cast<double>(ACE_OS::sysconf(_SC_CLK_TCK));
+
+    peak_rss_kb = 0;
+    std::ifstream status((base.str() + "/status").c_str());
+    while (std::getline(status, line)) {
+      if (line.compare(0, 6, "VmHWM:") == 0) {
+        peak_rss_kb = ACE_OS::strtol(line.c_str() + 6, 0, 10);
+      }
+    }
+    return true;
+#else
+    ACE_UNUSED_ARG(cpu_seconds);
+    ACE_UNUSED_ARG(peak_rss_kb);
+    return false;
+#endif
+  }
+
+  ACE_Process process_;
+  bool started_;
+  double cpu_base_;
+
+  Participant(const Participant&);
+  Participant& operator=(const Participant&);
+};
+
+/// The participants of a scenario, stopped when it ends
+class Participants {
+public:
+  explicit Participants(size_t count)
+  {
+    for (size_t i = 0; i < count; ++i) {
+      participants_.push_back(new Participant);
+    }
+  }
+
+  ~Participants()
+  {
+    for (size_t i = 0; i < participants_.size(); ++i) {
+      delete participants_[i];
+    }
+  }
+
+  size_t size() const { return participants_.size(); }
+  Participant* operator[](size_t i) { return participants_[i]; }
+
+private:
+  std::vector<Participant*> participants_;
+
+  Participants(const Participants&);
+  Participants& operator=(const Participants&);
+};
+
+/**
+ * Runs the scenarios, each with fresh participants and shares
+ */
+class Bench {
+public:
+  Bench(const Options& options, DirShare::ParticipantStatsDataReader_ptr stats_reader)
+    : options_(options)
+    , stats_reader_(stats_reader)
+  {
+  }
+
+  bool run(const Scenario& scenario, Result& result);
+
+private:
+  // Write the files of a scenario to staging (or seed the shares)
+  bool generate(const Scenario& scenario, const std::string& root,
+                std::vector<std::string>& names);
+
+  // Wait until every participant publishes statistics and they agree
+  bool wait_ready(size_t participants);
+
+  // Poll the receivers until they hold every expected file
+  void wait_propagated(const std::vector<Expected>& files,
+                       const std::vector<std::string>& receivers,
+                       Result& result);
+
+  const Options& options_;
+  DirShare::ParticipantStatsDataReader_ptr stats_reader_;
+};
+
+bool Bench::generate(const Scenario& scenario, const std::string& root,
+                     std::vector<std::string>& names)
+{
+  const std::string staging = join_path(root, "staging");
+  char name[64];
+  uint64_t seed = 1;
+
+  struct Kind {
+    size_t count;
+    const char* prefix;
+    unsigned long long size;
+    bool sparse;
+  };
+  const Kind kinds[] = {
+    { scaled(scenario.small_files, options_.scale), "small", 4 * KIB, false },
+    { scaled(scenario.medium_files, options_.scale), "medium", MIB, false },
+    { scaled(scenario.large_files, options_.scale), "large", 64 * MIB, false },
+    { scaled(scenario.huge_files, options_.scale), "huge", 256 * MIB, false },
+    { scaled(scenario.sparse_files, options_.scale), "sparse", 256 * MIB, true },
+    { scaled(scenario.append_files, options_.scale), "append", 64 * KIB, false }
+  };
+
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+    for (size_t i = 0; i < kinds[k].count; ++i, ++seed) {
+      ACE_OS::snprintf(name, sizeof(name), "%s_%06lu.bin", kinds[k].prefix,
+                       static_cast<unsigned long>(i));
+      const std::string path = join_path(staging, name);
+      const bool ok = kinds[k].sparse ?
+        write_sparse(path, kinds[k].size, MIB, 32 * MIB, seed) :
+        write_random(path, kinds[k].size, seed);
+      if (!ok) {
+        return false;
+      }
+      names.push_back(name);
+    }
+  }
+
+  // Appends start from identical copies in every share
+  if (scenario.append_files > 0) {
+    for (long p = 0; p < options_.participants; ++p) {
+      std::ostringstream share;
+      share << root << "/participant_" << p;
+      for (size_t i = 0; i < names.size(); ++i) {
+        const std::string source = join_path(staging, names[i]);
+        const std::string copy = join_path(share.str(), names[i]);
+        unsigned long long sec = 0;
+        unsigned long nsec = 0;
+        if (!DirShare::clone_file(source, copy) ||
+            !DirShare::get_file_mtime(source, sec, nsec) ||
+            !DirShare::set_file_mtime(copy, sec, nsec)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Cannot seed %C\n"),
+                           copy.c_str()),
+                          false);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool Bench::wait_ready(size_t participants)
+{
+  DirShare::FleetView view;
+  const ACE_Time_Value deadline = monotonic_now() + ACE_Time_Value(STARTUP_TIMEOUT_SEC);
+
+  while (!g_shutdown && monotonic_now() < deadline) {
+    DirShare::take_stats(stats_reader_, view);
+    if (view.nodes().size() >= participants && view.converged()) {
+      // Seen by us; give them time to discover each other as well
+      ACE_OS::sleep(static_cast<u_int>(options_.settle));
+      return !g_shutdown;
+    }
+    ACE_OS::sleep(ACE_Time_Value(0, 200000));
+  }
+
+  ACE_ERROR_RETURN((LM_ERROR,
+                   ACE_TEXT("ERROR: %N:%l: %lu of %lu participants ready after %d s\n"),
+                   static_cast<unsigned long>(view.nodes().size()),
+                   static_cast<unsigned long>(participants),
+                   STARTUP_TIMEOUT_SEC),
+                  false);
+}
+
+void Bench::wait_propagated(const std::vector<Expected>& files,
+                            const std::vector<std::string>& receivers,
+                            Result& result)
+{
+  // (File, receiver) pairs still to arrive
+  std::vector<std::pair<size_t, size_t> > pending;
+  for (size_t f = 0; f < files.size(); ++f) {
+    for (size_t r = 0; r < receivers.size(); ++r) {
+      pending.push_back(std::make_pair(f, r));
+    }
+  }
+
+  const ACE_Time_Value deadline = monotonic_now() + ACE_Time_Value(options_.timeout);
+  ACE_Time_Value last_arrival = files.empty() ? monotonic_now() : files.front().changed;
+
+  while (!pending.empty() && !g_shutdown && monotonic_now() < deadline) {
+    for (size_t i = 0; i < pending.size();) {
+      const Expected& file = files[pending[i].first];
+      const std::string copy = join_path(receivers[pending[i].second], file.name);
+
+      // Size and time first: the checksum is read once, when they match
+      unsigned long long size = 0;
+      unsigned long long sec = 0;
+      unsigned long nsec = 0;
+      const ACE_Time_Value seen = monotonic_now();
+      unsigned long checksum = 0;
+      if (DirShare::get_file_size(copy, size) && size == file.size &&
+          DirShare::get_file_mtime(copy, sec, nsec) && sec == file.mtime_sec &&
+          DirShare::calculate_file_crc32(copy.c_str(), checksum) &&
+          checksum == file.checksum) {
+        result.latencies.push_back(seconds(seen - file.changed));
+        if (seen > last_arrival) {
+          last_arrival = seen;
+        }
+        pending[i] = pending.back();
+        pending.pop_back();
+      } else {
+        ++i;
+      }
+    }
+    if (!pending.empty()) {
+      ACE_OS::sleep(ACE_Time_Value(0, POLL_INTERVAL_MSEC * 1000));
+    }
+  }
+
+  result.pending = pending.size();
+  result.completed = pending.empty();
+  result.seconds = files.empty() ? 0.0 : seconds(last_arrival - files.front().changed);
+}
+
+bool Bench::run(const Scenario& scenario, Result& result)
+{
+  result.name = scenario.name;
+  result.files = 0;
+  result.bytes = 0;
+  result.completed = false;
+  result.pending = 0;
+  result.seconds = 0.0;
+  result.cpu_seconds = -1.0;
+  result.peak_rss_kb = -1;
+
+  const std::string root = join_path(options_.work, scenario.name);
+  remove_tree(root);
+  ACE_OS::mkdir(root.c_str());
+  ACE_OS::mkdir(join_path(root, "staging").c_str());
+
+  std::vector<std::string> shares;
+  for (long p = 0; p < options_.participants; ++p) {
+    std::ostringstream share;
+    share << root << "/participant_" << p;
+    shares.push_back(share.str());
+    ACE_OS::mkdir(share.str().c_str());
+  }
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Scenario %C: generating %C\n"),
+             scenario.name, scenario.description));
+  std::vector<std::string> names;
+  if (!generate(scenario, root, names)) {
+    return false;
+  }
+
+  // Participant 0 sends, the others receive
+  Participants participants(shares.size());
+  for (size_t p = 0; p < participants.size(); ++p) {
+    if (!participants[p]->start(options_, shares[p], shares[p] + ".log")) {
+      return false;
+    }
+  }
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Scenario %C: waiting for %lu participants\n"),
+             scenario.name, static_cast<unsigned long>(participants.size())));
+  if (!wait_ready(participants.size())) {
+    return false;
+  }
+  for (size_t p = 0; p < participants.size(); ++p) {
+    if (!participants[p]->running()) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Participant %lu exited (see %C.log)\n"),
+                       static_cast<unsigned long>(p), shares[p].c_str()),
+                      false);
+    }
+    participants[p]->reset_cpu();
+  }
+
+  // The measured change: everything is read beforehand so the changes
+  // follow each other closely
+  const std::string staging = join_path(root, "staging");
+  std::vector<Expected> files(names.size());
+  if (scenario.append_files > 0) {
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (!write_random(join_path(shares[0], names[i]), 16 * KIB, 1000003 + i, std::ios::app)) {
+        return false;
+      }
+      files[i].changed = monotonic_now();
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      const ACE_Time_Value changed = files[i].changed;
+      if (!describe(join_path(shares[0], names[i]), names[i], files[i])) {
+        return false;
+      }
+      files[i].changed = changed;
+    }
+  } else {
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (!describe(join_path(staging, names[i]), names[i], files[i])) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      const std::string staged = join_path(staging, names[i]);
+      files[i].changed = monotonic_now();
+      if (ACE_OS::rename(staged.c_str(), join_path(shares[0], names[i]).c_str()) != 0) {
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("ERROR: %N:%l: Cannot move %C into the share\n"),
+                         staged.c_str()),
+                        false);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    result.bytes += files[i].size;
+  }
+  result.files = files.size();
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Scenario %C: %lu files changed, waiting for %lu receivers\n"),
+             scenario.name,
+             static_cast<unsigned long>(files.size()),
+             static_cast<unsigned long>(shares.size() - 1)));
+  wait_propagated(files, std::vector<std::string>(shares.begin() + 1, shares.end()), result);
+
+  double cpu_total = 0.0;
+  long rss_max = 0;
+  bool measured = true;
+  for (size_t p = 0; p < participants.size(); ++p) {
+    double cpu = 0.0;
+    long rss = 0;
+    if (!participants[p]->resources(cpu, rss)) {
+      measured = false;
+      break;
+    }
+    cpu_total += cpu;
+    rss_max = std::max(rss_max, rss);
+  }
+  if (measured) {
+    result.cpu_seconds = cpu_total;
+    result.peak_rss_kb = rss_max;
+  }
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Scenario %C: %C in %.2f s\n"),
+             scenario.name,
+             result.completed ? "completed" : "INCOMPLETE",
+             result.seconds));
+  return true;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double quantile)
+{
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(quantile * static_cast<double>(sorted.size()) + 0.999999);
+  if (rank == 0) {
+    rank = 1;
+  }
+  return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+std::string json_string(const std::string& text)
+{
+  std::string out = "\"";
+  for (size_t i = 0; i < text.size(); ++i) {
+    const unsigned char c = static_cast<unsigned char>(text[i]);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      ACE_OS::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  return out + "\"";
+}
+
+std::string report(const Options& options,
+                   const std::vector<Result>& results,
+                   const DirShare::FaultProxy* proxy)
+{
+  char host[256];
+  if (ACE_OS::hostname(host, sizeof(host)) != 0) {
+    host[0] = '\0';
+  }
+
+  std::string dirshare_args;
+  for (size_t i = 0; i < options.dirshare_args.size(); ++i) {
+    dirshare_args += (i > 0 ? " " : "") + options.dirshare_args[i];
+  }
+
+  std::ostringstream out;
+  out << "{\n"
+      << "  \"benchmark\": \"dirshare-bench\",\n"
+      << "  \"timestamp\": " << ACE_OS::gettimeofday().sec() << ",\n"
+      << "  \"hostname\": " << json_string(host) << ",\n"
+      << "  \"participants\": " << options.participants << ",\n"
+      << "  \"scale\": " << options.scale << ",\n"
+      << "  \"dirshare_args\": " << json_string(dirshare_args) << ",\n";
+  if (proxy) {
+    out << "  \"netem\": {\"spec\": " << json_string(options.netem)
+        << ", \"forwarded\": " << proxy->forwarded()
+        << ", \"bytes_forwarded\": " << proxy->bytes_forwarded()
+        << ", \"lost\": " << proxy->lost()
+        << ", \"overflowed\": " << proxy->overflowed() << "},\n";
+  } else {
+    out << "  \"netem\": null,\n";
+  }
+  out << "  \"scenarios\": [";
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    std::vector<double> sorted = result.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    const double elapsed = result.seconds > 0.0 ? result.seconds : 1e-9;
+
+    char line[512];
+    ACE_OS::snprintf(line, sizeof(line),
+                     "%s\n    {\"name\": %s, \"files\": %lu, \"bytes\": %llu, "
+                     "\"completed\": %s, \"pending\": %lu, \"seconds\": %.3f,\n"
+                     "     \"files_per_sec\": %.1f, \"mb_per_sec\": %.2f,\n"
+                     "     \"latency_ms\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f},\n",
+                     i > 0 ? "," : "",
+                     json_string(result.name).c_str(),
+                     static_cast<unsigned long>(result.files),
+                     result.bytes,
+                     result.completed ? "true" : "false",
+                     static_cast<unsigned long>(result.pending),
+                     result.seconds,
+                     static_cast<double>(result.files) / elapsed,
+                     static_cast<double>(result.bytes) / 1e6 / elapsed,
+                     percentile(sorted, 0.5) * 1000.0,
+                     percentile(sorted, 0.99) * 1000.0,
+                     (sorted.empty() ? 0.0 : sorted.back()) * 1000.0);
+    out << line;
+
+    if (result.cpu_seconds < 0.0) {
+      out << "     \"cpu_seconds\": null, \"peak_rss_kb\": null}";
+    } else {
+      ACE_OS::snprintf(line, sizeof(line),
+                       "     \"cpu_seconds\": %.2f, \"peak_rss_kb\": %ld}",
+                       result.cpu_seconds, result.peak_rss_kb);
+      out << line;
+    }
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+} // namespace
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  int return_code = 0;
+
+  try {
+    // Initialize DDS DomainParticipantFactory (this processes -DCPS* options)
+    DDS::DomainParticipantFactory_var dpf =
+      TheParticipantFactoryWithArgs(argc, argv);
+
+    Options options;
+    options.config = "rtps.ini";
+    options.domain_id = DEFAULT_DOMAIN_ID;
+    options.participants = DEFAULT_PARTICIPANTS;
+    options.timeout = DEFAULT_TIMEOUT_SEC;
+    options.settle = DEFAULT_SETTLE_SEC;
+    options.scale = 1.0;
+    options.keep = false;
+
+    // dirshare next to this executable, unless given
+    const std::string self = ACE_TEXT_ALWAYS_CHAR(argv[0]);
+    const std::string::size_type slash = self.rfind('/');
+    options.dirshare = (slash == std::string::npos ? std::string(".") : self.substr(0, slash)) +
+      "/dirshare";
+
+    const char* tmp = ACE_OS::getenv("TMPDIR");
+    std::ostringstream work;
+    work << (tmp && *tmp ? tmp : "/tmp") << "/dirshare-bench." << ACE_OS::getpid();
+    options.work = work.str();
+
+    ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hn:s:S:x:c:d:w:o:t:e:kN:"));
+    get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("participants"), 'n', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("scenario"), 's', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("scale"), 'S', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("dirshare"), 'x', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("config"), 'c', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("domain"), 'd', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("work"), 'w', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("output"), 'o', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("timeout"), 't', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("settle"), 'e', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("keep"), 'k', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("netem"), 'N', ACE_Get_Opt::ARG_REQUIRED);
+
+    int c;
+    long value = 0;
+    bool config_given = false;
+    while ((c = get_opts()) != -1) {
+      switch (c) {
+      case 'n':
+        if (!parse_number(get_opts.opt_arg(), 64, options.participants) ||
+            options.participants < 2) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid participant count (2-64): %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 's': {
+        const std::string name = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        bool known = false;
+        for (size_t i = 0; i < SCENARIO_COUNT; ++i) {
+          known = known || name == SCENARIOS[i].name;
+        }
+        if (!known) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Unknown scenario: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        options.scenarios.push_back(name);
+        break;
+      }
+      case 'S': {
+        const std::string text = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        char* end = 0;
+        options.scale = ACE_OS::strtod(text.c_str(), &end);
+        if (end == text.c_str() || *end != '\0' || options.scale <= 0.0 || options.scale > 100.0) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid scale: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      }
+      case 'x':
+        options.dirshare = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 'c':
+        options.config = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        config_given = true;
+        break;
+      case 'd':
+        if (!parse_number(get_opts.opt_arg(), MAX_DOMAIN_ID, value)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid domain id (0-%d): %s\n"),
+                           MAX_DOMAIN_ID,
+                           get_opts.opt_arg()),
+                          1);
+        }
+        options.domain_id = static_cast<DDS::DomainId_t>(value);
+        break;
+      case 'w':
+        options.work = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 'o':
+        options.output = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 't':
+        if (!parse_number(get_opts.opt_arg(), 86400, options.timeout) || options.timeout == 0) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid timeout: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'e':
+        if (!parse_number(get_opts.opt_arg(), 600, options.settle)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid settle time: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'k':
+        options.keep = true;
+        break;
+      case 'N':
+        options.netem = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+        break;
+      case 'h':
+      default:
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("Usage: %C [DDS options] [options] [-- dirshare options]\n")
+                         ACE_TEXT("Options:\n")
+                         ACE_TEXT("  -h, --help             Show this help message\n")
+                         ACE_TEXT("  -n, --participants <n> Local participants, one sender (default 3)\n")
+                         ACE_TEXT("  -s, --scenario <name>  small, large, mixed, sparse or append\n")
+                         ACE_TEXT("                         (repeatable; default: all)\n")
+                         ACE_TEXT("  -S, --scale <f>        Multiply the file counts (default 1.0)\n")
+                         ACE_TEXT("  -x, --dirshare <path>  Participant executable (default: next to this one)\n")
+                         ACE_TEXT("  -c, --config <file>    DDS configuration of the participants (default rtps.ini)\n")
+                         ACE_TEXT("  -d, --domain <id>      DDS domain of the run (default 99)\n")
+                         ACE_TEXT("  -w, --work <dir>       Directory for the shares and logs\n")
+                         ACE_TEXT("                         (default $TMPDIR/dirshare-bench.<pid>)\n")
+                         ACE_TEXT("  -o, --output <file>    Write the JSON report to file (default: stdout)\n")
+                         ACE_TEXT("  -t, --timeout <sec>    Give up on a scenario after sec seconds (default 300)\n")
+                         ACE_TEXT("  -e, --settle <sec>     Wait after the participants are up (default 3)\n")
+                         ACE_TEXT("  -k, --keep             Keep the shares and participant logs\n")
+                         ACE_TEXT("  -N, --netem <spec>     Relay all traffic through a fault proxy imposing spec,\n")
+                         ACE_TEXT("                         e.g. delay=40ms,loss=1%%,rate=10mbit (participants\n")
+                         ACE_TEXT("                         default to rtps_netem.ini; run the benchmark with\n")
+                         ACE_TEXT("                         -DCPSConfigFile rtps_netem.ini too)\n")
+                         ACE_TEXT("  -DCPSConfigFile <file> DDS configuration of the benchmark itself\n"),
+                         argv[0]),
+                        1);
+      }
+    }
+
+    for (int i = get_opts.opt_ind(); i < argc; ++i) {
+      options.dirshare_args.push_back(ACE_TEXT_ALWAYS_CHAR(argv[i]));
+    }
+    if (options.scenarios.empty()) {
+      for (size_t i = 0; i < SCENARIO_COUNT; ++i) {
+        options.scenarios.push_back(SCENARIOS[i].name);
+      }
+    }
+
+    DirShare::NetworkImpairment impairment;
+    const bool netem = !options.netem.empty();
+    if (netem) {
+      if (!DirShare::parse_impairment(options.netem, impairment)) {
+        return 1;
+      }
+      if (!config_given) {
+        options.config = "rtps_netem.ini";
+      }
+    }
+
+    if (ACE_OS::access(options.dirshare.c_str(), X_OK) != 0) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: DirShare executable not found: %C\n"),
+                       options.dirshare.c_str()),
+                      1);
+    }
+    if (!DirShare::file_exists(options.config)) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Configuration file not found: %C\n"),
+                       options.config.c_str()),
+                      1);
+    }
+    if (ACE_OS::mkdir(options.work.c_str()) != 0 && !DirShare::is_directory(options.work)) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Cannot create %C\n"),
+                       options.work.c_str()),
+                      1);
+    }
+
+    // Up before any participant, so discovery goes through it from the start
+    DirShare::FaultProxy proxy;
+    if (netem && !proxy.start(NETEM_HOST, NETEM_PORT, impairment)) {
+      return 1;
+    }
+
+    // The benchmark watches DirShare_Stats to know when participants are up
+    DDS::DomainParticipant_var participant =
+      dpf->create_participant(options.domain_id,
+                              PARTICIPANT_QOS_DEFAULT,
+                              0,
+                              OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+    if (!participant) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: create_participant failed!\n")),
+                      1);
+    }
+
+    DirShare::ParticipantStatsDataReader_var stats_reader =
+      DirShare::create_stats_reader(participant.in());
+
+    if (!stats_reader) {
+      return 1;
+    }
+
+    ACE_OS::signal(SIGINT, on_shutdown_signal);
+    ACE_OS::signal(SIGTERM, on_shutdown_signal);
+
+    Bench bench(options, stats_reader.in());
+    std::vector<Result> results;
+    for (size_t s = 0; s < options.scenarios.size() && !g_shutdown; ++s) {
+      for (size_t i = 0; i < SCENARIO_COUNT; ++i) {
+        if (options.scenarios[s] != SCENARIOS[i].name) {
+          continue;
+        }
+        Result result;
+        if (!bench.run(SCENARIOS[i], result)) {
+          return_code = 1;
+          break;
+        }
+        if (!result.completed) {
+          return_code = 1;
+        }
+        results.push_back(result);
+        if (!options.keep && result.completed) {
+          remove_tree(join_path(options.work, SCENARIOS[i].name));
+        }
+      }
+    }
+
+    const std::string json = report(options, results, netem ? &proxy : 0);
+    if (options.output.empty()) {
+      std::cout << json << std::flush;
+    } else {
+      std::ofstream file(options.output.c_str(), std::ios::trunc);
+      file << json;
+      if (!file) {
+        ACE_ERROR((LM_ERROR,
+                   ACE_TEXT("ERROR: %N:%l: Cannot write %C\n"),
+                   options.output.c_str()));
+        return_code = 1;
+      }
+    }
+
+    if (options.keep || return_code != 0) {
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Shares and logs kept in %C\n"),
+                 options.work.c_str()));
+    } else {
+      ACE_OS::rmdir(options.work.c_str());
+    }
+
+    participant->delete_contained_entities();
+    dpf->delete_participant(participant);
+    TheServiceParticipant->shutdown();
+    proxy.stop();
+
+  } catch (const CORBA::Exception& e) {
+    e._tao_print_exception("Exception caught in main():");
+    return_code = 1;
+  }
+
+  return return_code;
+}
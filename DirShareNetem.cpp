@@ -0,0 +1,117 @@
+// DirShareNetem.cpp
+// dirshare-netem: relay the RTPS traffic of local participants with
+// configurable delay, jitter, loss, reordering and bandwidth caps
+
+#include "FaultInjection.h"
+#include "Latency.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/OS_NS_signal.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <iostream>
+#include <string>
+
+namespace {
+
+volatile sig_atomic_t g_shutdown = 0;
+
+extern "C" void on_shutdown_signal(int)
+{
+  g_shutdown = 1;
+}
+
+void report(const DirShare::FaultProxy& proxy)
+{
+  char line[256];
+  ACE_OS::snprintf(line, sizeof(line),
+                   "forwarded %llu datagrams (%.3f MB), lost %llu, overflowed %llu\n",
+                   proxy.forwarded(),
+                   static_cast<double>(proxy.bytes_forwarded()) / 1e6,
+                   proxy.lost(),
+                   proxy.overflowed());
+  std::cout << line << std::flush;
+}
+
+} // namespace
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  std::string address = "127.0.0.1";
+  unsigned short port = 7600;
+  long interval = 0;
+
+  ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("ha:p:i:"));
+  get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("address"), 'a', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("port"), 'p', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("interval"), 'i', ACE_Get_Opt::ARG_REQUIRED);
+
+  int c;
+  while ((c = get_opts()) != -1) {
+    const char* arg = get_opts.opt_arg() ? ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()) : "";
+    switch (c) {
+    case 'a':
+      address = arg;
+      break;
+    case 'p':
+      port = static_cast<unsigned short>(ACE_OS::strtoul(arg, 0, 10));
+      if (port == 0) {
+        ACE_ERROR_RETURN((LM_ERROR, ACE_TEXT("ERROR: %N:%l: Invalid port: %C\n"), arg), 1);
+      }
+      break;
+    case 'i':
+      interval = ACE_OS::strtol(arg, 0, 10);
+      break;
+    case 'h':
+    default:
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("Usage: %C [options] [impairments]\n")
+                       ACE_TEXT("Relays the RTPS traffic of participants configured with\n")
+                       ACE_TEXT("rtps_netem.ini, imposing the impairments on every link.\n")
+                       ACE_TEXT("Impairments: comma-separated key=value, for example\n")
+                       ACE_TEXT("  delay=40ms,jitter=10ms,loss=1%%,reorder=0.5%%,rate=10mbit,limit=1000,seed=1\n")
+                       ACE_TEXT("Options:\n")
+                       ACE_TEXT("  -h, --help              Show this help message\n")
+                       ACE_TEXT("  -a, --address <host>    Address to bind (default 127.0.0.1)\n")
+                       ACE_TEXT("  -p, --port <port>       First of the SPDP, SEDP and data ports (default 7600)\n")
+                       ACE_TEXT("  -i, --interval <sec>    Print the counters this often (default: at exit)\n"),
+                       argv[0]),
+                      1);
+    }
+  }
+
+  std::string spec;
+  for (int i = get_opts.opt_ind(); i < argc; ++i) {
+    spec += spec.empty() ? "" : ",";
+    spec += ACE_TEXT_ALWAYS_CHAR(argv[i]);
+  }
+  DirShare::NetworkImpairment impairment;
+  if (!DirShare::parse_impairment(spec, impairment)) {
+    return 1;
+  }
+
+  DirShare::FaultProxy proxy;
+  if (!proxy.start(address, port, impairment)) {
+    return 1;
+  }
+
+  ACE_OS::signal(SIGINT, on_shutdown_signal);
+  ACE_OS::signal(SIGTERM, on_shutdown_signal);
+
+  ACE_Time_Value next_report = DirShare::monotonic_now() + ACE_Time_Value(interval);
+  while (!g_shutdown) {
+    ACE_OS::sleep(ACE_Time_Value(0, 200000));
+    if (interval > 0 && DirShare::monotonic_now() >= next_report) {
+      report(proxy);
+      next_report += ACE_Time_Value(interval);
+    }
+  }
+
+  proxy.stop();
+  report(proxy);
+  return 0;
+}
@@ -0,0 +1,289 @@
+// DirShareReplay.cpp
+// dirshare-replay: feed the samples recorded by dirshare --record into the
+// receive-path listeners, without DDS, to benchmark and profile them on
+// one machine
+
+#include "DirShareTypeSupportImpl.h"
+#include "Capture.h"
+#include "FileEventListenerImpl.h"
+#include "FileContentListenerImpl.h"
+#include "FileChunkListenerImpl.h"
+#include "SnapshotListenerImpl.h"
+#include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "FileUtils.h"
+#include "Metrics.h"
+#include "Latency.h"
+#include "Trace.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace {
+
+// Records replayed and their encoded size, per type
+struct TypeTotals {
+  unsigned long long records;
+  unsigned long long bytes;
+  TypeTotals() : records(0), bytes(0) {}
+};
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+/**
+ * The listeners of one participant, created as SyncNode does but without
+ * readers or writers: FileEvents and snapshots never request anything on
+ * their own (files are pushed, or pulled by the swarm downloader, whose
+ * sessions are in the capture as CAPTURE_PULL_OPEN)
+ */
+class ReceivePath {
+public:
+  explicit ReceivePath(const std::string& directory)
+    : event_listener_(new DirShare::FileEventListenerImpl(
+        directory, DDS::DataWriter::_nil(), DDS::DataWriter::_nil(),
+        change_tracker_, content_index_))
+    , content_listener_(new DirShare::FileContentListenerImpl(
+        directory, change_tracker_, content_index_))
+    , chunk_listener_(new DirShare::FileChunkListenerImpl(
+        directory, change_tracker_, content_index_))
+    , snapshot_listener_(new DirShare::SnapshotListenerImpl(
+        directory, DDS::DataWriter::_nil(), DDS::DataWriter::_nil()))
+    , event_ref_(event_listener_)
+    , content_ref_(content_listener_)
+    , chunk_ref_(chunk_listener_)
+    , snapshot_ref_(snapshot_listener_)
+  {
+  }
+
+  void deliver(const DirShare::CaptureRecord& record)
+  {
+    switch (record.type) {
+    case DirShare::CAPTURE_FILE_EVENT:
+      event_listener_->process_file_event(record.event);
+      break;
+    case DirShare::CAPTURE_FILE_CONTENT:
+      content_listener_->process_file_content(record.content);
+      break;
+    case DirShare::CAPTURE_TRANSFER_OPEN:
+      chunk_listener_->open_transfer(record.open);
+      break;
+    case DirShare::CAPTURE_PULL_OPEN:
+      chunk_listener_->open_pull_transfer(record.open);
+      break;
+    case DirShare::CAPTURE_FILE_CHUNK:
+      chunk_listener_->process_chunk(record.chunk);
+      break;
+    case DirShare::CAPTURE_FEC_CHUNK:
+      chunk_listener_->process_fec_chunk(record.fec_chunk);
+      break;
+    case DirShare::CAPTURE_CHUNKS_ENDED:
+      chunk_listener_->end_transfer(record.session_id);
+      break;
+    case DirShare::CAPTURE_OPEN_DISPOSED:
+      chunk_listener_->transfer_open_disposed(record.session_id);
+      break;
+    case DirShare::CAPTURE_DIRECTORY_SNAPSHOT:
+      snapshot_listener_->process_snapshot(record.snapshot);
+      break;
+    }
+    chunk_listener_->expire_transfers(DirShare::monotonic_now());
+  }
+
+  // End of the capture: nothing more can arrive for FEC sessions in grace
+  void finish()
+  {
+    chunk_listener_->expire_transfers(ACE_Time_Value::max_time);
+  }
+
+private:
+  DirShare::FileChangeTracker change_tracker_;
+  DirShare::ContentIndex content_index_;
+  DirShare::FileEventListenerImpl* event_listener_;
+  DirShare::FileContentListenerImpl* content_listener_;
+  DirShare::FileChunkListenerImpl* chunk_listener_;
+  DirShare::SnapshotListenerImpl* snapshot_listener_;
+
+  // Reference-counted like any listener; these own the objects above
+  DDS::DataReaderListener_var event_ref_;
+  DDS::DataReaderListener_var content_ref_;
+  DDS::DataReaderListener_var chunk_ref_;
+  DDS::DataReaderListener_var snapshot_ref_;
+};
+
+} // namespace
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  double speed = 1.0;
+  bool max_speed = false;
+  bool quiet = false;
+  std::string trace_file;
+  std::string metrics_file;
+
+  ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hs:xqT:M:"));
+  get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("speed"), 's', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("max-speed"), 'x', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("quiet"), 'q', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("trace"), 'T', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("metrics"), 'M', ACE_Get_Opt::ARG_REQUIRED);
+
+  int c;
+  while ((c = get_opts()) != -1) {
+    switch (c) {
+    case 's':
+      speed = ACE_OS::strtod(ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()), 0);
+      if (speed <= 0.0) {
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("ERROR: %N:%l: Invalid speed: %s\n"),
+                         get_opts.opt_arg()),
+                        1);
+      }
+      break;
+    case 'x':
+      max_speed = true;
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'T':
+      trace_file = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+      break;
+    case 'M':
+      metrics_file = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+      break;
+    case 'h':
+    default:
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("Usage: %C [options] <capture> <directory>\n")
+                       ACE_TEXT("Replays the samples recorded by dirshare --record into the\n")
+                       ACE_TEXT("receive path of a participant sharing <directory>.\n")
+                       ACE_TEXT("Options:\n")
+                       ACE_TEXT("  -h, --help              Show this help message\n")
+                       ACE_TEXT("  -s, --speed <factor>    Replay at factor times the recorded pace (default 1)\n")
+                       ACE_TEXT("  -x, --max-speed         Replay as fast as possible\n")
+                       ACE_TEXT("  -q, --quiet             Log warnings and errors only\n")
+                       ACE_TEXT("  -T, --trace <file>      Write the receive spans as a Chrome trace\n")
+                       ACE_TEXT("  -M, --metrics <file>    Write the metrics (Prometheus text) at the end\n"),
+                       argv[0]),
+                      1);
+    }
+  }
+
+  if (argc - get_opts.opt_ind() != 2) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Expected <capture> <directory> (see --help)\n")),
+                    1);
+  }
+  const std::string capture_file = ACE_TEXT_ALWAYS_CHAR(argv[get_opts.opt_ind()]);
+  const std::string directory = ACE_TEXT_ALWAYS_CHAR(argv[get_opts.opt_ind() + 1]);
+
+  if (!DirShare::is_directory(directory) && ACE_OS::mkdir(directory.c_str()) != 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot create directory %C: %m\n"),
+                     directory.c_str()),
+                    1);
+  }
+
+  DirShare::CaptureReader reader;
+  if (!reader.open(capture_file)) {
+    return 1;
+  }
+
+  if (quiet) {
+    ACE_LOG_MSG->priority_mask(LM_WARNING | LM_ERROR | LM_CRITICAL | LM_ALERT | LM_EMERGENCY,
+                               ACE_Log_Msg::PROCESS);
+  }
+  if (!trace_file.empty()) {
+    DirShare::Tracer::instance().enable();
+  }
+
+  ReceivePath receive_path(directory);
+  std::map<DirShare::CaptureRecordType, TypeTotals> totals;
+  unsigned long long records = 0;
+  unsigned long long bytes = 0;
+  ACE_Time_Value max_lag = ACE_Time_Value::zero;
+
+  DirShare::CaptureRecord record;
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  int status;
+  while ((status = reader.next(record)) > 0) {
+    if (!max_speed) {
+      // Recorded pace: deliver no earlier than the scaled arrival time
+      const double offset = static_cast<double>(record.time_usec) / 1e6 / speed;
+      ACE_Time_Value due;
+      due.set(offset);
+      due += start;
+      const ACE_Time_Value now = DirShare::monotonic_now();
+      if (due > now) {
+        ACE_OS::sleep(due - now);
+      } else if (now - due > max_lag) {
+        max_lag = now - due;
+      }
+    }
+
+    receive_path.deliver(record);
+    TypeTotals& type = totals[record.type];
+    ++type.records;
+    type.bytes += record.size;
+    ++records;
+    bytes += record.size;
+  }
+  receive_path.finish();
+  const ACE_Time_Value elapsed = DirShare::monotonic_now() - start;
+
+  const double elapsed_sec = seconds(elapsed) > 0.0 ? seconds(elapsed) : 1e-6;
+  char line[256];
+  ACE_OS::snprintf(line, sizeof(line),
+                   "Replayed %llu records (%.1f MB) in %.3f s: %.0f records/s, %.1f MB/s\n",
+                   records,
+                   static_cast<double>(bytes) / 1e6,
+                   seconds(elapsed),
+                   static_cast<double>(records) / elapsed_sec,
+                   static_cast<double>(bytes) / 1e6 / elapsed_sec);
+  std::cout << line;
+  for (std::map<DirShare::CaptureRecordType, TypeTotals>::const_iterator it = totals.begin();
+       it != totals.end(); ++it) {
+    ACE_OS::snprintf(line, sizeof(line), "  %-18s %10llu records %12.1f MB\n",
+                     DirShare::capture_record_name(it->first),
+                     it->second.records,
+                     static_cast<double>(it->second.bytes) / 1e6);
+    std::cout << line;
+  }
+  if (!max_speed) {
+    ACE_OS::snprintf(line, sizeof(line), "Largest delay behind the recorded pace: %.1f ms\n",
+                     seconds(max_lag) * 1e3);
+    std::cout << line;
+  }
+  std::cout << "Receive errors: "
+            << DirShare::MetricsRegistry::instance().total("dirshare_receive_errors_total")
+            << std::endl;
+
+  if (!trace_file.empty()) {
+    DirShare::Tracer::instance().write_chrome_trace(trace_file);
+  }
+  if (!metrics_file.empty()) {
+    std::ofstream out(metrics_file.c_str());
+    out << DirShare::MetricsRegistry::instance().exposition();
+    if (!out) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: Cannot write %C\n"),
+                 metrics_file.c_str()));
+      return 1;
+    }
+  }
+
+  return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// DirShareSim.cpp
+// dirshare-sim: run many participants in one process on an in-memory
+// transport and file system, and report the traffic and convergence time
+// of sync scenarios
+
+#include "Simulator.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_string.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Scenario parameters beyond SimulationConfig
+struct ScenarioOptions {
+  unsigned files;        // Files written (fanout, churn)
+  size_t file_size;      // Bytes per file
+  unsigned changes;      // Scripted changes (churn)
+  double spacing;        // Seconds between the conflicting writes (conflict)
+  double duration;       // Seconds over which changes are spread (churn)
+  unsigned long seed;
+};
+
+const char* const SCENARIOS[] = { "fanout", "conflict", "churn" };
+const size_t SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+ACE_Time_Value from_seconds(double value)
+{
+  ACE_Time_Value time;
+  time.set(value);
+  return time;
+}
+
+// Contents unique to a writer and a version, so every write is a change
+std::vector<unsigned char> make_contents(size_t size, unsigned writer, unsigned version)
+{
+  std::vector<unsigned char> data(size);
+  unsigned long state = writer * 2654435761UL + version + 1;
+  for (size_t i = 0; i < size; ++i) {
+    state = (state * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+    data[i] = static_cast<unsigned char>(state >> 16);
+  }
+  return data;
+}
+
+std::string file_name(unsigned index)
+{
+  char name[32];
+  ACE_OS::snprintf(name, sizeof(name), "file%04u.dat", index);
+  return name;
+}
+
+/**
+ * Script a scenario
+ *   fanout:   one peer writes every file at once
+ *   conflict: every peer writes the same file, spacing seconds apart
+ *   churn:    random peers write or delete random files over a period
+ */
+void script(DirShare::Simulator& simulator,
+            const std::string& scenario,
+            unsigned peers,
+            const ScenarioOptions& options)
+{
+  const ACE_Time_Value start(1, 0);
+  if (scenario == "fanout") {
+    for (unsigned f = 0; f < options.files; ++f) {
+      simulator.write_file(start, 0, file_name(f), make_contents(options.file_size, 0, f));
+    }
+  } else if (scenario == "conflict") {
+    for (unsigned p = 0; p < peers; ++p) {
+      simulator.write_file(start + from_seconds(options.spacing * p), p, "shared.dat",
+                           make_contents(options.file_size, p, 0));
+    }
+  } else {
+    unsigned seed = static_cast<unsigned>(options.seed);
+    for (unsigned c = 0; c < options.changes; ++c) {
+      const unsigned peer = static_cast<unsigned>(ACE_OS::rand_r(&seed)) % peers;
+      const unsigned file = static_cast<unsigned>(ACE_OS::rand_r(&seed)) % options.files;
+      const double offset = options.duration *
+        static_cast<double>(ACE_OS::rand_r(&seed)) / (static_cast<double>(RAND_MAX) + 1.0);
+      if (ACE_OS::rand_r(&seed) % 4 == 0) {
+        simulator.delete_file(start + from_seconds(offset), peer, file_name(file));
+      } else {
+        simulator.write_file(start + from_seconds(offset), peer, file_name(file),
+                             make_contents(options.file_size, peer, c));
+      }
+    }
+  }
+}
+
+void report(const std::string& scenario,
+            const DirShare::SimulationConfig& config,
+            const DirShare::SimulationResult& result)
+{
+  char line[256];
+  ACE_OS::snprintf(line, sizeof(line), "Scenario %s: %u peers\n", scenario.c_str(), config.peers);
+  std::cout << line;
+
+  unsigned long long samples = 0;
+  unsigned long long bytes = 0;
+  for (std::map<DirShare::CaptureRecordType, DirShare::SimulationTotals>::const_iterator it =
+         result.published.begin(); it != result.published.end(); ++it) {
+    ACE_OS::snprintf(line, sizeof(line), "  published %-12s %10llu samples %12.3f MB\n",
+                     DirShare::capture_record_name(it->first),
+                     it->second.samples,
+                     static_cast<double>(it->second.bytes) / 1e6);
+    std::cout << line;
+    samples += it->second.samples;
+    bytes += it->second.bytes;
+  }
+  ACE_OS::snprintf(line, sizeof(line),
+                   "  published %-12s %10llu samples %12.3f MB\n"
+                   "  delivered %-12s %10llu samples %12.3f MB\n",
+                   "total", samples, static_cast<double>(bytes) / 1e6,
+                   "total", result.deliveries,
+                   static_cast<double>(result.bytes_delivered) / 1e6);
+  std::cout << line;
+
+  if (result.converged) {
+    ACE_OS::snprintf(line, sizeof(line),
+                     "  converged %.3f s after the last change (at %.3f s virtual)\n",
+                     seconds(result.converged_at - result.last_action),
+                     seconds(result.converged_at));
+  } else {
+    ACE_OS::snprintf(line, sizeof(line), "  NOT converged (stopped at %.3f s virtual)\n",
+                     seconds(result.end_time));
+  }
+  std::cout << line;
+  ACE_OS::snprintf(line, sizeof(line), "  %llu scans, simulated %.1f s in %.3f s\n",
+                   result.scans, seconds(result.end_time), seconds(result.wall_time));
+  std::cout << line;
+}
+
+} // namespace
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  DirShare::SimulationConfig config;
+  config.peers = 100;
+  ScenarioOptions options;
+  options.files = 20;
+  options.file_size = 4096;
+  options.changes = 200;
+  options.spacing = 0.25;
+  options.duration = 30.0;
+  options.seed = 1;
+  std::vector<std::string> scenarios;
+  bool verbose = false;
+
+  ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hS:n:f:z:c:g:D:i:l:j:L:s:v"));
+  get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("scenario"), 'S', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("peers"), 'n', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("files"), 'f', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("size"), 'z', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("changes"), 'c', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("spacing"), 'g', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("duration"), 'D', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("interval"), 'i', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("latency"), 'l', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("jitter"), 'j', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("limit"), 'L', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("seed"), 's', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("verbose"), 'v', ACE_Get_Opt::NO_ARG);
+
+  int c;
+  while ((c = get_opts()) != -1) {
+    const char* arg = get_opts.opt_arg() ? ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()) : "";
+    switch (c) {
+    case 'S': {
+      bool known = false;
+      for (size_t i = 0; i < SCENARIO_COUNT; ++i) {
+        known = known || ACE_OS::strcmp(arg, SCENARIOS[i]) == 0;
+      }
+      if (!known) {
+        ACE_ERROR_RETURN((LM_ERROR, ACE_TEXT("ERROR: %N:%l: Unknown scenario: %C\n"), arg), 1);
+      }
+      scenarios.push_back(arg);
+      break;
+    }
+    case 'n':
+      config.peers = static_cast<unsigned>(ACE_OS::strtoul(arg, 0, 10));
+      if (config.peers < 2) {
+        ACE_ERROR_RETURN((LM_ERROR, ACE_TEXT("ERROR: %N:%l: At least 2 peers are needed\n")), 1);
+      }
+      break;
+    case 'f':
+      options.files = static_cast<unsigned>(ACE_OS::strtoul(arg, 0, 10));
+      if (options.files == 0) {
+        ACE_ERROR_RETURN((LM_ERROR, ACE_TEXT("ERROR: %N:%l: Invalid file count: %C\n"), arg), 1);
+      }
+      break;
+    case 'z':
+      options.file_size = static_cast<size_t>(ACE_OS::strtoul(arg, 0, 10));
+      break;
+    case 'c':
+      options.changes = static_cast<unsigned>(ACE_OS::strtoul(arg, 0, 10));
+      break;
+    case 'g':
+      options.spacing = ACE_OS::strtod(arg, 0);
+      break;
+    case 'D':
+      options.duration = ACE_OS::strtod(arg, 0);
+      break;
+    case 'i':
+      config.scan_interval = from_seconds(ACE_OS::strtod(arg, 0));
+      if (config.scan_interval <= ACE_Time_Value::zero) {
+        ACE_ERROR_RETURN((LM_ERROR, ACE_TEXT("ERROR: %N:%l: Invalid scan interval: %C\n"), arg), 1);
+      }
+      break;
+    case 'l':
+      config.latency = from_seconds(ACE_OS::strtod(arg, 0) / 1e3);
+      break;
+    case 'j':
+      config.jitter = from_seconds(ACE_OS::strtod(arg, 0) / 1e3);
+      break;
+    case 'L':
+      config.time_limit = from_seconds(ACE_OS::strtod(arg, 0));
+      break;
+    case 's':
+      options.seed = ACE_OS::strtoul(arg, 0, 10);
+      config.seed = options.seed;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+    default:
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("Usage: %C [options]\n")
+                       ACE_TEXT("Simulates participants sharing a directory in one process, on an\n")
+                       ACE_TEXT("in-memory transport and file system with a virtual clock.\n")
+                       ACE_TEXT("Options:\n")
+                       ACE_TEXT("  -h, --help              Show this help message\n")
+                       ACE_TEXT("  -S, --scenario <name>   fanout, conflict or churn (repeatable; default all)\n")
+                       ACE_TEXT("  -n, --peers <n>         Participants (default 100)\n")
+                       ACE_TEXT("  -f, --files <n>         Files written by fanout and churn (default 20)\n")
+                       ACE_TEXT("  -z, --size <bytes>      Size of each file (default 4096)\n")
+                       ACE_TEXT("  -c, --changes <n>       Changes made by churn (default 200)\n")
+                       ACE_TEXT("  -g, --spacing <sec>     Time between the conflicting writes (default 0.25)\n")
+                       ACE_TEXT("  -D, --duration <sec>    Period of the churn changes (default 30)\n")
+                       ACE_TEXT("  -i, --interval <sec>    Scan interval of each peer (default 1)\n")
+                       ACE_TEXT("  -l, --latency <ms>      One-way delivery latency (default 5)\n")
+                       ACE_TEXT("  -j, --jitter <ms>       Extra random delivery delay (default 2)\n")
+                       ACE_TEXT("  -L, --limit <sec>       Virtual time limit of each run (default 600)\n")
+                       ACE_TEXT("  -s, --seed <n>          Random seed (default 1)\n")
+                       ACE_TEXT("  -v, --verbose           Log the participants' messages\n"),
+                       argv[0]),
+                      1);
+    }
+  }
+
+  if (scenarios.empty()) {
+    scenarios.assign(SCENARIOS, SCENARIOS + SCENARIO_COUNT);
+  }
+
+  // Hundreds of participants log every sample they handle
+  if (!verbose) {
+    ACE_LOG_MSG->priority_mask(LM_WARNING | LM_ERROR | LM_CRITICAL | LM_ALERT | LM_EMERGENCY,
+                               ACE_Log_Msg::PROCESS);
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < scenarios.size(); ++i) {
+    DirShare::Simulator simulator(config);
+    script(simulator, scenarios[i], config.peers, options);
+
+    DirShare::SimulationResult result;
+    if (!simulator.run(result)) {
+      return 1;
+    }
+    report(scenarios[i], config, result);
+    if (!result.converged) {
+      status = 2;
+    }
+  }
+  return status;
+}
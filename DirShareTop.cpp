@@ -0,0 +1,336 @@
+// DirShareTop.cpp
+// dirshare-top: live view of every participant of a domain, from the
+// statistics they publish on DirShare_Stats
+
+#include "DirShareTypeSupportImpl.h"
+#include "Stats.h"
+
+#include <dds/DCPS/Marked_Default_Qos.h>
+#include <dds/DCPS/Service_Participant.h>
+#include <dds/DCPS/StaticIncludes.h>
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/OS_NS_signal.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+#if OPENDDS_DO_MANUAL_STATIC_INCLUDES
+#  include <dds/DCPS/RTPS/RtpsDiscovery.h>
+#  include <dds/DCPS/transport/rtps_udp/RtpsUdp.h>
+#endif
+
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace {
+
+const int DEFAULT_DOMAIN_ID = 42;
+const int MAX_DOMAIN_ID = 231;
+const int DEFAULT_INTERVAL_SEC = 2;
+
+// Participants publish every scan (2 s); one silent this long is dropped
+const int STALE_AFTER_SEC = 10;
+
+volatile sig_atomic_t g_shutdown = 0;
+
+extern "C" void on_shutdown_signal(int)
+{
+  g_shutdown = 1;
+}
+
+bool parse_number(const ACE_TCHAR* arg, long max, long& value)
+{
+  const std::string text = ACE_TEXT_ALWAYS_CHAR(arg);
+  char* end = 0;
+  value = ACE_OS::strtol(text.c_str(), &end, 10);
+  return end != text.c_str() && *end == '\0' && value >= 0 && value <= max;
+}
+
+// 1536 -> "1.5K"
+std::string format_bytes(double bytes)
+{
+  static const char* const UNITS[] = { "B", "K", "M", "G", "T" };
+  size_t unit = 0;
+  while (bytes >= 1024.0 && unit + 1 < sizeof(UNITS) / sizeof(UNITS[0])) {
+    bytes /= 1024.0;
+    ++unit;
+  }
+  char text[32];
+  ACE_OS::snprintf(text, sizeof(text), unit == 0 ? "%.0f%s" : "%.1f%s", bytes, UNITS[unit]);
+  return text;
+}
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+// The convergence the waiting mode is after
+bool reached(const DirShare::FleetView& view,
+             const DirShare::FleetView::Convergence& convergence,
+             size_t participants,
+             const ACE_Time_Value& after)
+{
+  return convergence.converged &&
+    view.nodes().size() >= participants &&
+    convergence.last_change >= after;
+}
+
+// One line for scripts: "converged participants=3 digests=1 ..."
+std::string convergence_line(const DirShare::FleetView& view,
+                             const DirShare::FleetView::Convergence& convergence)
+{
+  char line[256];
+  ACE_OS::snprintf(line, sizeof(line),
+                   "%s participants=%lu digests=%lu last_change=%.6f settled=%.6f time_to_converge=%.6f\n",
+                   convergence.converged ? "converged" : "diverged",
+                   static_cast<unsigned long>(view.nodes().size()),
+                   static_cast<unsigned long>(convergence.digests),
+                   seconds(convergence.last_change),
+                   seconds(convergence.settled),
+                   seconds(convergence.time_to_converge()));
+  return line;
+}
+
+std::string render(const DirShare::FleetView& view, DDS::DomainId_t domain_id)
+{
+  const DirShare::FleetView::NodeMap& nodes = view.nodes();
+  const DirShare::FleetView::Convergence convergence = view.convergence();
+
+  char line[256];
+  std::string out;
+  if (nodes.empty()) {
+    ACE_OS::snprintf(line, sizeof(line),
+                     "DirShare domain %d: waiting for statistics\n\n",
+                     static_cast<int>(domain_id));
+  } else if (convergence.converged) {
+    ACE_OS::snprintf(line, sizeof(line),
+                     "DirShare domain %d: %lu participants, converged %.1f s after the last change\n\n",
+                     static_cast<int>(domain_id),
+                     static_cast<unsigned long>(nodes.size()),
+                     seconds(convergence.time_to_converge()));
+  } else {
+    ACE_OS::snprintf(line, sizeof(line),
+                     "DirShare domain %d: %lu participants, diverged\n"
+                     "  %lu different directory digests\n\n",
+                     static_cast<int>(domain_id),
+                     static_cast<unsigned long>(nodes.size()),
+                     static_cast<unsigned long>(convergence.digests));
+  }
+  out += line;
+
+  ACE_OS::snprintf(line, sizeof(line),
+                   "%-8s %-16s %8s %8s %-16s %6s %7s %9s %9s %9s %6s\n",
+                   "NODE", "HOST", "FILES", "SIZE", "DIGEST", "LAG", "BACKLOG",
+                   "IN-FLIGHT", "SEND/s", "RECV/s", "ERRORS");
+  out += line;
+
+  for (DirShare::FleetView::NodeMap::const_iterator it = nodes.begin();
+       it != nodes.end(); ++it) {
+    const DirShare::ParticipantStats& stats = it->second.stats;
+    const unsigned long errors =
+      stats.checksum_errors + stats.write_errors + stats.transfer_errors;
+    ACE_OS::snprintf(line, sizeof(line),
+                     "%-8.8s %-16.16s %8lu %8s %016llx %6lu %7lu %9s %9s %9s %6lu\n",
+                     it->first.c_str(),
+                     stats.hostname.in(),
+                     static_cast<unsigned long>(stats.file_count),
+                     format_bytes(static_cast<double>(stats.total_bytes)).c_str(),
+                     static_cast<unsigned long long>(stats.directory_digest),
+                     view.lag(it->first),
+                     static_cast<unsigned long>(stats.backlog),
+                     format_bytes(static_cast<double>(stats.bytes_in_flight)).c_str(),
+                     format_bytes(it->second.send_rate).c_str(),
+                     format_bytes(it->second.receive_rate).c_str(),
+                     errors);
+    out += line;
+  }
+  return out;
+}
+
+} // namespace
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  int return_code = 0;
+
+  try {
+    // Initialize DDS DomainParticipantFactory (this processes -DCPS* options)
+    DDS::DomainParticipantFactory_var dpf =
+      TheParticipantFactoryWithArgs(argc, argv);
+
+    DDS::DomainId_t domain_id = DEFAULT_DOMAIN_ID;
+    long interval = DEFAULT_INTERVAL_SEC;
+    long iterations = 0;
+    bool batch = false;
+    bool wait = false;
+    long participants = 1;
+    long timeout = 0;
+    long after = 0;
+
+    ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hd:i:n:bwp:t:a:"));
+    get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("domain"), 'd', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("interval"), 'i', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("iterations"), 'n', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("batch"), 'b', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("wait-converged"), 'w', ACE_Get_Opt::NO_ARG);
+    get_opts.long_option(ACE_TEXT("participants"), 'p', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("timeout"), 't', ACE_Get_Opt::ARG_REQUIRED);
+    get_opts.long_option(ACE_TEXT("after"), 'a', ACE_Get_Opt::ARG_REQUIRED);
+
+    int c;
+    long value = 0;
+    while ((c = get_opts()) != -1) {
+      switch (c) {
+      case 'd':
+        if (!parse_number(get_opts.opt_arg(), MAX_DOMAIN_ID, value)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid domain id (0-%d): %s\n"),
+                           MAX_DOMAIN_ID,
+                           get_opts.opt_arg()),
+                          1);
+        }
+        domain_id = static_cast<DDS::DomainId_t>(value);
+        break;
+      case 'i':
+        if (!parse_number(get_opts.opt_arg(), 3600, interval) || interval == 0) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid interval: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'n':
+        if (!parse_number(get_opts.opt_arg(), 1000000, iterations)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid iteration count: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'b':
+        batch = true;
+        break;
+      case 'w':
+        wait = true;
+        break;
+      case 'p':
+        if (!parse_number(get_opts.opt_arg(), 10000, participants) || participants == 0) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid participant count: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 't':
+        if (!parse_number(get_opts.opt_arg(), 86400, timeout)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid timeout: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'a':
+        if (!parse_number(get_opts.opt_arg(), 0x7FFFFFFFL, after)) {
+          ACE_ERROR_RETURN((LM_ERROR,
+                           ACE_TEXT("ERROR: %N:%l: Invalid time: %s\n"),
+                           get_opts.opt_arg()),
+                          1);
+        }
+        break;
+      case 'h':
+      default:
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("Usage: %C [DDS options] [options]\n")
+                         ACE_TEXT("Options:\n")
+                         ACE_TEXT("  -h, --help             Show this help message\n")
+                         ACE_TEXT("  -d, --domain <id>      DDS domain to watch (default 42)\n")
+                         ACE_TEXT("  -i, --interval <sec>   Refresh interval (default 2)\n")
+                         ACE_TEXT("  -n, --iterations <n>   Exit after n refreshes (default: run until Ctrl+C)\n")
+                         ACE_TEXT("  -b, --batch            Append each refresh instead of redrawing the screen\n")
+                         ACE_TEXT("  -w, --wait-converged   Print nothing until the participants converge, then\n")
+                         ACE_TEXT("                         print one summary line and exit (2 on timeout)\n")
+                         ACE_TEXT("  -p, --participants <n> Participants required to converge (default 1)\n")
+                         ACE_TEXT("  -t, --timeout <sec>    Give up waiting after sec seconds (default: never)\n")
+                         ACE_TEXT("  -a, --after <time>     Only a convergence following a change at or after\n")
+                         ACE_TEXT("                         this Unix time counts\n")
+                         ACE_TEXT("  -DCPSConfigFile <file> Specify DDS configuration file (e.g., rtps.ini)\n"),
+                         argv[0]),
+                        1);
+      }
+    }
+
+    DDS::DomainParticipant_var participant =
+      dpf->create_participant(domain_id,
+                              PARTICIPANT_QOS_DEFAULT,
+                              0,
+                              OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+    if (!participant) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: create_participant failed!\n")),
+                      1);
+    }
+
+    DirShare::ParticipantStatsDataReader_var stats_reader =
+      DirShare::create_stats_reader(participant.in());
+
+    if (!stats_reader) {
+      return 1;
+    }
+
+    ACE_OS::signal(SIGINT, on_shutdown_signal);
+    ACE_OS::signal(SIGTERM, on_shutdown_signal);
+
+    DirShare::FleetView view;
+    const ACE_Time_Value started = ACE_OS::gettimeofday();
+    if (wait) {
+      return_code = 2;  // Until the convergence is seen
+    }
+    for (long n = 0; !g_shutdown && (iterations == 0 || n < iterations); ++n) {
+      if (n > 0) {
+        ACE_OS::sleep(static_cast<u_int>(interval));
+        if (g_shutdown) {
+          break;
+        }
+      }
+
+      DirShare::take_stats(stats_reader.in(), view);
+      const ACE_Time_Value now = ACE_OS::gettimeofday();
+      view.expire(now, ACE_Time_Value(STALE_AFTER_SEC));
+
+      if (wait) {
+        const DirShare::FleetView::Convergence convergence = view.convergence();
+        if (reached(view, convergence, static_cast<size_t>(participants),
+                    ACE_Time_Value(static_cast<time_t>(after)))) {
+          std::cout << convergence_line(view, convergence) << std::flush;
+          return_code = 0;
+          break;
+        }
+        if (timeout > 0 && now - started >= ACE_Time_Value(static_cast<time_t>(timeout))) {
+          std::cout << convergence_line(view, convergence) << std::flush;
+          break;
+        }
+        continue;
+      }
+
+      // Home and clear the screen, as top does
+      std::cout << (batch ? "\n" : "\033[H\033[2J") << render(view, domain_id) << std::flush;
+    }
+
+    participant->delete_contained_entities();
+    dpf->delete_participant(participant);
+    TheServiceParticipant->shutdown();
+
+  } catch (const CORBA::Exception& e) {
+    e._tao_print_exception("Exception caught in main():");
+    return_code = 1;
+  }
+
+  return return_code;
+}
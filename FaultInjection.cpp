@@ -0,0 +1,449 @@
+// FaultInjection.cpp
+// Implementation of the impairment model and the fault-injection proxy
+
+#include "FaultInjection.h"
+#include "Latency.h"
+
+#include <ace/ACE.h>
+#include <ace/Handle_Set.h>
+#include <ace/Log_Msg.h>
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_errno.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+
+namespace DirShare {
+
+namespace {
+
+// How often the worker checks for stop() while nothing is due
+const ACE_Time_Value POLL_TIMEOUT(0, 100000);
+
+// Largest UDP payload
+const size_t MAX_DATAGRAM = 65536;
+
+double seconds(const ACE_Time_Value& value)
+{
+  return static_cast<double>(value.sec()) + static_cast<double>(value.usec()) / 1e6;
+}
+
+ACE_Time_Value from_seconds(double value)
+{
+  ACE_Time_Value result;
+  result.set(value);
+  return result;
+}
+
+// Number with an optional unit suffix; false if the number is malformed
+bool split_number(const std::string& text, double& number, std::string& unit)
+{
+  char* end = 0;
+  number = ACE_OS::strtod(text.c_str(), &end);
+  if (end == text.c_str() || number < 0) {
+    return false;
+  }
+  unit = end;
+  return true;
+}
+
+bool parse_time(const std::string& text, ACE_Time_Value& value)
+{
+  double number = 0;
+  std::string unit;
+  if (!split_number(text, number, unit)) {
+    return false;
+  }
+  if (unit == "us") {
+    number /= 1e6;
+  } else if (unit == "ms" || unit.empty()) {
+    number /= 1e3;
+  } else if (unit != "s") {
+    return false;
+  }
+  value = from_seconds(number);
+  return true;
+}
+
+bool parse_probability(const std::string& text, double& value)
+{
+  std::string unit;
+  if (!split_number(text, value, unit)) {
+    return false;
+  }
+  if (unit == "%") {
+    value /= 100.0;
+  } else if (!unit.empty()) {
+    return false;
+  }
+  return value <= 1.0;
+}
+
+bool parse_rate(const std::string& text, unsigned long long& value)
+{
+  double number = 0;
+  std::string unit;
+  if (!split_number(text, number, unit)) {
+    return false;
+  }
+  if (unit == "kbit") {
+    number *= 1e3;
+  } else if (unit == "mbit") {
+    number *= 1e6;
+  } else if (unit == "gbit") {
+    number *= 1e9;
+  } else if (unit != "bit" && !unit.empty()) {
+    return false;
+  }
+  value = static_cast<unsigned long long>(number);
+  return true;
+}
+
+} // namespace
+
+NetworkImpairment::NetworkImpairment()
+  : delay(ACE_Time_Value::zero)
+  , jitter(ACE_Time_Value::zero)
+  , loss(0.0)
+  , reorder(0.0)
+  , rate_bps(0)
+  , limit(1000)
+  , seed(1)
+{
+}
+
+bool parse_impairment(const std::string& spec, NetworkImpairment& impairment)
+{
+  NetworkImpairment parsed;
+  std::string::size_type start = 0;
+  while (start < spec.size()) {
+    std::string::size_type comma = spec.find(',', start);
+    if (comma == std::string::npos) {
+      comma = spec.size();
+    }
+    const std::string item = spec.substr(start, comma - start);
+    start = comma + 1;
+    if (item.empty()) {
+      continue;
+    }
+
+    const std::string::size_type equals = item.find('=');
+    const std::string key = item.substr(0, equals);
+    const std::string value = equals == std::string::npos ? "" : item.substr(equals + 1);
+    bool valid = !value.empty();
+    if (valid) {
+      if (key == "delay") {
+        valid = parse_time(value, parsed.delay);
+      } else if (key == "jitter") {
+        valid = parse_time(value, parsed.jitter);
+      } else if (key == "loss") {
+        valid = parse_probability(value, parsed.loss);
+      } else if (key == "reorder") {
+        valid = parse_probability(value, parsed.reorder);
+      } else if (key == "rate") {
+        valid = parse_rate(value, parsed.rate_bps);
+      } else if (key == "limit") {
+        parsed.limit = static_cast<size_t>(ACE_OS::strtoul(value.c_str(), 0, 10));
+      } else if (key == "seed") {
+        parsed.seed = ACE_OS::strtoul(value.c_str(), 0, 10);
+      } else {
+        valid = false;
+      }
+    }
+    if (!valid) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Invalid impairment: %C\n"),
+                       item.c_str()),
+                      false);
+    }
+  }
+
+  impairment = parsed;
+  return true;
+}
+
+std::string impairment_string(const NetworkImpairment& impairment)
+{
+  std::string result;
+  char item[64];
+  if (impairment.delay != ACE_Time_Value::zero) {
+    ACE_OS::snprintf(item, sizeof(item), ",delay=%gms", seconds(impairment.delay) * 1e3);
+    result += item;
+  }
+  if (impairment.jitter != ACE_Time_Value::zero) {
+    ACE_OS::snprintf(item, sizeof(item), ",jitter=%gms", seconds(impairment.jitter) * 1e3);
+    result += item;
+  }
+  if (impairment.loss > 0) {
+    ACE_OS::snprintf(item, sizeof(item), ",loss=%g%%", impairment.loss * 100.0);
+    result += item;
+  }
+  if (impairment.reorder > 0) {
+    ACE_OS::snprintf(item, sizeof(item), ",reorder=%g%%", impairment.reorder * 100.0);
+    result += item;
+  }
+  if (impairment.rate_bps > 0) {
+    ACE_OS::snprintf(item, sizeof(item), ",rate=%gkbit",
+                     static_cast<double>(impairment.rate_bps) / 1e3);
+    result += item;
+  }
+  ACE_OS::snprintf(item, sizeof(item), ",limit=%lu,seed=%lu",
+                   static_cast<unsigned long>(impairment.limit), impairment.seed);
+  result += item;
+  return result.substr(1);
+}
+
+double ImpairmentRandom::next()
+{
+  // 32-bit LCG (Numerical Recipes), as the simulator uses
+  state_ = (state_ * 1664525UL + 1013904223UL) & 0xFFFFFFFFUL;
+  return static_cast<double>(state_) / 4294967296.0;
+}
+
+ImpairedLink::ImpairedLink()
+  : free_at_(ACE_Time_Value::zero)
+  , queued_(0)
+{
+}
+
+ImpairedLink::Fate ImpairedLink::admit(const NetworkImpairment& impairment,
+                                       const ACE_Time_Value& now,
+                                       size_t size,
+                                       ImpairmentRandom& random,
+                                       ACE_Time_Value& deliver_at)
+{
+  // Always three draws, so one impairment does not shift the others' sequence
+  const double loss_draw = random.next();
+  const double reorder_draw = random.next();
+  const double jitter_draw = random.next();
+
+  if (loss_draw < impairment.loss) {
+    return LOST;
+  }
+  if (impairment.limit > 0 && queued_ >= impairment.limit) {
+    return OVERFLOW;
+  }
+
+  // Serialization: the datagram leaves once the link has sent those before it
+  ACE_Time_Value departure = free_at_ > now ? free_at_ : now;
+  if (impairment.rate_bps > 0) {
+    departure += from_seconds(static_cast<double>(size) * 8.0 /
+                              static_cast<double>(impairment.rate_bps));
+    free_at_ = departure;
+  }
+
+  deliver_at = departure;
+  if (reorder_draw >= impairment.reorder) {
+    deliver_at += impairment.delay + from_seconds(seconds(impairment.jitter) * jitter_draw);
+  }
+  ++queued_;
+  return DELIVER;
+}
+
+FaultProxy::FaultProxy()
+  : buffer_(MAX_DATAGRAM)
+  , next_order_(0)
+  , random_(1)
+  , forwarded_(0)
+  , lost_(0)
+  , overflowed_(0)
+  , bytes_forwarded_(0)
+  , running_(false)
+  , stopping_(false)
+{
+}
+
+FaultProxy::~FaultProxy()
+{
+  stop();
+}
+
+bool FaultProxy::start(const std::string& host, unsigned short base_port,
+                       const NetworkImpairment& impairment)
+{
+  impairment_ = impairment;
+  random_ = ImpairmentRandom(impairment.seed);
+
+  for (int port = 0; port < PORTS; ++port) {
+    ACE_INET_Addr address;
+    if (address.set(static_cast<u_short>(base_port + port), host.c_str()) != 0 ||
+        sockets_[port].open(address) != 0) {
+      for (int opened = 0; opened < port; ++opened) {
+        sockets_[opened].close();
+      }
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: Cannot bind fault proxy port %C:%d: %m\n"),
+                       host.c_str(), base_port + port),
+                      false);
+    }
+  }
+
+  if (activate(THR_NEW_LWP | THR_JOINABLE, 1) != 0) {
+    for (int port = 0; port < PORTS; ++port) {
+      sockets_[port].close();
+    }
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: FaultProxy::start() - activate failed\n")),
+                    false);
+  }
+
+  running_ = true;
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Fault proxy on %C:%d-%d: %C\n"),
+             host.c_str(), base_port, base_port + PORTS - 1,
+             impairment_string(impairment_).c_str()));
+  return true;
+}
+
+void FaultProxy::stop()
+{
+  if (!running_) {
+    return;
+  }
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    stopping_ = true;
+  }
+  wait();
+  for (int port = 0; port < PORTS; ++port) {
+    sockets_[port].close();
+  }
+  while (!pending_.empty()) {
+    delete pending_.top();
+    pending_.pop();
+  }
+  running_ = false;
+}
+
+int FaultProxy::svc()
+{
+  for (;;) {
+    ACE_Time_Value timeout = POLL_TIMEOUT;
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      if (stopping_) {
+        break;
+      }
+      const ACE_Time_Value next = flush();
+      if (next != ACE_Time_Value::zero) {
+        const ACE_Time_Value now = monotonic_now();
+        const ACE_Time_Value until = next > now ? next - now : ACE_Time_Value::zero;
+        if (until < timeout) {
+          timeout = until;
+        }
+      }
+    }
+
+    ACE_Handle_Set readable;
+    for (int port = 0; port < PORTS; ++port) {
+      readable.set_bit(sockets_[port].get_handle());
+    }
+    const int ready = ACE::select(static_cast<int>(readable.max_set()) + 1, readable, &timeout);
+    if (ready < 0) {
+      if (errno != EINTR) {
+        ACE_ERROR((LM_WARNING,
+                   ACE_TEXT("WARNING: %N:%l: Fault proxy select failed: %m\n")));
+      }
+      continue;
+    }
+
+    for (int port = 0; ready > 0 && port < PORTS; ++port) {
+      if (!readable.is_set(sockets_[port].get_handle())) {
+        continue;
+      }
+      ACE_INET_Addr source;
+      const ssize_t size = sockets_[port].recv(&buffer_[0], buffer_.size(), source);
+      if (size <= 0) {
+        continue;
+      }
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      relay(port, source, &buffer_[0], static_cast<size_t>(size));
+    }
+  }
+  return 0;
+}
+
+void FaultProxy::relay(int port, const ACE_INET_Addr& source,
+                       const char* data, size_t size)
+{
+  std::vector<ACE_INET_Addr>& clients = clients_[port];
+  size_t from = 0;
+  while (from < clients.size() && clients[from] != source) {
+    ++from;
+  }
+  if (from == clients.size()) {
+    clients.push_back(source);
+    links_[port].push_back(ImpairedLink());
+  }
+
+  const ACE_Time_Value now = monotonic_now();
+  for (size_t to = 0; to < clients.size(); ++to) {
+    if (to == from) {
+      continue;
+    }
+    ACE_Time_Value deliver_at;
+    switch (links_[port][to].admit(impairment_, now, size, random_, deliver_at)) {
+    case ImpairedLink::LOST:
+      ++lost_;
+      continue;
+    case ImpairedLink::OVERFLOW:
+      ++overflowed_;
+      continue;
+    case ImpairedLink::DELIVER:
+      break;
+    }
+
+    Pending* pending = new Pending;
+    pending->at = deliver_at;
+    pending->order = next_order_++;
+    pending->port = port;
+    pending->client = to;
+    pending->data.assign(data, data + size);
+    pending_.push(pending);
+  }
+}
+
+ACE_Time_Value FaultProxy::flush()
+{
+  const ACE_Time_Value now = monotonic_now();
+  while (!pending_.empty() && pending_.top()->at <= now) {
+    Pending* pending = pending_.top();
+    pending_.pop();
+    links_[pending->port][pending->client].sent();
+    if (sockets_[pending->port].send(&pending->data[0], pending->data.size(),
+                                     clients_[pending->port][pending->client]) < 0) {
+      ACE_ERROR((LM_WARNING,
+                 ACE_TEXT("WARNING: %N:%l: Fault proxy send failed: %m\n")));
+    } else {
+      ++forwarded_;
+      bytes_forwarded_ += pending->data.size();
+    }
+    delete pending;
+  }
+  return pending_.empty() ? ACE_Time_Value::zero : pending_.top()->at;
+}
+
+unsigned long long FaultProxy::forwarded() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return forwarded_;
+}
+
+unsigned long long FaultProxy::lost() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return lost_;
+}
+
+unsigned long long FaultProxy::overflowed() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return overflowed_;
+}
+
+unsigned long long FaultProxy::bytes_forwarded() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return bytes_forwarded_;
+}
+
+} // namespace DirShare
@@ -0,0 +1,196 @@
+// FaultInjection.h
+// Network impairments (delay, jitter, loss, reordering, bandwidth) imposed
+// by a local UDP proxy between DirShare participants, for testing under
+// realistic networks without root access
+
+#ifndef DIRSHARE_FAULT_INJECTION_H
+#define DIRSHARE_FAULT_INJECTION_H
+
+#include <ace/Task.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/INET_Addr.h>
+#include <ace/SOCK_Dgram.h>
+#include <ace/Time_Value.h>
+
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * Impairments of every link through the proxy (netem-like)
+ */
+struct NetworkImpairment {
+  ACE_Time_Value delay;          // Added to every datagram
+  ACE_Time_Value jitter;         // Extra delay, uniform in [0, jitter)
+  double loss;                   // Probability a datagram is dropped
+  double reorder;                // Probability a datagram skips the delay
+  unsigned long long rate_bps;   // Bandwidth of each link (0: unlimited)
+  size_t limit;                  // Datagrams queued per link before drops
+  unsigned long seed;            // Of the loss, reorder and jitter draws
+
+  NetworkImpairment();
+};
+
+/**
+ * Parse an impairment specification
+ * Comma-separated key=value pairs, for example
+ * "delay=40ms,jitter=10ms,loss=1%,reorder=0.5%,rate=10mbit,limit=1000":
+ *   delay, jitter   Time with unit us, ms or s
+ *   loss, reorder   Percentage ("1%") or probability ("0.01")
+ *   rate            Bits per second with unit bit, kbit, mbit or gbit
+ *   limit           Datagrams
+ *   seed            Random seed
+ * An empty specification imposes nothing
+ * @param spec Specification
+ * @param impairment Output: parsed impairments
+ * @return false if spec is malformed (logged)
+ */
+bool parse_impairment(const std::string& spec, NetworkImpairment& impairment);
+
+/// Specification text of an impairment (as accepted by parse_impairment())
+std::string impairment_string(const NetworkImpairment& impairment);
+
+/**
+ * @class ImpairmentRandom
+ * @brief Seeded draws of the impairments; deterministic across platforms
+ */
+class ImpairmentRandom {
+public:
+  explicit ImpairmentRandom(unsigned long seed) : state_(seed) {}
+
+  /// Uniform in [0, 1)
+  double next();
+
+private:
+  unsigned long state_;
+};
+
+/**
+ * @class ImpairedLink
+ * @brief Fate of the datagrams sent over one link
+ *
+ * A datagram first waits for the link to be free (serialization at
+ * rate_bps), then travels for delay plus jitter. Jitter is drawn per
+ * datagram, so it reorders datagrams as a real path would; a reordered
+ * datagram additionally skips the delay. Datagrams beyond limit queued on
+ * the link are dropped, as a full router queue would.
+ */
+class ImpairedLink {
+public:
+  enum Fate { DELIVER, LOST, OVERFLOW };
+
+  ImpairedLink();
+
+  /**
+   * Decide the fate of one datagram
+   * @param impairment Impairments to apply
+   * @param now Time the datagram arrives at the proxy (monotonic)
+   * @param size Datagram size in bytes
+   * @param random Source of the loss, reorder and jitter draws
+   * @param deliver_at Output: time to forward the datagram (DELIVER only)
+   * @return DELIVER, or why the datagram is dropped
+   */
+  Fate admit(const NetworkImpairment& impairment,
+             const ACE_Time_Value& now,
+             size_t size,
+             ImpairmentRandom& random,
+             ACE_Time_Value& deliver_at);
+
+  /// A datagram admitted earlier has been forwarded
+  void sent() { if (queued_ > 0) --queued_; }
+
+  size_t queued() const { return queued_; }
+
+private:
+  ACE_Time_Value free_at_;   // When the link has sent what is queued
+  size_t queued_;
+};
+
+/**
+ * @class FaultProxy
+ * @brief UDP relay for RTPS that impairs what it forwards
+ *
+ * Participants configured with rtps_netem.ini send everything (SPDP, SEDP
+ * and user data) to the proxy's three ports instead of to each other, as
+ * they would to an RtpsRelay. Each datagram is forwarded, through an
+ * ImpairedLink per destination, to every other participant that has sent
+ * something to the same port; participants ignore RTPS messages addressed
+ * to others, so flooding is correct, if wasteful, for the few local
+ * participants of a test. One worker thread receives and forwards.
+ */
+class FaultProxy : public ACE_Task_Base {
+public:
+  enum { PORTS = 3 };  // SPDP, SEDP, data: base_port + 0, 1, 2
+
+  FaultProxy();
+  virtual ~FaultProxy();
+
+  /**
+   * Bind the ports and start the worker thread
+   * @param host Address to bind (e.g. "127.0.0.1")
+   * @param base_port First of the PORTS consecutive ports
+   * @param impairment Impairments of every link
+   * @return true on success (failures are logged)
+   */
+  bool start(const std::string& host, unsigned short base_port,
+             const NetworkImpairment& impairment);
+
+  /// Stop the worker thread and close the ports (queued datagrams are lost)
+  void stop();
+
+  virtual int svc();
+
+  /// Datagrams forwarded, dropped by loss, dropped by full link queues
+  unsigned long long forwarded() const;
+  unsigned long long lost() const;
+  unsigned long long overflowed() const;
+  unsigned long long bytes_forwarded() const;
+
+private:
+  // A datagram waiting for its delivery time
+  struct Pending {
+    ACE_Time_Value at;
+    unsigned long long order;
+    int port;
+    size_t client;
+    std::vector<char> data;
+  };
+
+  struct Later {
+    bool operator()(const Pending* a, const Pending* b) const
+    {
+      return a->at != b->at ? a->at > b->at : a->order > b->order;
+    }
+  };
+
+  // Forward one received datagram to the other clients of its port
+  void relay(int port, const ACE_INET_Addr& source, const char* data, size_t size);
+
+  // Send the datagrams that are due; returns the time of the next one
+  ACE_Time_Value flush();
+
+  NetworkImpairment impairment_;
+  ACE_SOCK_Dgram sockets_[PORTS];
+  std::vector<ACE_INET_Addr> clients_[PORTS];   // Senders seen on each port
+  std::vector<ImpairedLink> links_[PORTS];      // Towards each client
+  std::vector<char> buffer_;
+  std::priority_queue<Pending*, std::vector<Pending*>, Later> pending_;
+  unsigned long long next_order_;
+  ImpairmentRandom random_;
+  unsigned long long forwarded_;
+  unsigned long long lost_;
+  unsigned long long overflowed_;
+  unsigned long long bytes_forwarded_;
+  bool running_;
+  bool stopping_;
+  mutable ACE_Thread_Mutex lock_;
+
+  FaultProxy(const FaultProxy&);
+  FaultProxy& operator=(const FaultProxy&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_FAULT_INJECTION_H
@@ -0,0 +1,98 @@
+#include "FecChunkListenerImpl.h"
+#include "FileChunkListenerImpl.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+
+namespace DirShare {
+
+FecChunkListenerImpl::FecChunkListenerImpl(FileChunkListenerImpl& chunk_listener)
+  : chunk_listener_(chunk_listener)
+  , received_("received", "DirShare_FecChunks")
+{
+}
+
+FecChunkListenerImpl::~FecChunkListenerImpl()
+{
+}
+
+void FecChunkListenerImpl::on_requested_deadline_missed(
+  DDS::DataReader_ptr,
+  const DDS::RequestedDeadlineMissedStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_requested_incompatible_qos(
+  DDS::DataReader_ptr,
+  const DDS::RequestedIncompatibleQosStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_sample_rejected(
+  DDS::DataReader_ptr,
+  const DDS::SampleRejectedStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_liveliness_changed(
+  DDS::DataReader_ptr,
+  const DDS::LivelinessChangedStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_subscription_matched(
+  DDS::DataReader_ptr,
+  const DDS::SubscriptionMatchedStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_sample_lost(
+  DDS::DataReader_ptr,
+  const DDS::SampleLostStatus&)
+{
+}
+
+void FecChunkListenerImpl::on_data_available(DDS::DataReader_ptr reader)
+{
+  FecChunkDataReader_var fec_reader =
+    FecChunkDataReader::_narrow(reader);
+
+  if (!fec_reader) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: FecChunkListenerImpl::on_data_available() - ")
+               ACE_TEXT("failed to narrow DataReader!\n")));
+    return;
+  }
+
+  FecChunk chunk;
+  DDS::SampleInfo info;
+
+  DDS::ReturnCode_t status;
+  while ((status = fec_reader->take_next_sample(chunk, info)) == DDS::RETCODE_OK) {
+    if (info.valid_data) {
+      DIRSHARE_DEBUG_EVERY("FecChunk",
+                           ("Received FecChunk: session %llu group %u index %u (%u bytes)\n",
+                            static_cast<unsigned long long>(chunk.session_id),
+                            static_cast<unsigned int>(chunk.group),
+                            static_cast<unsigned int>(chunk.index),
+                            static_cast<unsigned int>(chunk.data.length())));
+
+      received_.sample(chunk.data.length());
+      chunk_listener_.process_fec_chunk(chunk);
+    } else if (info.instance_state != DDS::ALIVE_INSTANCE_STATE) {
+      FecChunk key;
+      if (fec_reader->get_key_value(key, info.instance_handle) == DDS::RETCODE_OK) {
+        chunk_listener_.end_transfer(key.session_id);
+      }
+    }
+  }
+
+  if (status != DDS::RETCODE_NO_DATA) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: FecChunkListenerImpl::on_data_available() - ")
+               ACE_TEXT("take_next_sample failed: %d\n"),
+               status));
+  }
+}
+
+} // namespace DirShare
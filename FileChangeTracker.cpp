@@ -2,11 +2,17 @@
 // Implementation of notification loop prevention tracker
 
 #include "FileChangeTracker.h"
+#include "Log.h"
 #include <ace/Log_Msg.h>
 
 namespace DirShare {
 
 FileChangeTracker::FileChangeTracker()
+  : suppressions_(MetricsRegistry::instance().counter(
+      "dirshare_suppressions_total",
+      "Remote updates for which local change notifications were suppressed"))
+  , suppressed_files_(MetricsRegistry::instance().gauge(
+      "dirshare_suppressed_files", "Files currently being updated from remote"))
 {
   // Constructor - mutex initialized by default constructor
 }
@@ -21,10 +27,11 @@ void FileChangeTracker::suppress_notifications(const std::string& path)
   ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
 
   suppressed_paths_.insert(path);
+  suppressions_.increment();
+  suppressed_files_.set(static_cast<long>(suppressed_paths_.size()));
 
-  ACE_DEBUG((LM_DEBUG,
-            ACE_TEXT("FileChangeTracker: Suppressing notifications for '%C'\n"),
-            path.c_str()));
+  DIRSHARE_DEBUG(("FileChangeTracker: Suppressing notifications for '%s'\n",
+                  path.c_str()));
 }
 
 void FileChangeTracker::resume_notifications(const std::string& path)
@@ -32,11 +39,11 @@ void FileChangeTracker::resume_notifications(const std::string& path)
   ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
 
   size_t erased = suppressed_paths_.erase(path);
+  suppressed_files_.set(static_cast<long>(suppressed_paths_.size()));
 
   if (erased > 0) {
-    ACE_DEBUG((LM_DEBUG,
-              ACE_TEXT("FileChangeTracker: Resumed notifications for '%C'\n"),
-              path.c_str()));
+    DIRSHARE_DEBUG(("FileChangeTracker: Resumed notifications for '%s'\n",
+                    path.c_str()));
   } else {
     ACE_DEBUG((LM_WARNING,
               ACE_TEXT("FileChangeTracker: Attempted to resume '%C' but it was not suppressed\n"),
@@ -46,14 +53,17 @@ void FileChangeTracker::resume_notifications(const std::string& path)
 
 bool FileChangeTracker::is_suppressed(const std::string& path) const
 {
-  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
-
-  bool suppressed = (suppressed_paths_.find(path) != suppressed_paths_.end());
+  bool suppressed;
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+    suppressed = (suppressed_paths_.find(path) != suppressed_paths_.end());
+  }
 
+  // Asked for every file of every scan: at most one line per file per second
   if (suppressed) {
-    ACE_DEBUG((LM_DEBUG,
-              ACE_TEXT("FileChangeTracker: Notifications suppressed for '%C' (remote update in progress)\n"),
-              path.c_str()));
+    DIRSHARE_DEBUG_EVERY(path.c_str(),
+                         ("FileChangeTracker: Notifications suppressed for '%s' (remote update in progress)\n",
+                          path.c_str()));
   }
 
   return suppressed;
@@ -65,6 +75,7 @@ void FileChangeTracker::clear()
 
   size_t count = suppressed_paths_.size();
   suppressed_paths_.clear();
+  suppressed_files_.set(0);
 
   ACE_DEBUG((LM_DEBUG,
             ACE_TEXT("FileChangeTracker: Cleared %d suppressed paths\n"),
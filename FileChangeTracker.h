@@ -11,6 +11,8 @@
 #include <ace/Thread_Mutex.h>
 #include <ace/Guard_T.h>
 
+#include "Metrics.h"
+
 namespace DirShare {
 
 /**
@@ -77,6 +79,8 @@ public:
 private:
   mutable ACE_Thread_Mutex mutex_;  // Thread-safe access
   std::set<std::string> suppressed_paths_;  // Files being updated from remote
+  Counter& suppressions_;
+  Gauge& suppressed_files_;
 };
 
 } // namespace DirShare
@@ -1,15 +1,62 @@
 #include "FileChunkListenerImpl.h"
 #include "FileUtils.h"
+#include "IgnoreMatcher.h"
+#include "SyncFilter.h"
 #include "Checksum.h"
+#include "ReedSolomon.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Log.h"
 
 #include <ace/Log_Msg.h>
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_sys_time.h>
+
+#include <algorithm>
+#include <cstring>
 
 namespace DirShare {
 
+namespace {
+
+// Sessions remembered after completion or discard, so that samples still
+// in flight for them are ignored
+const size_t MAX_CLOSED_SESSIONS = 256;
+
+// Time chunks are held for a session whose TransferOpen has not arrived.
+// Chunks are filtered like their header, so they only come first when the
+// header is delayed (lost and repaired); a session still unopened after
+// this is discarded, but not closed, so a late header still starts it
+const ACE_Time_Value EARLY_SESSION_TIMEOUT(30, 0);
+
+// Time an FEC session may still complete after its TransferOpen dispose:
+// its best-effort FecChunks are another instance, not ordered with it
+const ACE_Time_Value FEC_END_GRACE(2, 0);
+
+} // namespace
+
 FileChunkListenerImpl::FileChunkListenerImpl(const std::string& shared_dir,
-                                               FileChangeTracker& change_tracker)
+                                               FileChangeTracker& change_tracker,
+                                               ContentIndex& content_index)
   : shared_dir_(shared_dir)
   , change_tracker_(change_tracker)
+  , content_index_(content_index)
+  , observer_(0)
+  , ignore_(0)
+  , sync_filter_(0)
+  , remote_change_observer_(0)
+  , received_("received", "DirShare_FileChunks")
+  , reassembly_bytes_(MetricsRegistry::instance().gauge(
+      "dirshare_reassembly_buffer_bytes", "File data buffered by unfinished chunked transfers"))
+  , transfers_active_(MetricsRegistry::instance().gauge(
+      "dirshare_transfers_active", "Chunked transfers being received"))
+  , apply_duration_(MetricsRegistry::instance().histogram(
+      "dirshare_apply_duration_seconds",
+      "Time to verify and write a received file", 1e-6, "path=\"chunks\""))
+  , latency_("chunks")
+  , checksum_errors_(receive_errors("checksum"))
+  , write_errors_(receive_errors("write"))
+  , transfer_errors_(receive_errors("transfer"))
 {
 }
 
@@ -68,20 +115,22 @@ void FileChunkListenerImpl::on_data_available(DDS::DataReader_ptr reader)
   FileChunk chunk;
   DDS::SampleInfo info;
 
-  DDS::ReturnCode_t status = chunk_reader->take_next_sample(chunk, info);
-
-  if (status == DDS::RETCODE_OK) {
+  // Drain everything available so the instance is empty (and can be
+  // released by the reader) once its dispose has been seen
+  DDS::ReturnCode_t status;
+  while ((status = chunk_reader->take_next_sample(chunk, info)) == DDS::RETCODE_OK) {
     if (info.valid_data) {
-      ACE_DEBUG((LM_DEBUG,
-                 ACE_TEXT("(%P|%t) Received FileChunk: %C chunk %u/%u (%u bytes)\n"),
-                 chunk.filename.in(),
-                 chunk.chunk_id + 1,
-                 chunk.total_chunks,
-                 chunk.data.length()));
-
       process_chunk(chunk);
+    } else if (info.instance_state != DDS::ALIVE_INSTANCE_STATE) {
+      // The sender disposed (or lost) the transfer instance
+      FileChunk key;
+      if (chunk_reader->get_key_value(key, info.instance_handle) == DDS::RETCODE_OK) {
+        end_transfer(key.session_id);
+      }
     }
-  } else if (status != DDS::RETCODE_NO_DATA) {
+  }
+
+  if (status != DDS::RETCODE_NO_DATA) {
     ACE_ERROR((LM_ERROR,
                ACE_TEXT("ERROR: %N:%l: FileChunkListenerImpl::on_data_available() - ")
                ACE_TEXT("take_next_sample failed: %d\n"),
@@ -89,92 +138,573 @@ void FileChunkListenerImpl::on_data_available(DDS::DataReader_ptr reader)
   }
 }
 
-void FileChunkListenerImpl::process_chunk(const FileChunk& chunk)
+void FileChunkListenerImpl::open_transfer(const TransferOpen& open)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  SampleCapture::instance().record_open(open, false);
+  start_session(open, false);
+}
+
+bool FileChunkListenerImpl::open_pull_transfer(const TransferOpen& open)
 {
-  std::string filename = chunk.filename.in();
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
 
-  // Verify chunk checksum
-  if (chunk.data.length() > 0) {
-    uint32_t computed_checksum = compute_checksum(
-      reinterpret_cast<const uint8_t*>(chunk.data.get_buffer()),
-      chunk.data.length());
+  // Never displace a transfer that a peer is pushing
+  std::map<std::string, uint64_t>::const_iterator active =
+    active_transfers_.find(open.filename.in());
+  if (active != active_transfers_.end()) {
+    return false;
+  }
+
+  SampleCapture::instance().record_open(open, true);
+  start_session(open, true);
+  return true;
+}
+
+void FileChunkListenerImpl::abort_transfer(uint64_t session_id)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.find(session_id);
+  if (it == reassembly_buffer_.end()) {
+    return;
+  }
+
+  const std::string filename = it->second.filename;
+  DIRSHARE_INFO(("Session %llu of %s aborted (%u/%u chunks), discarding\n",
+                 static_cast<unsigned long long>(session_id),
+                 filename.c_str(),
+                 static_cast<unsigned int>(it->second.received_chunks.size()),
+                 static_cast<unsigned int>(it->second.total_chunks)));
+  close_session(session_id);
+  change_tracker_.resume_notifications(filename);
+}
+
+void FileChunkListenerImpl::set_observer(ChunkReceiptObserver* observer)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  observer_ = observer;
+}
+
+void FileChunkListenerImpl::set_ignore_matcher(const IgnoreMatcher* ignore)
+{
+  ignore_ = ignore;
+}
+
+void FileChunkListenerImpl::set_sync_filter(const SyncFilter* filter)
+{
+  sync_filter_ = filter;
+}
+
+void FileChunkListenerImpl::set_remote_change_observer(RemoteChangeObserver* observer)
+{
+  remote_change_observer_ = observer;
+}
+
+void FileChunkListenerImpl::start_session(const TransferOpen& open, bool pulled)
+{
+  const uint64_t session_id = open.session_id;
+  const std::string filename = open.filename.in();
+
+  if (closed_sessions_.find(session_id) != closed_sessions_.end()) {
+    return;
+  }
+
+  // Ignored locally (.dirshareignore): closing the session drops its chunks
+  if (ignore_ && ignore_->ignored(filename)) {
+    DIRSHARE_DEBUG(("Ignoring transfer of %s\n", filename.c_str()));
+    close_session(session_id);
+    return;
+  }
+
+  // Not subscribed to by this participant (selective sync)
+  if (sync_filter_ && !sync_filter_->matches(filename, open.file_size)) {
+    DIRSHARE_DEBUG(("Not subscribed to %s, dropping its transfer\n", filename.c_str()));
+    close_session(session_id);
+    return;
+  }
 
-    if (computed_checksum != chunk.chunk_checksum) {
+  if (open.chunk_size == 0 ||
+      open.total_chunks != (open.file_size + open.chunk_size - 1) / open.chunk_size) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Invalid TransferOpen for %C (%Q bytes, %u chunks of %u bytes)\n"),
+               filename.c_str(),
+               open.file_size,
+               open.total_chunks,
+               open.chunk_size));
+    transfer_errors_.increment();
+    close_session(session_id);
+    return;
+  }
+
+  // A newer transfer of the same file supersedes an unfinished one
+  std::map<std::string, uint64_t>::iterator active = active_transfers_.find(filename);
+  if (active != active_transfers_.end() && active->second != session_id) {
+    DIRSHARE_INFO(("Session %llu of %s superseded by session %llu, discarding\n",
+                   static_cast<unsigned long long>(active->second),
+                   filename.c_str(),
+                   static_cast<unsigned long long>(session_id)));
+    close_session(active->second);
+  }
+
+  ChunkedFile& chunked_file = reassembly_buffer_[session_id];
+  if (chunked_file.opened) {
+    return;
+  }
+
+  chunked_file.opened = true;
+  chunked_file.pulled = pulled;
+  chunked_file.session_id = session_id;
+  chunked_file.filename = filename;
+  chunked_file.total_chunks = open.total_chunks;
+  chunked_file.chunk_size = open.chunk_size;
+  chunked_file.file_size = open.file_size;
+  chunked_file.file_checksum = open.file_checksum;
+  chunked_file.timestamp_sec = open.timestamp_sec;
+  chunked_file.timestamp_nsec = open.timestamp_nsec;
+  chunked_file.fec_data_chunks = open.fec_data_chunks;
+  chunked_file.fec_repair_chunks = open.fec_repair_chunks;
+  chunked_file.origin = open.origin;
+  active_transfers_[filename] = session_id;
+  transfers_active_.set(static_cast<long>(active_transfers_.size()));
+
+  if (open.fec_data_chunks > 0 &&
+      !ReedSolomonCode(open.fec_data_chunks, open.fec_repair_chunks).valid()) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Invalid FEC parameters for %C (%u:%u)\n"),
+               filename.c_str(),
+               static_cast<unsigned int>(open.fec_data_chunks),
+               static_cast<unsigned int>(open.fec_repair_chunks)));
+    transfer_errors_.increment();
+    close_session(session_id);
+    change_tracker_.resume_notifications(filename);
+    return;
+  }
+
+  // Hole runs are never sent as chunks
+  for (CORBA::ULong i = 0; i < open.holes.length(); ++i) {
+    const ChunkRange& range = open.holes[i];
+    if (range.first_chunk + static_cast<uint64_t>(range.count) > open.total_chunks) {
       ACE_ERROR((LM_ERROR,
-                 ACE_TEXT("ERROR: %N:%l: Chunk checksum mismatch for %C chunk %u\n")
-                 ACE_TEXT("  Expected: 0x%08X, Computed: 0x%08X\n"),
+                 ACE_TEXT("ERROR: %N:%l: Invalid hole range for %C chunk %u (+%u)\n"),
                  filename.c_str(),
-                 chunk.chunk_id,
-                 chunk.chunk_checksum,
-                 computed_checksum));
+                 range.first_chunk,
+                 range.count));
+      transfer_errors_.increment();
+      close_session(session_id);
+      change_tracker_.resume_notifications(filename);
       return;
     }
+    for (uint32_t c = 0; c < range.count; ++c) {
+      chunked_file.received_chunks[range.first_chunk + c] = true;
+    }
   }
 
-  // Get or create reassembly buffer for this file
-  ChunkedFile& chunked_file = reassembly_buffer_[filename];
+  DIRSHARE_INFO(("Starting reassembly of file: %s (%llu bytes, %u chunks of %u bytes, session %llu)\n",
+                 filename.c_str(),
+                 static_cast<unsigned long long>(open.file_size),
+                 static_cast<unsigned int>(open.total_chunks),
+                 static_cast<unsigned int>(open.chunk_size),
+                 static_cast<unsigned long long>(session_id)));
+
+  // Chunks may arrive before their TransferOpen (different writers)
+  std::vector<FileChunk> pending;
+  pending.swap(chunked_file.pending);
+  for (size_t i = 0; i < pending.size(); ++i) {
+    apply_chunk(chunked_file, pending[i].offset,
+                pending[i].data.get_buffer(), pending[i].data.length());
+  }
+  std::vector<FecChunk> pending_fec;
+  pending_fec.swap(chunked_file.pending_fec);
+  for (size_t i = 0; i < pending_fec.size(); ++i) {
+    apply_fec_chunk(chunked_file, pending_fec[i]);
+  }
 
-  // Initialize on first chunk
-  if (chunked_file.total_chunks == 0) {
-    chunked_file.total_chunks = chunk.total_chunks;
-    chunked_file.file_size = chunk.file_size;
-    chunked_file.file_checksum = chunk.file_checksum;
-    chunked_file.timestamp_sec = chunk.timestamp_sec;
-    chunked_file.timestamp_nsec = chunk.timestamp_nsec;
-    chunked_file.data.resize(chunk.file_size);
+  check_session(session_id);
+}
 
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Starting reassembly of file: %C (%Q bytes, %u chunks)\n"),
-               filename.c_str(),
-               chunk.file_size,
-               chunk.total_chunks));
+void FileChunkListenerImpl::process_chunk(const FileChunk& chunk)
+{
+  TraceSpan span("receive", "process_chunk");
+  DIRSHARE_DEBUG_EVERY("FileChunk",
+                       ("Received FileChunk: session %llu offset %llu (%u bytes)\n",
+                        static_cast<unsigned long long>(chunk.session_id),
+                        static_cast<unsigned long long>(chunk.offset),
+                        static_cast<unsigned int>(chunk.data.length())));
+  received_.sample(chunk.data.length());
+
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  SampleCapture::instance().record(chunk);
+
+  if (closed_sessions_.find(chunk.session_id) != closed_sessions_.end()) {
+    return;
   }
 
-  // Validate consistency
-  if (chunk.total_chunks != chunked_file.total_chunks ||
-      chunk.file_size != chunked_file.file_size ||
-      chunk.file_checksum != chunked_file.file_checksum) {
+  // Verify chunk checksum
+  uint32_t computed_checksum = compute_checksum(
+    reinterpret_cast<const uint8_t*>(chunk.data.get_buffer()),
+    chunk.data.length());
+
+  if (computed_checksum != chunk.chunk_checksum) {
     ACE_ERROR((LM_ERROR,
-               ACE_TEXT("ERROR: %N:%l: Inconsistent chunk metadata for %C chunk %u\n"),
-               filename.c_str(),
-               chunk.chunk_id));
+               ACE_TEXT("ERROR: %N:%l: Chunk checksum mismatch for session %Q offset %Q\n")
+               ACE_TEXT("  Expected: 0x%08X, Computed: 0x%08X\n"),
+               chunk.session_id,
+               chunk.offset,
+               chunk.chunk_checksum,
+               computed_checksum));
+    checksum_errors_.increment();
     return;
   }
 
-  // Copy chunk data into reassembly buffer
-  const uint32_t chunk_size = 1024 * 1024; // 1MB
-  uint64_t offset = static_cast<uint64_t>(chunk.chunk_id) * chunk_size;
+  ChunkedFile& chunked_file = reassembly_buffer_[chunk.session_id];
+  if (!chunked_file.opened) {
+    if (chunked_file.early_since == ACE_Time_Value::zero) {
+      chunked_file.early_since = monotonic_now();
+    }
+    chunked_file.pending.push_back(chunk);
+    return;
+  }
+
+  apply_chunk(chunked_file, chunk.offset, chunk.data.get_buffer(), chunk.data.length());
+  check_session(chunk.session_id);
+}
 
-  if (offset + chunk.data.length() > chunked_file.file_size) {
+void FileChunkListenerImpl::process_fec_chunk(const FecChunk& chunk)
+{
+  TraceSpan span("receive", "process_fec_chunk");
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  SampleCapture::instance().record(chunk);
+
+  if (closed_sessions_.find(chunk.session_id) != closed_sessions_.end()) {
+    return;
+  }
+
+  // A corrupted chunk is treated like a lost one
+  uint32_t computed_checksum = compute_checksum(
+    reinterpret_cast<const uint8_t*>(chunk.data.get_buffer()),
+    chunk.data.length());
+
+  if (computed_checksum != chunk.chunk_checksum) {
     ACE_ERROR((LM_ERROR,
-               ACE_TEXT("ERROR: %N:%l: Chunk data exceeds file size for %C chunk %u\n"),
+               ACE_TEXT("ERROR: %N:%l: FEC chunk checksum mismatch for session %Q group %u index %u\n")
+               ACE_TEXT("  Expected: 0x%08X, Computed: 0x%08X\n"),
+               chunk.session_id,
+               chunk.group,
+               static_cast<unsigned int>(chunk.index),
+               chunk.chunk_checksum,
+               computed_checksum));
+    checksum_errors_.increment();
+    return;
+  }
+
+  ChunkedFile& chunked_file = reassembly_buffer_[chunk.session_id];
+  if (!chunked_file.opened) {
+    if (chunked_file.early_since == ACE_Time_Value::zero) {
+      chunked_file.early_since = monotonic_now();
+    }
+    chunked_file.pending_fec.push_back(chunk);
+    return;
+  }
+
+  apply_fec_chunk(chunked_file, chunk);
+  check_session(chunk.session_id);
+}
+
+void FileChunkListenerImpl::transfer_open_disposed(uint64_t session_id)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  SampleCapture::instance().record_session_end(CAPTURE_OPEN_DISPOSED, session_id);
+
+  // The best-effort dispose of a FecChunk instance may be lost; the
+  // reliable TransferOpen dispose, written after the last chunk, ends FEC
+  // sessions as well. FecChunks written before it may still arrive, so
+  // the session is given until the grace period ends, or until its own
+  // FecChunk dispose (end_transfer())
+  std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.find(session_id);
+  if (it == reassembly_buffer_.end() || it->second.fec_data_chunks == 0) {
+    return;
+  }
+
+  it->second.fec_deadline = monotonic_now() + FEC_END_GRACE;
+}
+
+void FileChunkListenerImpl::expire_transfers(const ACE_Time_Value& now)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::vector<uint64_t> expired;
+  for (std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.begin();
+       it != reassembly_buffer_.end();) {
+    ChunkedFile& chunked_file = it->second;
+    if (!chunked_file.opened) {
+      // Never opened: forget the early chunks, but not the session
+      if (now - chunked_file.early_since >= EARLY_SESSION_TIMEOUT) {
+        DIRSHARE_DEBUG(("Session %llu got no TransferOpen, dropping %u early chunks\n",
+                        static_cast<unsigned long long>(it->first),
+                        static_cast<unsigned int>(chunked_file.pending.size() +
+                                                  chunked_file.pending_fec.size())));
+        reassembly_buffer_.erase(it++);
+        continue;
+      }
+    } else if (chunked_file.fec_deadline != ACE_Time_Value::zero &&
+               now >= chunked_file.fec_deadline) {
+      chunked_file.chunks_ended = true;
+      expired.push_back(it->first);
+    }
+    ++it;
+  }
+
+  for (size_t i = 0; i < expired.size(); ++i) {
+    check_session(expired[i]);
+  }
+}
+
+void FileChunkListenerImpl::apply_chunk(ChunkedFile& chunked_file,
+                                        uint64_t offset,
+                                        const uint8_t* data,
+                                        uint32_t length)
+{
+  const std::string& filename = chunked_file.filename;
+
+  // Validate placement against the session header
+  uint64_t chunk_id = offset / chunked_file.chunk_size;
+  if (offset % chunked_file.chunk_size != 0 ||
+      chunk_id >= chunked_file.total_chunks ||
+      length > chunked_file.chunk_size ||
+      offset + length > chunked_file.file_size) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Chunk does not fit %C: offset %Q, %u bytes\n"),
                filename.c_str(),
-               chunk.chunk_id));
+               offset,
+               length));
+    transfer_errors_.increment();
+    return;
+  }
+
+  // Duplicates must not be buffered twice
+  uint32_t id = static_cast<uint32_t>(chunk_id);
+  const bool first_copy =
+    chunked_file.received_chunks.find(id) == chunked_file.received_chunks.end();
+  if (first_copy && length > 0) {
+    FileExtent extent;
+    extent.offset = offset;
+    extent.length = length;
+    chunked_file.extents.push_back(extent);
+    chunked_file.data.insert(chunked_file.data.end(), data, data + length);
+    reassembly_bytes_.add(static_cast<long>(length));
+  }
+
+  chunked_file.received_chunks[id] = true;
+
+  if (first_copy && chunked_file.pulled && observer_) {
+    observer_->chunk_received(chunked_file.session_id, id);
+  }
+
+  DIRSHARE_DEBUG_EVERY(filename.c_str(),
+                       ("Reassembly progress for %s: %u/%u chunks received\n",
+                        filename.c_str(),
+                        static_cast<unsigned int>(chunked_file.received_chunks.size()),
+                        static_cast<unsigned int>(chunked_file.total_chunks)));
+}
+
+void FileChunkListenerImpl::apply_fec_chunk(ChunkedFile& chunked_file, const FecChunk& chunk)
+{
+  const unsigned k = chunked_file.fec_data_chunks;
+  const unsigned m = chunked_file.fec_repair_chunks;
+  const uint32_t group = chunk.group;
+  const unsigned index = chunk.index;
+
+  if (k == 0 || index >= k + m ||
+      static_cast<uint64_t>(group) * k + (index < k ? index : 0) >= chunked_file.total_chunks ||
+      chunk.data.length() > chunked_file.chunk_size) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: FEC chunk does not fit %C: group %u index %u, %u bytes\n"),
+               chunked_file.filename.c_str(),
+               group,
+               index,
+               chunk.data.length()));
+    transfer_errors_.increment();
+    return;
+  }
+
+  // Late repair chunks (and duplicates) of a finished group
+  if (fec_group_complete(chunked_file, group)) {
+    chunked_file.fec_groups.erase(group);
+    return;
+  }
+
+  if (index < k) {
+    uint64_t offset = (static_cast<uint64_t>(group) * k + index) * chunked_file.chunk_size;
+    apply_chunk(chunked_file, offset, chunk.data.get_buffer(), chunk.data.length());
+
+    if (fec_group_complete(chunked_file, group)) {
+      chunked_file.fec_groups.erase(group);
+      return;
+    }
+  }
+
+  // Keep the (zero-padded) block until the group can be decoded
+  std::vector<uint8_t>& block = chunked_file.fec_groups[group].blocks[index];
+  block.assign(chunked_file.chunk_size, 0);
+  if (chunk.data.length() > 0) {
+    std::memcpy(&block[0], chunk.data.get_buffer(), chunk.data.length());
+  }
+
+  recover_fec_group(chunked_file, group);
+}
+
+bool FileChunkListenerImpl::fec_group_complete(const ChunkedFile& chunked_file,
+                                               uint32_t group) const
+{
+  const uint64_t first = static_cast<uint64_t>(group) * chunked_file.fec_data_chunks;
+  const uint64_t end = std::min<uint64_t>(first + chunked_file.fec_data_chunks,
+                                          chunked_file.total_chunks);
+  for (uint64_t c = first; c < end; ++c) {
+    if (chunked_file.received_chunks.find(static_cast<uint32_t>(c)) ==
+        chunked_file.received_chunks.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void FileChunkListenerImpl::recover_fec_group(ChunkedFile& chunked_file, uint32_t group)
+{
+  TraceSpan span("receive", "fec_decode", chunked_file.filename.c_str());
+  const unsigned k = chunked_file.fec_data_chunks;
+  const unsigned m = chunked_file.fec_repair_chunks;
+  const uint32_t chunk_size = chunked_file.chunk_size;
+  const uint64_t first = static_cast<uint64_t>(group) * k;
+
+  FecGroup& fec_group = chunked_file.fec_groups[group];
+
+  // Received blocks, plus the blocks known to be zero: hole chunks (marked
+  // received but never sent) and chunks past the end of the file
+  std::vector<uint8_t> zeros(chunk_size, 0);
+  std::vector<const uint8_t*> blocks(k + m, static_cast<const uint8_t*>(0));
+  unsigned present = 0;
+  for (unsigned index = 0; index < k + m; ++index) {
+    std::map<unsigned, std::vector<uint8_t> >::const_iterator it = fec_group.blocks.find(index);
+    if (it != fec_group.blocks.end()) {
+      blocks[index] = &it->second[0];
+    } else if (index < k &&
+               (first + index >= chunked_file.total_chunks ||
+                chunked_file.received_chunks.find(static_cast<uint32_t>(first + index)) !=
+                chunked_file.received_chunks.end())) {
+      blocks[index] = &zeros[0];
+    }
+    if (blocks[index]) {
+      ++present;
+    }
+  }
+
+  if (present < k) {
+    return; // Wait for more chunks of the group
+  }
+
+  std::map<unsigned, std::vector<uint8_t> > recovered;
+  if (!ReedSolomonCode(k, m).decode(blocks, chunk_size, recovered)) {
     return;
   }
 
-  std::memcpy(&chunked_file.data[offset],
-              chunk.data.get_buffer(),
-              chunk.data.length());
+  for (std::map<unsigned, std::vector<uint8_t> >::const_iterator it = recovered.begin();
+       it != recovered.end(); ++it) {
+    uint64_t offset = (first + it->first) * chunk_size;
+    uint32_t length = static_cast<uint32_t>(
+      std::min<uint64_t>(chunk_size, chunked_file.file_size - offset));
+    apply_chunk(chunked_file, offset, &it->second[0], length);
+  }
+
+  DIRSHARE_INFO_EVERY(chunked_file.filename.c_str(),
+                      ("Recovered %u lost chunks of %s (FEC group %u)\n",
+                       static_cast<unsigned int>(recovered.size()),
+                       chunked_file.filename.c_str(),
+                       static_cast<unsigned int>(group)));
 
-  chunked_file.received_chunks[chunk.chunk_id] = true;
+  chunked_file.fec_groups.erase(group);
+}
+
+void FileChunkListenerImpl::check_session(uint64_t session_id)
+{
+  std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.find(session_id);
+  if (it == reassembly_buffer_.end() || !it->second.opened) {
+    return;
+  }
 
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Reassembly progress for %C: %u/%u chunks received\n"),
-             filename.c_str(),
-             static_cast<unsigned int>(chunked_file.received_chunks.size()),
-             chunked_file.total_chunks));
+  ChunkedFile& chunked_file = it->second;
+  const std::string filename = chunked_file.filename;
 
-  // Check if file is complete
   if (chunked_file.is_complete()) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) All chunks received for %C, finalizing...\n"),
-               filename.c_str()));
+    DIRSHARE_INFO(("All chunks received for %s, finalizing...\n", filename.c_str()));
 
     finalize_file(filename, chunked_file);
 
     // Remove from reassembly buffer
-    reassembly_buffer_.erase(filename);
+    close_session(session_id);
+  } else if (chunked_file.chunks_ended) {
+    // All samples of the chunk instance precede its dispose, so the
+    // session can no longer complete
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Session %Q of %C ended incomplete (%u/%u chunks), discarding\n"),
+               session_id,
+               filename.c_str(),
+               static_cast<unsigned int>(chunked_file.received_chunks.size()),
+               chunked_file.total_chunks));
+    transfer_errors_.increment();
+    close_session(session_id);
+    // Resume notifications on error (SC-011: prevent permanent suppression)
+    change_tracker_.resume_notifications(filename);
+  }
+}
+
+void FileChunkListenerImpl::end_transfer(uint64_t session_id)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  SampleCapture::instance().record_session_end(CAPTURE_CHUNKS_ENDED, session_id);
+
+  std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.find(session_id);
+  if (it == reassembly_buffer_.end()) {
+    return; // Completed normally (or never seen)
+  }
+
+  // A pulled session is served by several peers, each ending its own instance
+  if (it->second.pulled) {
+    return;
+  }
+
+  // Its TransferOpen is still on the way: the session is checked once it
+  // arrives (or expires unopened)
+  it->second.chunks_ended = true;
+  if (it->second.opened) {
+    check_session(session_id);
+  }
+}
+
+void FileChunkListenerImpl::close_session(uint64_t session_id)
+{
+  std::map<uint64_t, ChunkedFile>::iterator it = reassembly_buffer_.find(session_id);
+  if (it != reassembly_buffer_.end()) {
+    std::map<std::string, uint64_t>::iterator active = active_transfers_.find(it->second.filename);
+    if (active != active_transfers_.end() && active->second == session_id) {
+      active_transfers_.erase(active);
+      transfers_active_.set(static_cast<long>(active_transfers_.size()));
+    }
+    reassembly_bytes_.sub(static_cast<long>(it->second.data.size()));
+    reassembly_buffer_.erase(it);
+
+    if (observer_) {
+      observer_->session_closed(session_id);
+    }
+  }
+
+  // Remember recently closed sessions so late samples do not reopen them
+  if (closed_sessions_.insert(session_id).second) {
+    closed_order_.push_back(session_id);
+    if (closed_order_.size() > MAX_CLOSED_SESSIONS) {
+      closed_sessions_.erase(closed_order_.front());
+      closed_order_.pop_front();
+    }
   }
 }
 
@@ -182,10 +712,13 @@ void FileChunkListenerImpl::finalize_file(
   const std::string& filename,
   ChunkedFile& chunked_file)
 {
+  const ACE_Time_Value received = ACE_OS::gettimeofday();
+  TraceSpan span("receive", "finalize_file", filename.c_str());
   std::string full_path = shared_dir_ + "/" + filename;
 
   // Check if file exists and compare timestamps for MODIFY case
-  if (file_exists(full_path)) {
+  const bool existed = file_exists(full_path);
+  if (existed) {
     unsigned long long local_timestamp_sec;
     unsigned long local_timestamp_nsec;
     if (get_file_mtime(full_path, local_timestamp_sec, local_timestamp_nsec)) {
@@ -198,25 +731,37 @@ void FileChunkListenerImpl::finalize_file(
         remote_is_newer = true;
       }
 
-      if (!remote_is_newer) {
-        ACE_DEBUG((LM_INFO,
-                   ACE_TEXT("(%P|%t) Local file is newer or same, ignoring FileChunk reassembly for: %C\n"),
-                   filename.c_str()));
+      // A local copy made for this transfer carries its timestamp, but
+      // stays a stand-in until compared with the received bytes below
+      const bool pending_copy =
+        chunked_file.timestamp_sec == local_timestamp_sec &&
+        chunked_file.timestamp_nsec == local_timestamp_nsec &&
+        content_index_.unverified(filename);
+
+      if (!remote_is_newer && !pending_copy) {
+        DIRSHARE_INFO(("Local file is newer or same, ignoring FileChunk reassembly for: %s\n",
+                       filename.c_str()));
         // Resume notifications even when rejecting update (SC-011: prevent permanent suppression)
         change_tracker_.resume_notifications(filename);
         return;
       }
 
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) Remote file is newer, updating local file with reassembled chunks: %C\n"),
-                 filename.c_str()));
+      DIRSHARE_INFO(("Remote file is newer, updating local file with reassembled chunks: %s\n",
+                     filename.c_str()));
     }
   }
 
-  // Verify file checksum
-  uint32_t computed_checksum = compute_checksum(
-    &chunked_file.data[0],
-    chunked_file.file_size);
+  const ACE_Time_Value apply_start = ACE_OS::gettimeofday();
+  const ACE_Time_Value verify_start = monotonic_now();
+
+  // Verify file checksum (holes are checksummed as zero runs)
+  const uint8_t* data = chunked_file.data.empty() ? 0 : &chunked_file.data[0];
+  uint32_t computed_checksum;
+  {
+    TraceSpan verify_span("receive", "calculate_extents_crc32", filename.c_str());
+    computed_checksum = static_cast<uint32_t>(calculate_extents_crc32(
+      data, chunked_file.extents, chunked_file.file_size));
+  }
 
   if (computed_checksum != chunked_file.file_checksum) {
     ACE_ERROR((LM_ERROR,
@@ -225,29 +770,41 @@ void FileChunkListenerImpl::finalize_file(
                filename.c_str(),
                chunked_file.file_checksum,
                computed_checksum));
+    checksum_errors_.increment();
     // Resume notifications on error (SC-011: prevent permanent suppression)
     change_tracker_.resume_notifications(filename);
     return;
   }
 
-  // Write file
-  if (!write_file(full_path,
-                  &chunked_file.data[0],
-                  chunked_file.file_size)) {
+  // Write file, recreating holes, unless the file already holds these
+  // bytes (e.g. materialized from a local copy); the index is only a hint
+  const ACE_Time_Value write_start = monotonic_now();
+  const ACE_Time_Value verify_time = write_start - verify_start;
+  if (content_index_.contains(filename, chunked_file.file_size, chunked_file.file_checksum) &&
+      file_matches_image(full_path, data, chunked_file.extents, chunked_file.file_size)) {
+    DIRSHARE_INFO(("Local file already holds this content, skipping write: %s\n",
+                   filename.c_str()));
+  } else if (!write_file_sparse(full_path,
+                                data,
+                                chunked_file.extents,
+                                chunked_file.file_size)) {
     ACE_ERROR((LM_ERROR,
                ACE_TEXT("ERROR: %N:%l: Failed to write reassembled file: %C\n"),
                full_path.c_str()));
+    write_errors_.increment();
     // Resume notifications on error (SC-011: prevent permanent suppression)
     change_tracker_.resume_notifications(filename);
     return;
   }
 
+  content_index_.update(filename, chunked_file.file_size, chunked_file.file_checksum);
+  content_index_.verified(filename);
+
   // Preserve timestamp
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Preserving timestamp for reassembled file %C: %Q.%09u\n"),
-             filename.c_str(),
-             chunked_file.timestamp_sec,
-             chunked_file.timestamp_nsec));
+  DIRSHARE_DEBUG(("Preserving timestamp for reassembled file %s: %llu.%09u\n",
+                  filename.c_str(),
+                  static_cast<unsigned long long>(chunked_file.timestamp_sec),
+                  static_cast<unsigned int>(chunked_file.timestamp_nsec)));
 
   if (!set_file_mtime(full_path, chunked_file.timestamp_sec, chunked_file.timestamp_nsec)) {
     ACE_ERROR((LM_WARNING,
@@ -259,27 +816,33 @@ void FileChunkListenerImpl::finalize_file(
     unsigned long long verified_sec;
     unsigned long verified_nsec;
     if (get_file_mtime(full_path, verified_sec, verified_nsec)) {
-      ACE_DEBUG((LM_DEBUG,
-                 ACE_TEXT("(%P|%t) Timestamp preserved for %C: original=%Q.%09u, actual=%Q.%09u\n"),
-                 filename.c_str(),
-                 chunked_file.timestamp_sec,
-                 chunked_file.timestamp_nsec,
-                 verified_sec,
-                 verified_nsec));
+      DIRSHARE_DEBUG(("Timestamp preserved for %s: original=%llu.%09u, actual=%llu.%09u\n",
+                      filename.c_str(),
+                      static_cast<unsigned long long>(chunked_file.timestamp_sec),
+                      static_cast<unsigned int>(chunked_file.timestamp_nsec),
+                      verified_sec,
+                      static_cast<unsigned int>(verified_nsec)));
     }
   }
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Successfully wrote reassembled file: %C (%Q bytes, checksum: 0x%08X)\n"),
-             filename.c_str(),
-             chunked_file.file_size,
-             chunked_file.file_checksum));
+  apply_duration_.record(ACE_OS::gettimeofday() - apply_start);
+  latency_.record(filename, chunked_file.origin, received, verify_time,
+                  monotonic_now() - write_start);
+
+  DIRSHARE_INFO(("Successfully wrote reassembled file: %s (%llu bytes, %llu data, checksum: 0x%08X)\n",
+                 filename.c_str(),
+                 static_cast<unsigned long long>(chunked_file.file_size),
+                 static_cast<unsigned long long>(chunked_file.data.size()),
+                 static_cast<unsigned int>(chunked_file.file_checksum)));
+
+  if (remote_change_observer_) {
+    remote_change_observer_->remote_change_applied(existed ? MODIFY : CREATE,
+                                                   filename, chunked_file.origin);
+  }
 
   // Resume notifications for this file (SC-011: prevent notification loop)
   change_tracker_.resume_notifications(filename);
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Resumed notifications for file: %C\n"),
-             filename.c_str()));
+  DIRSHARE_DEBUG(("Resumed notifications for file: %s\n", filename.c_str()));
 }
 
 } // namespace DirShare
@@ -2,34 +2,83 @@
 #define DIRSHARE_FILE_CHUNK_LISTENER_IMPL_H
 
 #include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
+#include "Latency.h"
 #include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "RemoteChangeObserver.h"
+#include "FileUtils.h"
 
 #include <dds/DCPS/LocalObject.h>
 #include <dds/DdsDcpsSubscriptionC.h>
 
+#include <ace/Thread_Mutex.h>
+
 #include <string>
 #include <map>
+#include <set>
+#include <deque>
 #include <vector>
 
 namespace DirShare {
 
-// Structure to track reassembly of chunked files
+class IgnoreMatcher;
+class SyncFilter;
+
+// Blocks of one FEC group received so far (data chunks zero-padded to the
+// chunk size, and repair chunks), held until the group is complete or can
+// be decoded
+struct FecGroup {
+  std::map<unsigned, std::vector<uint8_t> > blocks;  // Index in group -> block
+};
+
+// Structure to track reassembly of one transfer session
+// Only data chunks are buffered (in arrival order); hole chunks listed in the
+// TransferOpen are recorded as received and left unallocated when the file
+// is written
 struct ChunkedFile {
-  std::vector<uint8_t> data;
+  bool opened;                       // TransferOpen received
+  bool pulled;                       // Opened locally for chunk requests (see SwarmDownloader)
+  bool chunks_ended;                 // Chunk instance disposed by the sender
+  std::vector<FileChunk> pending;    // Chunks that arrived before the TransferOpen
+  std::vector<FecChunk> pending_fec; // ... and FEC chunks
+  std::string filename;
+  std::vector<uint8_t> data;         // Data chunk contents, in order of extents
+  std::vector<FileExtent> extents;   // File range of each buffered data chunk
   std::map<uint32_t, bool> received_chunks;
   uint32_t total_chunks;
+  uint32_t chunk_size;               // Chosen by the sender, fixed per transfer
   uint64_t file_size;
   uint32_t file_checksum;
   uint64_t timestamp_sec;
   uint32_t timestamp_nsec;
+  uint64_t session_id;
+  uint16_t fec_data_chunks;          // FEC group size (0: chunks come as FileChunks)
+  uint16_t fec_repair_chunks;
+  std::map<uint32_t, FecGroup> fec_groups;  // Incomplete FEC groups
+  ACE_Time_Value fec_deadline;       // Discard time after the TransferOpen dispose (zero: none)
+  ACE_Time_Value early_since;        // Arrival of the first chunk before the TransferOpen
+  ChangeOrigin origin;               // Latency tracing (from the TransferOpen)
 
   ChunkedFile()
-    : total_chunks(0)
+    : opened(false)
+    , pulled(false)
+    , chunks_ended(false)
+    , total_chunks(0)
+    , chunk_size(0)
     , file_size(0)
     , file_checksum(0)
     , timestamp_sec(0)
     , timestamp_nsec(0)
+    , session_id(0)
+    , fec_data_chunks(0)
+    , fec_repair_chunks(0)
   {
+    origin.event_id = 0;
+    origin.detect_sec = 0;
+    origin.detect_nsec = 0;
+    origin.scan_delay_usec = 0;
+    origin.queue_usec = 0;
   }
 
   bool is_complete() const {
@@ -46,12 +95,27 @@ struct ChunkedFile {
   }
 };
 
+// Told about the progress of pulled sessions
+// Called with the listener's lock held: implementations must not call back
+// into FileChunkListenerImpl
+class ChunkReceiptObserver {
+public:
+  virtual ~ChunkReceiptObserver() {}
+
+  // A chunk of a pulled session arrived for the first time
+  virtual void chunk_received(uint64_t session_id, uint32_t chunk_id) = 0;
+
+  // A session was finished, discarded or superseded
+  virtual void session_closed(uint64_t session_id) = 0;
+};
+
 class FileChunkListenerImpl
   : public virtual OpenDDS::DCPS::LocalObject<DDS::DataReaderListener>
 {
 public:
   explicit FileChunkListenerImpl(const std::string& shared_dir,
-                                  FileChangeTracker& change_tracker);
+                                  FileChangeTracker& change_tracker,
+                                  ContentIndex& content_index);
 
   virtual ~FileChunkListenerImpl();
 
@@ -81,13 +145,142 @@ public:
     DDS::DataReader_ptr reader,
     const DDS::SampleLostStatus& status);
 
+  /**
+   * Start (or complete) a transfer session from its TransferOpen header
+   * Called by TransferOpenListenerImpl; chunks received earlier for the
+   * session are applied now
+   * @param open Session header
+   */
+  void open_transfer(const TransferOpen& open);
+
+  /**
+   * Start a session whose chunks this participant requests itself
+   * Called by SwarmDownloader before sending the session's ChunkRequests.
+   * Chunks may come from several peers, so the end of any one peer's chunk
+   * instance does not end the session; it ends when complete or aborted
+   * @param open Session header (not published)
+   * @return false if a pushed transfer of the file is in progress
+   */
+  bool open_pull_transfer(const TransferOpen& open);
+
+  /**
+   * Discard an unfinished session
+   * @param session_id Session id
+   */
+  void abort_transfer(uint64_t session_id);
+
+  /**
+   * Report chunk arrivals and closed sessions (optional)
+   * @param observer Observer, or 0 to disable (not owned)
+   */
+  void set_observer(ChunkReceiptObserver* observer);
+
+  /**
+   * Drop transfers for files matched by the local ignore patterns
+   * Must be set before the reader is created
+   * @param ignore Compiled ignore patterns, or 0 for none (not owned)
+   */
+  void set_ignore_matcher(const IgnoreMatcher* ignore);
+
+  /**
+   * Drop transfers of files this participant does not subscribe to
+   * The DDS content filter can let through a few of them (see SyncFilter).
+   * Must be set before the reader is created
+   * @param filter Selective sync filter, or 0 for all files (not owned)
+   */
+  void set_sync_filter(const SyncFilter* filter);
+
+  /**
+   * Report each applied change (must be set before the reader is created)
+   * @param observer Observer, or 0 for none (not owned)
+   */
+  void set_remote_change_observer(RemoteChangeObserver* observer);
+
+  /**
+   * Process a chunk (data or repair) of an FEC session
+   * Called by FecChunkListenerImpl; lost data chunks of a group are
+   * reconstructed once enough of its chunks have arrived
+   * @param chunk Received FEC chunk
+   */
+  void process_fec_chunk(const FecChunk& chunk);
+
+  /**
+   * Process a chunk of a session (FileChunk or ChunkReply)
+   * Called for each valid sample taken by on_data_available(), and
+   * directly by dirshare-replay
+   * @param chunk Received chunk
+   */
+  void process_chunk(const FileChunk& chunk);
+
+  /**
+   * The sender ended a session's chunk instance (dispose or unregister)
+   * An incomplete session is discarded
+   * @param session_id Session id
+   */
+  void end_transfer(uint64_t session_id);
+
+  /**
+   * The sender disposed a session's TransferOpen instance
+   * Ends FEC sessions, whose best-effort chunk dispose may be lost, after
+   * a grace period for the FecChunks still in flight (see expire_transfers())
+   * @param session_id Session id
+   */
+  void transfer_open_disposed(uint64_t session_id);
+
+  /**
+   * Discard the incomplete FEC sessions whose grace period after the
+   * TransferOpen dispose has passed, and the early chunks of sessions
+   * whose TransferOpen has not arrived in 30 seconds
+   * Called periodically by the owner (SyncNode on each directory scan)
+   * @param now Monotonic time
+   */
+  void expire_transfers(const ACE_Time_Value& now);
+
 private:
   std::string shared_dir_;
   FileChangeTracker& change_tracker_;  // Reference to shared tracker for loop prevention
-  std::map<std::string, ChunkedFile> reassembly_buffer_;
+  ContentIndex& content_index_;        // Local content index, refreshed after writes
+  std::map<uint64_t, ChunkedFile> reassembly_buffer_;      // Keyed by session id
+  std::map<std::string, uint64_t> active_transfers_;       // Filename -> session id
+  std::set<uint64_t> closed_sessions_;                     // Recently finished sessions
+  std::deque<uint64_t> closed_order_;                      // ... oldest first
+  ChunkReceiptObserver* observer_;
+  const IgnoreMatcher* ignore_;        // Optional ignore patterns (not owned)
+  const SyncFilter* sync_filter_;      // Optional selective sync filter (not owned)
+  RemoteChangeObserver* remote_change_observer_;  // Optional (not owned)
+  TopicCounters received_;             // FileChunks and ChunkReplies
+  Gauge& reassembly_bytes_;            // Data chunks buffered by open sessions
+  Gauge& transfers_active_;            // Open sessions (active_transfers_)
+  Histogram& apply_duration_;
+  LatencyRecorder latency_;
+  Counter& checksum_errors_;
+  Counter& write_errors_;
+  Counter& transfer_errors_;
+  ACE_Thread_Mutex lock_;  // TransferOpen and FileChunk arrive on different readers
 
-  // Process received chunk
-  void process_chunk(const FileChunk& chunk);
+  // Start a session from its header (lock held)
+  void start_session(const TransferOpen& open, bool pulled);
+
+  // Place chunk data into an opened session
+  void apply_chunk(ChunkedFile& chunked_file,
+                   uint64_t offset,
+                   const uint8_t* data,
+                   uint32_t length);
+
+  // Place an FEC chunk into an opened session, decoding its group if possible
+  void apply_fec_chunk(ChunkedFile& chunked_file, const FecChunk& chunk);
+
+  // Whether every data chunk of an FEC group has been received
+  bool fec_group_complete(const ChunkedFile& chunked_file, uint32_t group) const;
+
+  // Rebuild the missing data chunks of an FEC group if k blocks are present
+  void recover_fec_group(ChunkedFile& chunked_file, uint32_t group);
+
+  // Finalize the session if complete, or discard it if it can no longer complete
+  void check_session(uint64_t session_id);
+
+  // Forget a session (and ignore its late samples)
+  void close_session(uint64_t session_id);
 
   // Finalize reassembled file
   void finalize_file(const std::string& filename, ChunkedFile& chunked_file);
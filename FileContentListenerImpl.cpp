@@ -1,16 +1,35 @@
 #include "FileContentListenerImpl.h"
 #include "FileUtils.h"
+#include "IgnoreMatcher.h"
+#include "SyncFilter.h"
 #include "Checksum.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Log.h"
 
 #include <ace/Log_Msg.h>
 #include <ace/OS_NS_sys_stat.h>
+#include <ace/OS_NS_sys_time.h>
 
 namespace DirShare {
 
 FileContentListenerImpl::FileContentListenerImpl(const std::string& shared_dir,
-                                                   FileChangeTracker& change_tracker)
+                                                   FileChangeTracker& change_tracker,
+                                                   ContentIndex& content_index)
   : shared_dir_(shared_dir)
   , change_tracker_(change_tracker)
+  , content_index_(content_index)
+  , ignore_(0)
+  , sync_filter_(0)
+  , remote_change_observer_(0)
+  , received_("received", "DirShare_FileContent")
+  , apply_duration_(MetricsRegistry::instance().histogram(
+      "dirshare_apply_duration_seconds",
+      "Time to verify and write a received file", 1e-6, "path=\"content\""))
+  , latency_("content")
+  , checksum_errors_(receive_errors("checksum"))
+  , write_errors_(receive_errors("write"))
+  , transfer_errors_(receive_errors("transfer"))
 {
 }
 
@@ -18,6 +37,21 @@ FileContentListenerImpl::~FileContentListenerImpl()
 {
 }
 
+void FileContentListenerImpl::set_ignore_matcher(const IgnoreMatcher* ignore)
+{
+  ignore_ = ignore;
+}
+
+void FileContentListenerImpl::set_sync_filter(const SyncFilter* filter)
+{
+  sync_filter_ = filter;
+}
+
+void FileContentListenerImpl::set_remote_change_observer(RemoteChangeObserver* observer)
+{
+  remote_change_observer_ = observer;
+}
+
 void FileContentListenerImpl::on_requested_deadline_missed(
   DDS::DataReader_ptr,
   const DDS::RequestedDeadlineMissedStatus&)
@@ -73,11 +107,6 @@ void FileContentListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 
   if (status == DDS::RETCODE_OK) {
     if (info.valid_data) {
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) Received FileContent: %C (%Q bytes)\n"),
-                 content.filename.in(),
-                 content.size));
-
       process_file_content(content);
     }
   } else if (status != DDS::RETCODE_NO_DATA) {
@@ -90,11 +119,34 @@ void FileContentListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 
 void FileContentListenerImpl::process_file_content(const FileContent& content)
 {
+  const ACE_Time_Value received = ACE_OS::gettimeofday();
   std::string filename = content.filename.in();
+  TraceSpan span("receive", "process_file_content", filename.c_str());
+  SampleCapture::instance().record(content);
+
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Received FileContent: %s (%llu bytes)\n",
+                       filename.c_str(),
+                       static_cast<unsigned long long>(content.size)));
+  received_.sample(content.data.length());
+
+  // Ignored locally (.dirshareignore)
+  if (ignore_ && ignore_->ignored(filename)) {
+    DIRSHARE_DEBUG(("Ignoring FileContent for %s\n", filename.c_str()));
+    return;
+  }
+
+  // Not subscribed to by this participant (selective sync)
+  if (sync_filter_ && !sync_filter_->matches(filename, content.size)) {
+    DIRSHARE_DEBUG(("Not subscribed to %s, dropping its FileContent\n", filename.c_str()));
+    return;
+  }
+
   std::string full_path = shared_dir_ + "/" + filename;
 
   // Check if file exists and compare timestamps for MODIFY case
-  if (file_exists(full_path)) {
+  const bool existed = file_exists(full_path);
+  if (existed) {
     unsigned long long local_timestamp_sec;
     unsigned long local_timestamp_nsec;
     if (get_file_mtime(full_path, local_timestamp_sec, local_timestamp_nsec)) {
@@ -107,21 +159,29 @@ void FileContentListenerImpl::process_file_content(const FileContent& content)
         remote_is_newer = true;
       }
 
-      if (!remote_is_newer) {
-        ACE_DEBUG((LM_INFO,
-                   ACE_TEXT("(%P|%t) Local file is newer or same, ignoring FileContent for: %C\n"),
-                   filename.c_str()));
+      // A local copy made for this transfer carries its timestamp, but
+      // stays a stand-in until compared with the received bytes below
+      const bool pending_copy =
+        content.timestamp_sec == local_timestamp_sec &&
+        content.timestamp_nsec == local_timestamp_nsec &&
+        content_index_.unverified(filename);
+
+      if (!remote_is_newer && !pending_copy) {
+        DIRSHARE_INFO_EVERY(filename.c_str(),
+                            ("Local file is newer or same, ignoring FileContent for: %s\n",
+                             filename.c_str()));
         // Resume notifications even when rejecting update (SC-011: prevent permanent suppression)
         change_tracker_.resume_notifications(filename);
         return;
       }
 
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) Remote file is newer, updating local file: %C\n"),
-                 filename.c_str()));
+      DIRSHARE_INFO_EVERY(filename.c_str(),
+                          ("Remote file is newer, updating local file: %s\n", filename.c_str()));
     }
   }
 
+  const ACE_Time_Value apply_start = ACE_OS::gettimeofday();
+
   // Validate metadata: size matches actual data length
   if (content.size != content.data.length()) {
     ACE_ERROR((LM_ERROR,
@@ -130,13 +190,16 @@ void FileContentListenerImpl::process_file_content(const FileContent& content)
                filename.c_str(),
                content.size,
                content.data.length()));
+    transfer_errors_.increment();
     // Resume notifications on error (SC-011: prevent permanent suppression)
     change_tracker_.resume_notifications(filename);
     return;
   }
 
   // Verify checksum
+  const ACE_Time_Value verify_start = monotonic_now();
   if (content.data.length() > 0) {
+    TraceSpan verify_span("receive", "compute_checksum", filename.c_str());
     uint32_t computed_checksum = compute_checksum(
       reinterpret_cast<const uint8_t*>(content.data.get_buffer()),
       content.data.length());
@@ -148,30 +211,49 @@ void FileContentListenerImpl::process_file_content(const FileContent& content)
                  filename.c_str(),
                  content.checksum,
                  computed_checksum));
+      checksum_errors_.increment();
       // Resume notifications on error (SC-011: prevent permanent suppression)
       change_tracker_.resume_notifications(filename);
       return;
     }
   }
 
-  // Write file content
-  if (!write_file(full_path,
+  const ACE_Time_Value write_start = monotonic_now();
+  const ACE_Time_Value verify_time = write_start - verify_start;
+
+  // Identical bytes already on disk (e.g. materialized from a local copy):
+  // skip the rewrite and only apply the timestamp below. The index is only
+  // a hint (CRC32, possibly a scan old); the bytes themselves decide
+  FileExtent whole_file;
+  whole_file.offset = 0;
+  whole_file.length = content.data.length();
+  if (content_index_.contains(filename, content.size, content.checksum) &&
+      file_matches_image(full_path,
+                         reinterpret_cast<const uint8_t*>(content.data.get_buffer()),
+                         std::vector<FileExtent>(1, whole_file),
+                         content.size)) {
+    DIRSHARE_INFO(("Local file already holds this content, skipping write: %s\n",
+                   filename.c_str()));
+  } else if (!write_file(full_path,
                   reinterpret_cast<const uint8_t*>(content.data.get_buffer()),
                   content.data.length())) {
     ACE_ERROR((LM_ERROR,
                ACE_TEXT("ERROR: %N:%l: Failed to write file: %C\n"),
                full_path.c_str()));
+    write_errors_.increment();
     // Resume notifications on error (SC-011: prevent permanent suppression)
     change_tracker_.resume_notifications(filename);
     return;
   }
 
+  content_index_.update(filename, content.size, content.checksum);
+  content_index_.verified(filename);
+
   // Preserve timestamp
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Preserving timestamp for %C: %Q.%09u\n"),
-             filename.c_str(),
-             content.timestamp_sec,
-             content.timestamp_nsec));
+  DIRSHARE_DEBUG(("Preserving timestamp for %s: %llu.%09u\n",
+                  filename.c_str(),
+                  static_cast<unsigned long long>(content.timestamp_sec),
+                  static_cast<unsigned int>(content.timestamp_nsec)));
 
   if (!set_file_mtime(full_path, content.timestamp_sec, content.timestamp_nsec)) {
     ACE_ERROR((LM_WARNING,
@@ -183,27 +265,32 @@ void FileContentListenerImpl::process_file_content(const FileContent& content)
     unsigned long long verified_sec;
     unsigned long verified_nsec;
     if (get_file_mtime(full_path, verified_sec, verified_nsec)) {
-      ACE_DEBUG((LM_DEBUG,
-                 ACE_TEXT("(%P|%t) Timestamp preserved for %C: original=%Q.%09u, actual=%Q.%09u\n"),
-                 filename.c_str(),
-                 content.timestamp_sec,
-                 content.timestamp_nsec,
-                 verified_sec,
-                 verified_nsec));
+      DIRSHARE_DEBUG(("Timestamp preserved for %s: original=%llu.%09u, actual=%llu.%09u\n",
+                      filename.c_str(),
+                      static_cast<unsigned long long>(content.timestamp_sec),
+                      static_cast<unsigned int>(content.timestamp_nsec),
+                      verified_sec,
+                      static_cast<unsigned int>(verified_nsec)));
     }
   }
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Successfully wrote file: %C (%Q bytes, checksum: 0x%08X)\n"),
-             filename.c_str(),
-             content.size,
-             content.checksum));
+  apply_duration_.record(ACE_OS::gettimeofday() - apply_start);
+  latency_.record(filename, content.origin, received, verify_time,
+                  monotonic_now() - write_start);
+
+  DIRSHARE_INFO(("Successfully wrote file: %s (%llu bytes, checksum: 0x%08X)\n",
+                 filename.c_str(),
+                 static_cast<unsigned long long>(content.size),
+                 static_cast<unsigned int>(content.checksum)));
+
+  if (remote_change_observer_) {
+    remote_change_observer_->remote_change_applied(existed ? MODIFY : CREATE,
+                                                   filename, content.origin);
+  }
 
   // Resume notifications for this file (SC-011: prevent notification loop)
   change_tracker_.resume_notifications(filename);
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Resumed notifications for file: %C\n"),
-             filename.c_str()));
+  DIRSHARE_DEBUG(("Resumed notifications for file: %s\n", filename.c_str()));
 }
 
 } // namespace DirShare
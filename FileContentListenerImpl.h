@@ -2,7 +2,11 @@
 #define DIRSHARE_FILE_CONTENT_LISTENER_IMPL_H
 
 #include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
+#include "Latency.h"
 #include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "RemoteChangeObserver.h"
 
 #include <dds/DCPS/LocalObject.h>
 #include <dds/DdsDcpsSubscriptionC.h>
@@ -11,15 +15,48 @@
 
 namespace DirShare {
 
+class IgnoreMatcher;
+class SyncFilter;
+
 class FileContentListenerImpl
   : public virtual OpenDDS::DCPS::LocalObject<DDS::DataReaderListener>
 {
 public:
   explicit FileContentListenerImpl(const std::string& shared_dir,
-                                    FileChangeTracker& change_tracker);
+                                    FileChangeTracker& change_tracker,
+                                    ContentIndex& content_index);
 
   virtual ~FileContentListenerImpl();
 
+  /**
+   * Drop contents for files matched by the local ignore patterns
+   * Must be set before the reader is created
+   * @param ignore Compiled ignore patterns, or 0 for none (not owned)
+   */
+  void set_ignore_matcher(const IgnoreMatcher* ignore);
+
+  /**
+   * Drop contents for files this participant does not subscribe to
+   * The DDS content filter can let through a few of them (see SyncFilter).
+   * Must be set before the reader is created
+   * @param filter Selective sync filter, or 0 for all files (not owned)
+   */
+  void set_sync_filter(const SyncFilter* filter);
+
+  /**
+   * Report each applied change (must be set before the reader is created)
+   * @param observer Observer, or 0 for none (not owned)
+   */
+  void set_remote_change_observer(RemoteChangeObserver* observer);
+
+  /**
+   * Apply one received FileContent
+   * Called for each valid sample taken by on_data_available(), and
+   * directly by dirshare-replay
+   * @param content Received content
+   */
+  void process_file_content(const FileContent& content);
+
   virtual void on_requested_deadline_missed(
     DDS::DataReader_ptr reader,
     const DDS::RequestedDeadlineMissedStatus& status);
@@ -49,9 +86,16 @@ public:
 private:
   std::string shared_dir_;
   FileChangeTracker& change_tracker_;  // Reference to shared tracker for loop prevention
-
-  // Process received file content
-  void process_file_content(const FileContent& content);
+  ContentIndex& content_index_;        // Local content index, refreshed after writes
+  const IgnoreMatcher* ignore_;        // Optional ignore patterns (not owned)
+  const SyncFilter* sync_filter_;      // Optional selective sync filter (not owned)
+  RemoteChangeObserver* remote_change_observer_;  // Optional (not owned)
+  TopicCounters received_;
+  Histogram& apply_duration_;
+  LatencyRecorder latency_;
+  Counter& checksum_errors_;
+  Counter& write_errors_;
+  Counter& transfer_errors_;
 };
 
 } // namespace DirShare
@@ -1,7 +1,14 @@
 #include "FileEventListenerImpl.h"
 #include "FileUtils.h"
+#include "IgnoreMatcher.h"
+#include "SyncFilter.h"
+#include "Checksum.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Log.h"
 #include <ace/Log_Msg.h>
 #include <ace/OS_NS_string.h>
+#include <ace/OS_NS_sys_time.h>
 
 namespace DirShare {
 
@@ -9,11 +16,21 @@ FileEventListenerImpl::FileEventListenerImpl(
   const std::string& shared_directory,
   DDS::DataWriter_ptr content_writer,
   DDS::DataWriter_ptr chunk_writer,
-  FileChangeTracker& change_tracker)
+  FileChangeTracker& change_tracker,
+  ContentIndex& content_index)
   : shared_directory_(shared_directory)
   , content_writer_(DDS::DataWriter::_duplicate(content_writer))
   , chunk_writer_(DDS::DataWriter::_duplicate(chunk_writer))
   , change_tracker_(change_tracker)
+  , content_index_(content_index)
+  , ignore_(0)
+  , sync_filter_(0)
+  , remote_change_observer_(0)
+  , received_("received", "DirShare_FileEvents")
+  , delete_latency_("delete")
+  , clone_latency_("clone")
+  , write_errors_(receive_errors("write"))
+  , transfer_errors_(receive_errors("transfer"))
 {
 }
 
@@ -21,6 +38,21 @@ FileEventListenerImpl::~FileEventListenerImpl()
 {
 }
 
+void FileEventListenerImpl::set_ignore_matcher(const IgnoreMatcher* ignore)
+{
+  ignore_ = ignore;
+}
+
+void FileEventListenerImpl::set_sync_filter(const SyncFilter* filter)
+{
+  sync_filter_ = filter;
+}
+
+void FileEventListenerImpl::set_remote_change_observer(RemoteChangeObserver* observer)
+{
+  remote_change_observer_ = observer;
+}
+
 void FileEventListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 {
   FileEventDataReader_var event_reader = FileEventDataReader::_narrow(reader);
@@ -38,42 +70,7 @@ void FileEventListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 
   while (ret == DDS::RETCODE_OK) {
     if (info.valid_data) {
-      std::string filename = event.filename.in();
-
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) FileEvent received: %C (operation: %d)\n"),
-                 filename.c_str(),
-                 event.operation));
-
-      // Validate filename for security
-      if (!is_valid_filename(filename)) {
-        ACE_ERROR((LM_ERROR,
-                   ACE_TEXT("ERROR: %N:%l: Invalid filename detected: %C\n"),
-                   filename.c_str()));
-        ret = event_reader->take_next_sample(event, info);
-        continue;
-      }
-
-      // Dispatch based on operation type
-      switch (event.operation) {
-      case DirShare::CREATE:
-        handle_create_event(event);
-        break;
-
-      case DirShare::MODIFY:
-        handle_modify_event(event);
-        break;
-
-      case DirShare::DELETE:
-        handle_delete_event(event);
-        break;
-
-      default:
-        ACE_ERROR((LM_ERROR,
-                   ACE_TEXT("ERROR: %N:%l: Unknown operation type: %d\n"),
-                   event.operation));
-        break;
-      }
+      process_file_event(event);
     }
 
     ret = event_reader->take_next_sample(event, info);
@@ -87,20 +84,73 @@ void FileEventListenerImpl::on_data_available(DDS::DataReader_ptr reader)
   }
 }
 
+void FileEventListenerImpl::process_file_event(const FileEvent& event)
+{
+  std::string filename = event.filename.in();
+  TraceSpan span("receive", "handle FileEvent", filename.c_str());
+  SampleCapture::instance().record(event);
+
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("FileEvent received: %s (operation: %d)\n",
+                       filename.c_str(),
+                       static_cast<int>(event.operation)));
+  received_.sample();
+
+  // Validate filename for security
+  if (!is_valid_filename(filename)) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Invalid filename detected: %C\n"),
+               filename.c_str()));
+    transfer_errors_.increment();
+    return;
+  }
+
+  // Ignored locally (.dirshareignore)
+  if (ignore_ && ignore_->ignored(filename)) {
+    DIRSHARE_DEBUG(("Ignoring FileEvent for %s\n", filename.c_str()));
+    return;
+  }
+
+  // Not subscribed to by this participant (selective sync)
+  if (sync_filter_ && !sync_filter_->matches(filename, event.metadata.size)) {
+    DIRSHARE_DEBUG(("Not subscribed to %s, dropping its FileEvent\n", filename.c_str()));
+    return;
+  }
+
+  // Dispatch based on operation type
+  switch (event.operation) {
+  case DirShare::CREATE:
+    handle_create_event(event);
+    break;
+
+  case DirShare::MODIFY:
+    handle_modify_event(event);
+    break;
+
+  case DirShare::DELETE:
+    handle_delete_event(event);
+    break;
+
+  default:
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: Unknown operation type: %d\n"),
+               event.operation));
+    break;
+  }
+}
+
 void FileEventListenerImpl::handle_create_event(const FileEvent& event)
 {
   std::string filename = event.filename.in();
   std::string full_path = shared_directory_ + "/" + filename;
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Handling CREATE event for: %C\n"),
-             filename.c_str()));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Handling CREATE event for: %s\n", filename.c_str()));
 
   // Check if file already exists locally
   if (file_exists(full_path)) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) File already exists locally, skipping: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("File already exists locally, skipping: %s\n", filename.c_str()));
     return;
   }
 
@@ -108,15 +158,15 @@ void FileEventListenerImpl::handle_create_event(const FileEvent& event)
   // This prevents FileMonitor from republishing a CREATE event when the remote
   // file content arrives and is written to disk
   change_tracker_.suppress_notifications(filename);
-  ACE_DEBUG((LM_DEBUG,
-             ACE_TEXT("(%P|%t) Suppressed notifications for incoming file: %C\n"),
-             filename.c_str()));
+  DIRSHARE_DEBUG(("Suppressed notifications for incoming file: %s\n", filename.c_str()));
+
+  // Content we already hold under another name is cloned locally
+  materialize_local_copy(event);
 
   // File will be received via FileContent or FileChunk topic
   // The listener will handle writing the file when content arrives
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Waiting for file content to arrive for: %C\n"),
-             filename.c_str()));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Waiting for file content to arrive for: %s\n", filename.c_str()));
 }
 
 void FileEventListenerImpl::handle_modify_event(const FileEvent& event)
@@ -124,21 +174,20 @@ void FileEventListenerImpl::handle_modify_event(const FileEvent& event)
   std::string filename = event.filename.in();
   std::string full_path = shared_directory_ + "/" + filename;
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Handling MODIFY event for: %C\n"),
-             filename.c_str()));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Handling MODIFY event for: %s\n", filename.c_str()));
 
   // Check if file exists locally
   if (!file_exists(full_path)) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Local file does not exist, treating MODIFY as CREATE: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("Local file does not exist, treating MODIFY as CREATE: %s\n",
+                         filename.c_str()));
     // Suppress notifications (SC-011: prevent notification loop)
     // File will be received via FileContent or FileChunk topic
     change_tracker_.suppress_notifications(filename);
-    ACE_DEBUG((LM_DEBUG,
-               ACE_TEXT("(%P|%t) Suppressed notifications for incoming MODIFY (treated as CREATE): %C\n"),
-               filename.c_str()));
+    DIRSHARE_DEBUG(("Suppressed notifications for incoming MODIFY (treated as CREATE): %s\n",
+                    filename.c_str()));
+    materialize_local_copy(event);
     return;
   }
 
@@ -156,13 +205,11 @@ void FileEventListenerImpl::handle_modify_event(const FileEvent& event)
   unsigned long long remote_timestamp_sec = event.metadata.timestamp_sec;
   unsigned long remote_timestamp_nsec = event.metadata.timestamp_nsec;
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Timestamp comparison for %C:\n")
-             ACE_TEXT("  Local:  %Q.%09u\n")
-             ACE_TEXT("  Remote: %Q.%09u\n"),
-             filename.c_str(),
-             local_timestamp_sec, local_timestamp_nsec,
-             remote_timestamp_sec, remote_timestamp_nsec));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Timestamp comparison for %s: local %llu.%09lu, remote %llu.%09lu\n",
+                       filename.c_str(),
+                       local_timestamp_sec, local_timestamp_nsec,
+                       remote_timestamp_sec, remote_timestamp_nsec));
 
   // Check if remote file is newer
   bool remote_is_newer = false;
@@ -174,40 +221,38 @@ void FileEventListenerImpl::handle_modify_event(const FileEvent& event)
   }
 
   if (remote_is_newer) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Remote file is newer, accepting MODIFY for: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("Remote file is newer, accepting MODIFY for: %s\n", filename.c_str()));
     // Suppress notifications (SC-011: prevent notification loop)
     // This prevents FileMonitor from republishing a MODIFY event when the remote
     // file content arrives and overwrites the local file
     change_tracker_.suppress_notifications(filename);
-    ACE_DEBUG((LM_DEBUG,
-               ACE_TEXT("(%P|%t) Suppressed notifications for incoming MODIFY: %C\n"),
-               filename.c_str()));
+    DIRSHARE_DEBUG(("Suppressed notifications for incoming MODIFY: %s\n", filename.c_str()));
+    materialize_local_copy(event);
     // File will be received via FileContent or FileChunk topic
     // The listener will overwrite the local file
   } else {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Local file is newer or same, ignoring MODIFY for: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("Local file is newer or same, ignoring MODIFY for: %s\n",
+                         filename.c_str()));
     // Ignore this modification event - local version wins
   }
 }
 
 void FileEventListenerImpl::handle_delete_event(const FileEvent& event)
 {
+  const ACE_Time_Value received = ACE_OS::gettimeofday();
   std::string filename = event.filename.in();
   std::string full_path = shared_directory_ + "/" + filename;
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Handling DELETE event for: %C\n"),
-             filename.c_str()));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Handling DELETE event for: %s\n", filename.c_str()));
 
   // Check if file exists locally
   if (!file_exists(full_path)) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) File does not exist locally, nothing to delete: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("File does not exist locally, nothing to delete: %s\n",
+                         filename.c_str()));
     return;
   }
 
@@ -225,13 +270,12 @@ void FileEventListenerImpl::handle_delete_event(const FileEvent& event)
   unsigned long long remote_timestamp_sec = event.timestamp_sec;
   unsigned long remote_timestamp_nsec = event.timestamp_nsec;
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Timestamp comparison for DELETE of %C:\n")
-             ACE_TEXT("  Local file:  %Q.%09u\n")
-             ACE_TEXT("  Remote DELETE: %Q.%09u\n"),
-             filename.c_str(),
-             local_timestamp_sec, local_timestamp_nsec,
-             remote_timestamp_sec, remote_timestamp_nsec));
+  DIRSHARE_INFO_EVERY(filename.c_str(),
+                      ("Timestamp comparison for DELETE of %s: local file %llu.%09lu, "
+                       "remote DELETE %llu.%09lu\n",
+                       filename.c_str(),
+                       local_timestamp_sec, local_timestamp_nsec,
+                       remote_timestamp_sec, remote_timestamp_nsec));
 
   // Check if remote delete is newer than local file
   // This implements last-write-wins: delete only if DELETE timestamp > local file timestamp
@@ -244,44 +288,99 @@ void FileEventListenerImpl::handle_delete_event(const FileEvent& event)
   }
 
   if (delete_is_newer) {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Remote DELETE is newer, deleting local file: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO(("Remote DELETE is newer, deleting local file: %s\n", filename.c_str()));
 
     // SC-011: Suppress notifications before deleting
     // This prevents FileMonitor from republishing a DELETE event
     change_tracker_.suppress_notifications(filename);
-    ACE_DEBUG((LM_DEBUG,
-               ACE_TEXT("(%P|%t) Suppressed notifications for DELETE: %C\n"),
-               filename.c_str()));
+    DIRSHARE_DEBUG(("Suppressed notifications for DELETE: %s\n", filename.c_str()));
 
     // Delete the local file
+    const ACE_Time_Value write_start = monotonic_now();
     if (!delete_file(full_path)) {
       ACE_ERROR((LM_ERROR,
                  ACE_TEXT("ERROR: %N:%l: Failed to delete file: %C\n"),
                  full_path.c_str()));
+      write_errors_.increment();
       // Resume notifications even on failure to prevent stuck suppression
       change_tracker_.resume_notifications(filename);
       return;
     }
 
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Successfully deleted file: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO(("Successfully deleted file: %s\n", filename.c_str()));
+    content_index_.remove(filename);
+    delete_latency_.record(filename, event.origin, received,
+                           ACE_Time_Value::zero, monotonic_now() - write_start);
+
+    if (remote_change_observer_) {
+      remote_change_observer_->remote_change_applied(DELETE, filename, event.origin);
+    }
 
     // Resume notifications after successful deletion
     change_tracker_.resume_notifications(filename);
-    ACE_DEBUG((LM_DEBUG,
-               ACE_TEXT("(%P|%t) Resumed notifications after DELETE: %C\n"),
-               filename.c_str()));
+    DIRSHARE_DEBUG(("Resumed notifications after DELETE: %s\n", filename.c_str()));
   } else {
-    ACE_DEBUG((LM_INFO,
-               ACE_TEXT("(%P|%t) Local file is newer than DELETE event, ignoring deletion for: %C\n"),
-               filename.c_str()));
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("Local file is newer than DELETE event, ignoring deletion for: %s\n",
+                         filename.c_str()));
     // Ignore this delete event - local version wins (last-write-wins conflict resolution)
   }
 }
 
+bool FileEventListenerImpl::materialize_local_copy(const FileEvent& event)
+{
+  const ACE_Time_Value received = ACE_OS::gettimeofday();
+  std::string filename = event.filename.in();
+
+  std::string source;
+  if (event.metadata.size == 0 ||
+      !content_index_.find(event.metadata.size, event.metadata.checksum,
+                           filename, source)) {
+    return false;
+  }
+
+  std::string source_path = shared_directory_ + "/" + source;
+  std::string full_path = shared_directory_ + "/" + filename;
+
+  // The index may be one scan behind; confirm the source still matches
+  const ACE_Time_Value verify_start = monotonic_now();
+  unsigned long source_checksum;
+  if (!calculate_file_crc32(source_path.c_str(), source_checksum) ||
+      source_checksum != event.metadata.checksum) {
+    content_index_.remove(source);
+    return false;
+  }
+
+  const ACE_Time_Value write_start = monotonic_now();
+  if (!clone_file(source_path, full_path)) {
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Failed to materialize %C from local copy %C\n"),
+               filename.c_str(),
+               source.c_str()));
+    // clone_file() left any existing file untouched; the transfer will write it
+    return false;
+  }
+
+  if (!set_file_mtime(full_path, event.metadata.timestamp_sec, event.metadata.timestamp_nsec)) {
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Failed to set timestamp for file: %C\n"),
+               full_path.c_str()));
+  }
+
+  // Only (size, CRC32) matched so far: the listener that receives the
+  // data compares it with the clone before it skips the write
+  content_index_.update(filename, event.metadata.size, event.metadata.checksum);
+  content_index_.mark_unverified(filename);
+  clone_latency_.record(filename, event.origin, received,
+                        write_start - verify_start, monotonic_now() - write_start);
+
+  DIRSHARE_INFO(("Materialized %s from local copy %s (%llu bytes) ahead of its transfer\n",
+                 filename.c_str(),
+                 source.c_str(),
+                 static_cast<unsigned long long>(event.metadata.size)));
+  return true;
+}
+
 bool FileEventListenerImpl::is_valid_filename(const std::string& filename) const
 {
   // Reject empty filenames
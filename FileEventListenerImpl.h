@@ -2,13 +2,20 @@
 #define DIRSHARE_FILEEVENTLISTENERIMPL_H
 
 #include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
+#include "Latency.h"
 #include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "RemoteChangeObserver.h"
 #include <dds/DdsDcpsSubscriptionC.h>
 #include <dds/DCPS/LocalObject.h>
 #include <string>
 
 namespace DirShare {
 
+class IgnoreMatcher;
+class SyncFilter;
+
 /**
  * FileEventListenerImpl: Listener for FileEvent topic
  * Handles CREATE, MODIFY, and DELETE events from remote participants
@@ -24,14 +31,45 @@ public:
    * @param content_writer DataWriter for requesting FileContent
    * @param chunk_writer DataWriter for requesting FileChunks
    * @param change_tracker Reference to FileChangeTracker for loop prevention
+   * @param content_index Reference to local ContentIndex for local materialization
    */
   FileEventListenerImpl(const std::string& shared_directory,
                         DDS::DataWriter_ptr content_writer,
                         DDS::DataWriter_ptr chunk_writer,
-                        FileChangeTracker& change_tracker);
+                        FileChangeTracker& change_tracker,
+                        ContentIndex& content_index);
 
   virtual ~FileEventListenerImpl();
 
+  /**
+   * Drop events for files matched by the local ignore patterns
+   * Must be set before the reader is created
+   * @param ignore Compiled ignore patterns, or 0 for none (not owned)
+   */
+  void set_ignore_matcher(const IgnoreMatcher* ignore);
+
+  /**
+   * Drop events for files this participant does not subscribe to
+   * The DDS content filter can let through a few of them (see SyncFilter).
+   * Must be set before the reader is created
+   * @param filter Selective sync filter, or 0 for all files (not owned)
+   */
+  void set_sync_filter(const SyncFilter* filter);
+
+  /**
+   * Report each applied change (must be set before the reader is created)
+   * @param observer Observer, or 0 for none (not owned)
+   */
+  void set_remote_change_observer(RemoteChangeObserver* observer);
+
+  /**
+   * Handle one received FileEvent
+   * Called for each valid sample taken by on_data_available(), and
+   * directly by dirshare-replay
+   * @param event Received event
+   */
+  void process_file_event(const FileEvent& event);
+
   // DDS DataReaderListener callbacks
   virtual void on_data_available(DDS::DataReader_ptr reader);
 
@@ -64,6 +102,15 @@ private:
   DDS::DataWriter_var content_writer_;
   DDS::DataWriter_var chunk_writer_;
   FileChangeTracker& change_tracker_;  // Reference to shared tracker for loop prevention
+  ContentIndex& content_index_;        // Local content index for materialization
+  const IgnoreMatcher* ignore_;        // Optional ignore patterns (not owned)
+  const SyncFilter* sync_filter_;      // Optional selective sync filter (not owned)
+  RemoteChangeObserver* remote_change_observer_;  // Optional (not owned)
+  TopicCounters received_;
+  LatencyRecorder delete_latency_;     // DELETE applied
+  LatencyRecorder clone_latency_;      // Content cloned from a local copy
+  Counter& write_errors_;
+  Counter& transfer_errors_;
 
   /**
    * Handle CREATE event - trigger file transfer
@@ -80,6 +127,18 @@ private:
    */
   void handle_delete_event(const FileEvent& event);
 
+  /**
+   * Materialize incoming content from a local file holding the same bytes
+   * Clones (reflink where supported) the local copy into place and applies
+   * the remote timestamp, so the subsequent FileContent/FileChunk transfer
+   * is recognized as already applied instead of being written again.
+   * That transfer still arrives in full: only (size, CRC32) matched, so
+   * its bytes are what verifies the clone.
+   * Must be called with notifications for the file already suppressed.
+   * @return true if the file was materialized locally
+   */
+  bool materialize_local_copy(const FileEvent& event);
+
   /**
    * Validate filename for security (no path traversal)
    */
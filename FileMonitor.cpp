@@ -1,8 +1,11 @@
 #include "FileMonitor.h"
 #include "Checksum.h"
 #include "FileUtils.h"
+#include "Trace.h"
+#include "Log.h"
 #include <ace/Guard_T.h>
 #include <ace/Log_Msg.h>
+#include <ace/OS_NS_sys_time.h>
 
 namespace DirShare {
 
@@ -12,6 +15,21 @@ FileMonitor::FileMonitor(const std::string& directory_path,
   : directory_path_(directory_path)
   , fail_silently_(fail_silently)
   , change_tracker_(change_tracker)
+  , content_index_(0)
+  , ignore_(0)
+  , scan_duration_(MetricsRegistry::instance().histogram(
+      "dirshare_scan_duration_seconds", "Duration of directory scans", 1e-6))
+  , files_scanned_(MetricsRegistry::instance().counter(
+      "dirshare_files_scanned_total", "Files examined by directory scans"))
+  , files_(MetricsRegistry::instance().gauge(
+      "dirshare_files", "Files in the shared directory at the last scan"))
+  , checksum_duration_(MetricsRegistry::instance().histogram(
+      "dirshare_checksum_duration_seconds", "Time to checksum one file", 1e-6))
+  , checksum_bytes_(MetricsRegistry::instance().counter(
+      "dirshare_checksum_bytes_total", "Bytes read to checksum files"))
+  , suppressed_changes_(MetricsRegistry::instance().counter(
+      "dirshare_suppressed_changes_total",
+      "Local changes not published because a remote update was being applied"))
 {
   // Verify directory exists
   if (!is_directory(directory_path_)) {
@@ -33,6 +51,8 @@ bool FileMonitor::scan_for_changes(
   std::vector<std::string>& deleted_files)
 {
   ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  TraceSpan span("scan", "scan_for_changes");
+  const ACE_Time_Value scan_start = ACE_OS::gettimeofday();
 
   created_files.clear();
   modified_files.clear();
@@ -40,7 +60,7 @@ bool FileMonitor::scan_for_changes(
 
   // Get current list of files
   std::vector<std::string> current_files;
-  if (!list_directory_files(directory_path_, current_files)) {
+  if (!list_directory_files(directory_path_, current_files, ignore_)) {
     ACE_ERROR((LM_ERROR,
                ACE_TEXT("ERROR: %N:%l: Failed to list directory: %C\n"),
                directory_path_.c_str()));
@@ -62,13 +82,32 @@ bool FileMonitor::scan_for_changes(
       continue;
     }
 
-    if (!calculate_file_checksum(full_path, state.checksum)) {
+    if (!calculate_file_checksum(full_path, state.size, state.checksum)) {
       continue;
     }
 
     current_state[filename] = state;
   }
 
+  // Keep the local content index current for the receive path
+  if (content_index_) {
+    for (std::map<std::string, FileState>::const_iterator it = current_state.begin();
+         it != current_state.end(); ++it) {
+      std::map<std::string, FileState>::const_iterator prev_it = previous_state_.find(it->first);
+      if (prev_it == previous_state_.end() ||
+          prev_it->second.size != it->second.size ||
+          prev_it->second.checksum != it->second.checksum) {
+        content_index_->update(it->first, it->second.size, it->second.checksum);
+      }
+    }
+    for (std::map<std::string, FileState>::const_iterator it = previous_state_.begin();
+         it != previous_state_.end(); ++it) {
+      if (current_state.find(it->first) == current_state.end()) {
+        content_index_->remove(it->first);
+      }
+    }
+  }
+
   // Detect created and modified files
   for (std::map<std::string, FileState>::const_iterator it = current_state.begin();
        it != current_state.end(); ++it) {
@@ -78,9 +117,10 @@ bool FileMonitor::scan_for_changes(
     // SC-011: Check if notifications are suppressed for this file
     // If true, this change came from a remote source and should NOT be republished
     if (change_tracker_.is_suppressed(filename)) {
-      ACE_DEBUG((LM_DEBUG,
-                ACE_TEXT("FileMonitor: Skipping suppressed file '%C' (remote update in progress)\n"),
-                filename.c_str()));
+      DIRSHARE_DEBUG_EVERY(filename.c_str(),
+                           ("FileMonitor: Skipping suppressed file '%s' (remote update in progress)\n",
+                            filename.c_str()));
+      suppressed_changes_.increment();
       continue;  // Skip this file - it's being updated from remote
     }
 
@@ -107,9 +147,10 @@ bool FileMonitor::scan_for_changes(
 
     // SC-011: Check if notifications are suppressed for this file
     if (change_tracker_.is_suppressed(filename)) {
-      ACE_DEBUG((LM_DEBUG,
-                ACE_TEXT("FileMonitor: Skipping suppressed file '%C' for DELETE detection (remote update in progress)\n"),
-                filename.c_str()));
+      DIRSHARE_DEBUG_EVERY(filename.c_str(),
+                           ("FileMonitor: Skipping suppressed file '%s' for DELETE detection (remote update in progress)\n",
+                            filename.c_str()));
+      suppressed_changes_.increment();
       continue;  // Skip this file - it's being deleted from remote
     }
 
@@ -119,20 +160,54 @@ bool FileMonitor::scan_for_changes(
     }
   }
 
+  // Fold the differences into the directory summary. Files written by
+  // peers count too: the digest describes the content, whoever wrote it.
+  const uint64_t digest = summary_.digest;
+  for (std::map<std::string, FileState>::const_iterator it = current_state.begin();
+       it != current_state.end(); ++it) {
+    std::map<std::string, FileState>::const_iterator prev_it = previous_state_.find(it->first);
+    if (prev_it != previous_state_.end()) {
+      if (prev_it->second.size == it->second.size &&
+          prev_it->second.checksum == it->second.checksum) {
+        continue;
+      }
+      summary_.remove(it->first, prev_it->second.size,
+                      static_cast<uint32_t>(prev_it->second.checksum));
+    }
+    summary_.add(it->first, it->second.size, static_cast<uint32_t>(it->second.checksum));
+  }
+  for (std::map<std::string, FileState>::const_iterator it = previous_state_.begin();
+       it != previous_state_.end(); ++it) {
+    if (current_state.find(it->first) == current_state.end()) {
+      summary_.remove(it->first, it->second.size, static_cast<uint32_t>(it->second.checksum));
+    }
+  }
+  if (summary_.digest != digest) {
+    summary_.digest_changed = scan_start;
+  }
+  if (!created_files.empty() || !modified_files.empty() || !deleted_files.empty()) {
+    summary_.local_change = scan_start;
+  }
+
   // Update previous state for next scan
   previous_state_ = current_state;
 
+  files_scanned_.increment(static_cast<unsigned long>(current_files.size()));
+  files_.set(static_cast<long>(current_state.size()));
+  scan_duration_.record(ACE_OS::gettimeofday() - scan_start);
+
   return true;
 }
 
 std::vector<FileMetadata> FileMonitor::get_all_files()
 {
   ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  TraceSpan span("scan", "get_all_files");
 
   std::vector<FileMetadata> result;
   std::vector<std::string> files;
 
-  if (!list_directory_files(directory_path_, files)) {
+  if (!list_directory_files(directory_path_, files, ignore_)) {
     ACE_ERROR((LM_ERROR,
                ACE_TEXT("ERROR: %N:%l: Failed to list directory: %C\n"),
                directory_path_.c_str()));
@@ -143,6 +218,9 @@ std::vector<FileMetadata> FileMonitor::get_all_files()
     FileMetadata metadata;
     if (get_file_metadata(files[i], metadata)) {
       result.push_back(metadata);
+      if (content_index_) {
+        content_index_->update(files[i], metadata.size, metadata.checksum);
+      }
     }
   }
 
@@ -172,7 +250,7 @@ bool FileMonitor::get_file_metadata(const std::string& filename, FileMetadata& m
   metadata.timestamp_nsec = static_cast<CORBA::ULong>(timestamp_nsec);
 
   unsigned long checksum;
-  if (!calculate_file_checksum(full_path, checksum)) {
+  if (!calculate_file_checksum(full_path, metadata.size, checksum)) {
     return false;
   }
   metadata.checksum = static_cast<CORBA::ULong>(checksum);
@@ -180,6 +258,66 @@ bool FileMonitor::get_file_metadata(const std::string& filename, FileMetadata& m
   return true;
 }
 
+bool FileMonitor::record_remote_change(const std::string& filename, FileMetadata& metadata)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+
+  const bool exists = get_file_metadata(filename, metadata);
+  if (ignore_ && ignore_->ignored(filename)) {
+    return exists;  // Never part of a scan
+  }
+
+  const uint64_t digest = summary_.digest;
+  std::map<std::string, FileState>::iterator prev_it = previous_state_.find(filename);
+  if (prev_it != previous_state_.end()) {
+    summary_.remove(filename, prev_it->second.size,
+                    static_cast<uint32_t>(prev_it->second.checksum));
+    previous_state_.erase(prev_it);
+  }
+
+  if (exists) {
+    FileState state;
+    state.size = metadata.size;
+    state.timestamp_sec = metadata.timestamp_sec;
+    state.timestamp_nsec = metadata.timestamp_nsec;
+    state.checksum = metadata.checksum;
+    previous_state_[filename] = state;
+    summary_.add(filename, state.size, static_cast<uint32_t>(state.checksum));
+  }
+
+  if (content_index_) {
+    if (exists) {
+      content_index_->update(filename, metadata.size, metadata.checksum);
+    } else {
+      content_index_->remove(filename);
+    }
+  }
+
+  if (summary_.digest != digest) {
+    summary_.digest_changed = ACE_OS::gettimeofday();
+  }
+  files_.set(static_cast<long>(previous_state_.size()));
+  return exists;
+}
+
+void FileMonitor::summarize(DirectorySummary& summary)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  summary = summary_;
+}
+
+void FileMonitor::set_content_index(ContentIndex* content_index)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  content_index_ = content_index;
+}
+
+void FileMonitor::set_ignore_matcher(const IgnoreMatcher* ignore)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(mutex_);
+  ignore_ = ignore;
+}
+
 std::string FileMonitor::build_path(const std::string& filename) const
 {
   // Simple path concatenation (assumes directory_path_ ends without separator)
@@ -191,9 +329,18 @@ std::string FileMonitor::build_path(const std::string& filename) const
   return path;
 }
 
-bool FileMonitor::calculate_file_checksum(const std::string& full_path, unsigned long& checksum)
+bool FileMonitor::calculate_file_checksum(const std::string& full_path,
+                                          unsigned long long size,
+                                          unsigned long& checksum)
 {
-  return calculate_file_crc32(full_path.c_str(), checksum);
+  TraceSpan span("scan", "calculate_file_crc32", trace_detail(full_path));
+  const ACE_Time_Value start = ACE_OS::gettimeofday();
+  if (!calculate_file_crc32(full_path.c_str(), checksum)) {
+    return false;
+  }
+  checksum_duration_.record(ACE_OS::gettimeofday() - start);
+  checksum_bytes_.increment(static_cast<unsigned long>(size));
+  return true;
 }
 
 bool FileMonitor::get_modification_time(const std::string& full_path,
@@ -3,6 +3,10 @@
 
 #include "DirShareTypeSupportImpl.h"
 #include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "IgnoreMatcher.h"
+#include "Metrics.h"
+#include "Stats.h"
 #include <ace/Thread_Mutex.h>
 #include <map>
 #include <string>
@@ -59,6 +63,37 @@ public:
    */
   bool get_file_metadata(const std::string& filename, FileMetadata& metadata);
 
+  /**
+   * Take a file as already seen in its current state, after a change from
+   * a peer was applied to it, so that no later scan reports the change as
+   * local. Call it before the file's notifications resume.
+   * @param filename Filename relative to monitored directory
+   * @param metadata Output: metadata of the file as written
+   * @return true if the file exists (metadata filled in), false if it is gone
+   */
+  bool record_remote_change(const std::string& filename, FileMetadata& metadata);
+
+  /**
+   * Summarize the files found by the last scan (count, size, digest)
+   * The summary is kept up to date by each scan, from the files that
+   * changed.
+   * @param summary Output: summary of the directory
+   */
+  void summarize(DirectorySummary& summary);
+
+  /**
+   * Keep a ContentIndex up to date with the results of each scan
+   * @param content_index Index to maintain (0 to disable)
+   */
+  void set_content_index(ContentIndex* content_index);
+
+  /**
+   * Leave ignored files out of every scan (they are never stat'ed or
+   * checksummed)
+   * @param ignore Compiled ignore patterns (0 to disable)
+   */
+  void set_ignore_matcher(const IgnoreMatcher* ignore);
+
 private:
   /**
    * Internal file state tracking structure
@@ -73,8 +108,19 @@ private:
   std::string directory_path_;
   bool fail_silently_;
   std::map<std::string, FileState> previous_state_;
+  DirectorySummary summary_;  // Of previous_state_
   ACE_Thread_Mutex mutex_;
   FileChangeTracker& change_tracker_;  // Reference to shared tracker for loop prevention
+  ContentIndex* content_index_;        // Optional local content index (not owned)
+  const IgnoreMatcher* ignore_;        // Optional ignore patterns (not owned)
+
+  // Metrics
+  Histogram& scan_duration_;
+  Counter& files_scanned_;
+  Gauge& files_;
+  Histogram& checksum_duration_;
+  Counter& checksum_bytes_;
+  Counter& suppressed_changes_;
 
   /**
    * Build full path from relative filename
@@ -83,8 +129,11 @@ private:
 
   /**
    * Calculate checksum for a file
+   * @param size File size, for the checksum throughput metrics
    */
-  bool calculate_file_checksum(const std::string& full_path, unsigned long& checksum);
+  bool calculate_file_checksum(const std::string& full_path,
+                               unsigned long long size,
+                               unsigned long& checksum);
 
   /**
    * Get modification time for a file
@@ -0,0 +1,580 @@
+#include "FilePublisher.h"
+#include "FileUtils.h"
+#include "Checksum.h"
+#include "ReedSolomon.h"
+#include "Trace.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/Time_Value.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace DirShare {
+
+namespace {
+
+// A chunk write that takes longer than this is counted as blocked by the
+// transport when feeding the chunk size tuner
+const ACE_Time_Value BLOCKED_WRITE_TIME(0, 50000); // 50ms
+
+// Attempts at a chunk write that times out on a full history before the
+// transfer is abandoned
+const int MAX_BLOCKED_WRITE_ATTEMPTS = 50;
+
+// Collect the runs of chunks that lie entirely in holes
+void find_hole_chunks(const FileImage& image,
+                      uint32_t chunk_size,
+                      uint32_t total_chunks,
+                      ChunkRangeSeq& holes)
+{
+  holes.length(0);
+  size_t extent_index = 0;
+
+  for (uint32_t chunk_id = 0; chunk_id < total_chunks; ++chunk_id) {
+    uint64_t offset = static_cast<uint64_t>(chunk_id) * chunk_size;
+    uint64_t chunk_end = offset + chunk_size;
+
+    while (extent_index < image.extents.size() &&
+           image.extents[extent_index].offset + image.extents[extent_index].length <= offset) {
+      ++extent_index;
+    }
+
+    bool is_hole = extent_index == image.extents.size() ||
+                   image.extents[extent_index].offset >= chunk_end;
+    if (!is_hole) {
+      continue;
+    }
+
+    CORBA::ULong n = holes.length();
+    if (n > 0 && holes[n - 1].first_chunk + holes[n - 1].count == chunk_id) {
+      ++holes[n - 1].count;
+    } else {
+      holes.length(n + 1);
+      holes[n].first_chunk = chunk_id;
+      holes[n].count = 1;
+    }
+  }
+}
+
+// Fill buffer with the file range [offset, offset + length) from the
+// extents overlapping it; gaps are zero. The cursor (extent_index,
+// extent_data_pos) only moves forward, so ranges must be requested in
+// ascending offset order
+void copy_chunk_data(const FileImage& image,
+                     uint64_t offset,
+                     uint32_t length,
+                     unsigned char* buffer,
+                     size_t& extent_index,
+                     size_t& extent_data_pos)
+{
+  const uint64_t chunk_end = offset + length;
+
+  // Skip extents that end before this chunk
+  while (extent_index < image.extents.size() &&
+         image.extents[extent_index].offset + image.extents[extent_index].length <= offset) {
+    extent_data_pos += static_cast<size_t>(image.extents[extent_index].length);
+    ++extent_index;
+  }
+
+  std::memset(buffer, 0, length);
+  size_t data_pos = extent_data_pos;
+  for (size_t i = extent_index;
+       i < image.extents.size() && image.extents[i].offset < chunk_end; ++i) {
+    const FileExtent& extent = image.extents[i];
+    uint64_t from = std::max<uint64_t>(offset, extent.offset);
+    uint64_t to = std::min<uint64_t>(chunk_end, extent.offset + extent.length);
+    std::memcpy(buffer + (from - offset),
+                &image.data[data_pos + static_cast<size_t>(from - extent.offset)],
+                static_cast<size_t>(to - from));
+    data_pos += static_cast<size_t>(extent.length);
+  }
+}
+
+// Whether chunk_id lies in one of the (sorted) hole runs; hole_index is a
+// cursor for ascending chunk ids
+bool is_hole_chunk(const ChunkRangeSeq& holes, uint32_t chunk_id, CORBA::ULong& hole_index)
+{
+  while (hole_index < holes.length() &&
+         holes[hole_index].first_chunk + holes[hole_index].count <= chunk_id) {
+    ++hole_index;
+  }
+  return hole_index < holes.length() && chunk_id >= holes[hole_index].first_chunk;
+}
+
+// A file that is still changing after this many reads is left for the next
+// scan, which will report it as MODIFY once it settles
+const int MAX_STABLE_READ_ATTEMPTS = 3;
+
+} // namespace
+
+FilePublisher::FilePublisher(const std::string& shared_directory,
+                             DDS::DataWriter_ptr content_writer,
+                             DDS::DataWriter_ptr open_writer,
+                             DDS::DataWriter_ptr chunk_writer,
+                             DDS::DataWriter_ptr fec_writer)
+  : shared_directory_(shared_directory)
+  , content_writer_(FileContentDataWriter::_narrow(content_writer))
+  , open_writer_(TransferOpenDataWriter::_narrow(open_writer))
+  , chunk_writer_(FileChunkDataWriter::_narrow(chunk_writer))
+  , fec_writer_(FecChunkDataWriter::_narrow(fec_writer))
+  , chunk_size_(DEFAULT_CHUNK_SIZE)
+  , chunk_threshold_(DEFAULT_CHUNK_THRESHOLD)
+  , chunk_tuner_(0)
+  , fec_data_chunks_(0)
+  , fec_repair_chunks_(0)
+  , next_session_id_(0)
+  , content_sent_("sent", "DirShare_FileContent")
+  , opens_sent_("sent", "DirShare_TransferOpen")
+  , chunks_sent_("sent", "DirShare_FileChunks")
+  , fec_sent_("sent", "DirShare_FecChunks")
+  , blocked_writes_(MetricsRegistry::instance().counter(
+      "dirshare_chunk_writes_blocked_total",
+      "FileChunk writes that timed out on a full reliable send history"))
+{
+  // Random high bits keep session ids from different peers (and restarts)
+  // apart; the low bits count transfers
+  ACE_Time_Value now = ACE_OS::gettimeofday();
+  uint32_t salt = static_cast<uint32_t>(now.usec()) * 2654435761U ^
+                  static_cast<uint32_t>(now.sec()) ^
+                  (static_cast<uint32_t>(ACE_OS::getpid()) << 16);
+  next_session_id_ = static_cast<uint64_t>(salt) << 32;
+}
+
+FilePublisher::~FilePublisher()
+{
+}
+
+void FilePublisher::set_chunk_size(uint32_t chunk_size)
+{
+  if (chunk_size < MIN_CHUNK_SIZE) {
+    chunk_size = MIN_CHUNK_SIZE;
+  } else if (chunk_size > MAX_CHUNK_SIZE) {
+    chunk_size = MAX_CHUNK_SIZE;
+  }
+  chunk_size_ = chunk_size;
+}
+
+void FilePublisher::set_chunk_threshold(uint64_t threshold)
+{
+  chunk_threshold_ = threshold;
+}
+
+void FilePublisher::set_chunk_tuner(ChunkSizeTuner* tuner)
+{
+  chunk_tuner_ = tuner;
+}
+
+bool FilePublisher::set_fec(uint16_t data_chunks, uint16_t repair_chunks)
+{
+  if (data_chunks == 0) {
+    fec_data_chunks_ = 0;
+    fec_repair_chunks_ = 0;
+    return true;
+  }
+
+  if (!fec_writer_ || !ReedSolomonCode(data_chunks, repair_chunks).valid()) {
+    return false;
+  }
+  fec_data_chunks_ = data_chunks;
+  fec_repair_chunks_ = repair_chunks;
+  return true;
+}
+
+bool FilePublisher::load_file(FileMetadata& metadata, FileImage& image)
+{
+  std::string filename = metadata.filename.in();
+  TraceSpan span("send", "load_file", filename.c_str());
+  std::string full_path = shared_directory_ + "/" + filename;
+
+  for (int attempt = 1; attempt <= MAX_STABLE_READ_ATTEMPTS; ++attempt) {
+    unsigned long long size;
+    unsigned long long mtime_sec;
+    unsigned long mtime_nsec;
+    if (read_file_extents_stable(full_path, image.data, image.extents,
+                                 size, mtime_sec, mtime_nsec)) {
+      // Checksum exactly the bytes that will be sent, not the scan's view
+      TraceSpan checksum_span("send", "calculate_extents_crc32", filename.c_str());
+      uint32_t checksum = static_cast<uint32_t>(calculate_extents_crc32(
+        image.data.empty() ? 0 : &image.data[0], image.extents, size));
+      if (checksum != metadata.checksum || size != metadata.size) {
+        DIRSHARE_INFO_EVERY(filename.c_str(),
+                            ("File changed since scan, sending current version: %s\n",
+                             filename.c_str()));
+      }
+      metadata.size = size;
+      metadata.checksum = checksum;
+      metadata.timestamp_sec = mtime_sec;
+      metadata.timestamp_nsec = static_cast<CORBA::ULong>(mtime_nsec);
+      return true;
+    }
+
+    if (!file_exists(full_path)) {
+      break;
+    }
+
+    DIRSHARE_INFO_EVERY(filename.c_str(),
+                        ("File modified while reading, retrying (%d/%d): %s\n",
+                         attempt, MAX_STABLE_READ_ATTEMPTS, filename.c_str()));
+    ACE_OS::sleep(ACE_Time_Value(0, 50000)); // 50ms
+  }
+
+  ACE_ERROR((LM_ERROR,
+             ACE_TEXT("ERROR: %N:%l: Failed to read a stable view of file: %C\n"),
+             full_path.c_str()));
+  return false;
+}
+
+bool FilePublisher::publish_file(const FileMetadata& metadata,
+                                 const FileImage& image,
+                                 const LocalChange* change)
+{
+  // Determine if file should be sent as chunks or content
+  if (metadata.size < chunk_threshold_) {
+    return publish_content(metadata, image, change);
+  }
+  return publish_chunks(metadata, image, change);
+}
+
+bool FilePublisher::publish_content(const FileMetadata& metadata,
+                                    const FileImage& image,
+                                    const LocalChange* change)
+{
+  FileContent content;
+  content.filename = metadata.filename;
+  content.size = metadata.size;
+  content.checksum = metadata.checksum;
+  content.timestamp_sec = metadata.timestamp_sec;
+  content.timestamp_nsec = metadata.timestamp_nsec;
+
+  // Small file: holes are sent as zeros
+  content.data.length(static_cast<CORBA::ULong>(metadata.size));
+  if (metadata.size > 0) {
+    std::memset(content.data.get_buffer(), 0, static_cast<size_t>(metadata.size));
+  }
+  size_t data_pos = 0;
+  for (size_t i = 0; i < image.extents.size(); ++i) {
+    const FileExtent& extent = image.extents[i];
+    std::memcpy(content.data.get_buffer() + extent.offset,
+                &image.data[data_pos],
+                static_cast<size_t>(extent.length));
+    data_pos += static_cast<size_t>(extent.length);
+  }
+
+  content.origin = origin_for_send(change);
+  DDS::ReturnCode_t ret;
+  {
+    TraceSpan span("send", "write FileContent", metadata.filename.in());
+    ret = content_writer_->write(content, DDS::HANDLE_NIL);
+  }
+  if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: write FileContent failed: %d\n"),
+               ret));
+    return false;
+  }
+  content_sent_.sample(content.data.length());
+
+  DIRSHARE_INFO(("Published FileContent: %s (%llu bytes)\n",
+                 metadata.filename.in(),
+                 static_cast<unsigned long long>(metadata.size)));
+  return true;
+}
+
+bool FilePublisher::publish_chunks(const FileMetadata& metadata,
+                                   const FileImage& image,
+                                   const LocalChange* change)
+{
+  TraceSpan span("send", "publish_chunks", metadata.filename.in());
+
+  // Fixed for the whole transfer, even if the tuner adjusts meanwhile
+  const uint32_t chunk_size = chunk_tuner_ ? chunk_tuner_->chunk_size() : chunk_size_;
+
+  // Session header: everything about the file is sent once, here
+  TransferOpen open;
+  open.session_id = next_session_id_++;
+  open.filename = metadata.filename;
+  open.file_size = metadata.size;
+  open.file_checksum = metadata.checksum;
+  open.chunk_size = chunk_size;
+  open.total_chunks = static_cast<CORBA::ULong>((metadata.size + chunk_size - 1) / chunk_size);
+  open.timestamp_sec = metadata.timestamp_sec;
+  open.timestamp_nsec = metadata.timestamp_nsec;
+  open.fec_data_chunks = fec_data_chunks_;
+  open.fec_repair_chunks = fec_repair_chunks_;
+  find_hole_chunks(image, chunk_size, open.total_chunks, open.holes);
+  open.origin = origin_for_send(change);
+
+  // All chunks of the session are samples of one instance (of FileChunk,
+  // or of FecChunk when FEC is enabled)
+  const bool use_fec = fec_data_chunks_ > 0;
+  FileChunk chunk_key;
+  chunk_key.session_id = open.session_id;
+  chunk_key.filename = open.filename;
+  chunk_key.file_size = open.file_size;
+  chunk_key.offset = 0;
+  chunk_key.chunk_checksum = 0;
+  FecChunk fec_key;
+  fec_key.session_id = open.session_id;
+  fec_key.filename = open.filename;
+  fec_key.file_size = open.file_size;
+  fec_key.group = 0;
+  fec_key.index = 0;
+  fec_key.chunk_checksum = 0;
+
+  DDS::InstanceHandle_t open_handle = open_writer_->register_instance(open);
+  DDS::InstanceHandle_t chunk_handle = use_fec ?
+    fec_writer_->register_instance(fec_key) :
+    chunk_writer_->register_instance(chunk_key);
+
+  bool ok = false;
+  if (open_handle == DDS::HANDLE_NIL || chunk_handle == DDS::HANDLE_NIL) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: register_instance failed for transfer of: %C\n"),
+               metadata.filename.in()));
+  } else {
+    DIRSHARE_INFO(("Publishing FileChunks for: %s (%llu bytes, %u chunks of %u bytes, session %llu)\n",
+                   metadata.filename.in(),
+                   static_cast<unsigned long long>(metadata.size),
+                   static_cast<unsigned int>(open.total_chunks),
+                   static_cast<unsigned int>(chunk_size),
+                   static_cast<unsigned long long>(open.session_id)));
+
+    DDS::ReturnCode_t ret = open_writer_->write(open, open_handle);
+    if (ret != DDS::RETCODE_OK) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: write TransferOpen failed: %d\n"),
+                 ret));
+    } else {
+      opens_sent_.sample();
+      ok = use_fec ? write_fec_chunks(open, chunk_handle, image) :
+                     write_chunks(open, chunk_handle, image);
+    }
+  }
+
+  // Release both instances whether or not the transfer completed, so writer
+  // and reader instance tables stay bounded; readers discard a session
+  // that is still incomplete when its chunk instance is disposed
+  if (chunk_handle != DDS::HANDLE_NIL && use_fec) {
+    fec_writer_->dispose(fec_key, chunk_handle);
+    fec_writer_->unregister_instance(fec_key, chunk_handle);
+  } else if (chunk_handle != DDS::HANDLE_NIL) {
+    chunk_writer_->dispose(chunk_key, chunk_handle);
+    chunk_writer_->unregister_instance(chunk_key, chunk_handle);
+  }
+  if (open_handle != DDS::HANDLE_NIL) {
+    open_writer_->dispose(open, open_handle);
+    open_writer_->unregister_instance(open, open_handle);
+  }
+
+  return ok;
+}
+
+bool FilePublisher::write_chunks(const TransferOpen& open,
+                                 DDS::InstanceHandle_t handle,
+                                 const FileImage& image)
+{
+  const uint32_t chunk_size = open.chunk_size;
+  const uint64_t file_size = open.file_size;
+
+  // Walk the (sorted) extents and hole runs alongside the chunks
+  size_t extent_index = 0;
+  size_t extent_data_pos = 0;
+  CORBA::ULong hole_index = 0;
+  uint32_t data_chunks = 0;
+
+  for (uint32_t chunk_id = 0; chunk_id < open.total_chunks; ++chunk_id) {
+    if (is_hole_chunk(open.holes, chunk_id, hole_index)) {
+      // Announced in TransferOpen, nothing to send
+      chunk_id = open.holes[hole_index].first_chunk + open.holes[hole_index].count - 1;
+      continue;
+    }
+
+    // Calculate chunk range
+    uint64_t offset = static_cast<uint64_t>(chunk_id) * chunk_size;
+    uint32_t this_chunk_size = static_cast<uint32_t>(
+      (offset + chunk_size > file_size) ?
+      (file_size - offset) : chunk_size);
+
+    FileChunk chunk;
+    chunk.session_id = open.session_id;
+    chunk.filename = open.filename;
+    chunk.file_size = open.file_size;
+    chunk.offset = offset;
+
+    // Assemble chunk data from every extent overlapping it; gaps are zero
+    chunk.data.length(this_chunk_size);
+    unsigned char* buffer = chunk.data.get_buffer();
+    copy_chunk_data(image, offset, this_chunk_size, buffer, extent_index, extent_data_pos);
+
+    // Calculate chunk checksum
+    chunk.chunk_checksum = compute_checksum(buffer, this_chunk_size);
+
+    ACE_Time_Value write_start = ACE_OS::gettimeofday();
+    DDS::ReturnCode_t ret = write_chunk(chunk, chunk_size, handle);
+    ACE_Time_Value write_time = ACE_OS::gettimeofday() - write_start;
+
+    if (ret != DDS::RETCODE_OK) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: write FileChunk failed: %d\n"),
+                 ret));
+      return false;
+    }
+    ++data_chunks;
+
+    // Small delay to avoid overwhelming UDP send buffer
+    ACE_Time_Value delay(0, 10000); // 10ms
+    {
+      TraceSpan pacing_span("send", "chunk_pacing");
+      ACE_OS::sleep(delay);
+    }
+
+    if (chunk_tuner_) {
+      chunk_tuner_->record_write(chunk_size, this_chunk_size, write_time + delay,
+                                 write_time > BLOCKED_WRITE_TIME);
+    }
+  }
+
+  DIRSHARE_INFO(("Completed publishing chunks for: %s (%u data, %u hole)\n",
+                 open.filename.in(),
+                 static_cast<unsigned int>(data_chunks),
+                 static_cast<unsigned int>(open.total_chunks - data_chunks)));
+  return true;
+}
+
+bool FilePublisher::write_fec_chunks(const TransferOpen& open,
+                                     DDS::InstanceHandle_t handle,
+                                     const FileImage& image)
+{
+  const uint32_t chunk_size = open.chunk_size;
+  const uint64_t file_size = open.file_size;
+  const unsigned k = open.fec_data_chunks;
+  const ReedSolomonCode code(k, open.fec_repair_chunks);
+  const uint32_t groups = (open.total_chunks + k - 1) / k;
+
+  size_t extent_index = 0;
+  size_t extent_data_pos = 0;
+  CORBA::ULong hole_index = 0;
+  uint32_t data_chunks = 0;
+  uint32_t repair_chunks = 0;
+
+  // One group of zero-padded chunks (holes and chunks past the end stay zero)
+  std::vector<std::vector<uint8_t> > blocks(k, std::vector<uint8_t>(chunk_size));
+  std::vector<const uint8_t*> block_ptrs(k);
+  for (unsigned j = 0; j < k; ++j) {
+    block_ptrs[j] = &blocks[j][0];
+  }
+  std::vector<std::vector<uint8_t> > repair;
+
+  for (uint32_t group = 0; group < groups; ++group) {
+    for (unsigned j = 0; j < k; ++j) {
+      uint32_t chunk_id = group * k + j;
+      unsigned char* buffer = &blocks[j][0];
+
+      if (chunk_id >= open.total_chunks ||
+          is_hole_chunk(open.holes, chunk_id, hole_index)) {
+        std::memset(buffer, 0, chunk_size);
+        continue;
+      }
+
+      uint64_t offset = static_cast<uint64_t>(chunk_id) * chunk_size;
+      uint32_t this_chunk_size = static_cast<uint32_t>(
+        (offset + chunk_size > file_size) ?
+        (file_size - offset) : chunk_size);
+
+      std::memset(buffer + this_chunk_size, 0, chunk_size - this_chunk_size);
+      copy_chunk_data(image, offset, this_chunk_size, buffer, extent_index, extent_data_pos);
+
+      if (!write_fec_chunk(open, group, j, buffer, this_chunk_size, handle)) {
+        return false;
+      }
+      ++data_chunks;
+    }
+
+    {
+      TraceSpan encode_span("send", "fec_encode");
+      code.encode(block_ptrs, chunk_size, repair);
+    }
+    for (unsigned i = 0; i < repair.size(); ++i) {
+      if (!write_fec_chunk(open, group, k + i, &repair[i][0], chunk_size, handle)) {
+        return false;
+      }
+      ++repair_chunks;
+    }
+  }
+
+  DIRSHARE_INFO(("Completed publishing FEC chunks for: %s (%u data, %u repair, %u hole)\n",
+                 open.filename.in(),
+                 static_cast<unsigned int>(data_chunks),
+                 static_cast<unsigned int>(repair_chunks),
+                 static_cast<unsigned int>(open.total_chunks - data_chunks)));
+  return true;
+}
+
+bool FilePublisher::write_fec_chunk(const TransferOpen& open,
+                                    uint32_t group,
+                                    unsigned index,
+                                    const unsigned char* data,
+                                    uint32_t length,
+                                    DDS::InstanceHandle_t handle)
+{
+  FecChunk chunk;
+  chunk.session_id = open.session_id;
+  chunk.filename = open.filename;
+  chunk.file_size = open.file_size;
+  chunk.group = group;
+  chunk.index = static_cast<CORBA::UShort>(index);
+  chunk.data.length(length);
+  std::memcpy(chunk.data.get_buffer(), data, length);
+  chunk.chunk_checksum = compute_checksum(data, length);
+
+  // Best effort: write() does not wait for acknowledgements, losses are
+  // repaired by the receiver
+  DDS::ReturnCode_t ret;
+  {
+    TraceSpan span("send", "write FecChunk");
+    ret = fec_writer_->write(chunk, handle);
+  }
+  if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: write FecChunk failed: %d\n"),
+               ret));
+    return false;
+  }
+  fec_sent_.sample(length);
+
+  // Small delay to avoid overwhelming UDP send buffer
+  TraceSpan pacing_span("send", "chunk_pacing");
+  ACE_OS::sleep(ACE_Time_Value(0, 10000)); // 10ms
+  return true;
+}
+
+DDS::ReturnCode_t FilePublisher::write_chunk(const FileChunk& chunk,
+                                             uint32_t chunk_size,
+                                             DDS::InstanceHandle_t handle)
+{
+  // A full reliable history makes write() time out; give the readers'
+  // acknowledgements a chance to free it before failing the transfer
+  DDS::ReturnCode_t ret = DDS::RETCODE_TIMEOUT;
+  for (int attempt = 0;
+       attempt < MAX_BLOCKED_WRITE_ATTEMPTS && ret == DDS::RETCODE_TIMEOUT;
+       ++attempt) {
+    TraceSpan span("send", "write FileChunk");
+    ret = chunk_writer_->write(chunk, handle);
+    if (ret == DDS::RETCODE_TIMEOUT) {
+      blocked_writes_.increment();
+      if (chunk_tuner_) {
+        chunk_tuner_->record_write(chunk_size, 0, BLOCKED_WRITE_TIME, true);
+      }
+    }
+  }
+  if (ret == DDS::RETCODE_OK) {
+    chunks_sent_.sample(chunk.data.length());
+  }
+  return ret;
+}
+
+} // namespace DirShare
@@ -0,0 +1,169 @@
+#ifndef DIRSHARE_FILE_PUBLISHER_H
+#define DIRSHARE_FILE_PUBLISHER_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "FileUtils.h"
+#include "ChunkSizeTuner.h"
+#include "Metrics.h"
+#include "Latency.h"
+
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+// Defaults for the chunked transfer path (runtime configurable)
+const uint64_t DEFAULT_CHUNK_THRESHOLD = 10 * 1024 * 1024; // 10MB
+const uint32_t DEFAULT_CHUNK_SIZE = 1024 * 1024; // 1MB
+const uint32_t MIN_CHUNK_SIZE = 16 * 1024; // 16KB
+const uint32_t MAX_CHUNK_SIZE = 16 * 1024 * 1024; // 16MB
+
+/**
+ * File contents as read for sending
+ * Only data extents are held; the ranges between them are holes of a
+ * sparse file and are sent as metadata only
+ */
+struct FileImage {
+  std::vector<unsigned char> data;  // Extent contents, concatenated in order
+  std::vector<FileExtent> extents;  // Data extents in ascending offset order
+};
+
+/**
+ * FilePublisher: Send path for file content
+ * Publishes files as FileContent (small files) or as a TransferOpen session
+ * header followed by FileChunks (large files).
+ * Used for the initial snapshot push as well as CREATE and MODIFY events,
+ * so every transfer goes through the same read-consistency guard.
+ */
+class FilePublisher {
+public:
+  /**
+   * Constructor
+   * @param shared_directory Path to the shared directory
+   * @param content_writer DataWriter for the FileContent topic
+   * @param open_writer DataWriter for the TransferOpen topic
+   * @param chunk_writer DataWriter for the FileChunks topic
+   * @param fec_writer DataWriter for the (best-effort) FecChunks topic, or
+   *        nil if FEC is never used
+   */
+  FilePublisher(const std::string& shared_directory,
+                DDS::DataWriter_ptr content_writer,
+                DDS::DataWriter_ptr open_writer,
+                DDS::DataWriter_ptr chunk_writer,
+                DDS::DataWriter_ptr fec_writer);
+
+  ~FilePublisher();
+
+  /**
+   * Set the chunk size for chunked transfers
+   * Receivers take the size from each TransferOpen, so peers may differ
+   * @param chunk_size Chunk size in bytes (MIN_CHUNK_SIZE..MAX_CHUNK_SIZE)
+   */
+  void set_chunk_size(uint32_t chunk_size);
+
+  /**
+   * Set the file size from which files are sent as FileChunks
+   * @param threshold Size in bytes; smaller files are sent as FileContent
+   */
+  void set_chunk_threshold(uint64_t threshold);
+
+  /**
+   * Let a tuner choose the chunk size (optional)
+   * When set, the tuner's size is used instead of set_chunk_size() and is
+   * fed with the outcome of every chunk write
+   * @param tuner Chunk size tuner, or 0 to disable (not owned)
+   */
+  void set_chunk_tuner(ChunkSizeTuner* tuner);
+
+  /**
+   * Send chunked transfers with forward error correction
+   * Chunks go to the best-effort FecChunks topic in groups of data_chunks,
+   * each followed by repair_chunks Reed-Solomon repair chunks
+   * @param data_chunks Group size k, or 0 to disable FEC
+   * @param repair_chunks Repair chunks per group m
+   * @return false if (k, m) is not a valid code or there is no FEC writer
+   */
+  bool set_fec(uint16_t data_chunks, uint16_t repair_chunks);
+
+  /**
+   * Read a consistent view of a file for sending
+   * The file is re-read (a bounded number of times) if it is modified while
+   * being read. On success, size, checksum and timestamp in metadata are
+   * refreshed so that they describe exactly the bytes in data, even if the
+   * file changed after the scan that produced metadata.
+   * @param metadata In/out: file metadata (filename is input)
+   * @param image Output: file contents (data extents only)
+   * @return true if a stable view was read, false if the file kept
+   *         changing or could not be read
+   */
+  bool load_file(FileMetadata& metadata, FileImage& image);
+
+  /**
+   * Publish file content previously read by load_file()
+   * @param metadata File metadata describing image
+   * @param image File contents
+   * @param change Local change being sent, stamped for latency tracing
+   *        (0: untraced, e.g. the snapshot push)
+   * @return true if all samples were written, false on write error
+   */
+  bool publish_file(const FileMetadata& metadata,
+                    const FileImage& image,
+                    const LocalChange* change = 0);
+
+private:
+  std::string shared_directory_;
+  FileContentDataWriter_var content_writer_;
+  TransferOpenDataWriter_var open_writer_;
+  FileChunkDataWriter_var chunk_writer_;
+  FecChunkDataWriter_var fec_writer_;
+  uint32_t chunk_size_;
+  uint64_t chunk_threshold_;
+  ChunkSizeTuner* chunk_tuner_;
+  uint16_t fec_data_chunks_;    // 0: FEC disabled
+  uint16_t fec_repair_chunks_;
+  uint64_t next_session_id_;
+
+  TopicCounters content_sent_;
+  TopicCounters opens_sent_;
+  TopicCounters chunks_sent_;
+  TopicCounters fec_sent_;
+  Counter& blocked_writes_;
+
+  // Send as a single FileContent sample (small file)
+  bool publish_content(const FileMetadata& metadata,
+                       const FileImage& image,
+                       const LocalChange* change);
+
+  // Send a TransferOpen session header followed by the session's FileChunk
+  // samples (large file); both instances are released after the transfer
+  bool publish_chunks(const FileMetadata& metadata,
+                      const FileImage& image,
+                      const LocalChange* change);
+
+  // Write the data chunks of a session (hole runs are listed in open)
+  bool write_chunks(const TransferOpen& open,
+                    DDS::InstanceHandle_t handle,
+                    const FileImage& image);
+
+  // Write the chunks of a session as FEC groups (data + repair chunks)
+  bool write_fec_chunks(const TransferOpen& open,
+                        DDS::InstanceHandle_t handle,
+                        const FileImage& image);
+
+  // Write one FecChunk sample
+  bool write_fec_chunk(const TransferOpen& open,
+                       uint32_t group,
+                       unsigned index,
+                       const unsigned char* data,
+                       uint32_t length,
+                       DDS::InstanceHandle_t handle);
+
+  // Write one chunk sample, retrying while the writer's history is full
+  DDS::ReturnCode_t write_chunk(const FileChunk& chunk,
+                                uint32_t chunk_size,
+                                DDS::InstanceHandle_t handle);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_FILE_PUBLISHER_H
@@ -0,0 +1,315 @@
+// FileSystem.cpp
+// Replaceable backend of the FileUtils functions, and an in-memory
+// implementation for running many participants in one process
+
+#include "FileSystem.h"
+#include "IgnoreMatcher.h"
+
+#include <ace/Guard_T.h>
+
+#include <cstring>
+
+namespace DirShare {
+
+FileSystem* FileSystem::mounted_ = 0;
+
+FileSystem::~FileSystem()
+{
+}
+
+void FileSystem::mount(FileSystem* file_system)
+{
+  mounted_ = file_system;
+}
+
+MemoryFileSystem::MemoryFileSystem()
+  : now_sec_(0)
+  , changes_(0)
+{
+}
+
+MemoryFileSystem::~MemoryFileSystem()
+{
+}
+
+std::string MemoryFileSystem::normalize(const std::string& path)
+{
+  std::string result;
+  result.reserve(path.size());
+  for (size_t i = 0; i < path.size(); ++i) {
+    const char c = path[i] == '\\' ? '/' : path[i];
+    if (c == '/' && !result.empty() && result[result.size() - 1] == '/') {
+      continue;
+    }
+    result += c;
+  }
+  if (result.size() > 1 && result[result.size() - 1] == '/') {
+    result.erase(result.size() - 1);
+  }
+  return result;
+}
+
+MemoryFileSystem::File* MemoryFileSystem::store(const std::string& path)
+{
+  const std::string::size_type slash = path.rfind('/');
+  const std::string directory = slash == std::string::npos ? std::string(".") :
+                                (slash == 0 ? std::string("/") : path.substr(0, slash));
+  if (directories_.find(directory) == directories_.end() ||
+      directories_.find(path) != directories_.end()) {
+    return 0;
+  }
+
+  File& file = files_[path];
+  file.mtime_sec = now_sec_;
+  ++changes_;
+  return &file;
+}
+
+bool MemoryFileSystem::make_directory(const std::string& path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  const std::string normalized = normalize(path);
+  if (files_.find(normalized) != files_.end()) {
+    return false;
+  }
+  directories_.insert(normalized);
+  return true;
+}
+
+void MemoryFileSystem::set_time(unsigned long long sec)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  now_sec_ = sec;
+}
+
+unsigned long long MemoryFileSystem::changes() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return changes_;
+}
+
+unsigned long long MemoryFileSystem::bytes() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  unsigned long long total = 0;
+  for (FileMap::const_iterator it = files_.begin(); it != files_.end(); ++it) {
+    total += it->second.data.size();
+  }
+  return total;
+}
+
+bool MemoryFileSystem::read_file(const std::string& file_path,
+                                 std::vector<unsigned char>& data)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator it = files_.find(normalize(file_path));
+  if (it == files_.end()) {
+    return false;
+  }
+  data = it->second.data;
+  return true;
+}
+
+bool MemoryFileSystem::read_file_range(const std::string& file_path,
+                                       unsigned long long offset,
+                                       size_t length,
+                                       std::vector<unsigned char>& data)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator it = files_.find(normalize(file_path));
+  if (it == files_.end() || offset + length > it->second.data.size()) {
+    return false;
+  }
+  data.assign(it->second.data.begin() + static_cast<size_t>(offset),
+              it->second.data.begin() + static_cast<size_t>(offset) + length);
+  return true;
+}
+
+bool MemoryFileSystem::read_file_stable(const std::string& file_path,
+                                        std::vector<unsigned char>& data,
+                                        unsigned long long& mtime_sec,
+                                        unsigned long& mtime_nsec)
+{
+  // Operations are atomic, so every read is a stable view
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator it = files_.find(normalize(file_path));
+  if (it == files_.end()) {
+    return false;
+  }
+  data = it->second.data;
+  mtime_sec = it->second.mtime_sec;
+  mtime_nsec = 0;
+  return true;
+}
+
+bool MemoryFileSystem::read_file_extents_stable(const std::string& file_path,
+                                                std::vector<unsigned char>& data,
+                                                std::vector<FileExtent>& extents,
+                                                unsigned long long& size,
+                                                unsigned long long& mtime_sec,
+                                                unsigned long& mtime_nsec)
+{
+  if (!read_file_stable(file_path, data, mtime_sec, mtime_nsec)) {
+    return false;
+  }
+
+  // Stored expanded: the whole file is one extent, as without SEEK_DATA
+  size = data.size();
+  extents.clear();
+  if (!data.empty()) {
+    FileExtent extent;
+    extent.offset = 0;
+    extent.length = size;
+    extents.push_back(extent);
+  }
+  return true;
+}
+
+bool MemoryFileSystem::write_file(const std::string& file_path,
+                                  const unsigned char* data,
+                                  size_t size)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  File* file = store(normalize(file_path));
+  if (!file) {
+    return false;
+  }
+  file->data.assign(data, data + size);
+  return true;
+}
+
+bool MemoryFileSystem::write_file_sparse(const std::string& file_path,
+                                         const unsigned char* data,
+                                         const std::vector<FileExtent>& extents,
+                                         unsigned long long size)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  File* file = store(normalize(file_path));
+  if (!file) {
+    return false;
+  }
+  file->data.assign(static_cast<size_t>(size), 0);
+  size_t data_pos = 0;
+  for (size_t i = 0; i < extents.size(); ++i) {
+    const FileExtent& extent = extents[i];
+    if (extent.offset + extent.length > size) {
+      return false;
+    }
+    std::memcpy(&file->data[static_cast<size_t>(extent.offset)],
+                data + data_pos,
+                static_cast<size_t>(extent.length));
+    data_pos += static_cast<size_t>(extent.length);
+  }
+  return true;
+}
+
+bool MemoryFileSystem::clone_file(const std::string& source_path,
+                                  const std::string& dest_path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator source = files_.find(normalize(source_path));
+  if (source == files_.end()) {
+    return false;
+  }
+  const std::vector<unsigned char> data = source->second.data;
+  File* file = store(normalize(dest_path));
+  if (!file) {
+    return false;
+  }
+  file->data = data;
+  return true;
+}
+
+bool MemoryFileSystem::get_file_size(const std::string& file_path,
+                                     unsigned long long& size)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator it = files_.find(normalize(file_path));
+  if (it == files_.end()) {
+    return false;
+  }
+  size = it->second.data.size();
+  return true;
+}
+
+bool MemoryFileSystem::get_file_mtime(const std::string& file_path,
+                                      unsigned long long& sec,
+                                      unsigned long& nsec)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::const_iterator it = files_.find(normalize(file_path));
+  if (it == files_.end()) {
+    return false;
+  }
+  sec = it->second.mtime_sec;
+  nsec = 0;
+  return true;
+}
+
+bool MemoryFileSystem::set_file_mtime(const std::string& file_path,
+                                      unsigned long long sec,
+                                      unsigned long)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  FileMap::iterator it = files_.find(normalize(file_path));
+  if (it == files_.end()) {
+    return false;
+  }
+  it->second.mtime_sec = sec;
+  ++changes_;
+  return true;
+}
+
+bool MemoryFileSystem::file_exists(const std::string& file_path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return files_.find(normalize(file_path)) != files_.end();
+}
+
+bool MemoryFileSystem::is_directory(const std::string& path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return directories_.find(normalize(path)) != directories_.end();
+}
+
+bool MemoryFileSystem::delete_file(const std::string& file_path)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  if (files_.erase(normalize(file_path)) == 0) {
+    return false;
+  }
+  ++changes_;
+  return true;
+}
+
+bool MemoryFileSystem::list_directory_files(const std::string& directory_path,
+                                            std::vector<std::string>& files,
+                                            const IgnoreMatcher* ignore)
+{
+  files.clear();
+
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  const std::string directory = normalize(directory_path);
+  if (directories_.find(directory) == directories_.end()) {
+    return false;
+  }
+
+  // Paths sort by directory, so its files are one range of the map
+  const std::string prefix = directory == "/" ? directory : directory + "/";
+  for (FileMap::const_iterator it = files_.lower_bound(prefix);
+       it != files_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+    const std::string filename = it->first.substr(prefix.size());
+    if (filename.find('/') != std::string::npos) {
+      continue; // In a subdirectory
+    }
+    if (ignore && ignore->ignored(filename)) {
+      continue;
+    }
+    if (is_valid_filename(filename)) {
+      files.push_back(filename);
+    }
+  }
+  return true;
+}
+
+} // namespace DirShare
@@ -0,0 +1,186 @@
+// FileSystem.h
+// Replaceable backend of the FileUtils functions, and an in-memory
+// implementation for running many participants in one process
+
+#ifndef DIRSHARE_FILESYSTEM_H
+#define DIRSHARE_FILESYSTEM_H
+
+#include "FileUtils.h"
+
+#include <ace/Thread_Mutex.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * @class FileSystem
+ * @brief File operations behind the FileUtils functions
+ *
+ * By default FileUtils works on the local disk. Once a FileSystem is
+ * mounted, every FileUtils operation (and calculate_file_crc32()) is
+ * forwarded to it instead, so the scan, send and receive paths run
+ * unchanged on another storage. Each member has the contract of the
+ * FileUtils function of the same name. While nothing is mounted, the cost
+ * is one test of a pointer per call.
+ */
+class FileSystem {
+public:
+  virtual ~FileSystem();
+
+  /// The mounted file system, or 0 for the local disk
+  static FileSystem* mounted() { return mounted_; }
+
+  /**
+   * Route FileUtils to a file system
+   * Not synchronized: mount before starting the threads that do file I/O
+   * @param file_system File system to use (not owned), or 0 for the local disk
+   */
+  static void mount(FileSystem* file_system);
+
+  virtual bool read_file(const std::string& file_path,
+                         std::vector<unsigned char>& data) = 0;
+  virtual bool read_file_range(const std::string& file_path,
+                               unsigned long long offset,
+                               size_t length,
+                               std::vector<unsigned char>& data) = 0;
+  virtual bool read_file_stable(const std::string& file_path,
+                                std::vector<unsigned char>& data,
+                                unsigned long long& mtime_sec,
+                                unsigned long& mtime_nsec) = 0;
+  virtual bool read_file_extents_stable(const std::string& file_path,
+                                        std::vector<unsigned char>& data,
+                                        std::vector<FileExtent>& extents,
+                                        unsigned long long& size,
+                                        unsigned long long& mtime_sec,
+                                        unsigned long& mtime_nsec) = 0;
+  virtual bool write_file(const std::string& file_path,
+                          const unsigned char* data,
+                          size_t size) = 0;
+  virtual bool write_file_sparse(const std::string& file_path,
+                                 const unsigned char* data,
+                                 const std::vector<FileExtent>& extents,
+                                 unsigned long long size) = 0;
+  virtual bool clone_file(const std::string& source_path,
+                          const std::string& dest_path) = 0;
+  virtual bool get_file_size(const std::string& file_path,
+                             unsigned long long& size) = 0;
+  virtual bool get_file_mtime(const std::string& file_path,
+                              unsigned long long& sec,
+                              unsigned long& nsec) = 0;
+  virtual bool set_file_mtime(const std::string& file_path,
+                              unsigned long long sec,
+                              unsigned long nsec) = 0;
+  virtual bool file_exists(const std::string& file_path) = 0;
+  virtual bool is_directory(const std::string& path) = 0;
+  virtual bool delete_file(const std::string& file_path) = 0;
+  virtual bool list_directory_files(const std::string& directory_path,
+                                    std::vector<std::string>& files,
+                                    const IgnoreMatcher* ignore) = 0;
+
+private:
+  static FileSystem* mounted_;
+};
+
+/**
+ * @class MemoryFileSystem
+ * @brief File system held in memory, for simulations and tests
+ *
+ * Directories are created explicitly with make_directory() and hold
+ * regular files only. Files written are stamped with the time given to
+ * set_time() (a virtual clock), and modification times keep whole seconds
+ * like get_file_mtime() on disk, so conflicts between peers resolve the
+ * same way as on a real directory. Sparse images are stored expanded.
+ * All operations are serialized by one lock.
+ */
+class MemoryFileSystem : public FileSystem {
+public:
+  MemoryFileSystem();
+  virtual ~MemoryFileSystem();
+
+  /**
+   * Create a directory (its parent need not exist)
+   * @param path Directory path
+   * @return false if a file exists at path
+   */
+  bool make_directory(const std::string& path);
+
+  /// Modification time of the files written from now on
+  void set_time(unsigned long long sec);
+
+  /// Number of writes, deletions and timestamp changes so far
+  unsigned long long changes() const;
+
+  /// Bytes held by all files
+  unsigned long long bytes() const;
+
+  virtual bool read_file(const std::string& file_path,
+                         std::vector<unsigned char>& data);
+  virtual bool read_file_range(const std::string& file_path,
+                               unsigned long long offset,
+                               size_t length,
+                               std::vector<unsigned char>& data);
+  virtual bool read_file_stable(const std::string& file_path,
+                                std::vector<unsigned char>& data,
+                                unsigned long long& mtime_sec,
+                                unsigned long& mtime_nsec);
+  virtual bool read_file_extents_stable(const std::string& file_path,
+                                        std::vector<unsigned char>& data,
+                                        std::vector<FileExtent>& extents,
+                                        unsigned long long& size,
+                                        unsigned long long& mtime_sec,
+                                        unsigned long& mtime_nsec);
+  virtual bool write_file(const std::string& file_path,
+                          const unsigned char* data,
+                          size_t size);
+  virtual bool write_file_sparse(const std::string& file_path,
+                                 const unsigned char* data,
+                                 const std::vector<FileExtent>& extents,
+                                 unsigned long long size);
+  virtual bool clone_file(const std::string& source_path,
+                          const std::string& dest_path);
+  virtual bool get_file_size(const std::string& file_path,
+                             unsigned long long& size);
+  virtual bool get_file_mtime(const std::string& file_path,
+                              unsigned long long& sec,
+                              unsigned long& nsec);
+  virtual bool set_file_mtime(const std::string& file_path,
+                              unsigned long long sec,
+                              unsigned long nsec);
+  virtual bool file_exists(const std::string& file_path);
+  virtual bool is_directory(const std::string& path);
+  virtual bool delete_file(const std::string& file_path);
+  virtual bool list_directory_files(const std::string& directory_path,
+                                    std::vector<std::string>& files,
+                                    const IgnoreMatcher* ignore);
+
+private:
+  struct File {
+    std::vector<unsigned char> data;
+    unsigned long long mtime_sec;
+  };
+  typedef std::map<std::string, File> FileMap;
+
+  // Path without repeated or trailing separators
+  static std::string normalize(const std::string& path);
+
+  // Replace the contents of the file at a normalized path, if its
+  // directory exists; caller holds lock_
+  File* store(const std::string& path);
+
+  FileMap files_;                        // By normalized path
+  std::set<std::string> directories_;   // Normalized paths
+  unsigned long long now_sec_;
+  unsigned long long changes_;
+  mutable ACE_Thread_Mutex lock_;
+
+  MemoryFileSystem(const MemoryFileSystem&);
+  MemoryFileSystem& operator=(const MemoryFileSystem&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_FILESYSTEM_H
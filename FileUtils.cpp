@@ -1,17 +1,38 @@
 #include "FileUtils.h"
+#include "FileSystem.h"
+#include "Checksum.h"
+#include "IgnoreMatcher.h"
+#include "Trace.h"
 #include <ace/OS_NS_sys_stat.h>
 #include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_string.h>
 #include <ace/OS_NS_time.h>
 #include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_fcntl.h>
 #include <ace/Dirent.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 #include <sys/types.h>
 #include <utime.h>
 
+#if defined (__linux__)
+#  include <sys/ioctl.h>
+#  include <linux/fs.h>
+#endif
+
 namespace DirShare {
 
+const char* const TEMP_FILE_SUFFIX = ".dirshare-part";
+
 bool read_file(const std::string& file_path, std::vector<unsigned char>& data)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->read_file(file_path, data);
+  }
+
   std::ifstream file(file_path.c_str(), std::ios::binary | std::ios::ate);
   if (!file.is_open()) {
     return false;
@@ -28,10 +49,447 @@ bool read_file(const std::string& file_path, std::vector<unsigned char>& data)
   return true;
 }
 
+bool read_file_range(const std::string& file_path,
+                     unsigned long long offset,
+                     size_t length,
+                     std::vector<unsigned char>& data)
+{
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->read_file_range(file_path, offset, length, data);
+  }
+
+  ACE_HANDLE handle = ACE_OS::open(file_path.c_str(), O_RDONLY);
+  if (handle == ACE_INVALID_HANDLE) {
+    return false;
+  }
+
+  data.resize(length);
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = ACE_OS::pread(handle, &data[done], length - done,
+                              static_cast<ACE_OFF_T>(offset + done));
+    if (n <= 0) {
+      break; // Error, or the file is shorter than expected
+    }
+    done += static_cast<size_t>(n);
+  }
+
+  ACE_OS::close(handle);
+  return done == length;
+}
+
+namespace {
+
+// Compare the fields that change whenever file content is replaced or rewritten
+bool same_file_state(const ACE_stat& before, const ACE_stat& after)
+{
+  if (before.st_dev != after.st_dev ||
+      before.st_ino != after.st_ino ||
+      before.st_size != after.st_size ||
+      before.st_mtime != after.st_mtime ||
+      before.st_ctime != after.st_ctime) {
+    return false;
+  }
+#if defined (__APPLE__)
+  return before.st_mtimespec.tv_nsec == after.st_mtimespec.tv_nsec &&
+         before.st_ctimespec.tv_nsec == after.st_ctimespec.tv_nsec;
+#elif defined (__linux__)
+  return before.st_mtim.tv_nsec == after.st_mtim.tv_nsec &&
+         before.st_ctim.tv_nsec == after.st_ctim.tv_nsec;
+#else
+  return true;
+#endif
+}
+
+} // namespace
+
+bool read_file_stable(const std::string& file_path,
+                      std::vector<unsigned char>& data,
+                      unsigned long long& mtime_sec,
+                      unsigned long& mtime_nsec)
+{
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->read_file_stable(file_path, data, mtime_sec, mtime_nsec);
+  }
+
+  ACE_HANDLE handle = ACE_OS::open(file_path.c_str(), O_RDONLY);
+  if (handle == ACE_INVALID_HANDLE) {
+    return false;
+  }
+
+  ACE_stat before;
+  if (ACE_OS::fstat(handle, &before) != 0) {
+    ACE_OS::close(handle);
+    return false;
+  }
+
+  data.resize(static_cast<size_t>(before.st_size));
+  size_t total = 0;
+  while (total < data.size()) {
+    ssize_t n = ACE_OS::read(handle, &data[total], data.size() - total);
+    if (n <= 0) {
+      break; // Error, or file truncated underneath us
+    }
+    total += static_cast<size_t>(n);
+  }
+
+  ACE_stat after;
+  bool stable = (total == data.size()) &&
+                ACE_OS::fstat(handle, &after) == 0 &&
+                same_file_state(before, after);
+  ACE_OS::close(handle);
+
+  if (!stable) {
+    return false;
+  }
+
+  // Same granularity as get_file_mtime() so metadata comparisons stay consistent
+  mtime_sec = static_cast<unsigned long long>(after.st_mtime);
+  mtime_nsec = 0;
+  return true;
+}
+
+namespace {
+
+// Enumerate the data extents of an open file
+void find_data_extents(ACE_HANDLE handle,
+                       unsigned long long size,
+                       std::vector<FileExtent>& extents)
+{
+  extents.clear();
+
+#if defined (SEEK_DATA) && defined (SEEK_HOLE)
+  ACE_OFF_T pos = 0;
+  while (static_cast<unsigned long long>(pos) < size) {
+    ACE_OFF_T data_start = ACE_OS::lseek(handle, pos, SEEK_DATA);
+    if (data_start < 0) {
+      if (errno == ENXIO) {
+        return; // Only a hole remains up to EOF
+      }
+      break; // Not supported by this filesystem
+    }
+
+    ACE_OFF_T hole_start = ACE_OS::lseek(handle, data_start, SEEK_HOLE);
+    if (hole_start < 0) {
+      break;
+    }
+
+    unsigned long long end = std::min(static_cast<unsigned long long>(hole_start), size);
+    if (end > static_cast<unsigned long long>(data_start)) {
+      FileExtent extent;
+      extent.offset = static_cast<unsigned long long>(data_start);
+      extent.length = end - extent.offset;
+      extents.push_back(extent);
+    }
+    pos = hole_start;
+  }
+
+  if (static_cast<unsigned long long>(pos) >= size) {
+    return;
+  }
+  extents.clear();
+#endif
+
+  // No hole information: treat the whole file as data
+  if (size > 0) {
+    FileExtent extent;
+    extent.offset = 0;
+    extent.length = size;
+    extents.push_back(extent);
+  }
+}
+
+bool is_zero_block(const unsigned char* data, size_t length)
+{
+  return length == 0 ||
+         (data[0] == 0 && std::memcmp(data, data + 1, length - 1) == 0);
+}
+
+bool pwrite_all(ACE_HANDLE handle,
+                const unsigned char* data,
+                size_t length,
+                unsigned long long offset)
+{
+  while (length > 0) {
+    ssize_t n = ACE_OS::pwrite(handle, data, length, static_cast<ACE_OFF_T>(offset));
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    length -= static_cast<size_t>(n);
+    offset += static_cast<unsigned long long>(n);
+  }
+  return true;
+}
+
+bool extent_offset_less(const std::pair<FileExtent, size_t>& a,
+                        const std::pair<FileExtent, size_t>& b)
+{
+  return a.first.offset < b.first.offset;
+}
+
+// Order of extents by file offset, with each extent's position in data
+void sort_extents(const std::vector<FileExtent>& extents,
+                  std::vector<std::pair<FileExtent, size_t> >& sorted)
+{
+  sorted.clear();
+  size_t data_pos = 0;
+  for (size_t i = 0; i < extents.size(); ++i) {
+    sorted.push_back(std::make_pair(extents[i], data_pos));
+    data_pos += static_cast<size_t>(extents[i].length);
+  }
+
+  std::sort(sorted.begin(), sorted.end(), extent_offset_less);
+}
+
+} // namespace
+
+bool read_file_extents_stable(const std::string& file_path,
+                              std::vector<unsigned char>& data,
+                              std::vector<FileExtent>& extents,
+                              unsigned long long& size,
+                              unsigned long long& mtime_sec,
+                              unsigned long& mtime_nsec)
+{
+  TraceSpan span("io", "read_file_extents_stable", trace_detail(file_path));
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->read_file_extents_stable(file_path, data, extents, size,
+                                                 mtime_sec, mtime_nsec);
+  }
+
+  ACE_HANDLE handle = ACE_OS::open(file_path.c_str(), O_RDONLY);
+  if (handle == ACE_INVALID_HANDLE) {
+    return false;
+  }
+
+  ACE_stat before;
+  if (ACE_OS::fstat(handle, &before) != 0) {
+    ACE_OS::close(handle);
+    return false;
+  }
+
+  size = static_cast<unsigned long long>(before.st_size);
+  find_data_extents(handle, size, extents);
+
+  unsigned long long data_size = 0;
+  for (size_t i = 0; i < extents.size(); ++i) {
+    data_size += extents[i].length;
+  }
+  data.resize(static_cast<size_t>(data_size));
+
+  bool complete = true;
+  size_t data_pos = 0;
+  for (size_t i = 0; i < extents.size() && complete; ++i) {
+    unsigned long long done = 0;
+    while (done < extents[i].length) {
+      ssize_t n = ACE_OS::pread(handle, &data[data_pos],
+                                static_cast<size_t>(extents[i].length - done),
+                                static_cast<ACE_OFF_T>(extents[i].offset + done));
+      if (n <= 0) {
+        complete = false; // Error, or file truncated underneath us
+        break;
+      }
+      done += static_cast<unsigned long long>(n);
+      data_pos += static_cast<size_t>(n);
+    }
+  }
+
+  ACE_stat after;
+  bool stable = complete &&
+                ACE_OS::fstat(handle, &after) == 0 &&
+                same_file_state(before, after);
+  ACE_OS::close(handle);
+
+  if (!stable) {
+    return false;
+  }
+
+  // Same granularity as get_file_mtime() so metadata comparisons stay consistent
+  mtime_sec = static_cast<unsigned long long>(after.st_mtime);
+  mtime_nsec = 0;
+  return true;
+}
+
+unsigned long calculate_extents_crc32(const unsigned char* data,
+                                      const std::vector<FileExtent>& extents,
+                                      unsigned long long size)
+{
+  std::vector<std::pair<FileExtent, size_t> > sorted;
+  sort_extents(extents, sorted);
+
+  unsigned long crc = 0xFFFFFFFF;
+  unsigned long long pos = 0;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    const FileExtent& extent = sorted[i].first;
+    crc = calculate_crc32_zeros(extent.offset - pos, crc);
+    crc = calculate_crc32_incremental(data + sorted[i].second,
+                                      static_cast<size_t>(extent.length),
+                                      crc);
+    pos = extent.offset + extent.length;
+  }
+  crc = calculate_crc32_zeros(size - pos, crc);
+  return finalize_crc32(crc);
+}
+
+namespace {
+
+// Bytes compared per read by file_matches_image()
+const size_t COMPARE_BLOCK_SIZE = 256 * 1024;
+
+// Read exactly length bytes at offset, from the mounted FileSystem or an
+// open file
+bool read_block(FileSystem* file_system,
+                const std::string& file_path,
+                ACE_HANDLE handle,
+                unsigned long long offset,
+                size_t length,
+                std::vector<unsigned char>& buffer)
+{
+  if (file_system) {
+    return file_system->read_file_range(file_path, offset, length, buffer);
+  }
+
+  buffer.resize(length);
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = ACE_OS::pread(handle, &buffer[done], length - done,
+                              static_cast<ACE_OFF_T>(offset + done));
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Compare a file range with expected bytes, or with zeros if expected is 0
+bool range_matches(FileSystem* file_system,
+                   const std::string& file_path,
+                   ACE_HANDLE handle,
+                   unsigned long long offset,
+                   unsigned long long length,
+                   const unsigned char* expected,
+                   std::vector<unsigned char>& buffer)
+{
+  while (length > 0) {
+    const size_t block = static_cast<size_t>(
+      std::min(length, static_cast<unsigned long long>(COMPARE_BLOCK_SIZE)));
+    if (!read_block(file_system, file_path, handle, offset, block, buffer)) {
+      return false;
+    }
+    if (expected ? std::memcmp(&buffer[0], expected, block) != 0
+                 : !is_zero_block(&buffer[0], block)) {
+      return false;
+    }
+    if (expected) {
+      expected += block;
+    }
+    offset += block;
+    length -= block;
+  }
+  return true;
+}
+
+// Check that a file range reads as zeros; holes (SEEK_HOLE) are skipped
+// without reading them
+bool zeros_match(FileSystem* file_system,
+                 const std::string& file_path,
+                 ACE_HANDLE handle,
+                 unsigned long long offset,
+                 unsigned long long length,
+                 std::vector<unsigned char>& buffer)
+{
+#if defined (SEEK_DATA) && defined (SEEK_HOLE)
+  const unsigned long long end = offset + length;
+  while (!file_system && offset < end) {
+    ACE_OFF_T data_start = ACE_OS::lseek(handle, static_cast<ACE_OFF_T>(offset), SEEK_DATA);
+    if (data_start < 0) {
+      if (errno == ENXIO) {
+        return true; // Only a hole remains up to EOF
+      }
+      break; // Not supported by this filesystem: read the rest
+    }
+    if (static_cast<unsigned long long>(data_start) >= end) {
+      return true;
+    }
+    ACE_OFF_T hole_start = ACE_OS::lseek(handle, data_start, SEEK_HOLE);
+    if (hole_start < 0) {
+      offset = static_cast<unsigned long long>(data_start);
+      break;
+    }
+    const unsigned long long data_end =
+      std::min(static_cast<unsigned long long>(hole_start), end);
+    if (!range_matches(file_system, file_path, handle,
+                       static_cast<unsigned long long>(data_start),
+                       data_end - static_cast<unsigned long long>(data_start),
+                       0, buffer)) {
+      return false;
+    }
+    offset = data_end;
+  }
+  if (offset >= end) {
+    return true;
+  }
+  length = end - offset;
+#endif
+  return range_matches(file_system, file_path, handle, offset, length, 0, buffer);
+}
+
+} // namespace
+
+bool file_matches_image(const std::string& file_path,
+                        const unsigned char* data,
+                        const std::vector<FileExtent>& extents,
+                        unsigned long long size)
+{
+  TraceSpan span("io", "file_matches_image", trace_detail(file_path));
+  unsigned long long file_size;
+  if (!get_file_size(file_path, file_size) || file_size != size) {
+    return false;
+  }
+
+  FileSystem* file_system = FileSystem::mounted();
+  ACE_HANDLE handle = ACE_INVALID_HANDLE;
+  if (!file_system) {
+    handle = ACE_OS::open(file_path.c_str(), O_RDONLY);
+    if (handle == ACE_INVALID_HANDLE) {
+      return false;
+    }
+  }
+
+  std::vector<std::pair<FileExtent, size_t> > sorted;
+  sort_extents(extents, sorted);
+
+  // Extent by extent, one block at a time; between the extents (and after
+  // the last) the file must hold zeros
+  std::vector<unsigned char> buffer;
+  unsigned long long pos = 0;
+  bool matches = true;
+  for (size_t i = 0; i < sorted.size() && matches; ++i) {
+    const FileExtent& extent = sorted[i].first;
+    matches = extent.offset >= pos && extent.offset + extent.length <= size &&
+              zeros_match(file_system, file_path, handle, pos, extent.offset - pos, buffer) &&
+              range_matches(file_system, file_path, handle, extent.offset, extent.length,
+                            data + sorted[i].second, buffer);
+    pos = extent.offset + extent.length;
+  }
+  matches = matches && zeros_match(file_system, file_path, handle, pos, size - pos, buffer);
+
+  if (handle != ACE_INVALID_HANDLE) {
+    ACE_OS::close(handle);
+  }
+  return matches;
+}
+
 bool write_file(const std::string& file_path,
                 const unsigned char* data,
                 size_t size)
 {
+  TraceSpan span("io", "write_file", trace_detail(file_path));
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->write_file(file_path, data, size);
+  }
+
   std::ofstream file(file_path.c_str(), std::ios::binary);
   if (!file.is_open()) {
     return false;
@@ -44,8 +502,139 @@ bool write_file(const std::string& file_path,
   return true;
 }
 
+bool write_file_sparse(const std::string& file_path,
+                       const unsigned char* data,
+                       const std::vector<FileExtent>& extents,
+                       unsigned long long size)
+{
+  TraceSpan span("io", "write_file_sparse", trace_detail(file_path));
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->write_file_sparse(file_path, data, extents, size);
+  }
+
+  // Zero blocks are skipped at this granularity (typical filesystem block)
+  const unsigned long long SPARSE_BLOCK_SIZE = 4096;
+
+  ACE_HANDLE handle = ACE_OS::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (handle == ACE_INVALID_HANDLE) {
+    return false;
+  }
+
+  bool ok = true;
+  size_t data_pos = 0;
+  for (size_t i = 0; i < extents.size() && ok; ++i) {
+    const FileExtent& extent = extents[i];
+    const unsigned char* extent_data = data + data_pos;
+    data_pos += static_cast<size_t>(extent.length);
+
+    // Write runs of non-zero blocks, leaving zero blocks as holes
+    unsigned long long end = extent.offset + extent.length;
+    unsigned long long run_start = extent.offset;
+    unsigned long long pos = extent.offset;
+    while (pos < end && ok) {
+      unsigned long long block_end = std::min(end, (pos / SPARSE_BLOCK_SIZE + 1) * SPARSE_BLOCK_SIZE);
+      if (is_zero_block(extent_data + (pos - extent.offset),
+                        static_cast<size_t>(block_end - pos))) {
+        if (pos > run_start) {
+          ok = pwrite_all(handle, extent_data + (run_start - extent.offset),
+                          static_cast<size_t>(pos - run_start), run_start);
+        }
+        run_start = block_end;
+      }
+      pos = block_end;
+    }
+    if (ok && end > run_start) {
+      ok = pwrite_all(handle, extent_data + (run_start - extent.offset),
+                      static_cast<size_t>(end - run_start), run_start);
+    }
+  }
+
+  // Sets the logical size; a trailing hole is not allocated
+  if (ok && ACE_OS::ftruncate(handle, static_cast<ACE_OFF_T>(size)) != 0) {
+    ok = false;
+  }
+
+  return ACE_OS::close(handle) == 0 && ok;
+}
+
+bool clone_file(const std::string& source_path, const std::string& dest_path)
+{
+  TraceSpan span("io", "clone_file", trace_detail(dest_path));
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->clone_file(source_path, dest_path);
+  }
+
+  ACE_HANDLE src = ACE_OS::open(source_path.c_str(), O_RDONLY);
+  if (src == ACE_INVALID_HANDLE) {
+    return false;
+  }
+
+  ACE_stat st;
+  if (ACE_OS::fstat(src, &st) != 0) {
+    ACE_OS::close(src);
+    return false;
+  }
+
+  // Same directory as dest_path, so that the rename cannot cross devices
+  const std::string temp_path = dest_path + TEMP_FILE_SUFFIX;
+  ACE_HANDLE dst = ACE_OS::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (dst == ACE_INVALID_HANDLE) {
+    ACE_OS::close(src);
+    return false;
+  }
+
+  const unsigned long long size = static_cast<unsigned long long>(st.st_size);
+  unsigned long long copied = 0;
+
+#if defined (__linux__) && defined (FICLONE)
+  // Reflink: no data is copied, the filesystem shares the extents
+  if (::ioctl(dst, FICLONE, src) == 0) {
+    copied = size;
+  }
+#endif
+
+#if defined (__linux__) && defined (__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  // In-kernel copy (may still share extents on some filesystems)
+  while (copied < size) {
+    loff_t in_off = static_cast<loff_t>(copied);
+    loff_t out_off = static_cast<loff_t>(copied);
+    ssize_t n = ::copy_file_range(src, &in_off, dst, &out_off,
+                                  static_cast<size_t>(size - copied), 0);
+    if (n <= 0) {
+      break; // Unsupported here (e.g. cross-device); fall back below
+    }
+    copied += static_cast<unsigned long long>(n);
+  }
+#endif
+
+  // Portable fallback for whatever is left
+  std::vector<unsigned char> buffer(copied < size ? 1024 * 1024 : 0);
+  while (copied < size) {
+    ssize_t n = ACE_OS::pread(src, &buffer[0], buffer.size(), static_cast<ACE_OFF_T>(copied));
+    if (n <= 0 ||
+        ACE_OS::pwrite(dst, &buffer[0], static_cast<size_t>(n),
+                       static_cast<ACE_OFF_T>(copied)) != n) {
+      break;
+    }
+    copied += static_cast<unsigned long long>(n);
+  }
+
+  ACE_OS::close(src);
+  if (ACE_OS::close(dst) != 0 || copied != size ||
+      ACE_OS::rename(temp_path.c_str(), dest_path.c_str()) != 0) {
+    ACE_OS::unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
 bool get_file_size(const std::string& file_path, unsigned long long& size)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->get_file_size(file_path, size);
+  }
+
   ACE_stat st;
   if (ACE_OS::stat(file_path.c_str(), &st) != 0) {
     return false;
@@ -59,6 +648,10 @@ bool get_file_mtime(const std::string& file_path,
                     unsigned long long& sec,
                     unsigned long& nsec)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->get_file_mtime(file_path, sec, nsec);
+  }
+
   ACE_stat st;
   if (ACE_OS::stat(file_path.c_str(), &st) != 0) {
     return false;
@@ -75,6 +668,10 @@ bool set_file_mtime(const std::string& file_path,
                     unsigned long long sec,
                     unsigned long nsec)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->set_file_mtime(file_path, sec, nsec);
+  }
+
   // Get current access time
   ACE_stat st;
   if (ACE_OS::stat(file_path.c_str(), &st) != 0) {
@@ -91,6 +688,10 @@ bool set_file_mtime(const std::string& file_path,
 
 bool file_exists(const std::string& file_path)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->file_exists(file_path);
+  }
+
   ACE_stat st;
   if (ACE_OS::stat(file_path.c_str(), &st) != 0) {
     return false;
@@ -101,6 +702,10 @@ bool file_exists(const std::string& file_path)
 
 bool is_directory(const std::string& path)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->is_directory(path);
+  }
+
   ACE_stat st;
   if (ACE_OS::stat(path.c_str(), &st) != 0) {
     return false;
@@ -110,12 +715,21 @@ bool is_directory(const std::string& path)
 
 bool delete_file(const std::string& file_path)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->delete_file(file_path);
+  }
+
   return ACE_OS::unlink(file_path.c_str()) == 0;
 }
 
 bool list_directory_files(const std::string& directory_path,
-                         std::vector<std::string>& files)
+                         std::vector<std::string>& files,
+                         const IgnoreMatcher* ignore)
 {
+  if (FileSystem* file_system = FileSystem::mounted()) {
+    return file_system->list_directory_files(directory_path, files, ignore);
+  }
+
   files.clear();
 
   // Check if directory exists
@@ -133,6 +747,18 @@ bool list_directory_files(const std::string& directory_path,
       continue;
     }
 
+    // Skip ignored names before any filesystem work
+    if (ignore && ignore->ignored(filename)) {
+      continue;
+    }
+
+    // Skip copies in progress (clone_file())
+    const size_t suffix_length = ACE_OS::strlen(TEMP_FILE_SUFFIX);
+    if (filename.size() > suffix_length &&
+        filename.compare(filename.size() - suffix_length, suffix_length, TEMP_FILE_SUFFIX) == 0) {
+      continue;
+    }
+
     // Build full path
     std::string full_path = directory_path;
     if (!full_path.empty() && full_path[full_path.length() - 1] != '/' &&
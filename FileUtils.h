@@ -6,6 +6,8 @@
 
 namespace DirShare {
 
+class IgnoreMatcher;
+
 /**
  * File I/O utility functions
  * Provides cross-platform file operations with timestamp preservation
@@ -19,6 +21,75 @@ namespace DirShare {
  */
 bool read_file(const std::string& file_path, std::vector<unsigned char>& data);
 
+/**
+ * Read a byte range of a file
+ * @param file_path Path to file
+ * @param offset Byte offset of the range
+ * @param length Number of bytes to read
+ * @param data Output: range contents (exactly length bytes)
+ * @return true if successful, false on error or if the range ends past EOF
+ */
+bool read_file_range(const std::string& file_path,
+                     unsigned long long offset,
+                     size_t length,
+                     std::vector<unsigned char>& data);
+
+/**
+ * Read entire file into buffer, guarding against concurrent modification
+ * Takes fstat() of the open file before and after the read; if size, inode,
+ * mtime or ctime changed in between, the read is rejected so that a caller
+ * never publishes bytes that mix two versions of the file
+ * @param file_path Path to file
+ * @param data Output: file contents (a consistent view)
+ * @param mtime_sec Output: modification time of the bytes read (seconds)
+ * @param mtime_nsec Output: modification time of the bytes read (nanoseconds part)
+ * @return true if a stable view was read, false on error or concurrent change
+ */
+bool read_file_stable(const std::string& file_path,
+                      std::vector<unsigned char>& data,
+                      unsigned long long& mtime_sec,
+                      unsigned long& mtime_nsec);
+
+/**
+ * Byte range of a file that holds data
+ * Ranges not covered by any extent are holes and read as zeros
+ */
+struct FileExtent {
+  unsigned long long offset;
+  unsigned long long length;
+};
+
+/**
+ * Read the data extents of a file, guarding against concurrent modification
+ * Same consistency check as read_file_stable(), but holes are located with
+ * SEEK_DATA/SEEK_HOLE and not read, so a sparse file costs only its
+ * allocated size. Where SEEK_DATA is unsupported the whole file is one extent
+ * @param file_path Path to file
+ * @param data Output: contents of the data extents, concatenated in order
+ * @param extents Output: data extents in ascending offset order
+ * @param size Output: logical file size (including holes)
+ * @param mtime_sec Output: modification time of the bytes read (seconds)
+ * @param mtime_nsec Output: modification time of the bytes read (nanoseconds part)
+ * @return true if a stable view was read, false on error or concurrent change
+ */
+bool read_file_extents_stable(const std::string& file_path,
+                              std::vector<unsigned char>& data,
+                              std::vector<FileExtent>& extents,
+                              unsigned long long& size,
+                              unsigned long long& mtime_sec,
+                              unsigned long& mtime_nsec);
+
+/**
+ * Calculate the CRC32 of a sparse file image without materializing holes
+ * @param data Contents of the extents, concatenated in the order of extents
+ * @param extents Data extents (any order, non-overlapping)
+ * @param size Logical file size
+ * @return CRC32 checksum of the complete file
+ */
+unsigned long calculate_extents_crc32(const unsigned char* data,
+                                      const std::vector<FileExtent>& extents,
+                                      unsigned long long size);
+
 /**
  * Write buffer to file
  * @param file_path Path to file
@@ -30,6 +101,54 @@ bool write_file(const std::string& file_path,
                 const unsigned char* data,
                 size_t size);
 
+/**
+ * Write a sparse file image
+ * The file is truncated and only non-zero blocks of each extent are written,
+ * so holes on the sender (and zero blocks inside extents) stay unallocated
+ * @param file_path Path to file
+ * @param data Contents of the extents, concatenated in the order of extents
+ * @param extents Data extents (any order, non-overlapping)
+ * @param size Logical file size
+ * @return true if successful, false on error
+ */
+bool write_file_sparse(const std::string& file_path,
+                       const unsigned char* data,
+                       const std::vector<FileExtent>& extents,
+                       unsigned long long size);
+
+/**
+ * Check whether a file holds exactly the bytes of a (sparse) file image
+ * Compares the bytes themselves, not a checksum, a block at a time; holes
+ * of the file (SEEK_HOLE) are not read. Stops at the first difference
+ * @param file_path Path to file
+ * @param data Contents of the extents, concatenated in the order of extents
+ * @param extents Data extents (any order, non-overlapping); the rest is zeros
+ * @param size Logical file size
+ * @return true if the file exists and its contents equal the image
+ */
+bool file_matches_image(const std::string& file_path,
+                        const unsigned char* data,
+                        const std::vector<FileExtent>& extents,
+                        unsigned long long size);
+
+/**
+ * Suffix of the temporary files written next to a file being replaced;
+ * list_directory_files() leaves them out
+ */
+extern const char* const TEMP_FILE_SUFFIX;
+
+/**
+ * Materialize a copy of a local file under another name
+ * Tries a copy-on-write reflink (FICLONE) first, so the copy shares disk
+ * extents with the source, then copy_file_range(), then a read/write copy.
+ * The copy is made in a temporary file next to dest_path and renamed over
+ * it only once complete, so an existing dest_path is never left partial
+ * @param source_path Path to existing file
+ * @param dest_path Path to create or replace
+ * @return true if successful, false on error (dest_path is unchanged)
+ */
+bool clone_file(const std::string& source_path, const std::string& dest_path);
+
 /**
  * Get file size
  * @param file_path Path to file
@@ -84,13 +203,16 @@ bool delete_file(const std::string& file_path);
 
 /**
  * List all regular files in directory (non-recursive)
- * Ignores subdirectories, symbolic links, and special files
+ * Ignores subdirectories, symbolic links, special files and the temporary
+ * files of clone_file() (TEMP_FILE_SUFFIX)
  * @param directory_path Path to directory
  * @param files Output: list of filenames (relative to directory)
+ * @param ignore Names to leave out, checked before the entry is stat'ed (0: none)
  * @return true if successful, false on error
  */
 bool list_directory_files(const std::string& directory_path,
-                         std::vector<std::string>& files);
+                         std::vector<std::string>& files,
+                         const IgnoreMatcher* ignore = 0);
 
 /**
  * Validate filename for security
@@ -0,0 +1,365 @@
+// IgnoreMatcher.cpp
+// Implementation of the compiled ignore patterns
+
+#include "IgnoreMatcher.h"
+
+#include <ace/Log_Msg.h>
+
+#include <fstream>
+
+namespace DirShare {
+
+const char* const IGNORE_FILE_NAME = ".dirshareignore";
+
+IgnoreMatcher::IgnoreMatcher()
+  : prefixes_(1)
+  , suffixes_(1)
+{
+}
+
+IgnoreMatcher::~IgnoreMatcher()
+{
+}
+
+bool IgnoreMatcher::load_file(const std::string& path)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    add_pattern(line);
+  }
+  return true;
+}
+
+bool IgnoreMatcher::add_pattern(const std::string& line)
+{
+  std::string pattern = line;
+  if (!pattern.empty() && pattern[pattern.size() - 1] == '\r') {
+    pattern.erase(pattern.size() - 1);
+  }
+
+  // Trailing spaces are dropped unless quoted with '\'
+  while (!pattern.empty() && pattern[pattern.size() - 1] == ' ' &&
+         !(pattern.size() >= 2 && pattern[pattern.size() - 2] == '\\')) {
+    pattern.erase(pattern.size() - 1);
+  }
+
+  if (pattern.empty() || pattern[0] == '#') {
+    return false;
+  }
+
+  bool negate = false;
+  if (pattern[0] == '!') {
+    negate = true;
+    pattern.erase(0, 1);
+  }
+
+  // Only regular files at the top of the share are synced: a pattern for
+  // directories only, or for a path inside one, can never match
+  if (!pattern.empty() && pattern[pattern.size() - 1] == '/') {
+    return false;
+  }
+  if (!pattern.empty() && pattern[0] == '/') {
+    pattern.erase(0, 1);
+  }
+  while (pattern.compare(0, 3, "**/") == 0) {
+    pattern.erase(0, 3);
+  }
+  if (pattern.empty() || pattern.find('/') != std::string::npos) {
+    return false;
+  }
+
+  std::vector<Token> tokens;
+  std::vector<std::bitset<256> > classes;
+  if (!compile(pattern, tokens, classes)) {
+    return false;
+  }
+
+  // Classify by shape: literal, "literal*", "*literal" or general glob
+  size_t stars = 0;
+  size_t others = 0;
+  std::string literal;
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    if (tokens[i].kind == Token::LITERAL) {
+      literal += static_cast<char>(tokens[i].ch);
+    } else if (tokens[i].kind == Token::STAR) {
+      ++stars;
+    } else {
+      ++others;
+    }
+  }
+
+  const int rule = static_cast<int>(negate_.size());
+  if (others == 0 && stars == 0) {
+    exact_[literal] = rule;
+  } else if (others == 0 && stars == 1 &&
+             tokens[tokens.size() - 1].kind == Token::STAR) {
+    trie_insert(prefixes_, literal, rule);
+  } else if (others == 0 && stars == 1 && tokens[0].kind == Token::STAR) {
+    trie_insert(suffixes_, std::string(literal.rbegin(), literal.rend()), rule);
+  } else {
+    globs_.push_back(Glob());
+    if (!build_dfa(tokens, classes, globs_.back())) {
+      globs_.pop_back();
+      ACE_ERROR((LM_WARNING,
+                 ACE_TEXT("WARNING: %N:%l: Ignore pattern too complex, skipped: %C\n"),
+                 line.c_str()));
+      return false;
+    }
+    globs_.back().rule = rule;
+  }
+  negate_.push_back(negate);
+  return true;
+}
+
+bool IgnoreMatcher::ignored(const std::string& filename) const
+{
+  if (negate_.empty()) {
+    return false;
+  }
+
+  int best = -1;
+  std::map<std::string, int>::const_iterator exact = exact_.find(filename);
+  if (exact != exact_.end()) {
+    best = exact->second;
+  }
+  best = trie_best(prefixes_, filename, false, best);
+  best = trie_best(suffixes_, filename, true, best);
+
+  // Only a glob added after the best match so far can change the outcome
+  for (size_t i = globs_.size(); i-- > 0 && globs_[i].rule > best; ) {
+    if (run(globs_[i], filename)) {
+      best = globs_[i].rule;
+      break;
+    }
+  }
+
+  return best >= 0 && !negate_[best];
+}
+
+bool IgnoreMatcher::compile(const std::string& pattern,
+                            std::vector<Token>& tokens,
+                            std::vector<std::bitset<256> >& classes)
+{
+  tokens.clear();
+  classes.clear();
+
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    Token token;
+    token.ch = 0;
+    token.char_class = 0;
+    const char c = pattern[i];
+
+    if (c == '*') {
+      if (!tokens.empty() && tokens[tokens.size() - 1].kind == Token::STAR) {
+        continue;
+      }
+      token.kind = Token::STAR;
+    } else if (c == '?') {
+      token.kind = Token::ANY;
+    } else if (c == '\\') {
+      if (++i == pattern.size()) {
+        return false;  // Trailing backslash: invalid, as in git
+      }
+      token.kind = Token::LITERAL;
+      token.ch = static_cast<unsigned char>(pattern[i]);
+    } else if (c == '[') {
+      // Parse the class; without a closing ']' the '[' is a literal
+      std::bitset<256> set;
+      size_t j = i + 1;
+      bool invert = false;
+      if (j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^')) {
+        invert = true;
+        ++j;
+      }
+      bool closed = false;
+      bool first = true;
+      for (; j < pattern.size(); ++j, first = false) {
+        unsigned char lo = static_cast<unsigned char>(pattern[j]);
+        if (lo == ']' && !first) {
+          closed = true;
+          break;
+        }
+        if (lo == '\\' && j + 1 < pattern.size()) {
+          lo = static_cast<unsigned char>(pattern[++j]);
+        }
+        unsigned char hi = lo;
+        if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+          j += 2;
+          if (pattern[j] == '\\' && j + 1 < pattern.size()) {
+            ++j;
+          }
+          hi = static_cast<unsigned char>(pattern[j]);
+        }
+        for (unsigned int ch = lo; ch <= hi; ++ch) {
+          set.set(ch);
+        }
+      }
+
+      if (closed) {
+        if (invert) {
+          set.flip();
+        }
+        token.kind = Token::CLASS;
+        token.char_class = classes.size();
+        classes.push_back(set);
+        i = j;
+      } else {
+        token.kind = Token::LITERAL;
+        token.ch = '[';
+      }
+    } else {
+      token.kind = Token::LITERAL;
+      token.ch = static_cast<unsigned char>(c);
+    }
+    tokens.push_back(token);
+  }
+  return true;
+}
+
+void IgnoreMatcher::trie_insert(std::vector<TrieNode>& trie,
+                                const std::string& key, int rule)
+{
+  int node = 0;
+  for (size_t i = 0; i < key.size(); ++i) {
+    const unsigned char c = static_cast<unsigned char>(key[i]);
+    std::map<unsigned char, int>::iterator next = trie[node].next.find(c);
+    if (next == trie[node].next.end()) {
+      const int child = static_cast<int>(trie.size());
+      trie[node].next[c] = child;
+      trie.push_back(TrieNode());
+      node = child;
+    } else {
+      node = next->second;
+    }
+  }
+  trie[node].rule = rule;
+}
+
+int IgnoreMatcher::trie_best(const std::vector<TrieNode>& trie,
+                             const std::string& text, bool reversed, int best)
+{
+  int node = 0;
+  for (size_t i = 0; ; ++i) {
+    if (trie[node].rule > best) {
+      best = trie[node].rule;
+    }
+    if (i == text.size()) {
+      break;
+    }
+    const unsigned char c = static_cast<unsigned char>(
+      reversed ? text[text.size() - 1 - i] : text[i]);
+    std::map<unsigned char, int>::const_iterator next = trie[node].next.find(c);
+    if (next == trie[node].next.end()) {
+      break;
+    }
+    node = next->second;
+  }
+  return best;
+}
+
+bool IgnoreMatcher::build_dfa(const std::vector<Token>& tokens,
+                              const std::vector<std::bitset<256> >& classes,
+                              Glob& glob)
+{
+  const size_t positions = tokens.size() + 1;  // Last: whole glob matched
+
+  // Bytes that every token accepts or rejects alike share a column
+  std::map<std::vector<bool>, unsigned char> signatures;
+  std::vector<unsigned char> representative;
+  for (unsigned int b = 0; b < 256; ++b) {
+    std::vector<bool> signature(tokens.size());
+    for (size_t p = 0; p < tokens.size(); ++p) {
+      const Token& token = tokens[p];
+      signature[p] = (token.kind == Token::LITERAL && token.ch == b) ||
+        (token.kind == Token::CLASS && classes[token.char_class].test(b));
+    }
+    std::map<std::vector<bool>, unsigned char>::iterator known = signatures.find(signature);
+    if (known == signatures.end()) {
+      const unsigned char column = static_cast<unsigned char>(representative.size());
+      known = signatures.insert(std::make_pair(signature, column)).first;
+      representative.push_back(static_cast<unsigned char>(b));
+    }
+    glob.column[b] = known->second;
+  }
+  glob.columns = representative.size();
+
+  // A DFA state is the set of token positions the name can have reached;
+  // a '*' position also reaches the next one without consuming anything
+  std::vector<std::vector<bool> > states;
+  std::map<std::vector<bool>, int> index;
+
+  std::vector<bool> start(positions);
+  start[0] = true;
+  for (size_t p = 0; p + 1 < positions; ++p) {
+    if (start[p] && tokens[p].kind == Token::STAR) {
+      start[p + 1] = true;
+    }
+  }
+  states.push_back(start);
+  index[start] = 0;
+
+  glob.next.clear();
+  glob.accept.clear();
+  for (size_t s = 0; s < states.size(); ++s) {
+    glob.accept.push_back(states[s][positions - 1]);
+
+    for (size_t c = 0; c < glob.columns; ++c) {
+      const unsigned char b = representative[c];
+      std::vector<bool> target(positions);
+      bool any = false;
+      for (size_t p = 0; p + 1 < positions; ++p) {
+        if (!states[s][p]) {
+          continue;
+        }
+        const Token& token = tokens[p];
+        if (token.kind == Token::STAR) {
+          target[p] = any = true;
+        } else if (token.kind == Token::ANY ||
+                   (token.kind == Token::LITERAL && token.ch == b) ||
+                   (token.kind == Token::CLASS && classes[token.char_class].test(b))) {
+          target[p + 1] = any = true;
+        }
+      }
+      if (!any) {
+        glob.next.push_back(-1);
+        continue;
+      }
+      for (size_t p = 0; p + 1 < positions; ++p) {
+        if (target[p] && tokens[p].kind == Token::STAR) {
+          target[p + 1] = true;
+        }
+      }
+
+      std::map<std::vector<bool>, int>::iterator known = index.find(target);
+      if (known == index.end()) {
+        if (states.size() == MAX_GLOB_STATES) {
+          return false;
+        }
+        known = index.insert(std::make_pair(target, static_cast<int>(states.size()))).first;
+        states.push_back(target);
+      }
+      glob.next.push_back(known->second);
+    }
+  }
+  return true;
+}
+
+bool IgnoreMatcher::run(const Glob& glob, const std::string& text)
+{
+  int state = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    state = glob.next[state * glob.columns +
+                      glob.column[static_cast<unsigned char>(text[i])]];
+    if (state < 0) {
+      return false;
+    }
+  }
+  return glob.accept[state];
+}
+
+} // namespace DirShare
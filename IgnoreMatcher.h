@@ -0,0 +1,135 @@
+// IgnoreMatcher.h
+// Compiled .dirshareignore patterns: files that are neither scanned,
+// published nor accepted from peers
+
+#ifndef DIRSHARE_IGNORE_MATCHER_H
+#define DIRSHARE_IGNORE_MATCHER_H
+
+#include <bitset>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/// Name of the ignore file, read from the root of the shared directory
+extern const char* const IGNORE_FILE_NAME;
+
+/**
+ * @class IgnoreMatcher
+ * @brief gitignore-style patterns compiled for per-filename lookups
+ *
+ * Each line of the ignore file is one pattern, as in .gitignore: blank
+ * lines and lines starting with '#' are skipped, a leading '!' re-includes
+ * files excluded by an earlier pattern, and the last matching pattern
+ * decides. '*' matches any run of characters, '?' one character, "[a-z]"
+ * and "[!a-z]" a character class; '\' quotes the next character. The share
+ * is flat, so a leading '/' or "**" directory prefix is dropped, and
+ * patterns that can only match inside a subdirectory ("dir/", "a/b") are
+ * skipped.
+ *
+ * Patterns are compiled by shape. Literal names go to a map of exact
+ * names, "prefix*" and "*suffix" patterns to a prefix trie and a trie of
+ * reversed suffixes, and each remaining glob to a DFA: bytes that no token
+ * of the glob tells apart share one column, and each state has one entry
+ * per column, so a match costs one table lookup per character and never
+ * backtracks. One lookup walks both tries once over the name, whatever the
+ * number of patterns, and runs the general globs from the last one down
+ * until one matches or it reaches a pattern older than the best match so
+ * far. A glob whose DFA would exceed MAX_GLOB_STATES states (a '*' followed
+ * by many '?' or classes) is skipped with a warning.
+ *
+ * The matcher is read-only after loading and may be shared between
+ * threads.
+ */
+class IgnoreMatcher {
+public:
+  IgnoreMatcher();
+  ~IgnoreMatcher();
+
+  /**
+   * Load patterns from an ignore file
+   * @param path Path to the ignore file
+   * @return false if the file cannot be read (no patterns added)
+   */
+  bool load_file(const std::string& path);
+
+  /**
+   * Compile one line of an ignore file
+   * @param line Pattern line (comments and blank lines are accepted and skipped)
+   * @return true if a pattern was added
+   */
+  bool add_pattern(const std::string& line);
+
+  /**
+   * @return Number of compiled patterns
+   */
+  size_t size() const { return negate_.size(); }
+
+  bool empty() const { return negate_.empty(); }
+
+  /// Largest DFA built for one glob
+  static const size_t MAX_GLOB_STATES = 1024;
+
+  /**
+   * Check whether a file is ignored
+   * @param filename Filename relative to the shared directory
+   * @return true if the last pattern matching the name is not negated
+   */
+  bool ignored(const std::string& filename) const;
+
+private:
+  struct Token {
+    enum Kind { LITERAL, ANY, CLASS, STAR };
+    Kind kind;
+    unsigned char ch;     // LITERAL
+    size_t char_class;    // CLASS: index into classes_
+  };
+
+  // A general glob as a DFA. State 0 is the start; a transition to -1
+  // means no continuation of the name can match
+  struct Glob {
+    unsigned char column[256];  // Byte -> column of the transition table
+    size_t columns;
+    std::vector<int> next;      // state * columns + column -> state
+    std::vector<bool> accept;   // Per state
+    int rule;
+  };
+
+  struct TrieNode {
+    std::map<unsigned char, int> next;
+    int rule;             // Highest rule ending at this node (-1: none)
+    TrieNode() : rule(-1) {}
+  };
+
+  // Parse a pattern body into tokens; false if it is malformed
+  static bool compile(const std::string& pattern,
+                      std::vector<Token>& tokens,
+                      std::vector<std::bitset<256> >& classes);
+
+  // Subset construction over the token positions; false if the DFA would
+  // have more than MAX_GLOB_STATES states
+  static bool build_dfa(const std::vector<Token>& tokens,
+                        const std::vector<std::bitset<256> >& classes,
+                        Glob& glob);
+
+  // Record a literal path in a trie
+  static void trie_insert(std::vector<TrieNode>& trie,
+                          const std::string& key, int rule);
+
+  // Highest rule on the path of text through a trie, or best if higher
+  static int trie_best(const std::vector<TrieNode>& trie,
+                       const std::string& text, bool reversed, int best);
+
+  static bool run(const Glob& glob, const std::string& text);
+
+  std::vector<bool> negate_;                  // Per rule, in file order
+  std::map<std::string, int> exact_;          // Literal names
+  std::vector<TrieNode> prefixes_;            // "prefix*"
+  std::vector<TrieNode> suffixes_;            // "*suffix", reversed
+  std::vector<Glob> globs_;                   // Everything else, by rule
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_IGNORE_MATCHER_H
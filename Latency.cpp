@@ -0,0 +1,218 @@
+// Latency.cpp
+// Implementation of propagation latency tracing
+
+#include "Latency.h"
+#include "Checksum.h"
+#include "Log.h"
+
+#include <ace/Atomic_Op.h>
+#include <ace/Guard_T.h>
+#include <ace/Log_Msg.h>
+#include <ace/High_Res_Timer.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <cstring>
+
+namespace DirShare {
+
+namespace {
+
+const char* const STAGE_NAMES[LatencyRecorder::STAGE_COUNT] = {
+  "scan", "queue", "transfer", "verify", "write"
+};
+
+long long to_usec(const ACE_Time_Value& value)
+{
+  return static_cast<long long>(value.sec()) * 1000000 + value.usec();
+}
+
+unsigned long clamp_usec(long long usec)
+{
+  if (usec < 0) {
+    return 0;
+  }
+  return usec > 0xFFFFFFFFLL ? 0xFFFFFFFFul : static_cast<unsigned long>(usec);
+}
+
+// High 32 bits of this process's event ids: host name, process id and
+// start time, so that ids from different participants do not collide
+uint64_t make_origin_prefix()
+{
+  char text[512];
+  char host[256];
+  if (ACE_OS::hostname(host, sizeof(host)) != 0) {
+    host[0] = '\0';
+  }
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  ACE_OS::snprintf(text, sizeof(text), "%s/%ld/%ld.%06ld", host,
+                   static_cast<long>(ACE_OS::getpid()),
+                   static_cast<long>(now.sec()), static_cast<long>(now.usec()));
+  const uint32_t hash = compute_checksum(reinterpret_cast<const uint8_t*>(text),
+                                         std::strlen(text));
+  return static_cast<uint64_t>(hash == 0 ? 1 : hash) << 32;
+}
+
+uint64_t origin_prefix()
+{
+  static const uint64_t prefix = make_origin_prefix();
+  return prefix;
+}
+
+ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long>& local_sequence()
+{
+  static ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long> sequence(0);
+  return sequence;
+}
+
+uint64_t next_event_id()
+{
+  const unsigned long n = ++local_sequence();
+  return origin_prefix() | (n & 0xFFFFFFFFul);
+}
+
+} // namespace
+
+ACE_Time_Value monotonic_now()
+{
+  return ACE_High_Res_Timer::gettimeofday_hr();
+}
+
+uint32_t local_origin()
+{
+  return static_cast<uint32_t>(origin_prefix() >> 32);
+}
+
+uint32_t last_local_sequence()
+{
+  return static_cast<uint32_t>(local_sequence().value() & 0xFFFFFFFFul);
+}
+
+LocalChange stamp_local_change(const FileMetadata& metadata)
+{
+  LocalChange change;
+  change.detected = monotonic_now();
+
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  change.origin.event_id = next_event_id();
+  change.origin.detect_sec = static_cast<CORBA::ULongLong>(now.sec());
+  change.origin.detect_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
+  change.origin.queue_usec = 0;
+
+  const long long modified_usec =
+    static_cast<long long>(metadata.timestamp_sec) * 1000000 + metadata.timestamp_nsec / 1000;
+  change.origin.scan_delay_usec = metadata.timestamp_sec == 0 ? 0 :
+    static_cast<CORBA::ULong>(clamp_usec(to_usec(now) - modified_usec));
+  return change;
+}
+
+ChangeOrigin origin_for_send(const LocalChange* change)
+{
+  ChangeOrigin origin;
+  if (!change) {
+    origin.event_id = 0;
+    origin.detect_sec = 0;
+    origin.detect_nsec = 0;
+    origin.scan_delay_usec = 0;
+    origin.queue_usec = 0;
+    return origin;
+  }
+
+  origin = change->origin;
+  origin.queue_usec = static_cast<CORBA::ULong>(
+    clamp_usec(to_usec(monotonic_now() - change->detected)));
+  return origin;
+}
+
+AppliedOrigins& AppliedOrigins::instance()
+{
+  static AppliedOrigins applied;
+  return applied;
+}
+
+void AppliedOrigins::applied(uint64_t event_id)
+{
+  const uint32_t origin = static_cast<uint32_t>(event_id >> 32);
+  const uint32_t sequence = static_cast<uint32_t>(event_id & 0xFFFFFFFFu);
+  if (origin == 0) {
+    return;
+  }
+
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  uint32_t& last = last_sequence_[origin];
+  if (sequence > last) {
+    last = sequence;
+  }
+}
+
+void AppliedOrigins::progress(OriginProgressSeq& progress) const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  progress.length(static_cast<CORBA::ULong>(last_sequence_.size()));
+  CORBA::ULong i = 0;
+  for (std::map<uint32_t, uint32_t>::const_iterator it = last_sequence_.begin();
+       it != last_sequence_.end(); ++it, ++i) {
+    progress[i].origin = it->first;
+    progress[i].last_sequence = it->second;
+  }
+}
+
+LatencyRecorder::LatencyRecorder(const std::string& path)
+  : path_(path)
+  , total_(MetricsRegistry::instance().histogram(
+      "dirshare_propagation_latency_seconds",
+      "Detection of a change on its origin to its apply here, by receive path",
+      1e-6, "path=\"" + path + "\""))
+{
+  for (int s = 0; s < STAGE_COUNT; ++s) {
+    stages_[s] = &MetricsRegistry::instance().histogram(
+      "dirshare_propagation_stage_seconds",
+      "Propagation latency of applied changes, by receive path and stage",
+      1e-6, "path=\"" + path + "\",stage=\"" + STAGE_NAMES[s] + "\"");
+  }
+}
+
+void LatencyRecorder::record(const std::string& filename,
+                             const ChangeOrigin& origin,
+                             const ACE_Time_Value& received,
+                             const ACE_Time_Value& verify,
+                             const ACE_Time_Value& write)
+{
+  if (origin.event_id == 0) {
+    return;
+  }
+  AppliedOrigins::instance().applied(origin.event_id);
+
+  const long long detected_usec =
+    static_cast<long long>(origin.detect_sec) * 1000000 + origin.detect_nsec / 1000;
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+
+  unsigned long usec[STAGE_COUNT];
+  usec[SCAN] = origin.scan_delay_usec;
+  usec[QUEUE] = origin.queue_usec;
+  usec[TRANSFER] = clamp_usec(to_usec(received) - detected_usec - origin.queue_usec);
+  usec[VERIFY] = clamp_usec(to_usec(verify));
+  usec[WRITE] = clamp_usec(to_usec(write));
+  const unsigned long total = clamp_usec(to_usec(now) - detected_usec);
+
+  for (int s = 0; s < STAGE_COUNT; ++s) {
+    stages_[s]->record(static_cast<uint64_t>(usec[s]));
+  }
+  total_.record(static_cast<uint64_t>(total));
+
+  DIRSHARE_DEBUG(("Latency of %s (event %llu, %s): %luus from detection "
+                  "(scan %luus, queue %luus, transfer %luus, verify %luus, write %luus)\n",
+                  filename.c_str(),
+                  static_cast<unsigned long long>(origin.event_id),
+                  path_.c_str(),
+                  total,
+                  usec[SCAN],
+                  usec[QUEUE],
+                  usec[TRANSFER],
+                  usec[VERIFY],
+                  usec[WRITE]));
+}
+
+} // namespace DirShare
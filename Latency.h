@@ -0,0 +1,130 @@
+// Latency.h
+// End-to-end propagation latency: origin stamps for local changes and the
+// per-stage latency histograms recorded by receivers
+
+#ifndef DIRSHARE_LATENCY_H
+#define DIRSHARE_LATENCY_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
+
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+
+#include <map>
+#include <string>
+
+namespace DirShare {
+
+/// Monotonic time, for durations measured on one host
+ACE_Time_Value monotonic_now();
+
+/// Origin id of this process: the high 32 bits of its event ids
+uint32_t local_origin();
+
+/// Sequence (low 32 bits of the event id) of the last change stamped here
+uint32_t last_local_sequence();
+
+/**
+ * A change found by a local scan, stamped at detection
+ * The origin is sent with the change; the monotonic detection time stays
+ * on this host and measures how long the change waits before it is sent.
+ */
+struct LocalChange {
+  ChangeOrigin origin;
+  ACE_Time_Value detected;  // Monotonic
+};
+
+/**
+ * Stamp a change detected now with a new event id
+ * @param metadata File metadata; its modification time gives the scan
+ *        delay (0 when there is none, e.g. for DELETE)
+ * @return Stamped change
+ */
+LocalChange stamp_local_change(const FileMetadata& metadata);
+
+/**
+ * Origin to put on a sample about to be written
+ * @param change Stamped change, or 0 for an untraced sample
+ * @return change->origin with the queue wait up to now filled in, or an
+ *         all-zero origin
+ */
+ChangeOrigin origin_for_send(const LocalChange* change);
+
+/**
+ * @class AppliedOrigins
+ * @brief Highest sequence of the traced changes applied here, per origin
+ *
+ * Changes of one origin may complete out of order (a large file finishes
+ * after a later small one), so this is the newest change applied rather
+ * than a guarantee that every older one was. Filled by LatencyRecorder.
+ */
+class AppliedOrigins {
+public:
+  /// The table of the process
+  static AppliedOrigins& instance();
+
+  /// Note a change as applied (event id 0 is ignored)
+  void applied(uint64_t event_id);
+
+  /**
+   * Copy the table
+   * @param progress Output: one entry per origin, by origin id
+   */
+  void progress(OriginProgressSeq& progress) const;
+
+private:
+  std::map<uint32_t, uint32_t> last_sequence_;  // Origin -> sequence
+  mutable ACE_Thread_Mutex lock_;
+};
+
+/**
+ * @class LatencyRecorder
+ * @brief Records the propagation latency of received changes
+ *
+ * For each traced change applied by a receive path, the delay from the
+ * origin's detection to the end of the local apply is recorded in
+ * dirshare_propagation_latency_seconds, and its stages in
+ * dirshare_propagation_stage_seconds:
+ *   scan      file modification to detection (origin)
+ *   queue     detection to the first write of the sample (origin)
+ *   transfer  first write to complete reception here (wall clocks)
+ *   verify    checksum verification (here)
+ *   write     disk write and timestamp (here)
+ * Both carry a path label naming the receive path. Every traced change is
+ * also logged at debug level, and noted in AppliedOrigins. The transfer and total delays compare wall
+ * clocks of two hosts, so clock skew shows up in them; negative delays are
+ * counted as 0.
+ */
+class LatencyRecorder {
+public:
+  enum Stage { SCAN, QUEUE, TRANSFER, VERIFY, WRITE, STAGE_COUNT };
+
+  /**
+   * @param path Receive path ("content", "chunks", "clone", "delete")
+   */
+  explicit LatencyRecorder(const std::string& path);
+
+  /**
+   * Record an applied change (nothing is recorded for untraced changes)
+   * @param filename File name, for the log
+   * @param origin Origin stamp received with the change
+   * @param received Wall clock when the change was completely received
+   * @param verify Time spent verifying it
+   * @param write Time spent writing it
+   */
+  void record(const std::string& filename,
+              const ChangeOrigin& origin,
+              const ACE_Time_Value& received,
+              const ACE_Time_Value& verify,
+              const ACE_Time_Value& write);
+
+private:
+  std::string path_;
+  Histogram* stages_[STAGE_COUNT];
+  Histogram& total_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_LATENCY_H
@@ -0,0 +1,319 @@
+// Log.cpp
+// Implementation of asynchronous logging
+
+#include "Log.h"
+#include "Latency.h"
+
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_string.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_Thread.h>
+#include <ace/OS_NS_unistd.h>
+
+namespace DirShare {
+
+namespace {
+
+const ACE_Time_Value DEFAULT_RATE_INTERVAL(1, 0);
+
+void write_to_ace(ACE_Log_Priority priority, const char* text)
+{
+  ACE_DEBUG((priority, ACE_TEXT("%C"), text));
+}
+
+// FNV-1a of the key, mixed with the statement it was logged from
+unsigned long rate_hash(const char* key, const char* format)
+{
+  unsigned long hash = 2166136261ul;
+  for (const char* p = key; *p; ++p) {
+    hash ^= static_cast<unsigned char>(*p);
+    hash *= 16777619ul;
+  }
+  hash ^= static_cast<unsigned long>(reinterpret_cast<size_t>(format));
+  hash *= 16777619ul;
+  return hash;
+}
+
+} // namespace
+
+AsyncLog::AsyncLog()
+  : running_(0)
+  , stopping_(false)
+  , records_per_thread_(DEFAULT_RECORDS_PER_THREAD)
+  , output_(write_to_ace)
+  , wakeup_(lock_)
+  , rate_interval_(DEFAULT_RATE_INTERVAL)
+  , written_(0)
+  , dropped_(0)
+  , rate_limited_(0)
+{
+  for (size_t i = 0; i < RATE_SLOTS; ++i) {
+    rate_slots_[i].hash = 0;
+    rate_slots_[i].held = 0;
+  }
+}
+
+AsyncLog::~AsyncLog()
+{
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    delete buffers_[i];
+  }
+}
+
+AsyncLog& AsyncLog::instance()
+{
+  static AsyncLog log;
+  return log;
+}
+
+bool AsyncLog::start(const ACE_Time_Value& flush_interval, size_t records_per_thread)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  if (running_.value() != 0) {
+    return true;
+  }
+
+  flush_interval_ = flush_interval > ACE_Time_Value::zero ? flush_interval : ACE_Time_Value(0, 100000);
+  records_per_thread_ = records_per_thread > 0 ? records_per_thread : 1;
+  spare_.reserve(records_per_thread_);
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    ACE_Guard<ACE_Thread_Mutex> buffer_guard(buffers_[i]->lock);
+    buffers_[i]->records.reserve(records_per_thread_);
+  }
+
+  stopping_ = false;
+  if (activate(THR_NEW_LWP | THR_JOINABLE, 1) != 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: AsyncLog::start() - activate failed\n")),
+                    false);
+  }
+  running_ = 1;
+  return true;
+}
+
+void AsyncLog::stop()
+{
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    if (running_.value() == 0) {
+      return;
+    }
+    stopping_ = true;
+    wakeup_.signal();
+  }
+  wait();
+
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    running_ = 0;
+  }
+
+  // Later messages are written synchronously; drain until a pass finds
+  // nothing so that none queued around the change is left behind
+  while (flush() > 0) {
+  }
+}
+
+int AsyncLog::svc()
+{
+  for (;;) {
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      if (stopping_) {
+        break;
+      }
+      const ACE_Time_Value deadline = ACE_OS::gettimeofday() + flush_interval_;
+      wakeup_.wait(&deadline);
+      if (stopping_) {
+        break;
+      }
+    }
+    flush();
+  }
+  return 0;
+}
+
+LogBuffer* AsyncLog::thread_buffer()
+{
+  // The slot is created by the first access from each thread
+  ThreadSlot* slot = slot_;
+  if (!slot) {
+    return 0;
+  }
+  if (!slot->buffer) {
+    LogBuffer* buffer = new LogBuffer;
+    char thread_id[32];
+    ACE_OS::thr_id(thread_id, sizeof(thread_id));
+    ACE_OS::snprintf(buffer->prefix, sizeof(buffer->prefix), "(%ld|%s) ",
+                     static_cast<long>(ACE_OS::getpid()), thread_id);
+    buffer->dropped = 0;
+
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    buffer->records.reserve(records_per_thread_);
+    buffers_.push_back(buffer);
+    slot->buffer = buffer;
+  }
+  return slot->buffer;
+}
+
+bool AsyncLog::admit(const char* key, const char* format, unsigned long& held)
+{
+  const unsigned long hash = rate_hash(key, format);
+  const ACE_Time_Value now = monotonic_now();
+
+  ACE_Guard<ACE_Thread_Mutex> guard(rate_lock_);
+  if (rate_interval_ == ACE_Time_Value::zero) {
+    return true;
+  }
+  RateSlot& slot = rate_slots_[hash % RATE_SLOTS];
+  if (slot.hash == hash && now - slot.last < rate_interval_) {
+    ++slot.held;
+    ++rate_limited_;
+    return false;
+  }
+  held = slot.hash == hash ? slot.held : 0;
+  slot.hash = hash;
+  slot.last = now;
+  slot.held = 0;
+  return true;
+}
+
+void AsyncLog::log(ACE_Log_Priority priority, const char* key, const char* format, va_list args)
+{
+  unsigned long held = 0;
+  if (key && !admit(key, format, held)) {
+    return;
+  }
+  LogBuffer* buffer = thread_buffer();
+  if (!buffer) {
+    return;
+  }
+
+  LogRecord record;
+  record.priority = priority;
+  const size_t capacity = sizeof(record.text);
+  size_t length = ACE_OS::strlen(buffer->prefix);
+  ACE_OS::strcpy(record.text, buffer->prefix);
+  const int formatted = ACE_OS::vsnprintf(record.text + length, capacity - length, format, args);
+  if (formatted > 0) {
+    length += static_cast<size_t>(formatted);
+  }
+  if (length >= capacity) {
+    // Truncated; keep the line terminated
+    length = capacity - 1;
+    record.text[length - 1] = '\n';
+  }
+  if (held > 0) {
+    const bool newline = length > 0 && record.text[length - 1] == '\n';
+    if (newline) {
+      --length;
+    }
+    const int note = ACE_OS::snprintf(record.text + length, capacity - length,
+                                      " [%lu similar suppressed]\n", held);
+    if (note < 0 || static_cast<size_t>(note) >= capacity - length) {
+      record.text[capacity - 2] = '\n';
+      record.text[capacity - 1] = '\0';
+    }
+  }
+
+  ACE_Guard<ACE_Thread_Mutex> guard(buffer->lock);
+  if (running_.value() == 0) {
+    // Synchronous until start() and after stop()
+    ACE_Guard<ACE_Thread_Mutex> write_guard(write_lock_);
+    output_(record.priority, record.text);
+    ++written_;
+    return;
+  }
+  if (buffer->records.size() >= records_per_thread_) {
+    ++buffer->dropped;
+    return;
+  }
+  buffer->records.push_back(record);
+}
+
+size_t AsyncLog::flush()
+{
+  ACE_Guard<ACE_Thread_Mutex> write_guard(write_lock_);
+
+  std::vector<LogBuffer*> buffers;
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    buffers = buffers_;
+  }
+
+  size_t count = 0;
+  unsigned long dropped = 0;
+  for (size_t b = 0; b < buffers.size(); ++b) {
+    LogBuffer& buffer = *buffers[b];
+    {
+      // Exchange the records for the empty spare; the logging thread waits
+      // for the swap only, not for the output
+      ACE_Guard<ACE_Thread_Mutex> guard(buffer.lock);
+      buffer.records.swap(spare_);
+      dropped += buffer.dropped;
+      buffer.dropped = 0;
+    }
+    for (size_t i = 0; i < spare_.size(); ++i) {
+      output_(spare_[i].priority, spare_[i].text);
+    }
+    count += spare_.size();
+    spare_.clear();
+  }
+  written_ += count;
+
+  if (dropped > 0) {
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      dropped_ += dropped;
+    }
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: %u log messages dropped, thread buffers full\n"),
+               static_cast<unsigned int>(dropped)));
+  }
+  return count;
+}
+
+void AsyncLog::rate_interval(const ACE_Time_Value& interval)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(rate_lock_);
+  rate_interval_ = interval;
+  for (size_t i = 0; i < RATE_SLOTS; ++i) {
+    rate_slots_[i].hash = 0;
+    rate_slots_[i].held = 0;
+  }
+}
+
+void AsyncLog::output(LogOutput output)
+{
+  ACE_Guard<ACE_Thread_Mutex> write_guard(write_lock_);
+  output_ = output ? output : write_to_ace;
+}
+
+unsigned long long AsyncLog::written() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(write_lock_);
+  return written_;
+}
+
+unsigned long long AsyncLog::dropped() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return dropped_;
+}
+
+unsigned long long AsyncLog::rate_limited() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(rate_lock_);
+  return rate_limited_;
+}
+
+void LogStatement::format(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  AsyncLog::instance().log(priority_, key_, format, args);
+  va_end(args);
+}
+
+} // namespace DirShare
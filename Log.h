@@ -0,0 +1,237 @@
+// Log.h
+// Asynchronous, rate-limited logging for the per-file and per-chunk paths
+
+#ifndef DIRSHARE_LOG_H
+#define DIRSHARE_LOG_H
+
+#include <ace/Atomic_Op.h>
+#include <ace/Log_Msg.h>
+#include <ace/Task.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Condition_Thread_Mutex.h>
+#include <ace/Time_Value.h>
+#include <ace/TSS_T.h>
+
+#include <cstdarg>
+#include <vector>
+
+// Compile-time threshold: statements below it are removed with their
+// arguments. Production builds use -DDIRSHARE_LOG_LEVEL=DIRSHARE_LOG_LEVEL_INFO.
+#define DIRSHARE_LOG_LEVEL_DEBUG 1
+#define DIRSHARE_LOG_LEVEL_INFO 2
+#define DIRSHARE_LOG_LEVEL_NONE 3
+
+#ifndef DIRSHARE_LOG_LEVEL
+#define DIRSHARE_LOG_LEVEL DIRSHARE_LOG_LEVEL_DEBUG
+#endif
+
+#if defined(__GNUC__)
+#define DIRSHARE_LOG_FORMAT_CHECK __attribute__((format(printf, 2, 3)))
+#else
+#define DIRSHARE_LOG_FORMAT_CHECK
+#endif
+
+namespace DirShare {
+
+/**
+ * One formatted message waiting for the writer thread
+ */
+struct LogRecord {
+  ACE_Log_Priority priority;
+  char text[248];  // "(pid|tid) message", truncated
+};
+
+/**
+ * Messages of one thread, in the order they were logged
+ */
+struct LogBuffer {
+  std::vector<LogRecord> records;  // Capacity fixed by AsyncLog::start()
+  char prefix[48];                 // "(pid|tid) " of the owning thread
+  unsigned long dropped;           // Full buffer; reported by the writer
+  ACE_Thread_Mutex lock;           // Taken by the owning thread and the writer
+};
+
+/// Destination of the messages; the default hands them to ACE_Log_Msg
+typedef void (*LogOutput)(ACE_Log_Priority priority, const char* text);
+
+/**
+ * @class AsyncLog
+ * @brief Process-wide logger for messages issued per file or per chunk
+ *
+ * Statements are issued with the DIRSHARE_DEBUG / DIRSHARE_INFO macros:
+ *
+ *   DIRSHARE_DEBUG(("Received chunk %u of %s\n", index, name));
+ *   DIRSHARE_DEBUG_EVERY(name, ("Reassembly progress for %s\n", name));
+ *
+ * The format is printf's (%s, %llu), not ACE's (%C, %Q), and carries no
+ * %N:%l. A statement below DIRSHARE_LOG_LEVEL compiles to nothing, one
+ * whose priority ACE_Log_Msg has disabled costs a mask test, and any
+ * other formats into a buffer of the calling thread. Plain statements
+ * take no shared lock. Once start() has been called, a writer thread
+ * drains the buffers every flush interval; before that (and after stop())
+ * messages are written synchronously, so tools and tests need not start it.
+ *
+ * The _EVERY variants pass at most one message per key and statement per
+ * interval, e.g. one progress line per file per second; the next message
+ * that passes tells how many were held back. They check the limiter under
+ * a process-wide lock, held for one slot lookup. A full thread buffer
+ * drops messages instead of blocking; the writer reports the count.
+ *
+ * Messages of one thread keep their order; errors and warnings remain
+ * synchronous ACE_ERROR calls and may overtake queued messages.
+ */
+class AsyncLog : public ACE_Task_Base {
+public:
+  enum {
+    DEFAULT_RECORDS_PER_THREAD = 1024,
+    RATE_SLOTS = 256  // Rate limiter slots; colliding keys share one
+  };
+
+  /// The logger of the process
+  static AsyncLog& instance();
+
+  /**
+   * Start the writer thread
+   * @param flush_interval Time between drains of the thread buffers
+   * @param records_per_thread Messages a thread may queue between drains
+   * @return true on success (failures are logged)
+   */
+  bool start(const ACE_Time_Value& flush_interval = ACE_Time_Value(0, 100000),
+             size_t records_per_thread = DEFAULT_RECORDS_PER_THREAD);
+
+  /**
+   * Write the queued messages and stop the writer thread
+   */
+  void stop();
+
+  /**
+   * Write the queued messages of every thread now
+   * @return Number of messages written
+   */
+  size_t flush();
+
+  /// Whether a statement at priority would be written at all
+  bool enabled(ACE_Log_Priority priority) const
+  {
+    return ACE_LOG_MSG->log_priority_enabled(priority) != 0;
+  }
+
+  /**
+   * Minimum time between two messages of an _EVERY statement for one key
+   * @param interval Zero passes every message
+   */
+  void rate_interval(const ACE_Time_Value& interval);
+
+  /// Replace the destination of the messages (0 restores ACE_Log_Msg)
+  void output(LogOutput output);
+
+  /**
+   * Format and queue a message
+   * @param priority ACE priority of the message
+   * @param key Rate limiter key, or 0 for none
+   * @param format printf format
+   * @param args Arguments of format
+   */
+  void log(ACE_Log_Priority priority, const char* key, const char* format, va_list args);
+
+  /// Messages written since the process started
+  unsigned long long written() const;
+
+  /// Messages dropped because a thread buffer was full
+  unsigned long long dropped() const;
+
+  /// Messages held back by the rate limiter
+  unsigned long long rate_limited() const;
+
+  virtual int svc();
+
+private:
+  struct ThreadSlot {
+    LogBuffer* buffer;
+    ThreadSlot() : buffer(0) {}
+  };
+
+  struct RateSlot {
+    unsigned long hash;
+    ACE_Time_Value last;
+    unsigned long held;
+  };
+
+  AsyncLog();
+  ~AsyncLog();
+
+  // Buffer of the calling thread, created on first use
+  LogBuffer* thread_buffer();
+
+  // False if the message is held back; held receives the count to report
+  bool admit(const char* key, const char* format, unsigned long& held);
+
+  ACE_Atomic_Op<ACE_Thread_Mutex, long> running_;  // Read by log() without lock_
+  bool stopping_;
+  ACE_Time_Value flush_interval_;
+  size_t records_per_thread_;
+  LogOutput output_;
+  ACE_TSS<ThreadSlot> slot_;
+  std::vector<LogBuffer*> buffers_;  // Owned; kept after their thread exits
+  mutable ACE_Thread_Mutex lock_;        // Protects buffers_, stopping_, dropped_; serializes start()/stop()
+  ACE_Condition_Thread_Mutex wakeup_;
+  mutable ACE_Thread_Mutex write_lock_;  // Serializes output; protects written_, spare_
+  std::vector<LogRecord> spare_;         // Swapped with a thread buffer by flush()
+
+  ACE_Time_Value rate_interval_;
+  RateSlot rate_slots_[RATE_SLOTS];
+  mutable ACE_Thread_Mutex rate_lock_;   // Protects the slots and rate_limited_
+
+  unsigned long long written_;
+  unsigned long long dropped_;
+  unsigned long long rate_limited_;
+
+  AsyncLog(const AsyncLog&);
+  AsyncLog& operator=(const AsyncLog&);
+};
+
+/**
+ * @class LogStatement
+ * @brief Carries priority and key to the format arguments of a macro
+ */
+class LogStatement {
+public:
+  LogStatement(ACE_Log_Priority priority, const char* key)
+    : priority_(priority)
+    , key_(key)
+  {
+  }
+
+  void format(const char* format, ...) DIRSHARE_LOG_FORMAT_CHECK;
+
+private:
+  ACE_Log_Priority priority_;
+  const char* key_;
+};
+
+} // namespace DirShare
+
+#define DIRSHARE_LOG_STATEMENT(PRIORITY, KEY, X) \
+  do { \
+    if (DirShare::AsyncLog::instance().enabled(PRIORITY)) { \
+      DirShare::LogStatement(PRIORITY, KEY).format X; \
+    } \
+  } while (0)
+
+#if DIRSHARE_LOG_LEVEL <= DIRSHARE_LOG_LEVEL_DEBUG
+#define DIRSHARE_DEBUG(X) DIRSHARE_LOG_STATEMENT(LM_DEBUG, 0, X)
+#define DIRSHARE_DEBUG_EVERY(KEY, X) DIRSHARE_LOG_STATEMENT(LM_DEBUG, KEY, X)
+#else
+#define DIRSHARE_DEBUG(X) do {} while (0)
+#define DIRSHARE_DEBUG_EVERY(KEY, X) do {} while (0)
+#endif
+
+#if DIRSHARE_LOG_LEVEL <= DIRSHARE_LOG_LEVEL_INFO
+#define DIRSHARE_INFO(X) DIRSHARE_LOG_STATEMENT(LM_INFO, 0, X)
+#define DIRSHARE_INFO_EVERY(KEY, X) DIRSHARE_LOG_STATEMENT(LM_INFO, KEY, X)
+#else
+#define DIRSHARE_INFO(X) do {} while (0)
+#define DIRSHARE_INFO_EVERY(KEY, X) do {} while (0)
+#endif
+
+#endif // DIRSHARE_LOG_H
@@ -0,0 +1,304 @@
+// MainLoop.cpp
+// Implementation of the reactor-driven main loop
+
+#include "MainLoop.h"
+#include "Latency.h"
+
+#include <ace/Flag_Manip.h>
+#include <ace/Guard_T.h>
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_errno.h>
+#include <ace/OS_NS_unistd.h>
+#include <ace/Thread.h>
+
+#if defined (__linux__)
+#  include <sys/inotify.h>
+#endif
+
+namespace DirShare {
+
+namespace {
+
+// Timer act of the periodic scan; the one-shot timer has none
+const int PERIODIC_SCAN = 1;
+
+} // namespace
+
+DirectoryWatch::DirectoryWatch()
+  : handle_(ACE_INVALID_HANDLE)
+  , gone_(false)
+{
+}
+
+DirectoryWatch::~DirectoryWatch()
+{
+  close();
+}
+
+bool DirectoryWatch::open(const std::string& directory)
+{
+  close();
+  gone_ = false;
+#if defined (__linux__)
+  const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    ACE_ERROR_RETURN((LM_WARNING,
+                     ACE_TEXT("WARNING: %N:%l: inotify unavailable (%m), polling %C\n"),
+                     directory.c_str()),
+                    false);
+  }
+  const uint32_t events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                          IN_DELETE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+  if (inotify_add_watch(fd, directory.c_str(), events) < 0) {
+    ACE_OS::close(fd);
+    ACE_ERROR_RETURN((LM_WARNING,
+                     ACE_TEXT("WARNING: %N:%l: Cannot watch %C (%m), polling it\n"),
+                     directory.c_str()),
+                    false);
+  }
+  handle_ = fd;
+  return true;
+#else
+  ACE_UNUSED_ARG(directory);
+  return false;
+#endif
+}
+
+void DirectoryWatch::close()
+{
+  if (handle_ != ACE_INVALID_HANDLE) {
+    ACE_OS::close(handle_);
+    handle_ = ACE_INVALID_HANDLE;
+  }
+}
+
+size_t DirectoryWatch::drain()
+{
+  size_t changes = 0;
+#if defined (__linux__)
+  // Aligned for the inotify_event records read into it
+  union {
+    inotify_event event;
+    char bytes[4096];
+  } buffer;
+  for (;;) {
+    const ssize_t size = ACE_OS::read(handle_, buffer.bytes, sizeof(buffer.bytes));
+    if (size <= 0) {
+      break;
+    }
+    for (ssize_t offset = 0; offset < size; ) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer.bytes + offset);
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        gone_ = true;
+      }
+      ++changes;
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+    }
+  }
+#endif
+  return changes;
+}
+
+MainLoop::MainLoop(MainLoopHandler& handler)
+  : handler_(handler)
+  , dump_signal_(0)
+  , periodic_timer_(-1)
+  , pending_timer_(-1)
+  , opened_(false)
+  , shutdown_signaled_(0)
+  , dump_signaled_(0)
+  , scans_(0)
+{
+  reactor(&reactor_);
+}
+
+MainLoop::~MainLoop()
+{
+  close();
+}
+
+bool MainLoop::open(const std::string& directory,
+                    const ACE_Time_Value& scan_interval,
+                    const ACE_Time_Value& settle,
+                    int dump_signal)
+{
+  close();
+  settle_ = settle;
+  dump_signal_ = dump_signal;
+  opened_ = true;
+
+  if (wakeup_.open() != 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: MainLoop::open() - cannot create wakeup pipe\n")),
+                    false);
+  }
+  // Neither end may block: the signal handler writes, the loop drains
+  ACE::set_flags(wakeup_.read_handle(), ACE_NONBLOCK);
+  ACE::set_flags(wakeup_.write_handle(), ACE_NONBLOCK);
+  if (reactor_.register_handler(wakeup_.read_handle(), this, ACE_Event_Handler::READ_MASK) != 0 ||
+      reactor_.register_handler(SIGINT, this) != 0 ||
+      reactor_.register_handler(SIGTERM, this) != 0 ||
+      (dump_signal_ != 0 && reactor_.register_handler(dump_signal_, this) != 0)) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: MainLoop::open() - cannot register signal handlers\n")),
+                    false);
+  }
+
+  periodic_timer_ = reactor_.schedule_timer(this, &PERIODIC_SCAN, scan_interval, scan_interval);
+  if (periodic_timer_ == -1) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: MainLoop::open() - cannot schedule scan timer\n")),
+                    false);
+  }
+
+  if (watch_.open(directory)) {
+    if (reactor_.register_handler(watch_.handle(), this, ACE_Event_Handler::READ_MASK) != 0) {
+      watch_.close();
+    }
+  }
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Scanning %C every %d s%C\n"),
+             directory.c_str(),
+             static_cast<int>(scan_interval.sec()),
+             watching() ? " and on change notifications" : ""));
+  return true;
+}
+
+void MainLoop::close()
+{
+  if (!opened_) {
+    return;
+  }
+  opened_ = false;
+  reactor_.cancel_timer(this);
+  periodic_timer_ = -1;
+  pending_timer_ = -1;
+  if (watch_.handle() != ACE_INVALID_HANDLE) {
+    reactor_.remove_handler(watch_.handle(),
+                            ACE_Event_Handler::READ_MASK | ACE_Event_Handler::DONT_CALL);
+    watch_.close();
+  }
+  reactor_.remove_handler(SIGINT, static_cast<ACE_Sig_Action*>(0));
+  reactor_.remove_handler(SIGTERM, static_cast<ACE_Sig_Action*>(0));
+  if (dump_signal_ != 0) {
+    reactor_.remove_handler(dump_signal_, static_cast<ACE_Sig_Action*>(0));
+  }
+  if (wakeup_.read_handle() != ACE_INVALID_HANDLE) {
+    reactor_.remove_handler(wakeup_.read_handle(),
+                            ACE_Event_Handler::READ_MASK | ACE_Event_Handler::DONT_CALL);
+  }
+  wakeup_.close();
+}
+
+int MainLoop::run()
+{
+  reactor_.owner(ACE_Thread::self());
+  reactor_.reset_reactor_event_loop();
+  return reactor_.run_reactor_event_loop() == -1 ? -1 : 0;
+}
+
+void MainLoop::request_scan()
+{
+  reactor_.notify(this, ACE_Event_Handler::EXCEPT_MASK);
+}
+
+void MainLoop::shutdown()
+{
+  reactor_.end_reactor_event_loop();
+}
+
+unsigned long MainLoop::scans() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  return scans_;
+}
+
+int MainLoop::handle_signal(int signum, siginfo_t*, ucontext_t*)
+{
+  // Signal context: record the signal and wake the reactor, nothing else
+  if (signum == dump_signal_) {
+    dump_signaled_ = 1;
+  } else {
+    shutdown_signaled_ = 1;
+  }
+  const char byte = 0;
+  ACE_OS::write(wakeup_.write_handle(), &byte, 1);
+  return 0;
+}
+
+int MainLoop::handle_input(ACE_HANDLE handle)
+{
+  if (handle == watch_.handle()) {
+    if (watch_.drain() > 0) {
+      schedule_scan();
+    }
+    if (watch_.gone()) {
+      ACE_ERROR((LM_WARNING,
+                 ACE_TEXT("WARNING: %N:%l: Shared directory moved or deleted, polling only\n")));
+      reactor_.remove_handler(handle,
+                              ACE_Event_Handler::READ_MASK | ACE_Event_Handler::DONT_CALL);
+      watch_.close();
+    }
+    return 0;
+  }
+
+  char bytes[64];
+  while (ACE_OS::read(handle, bytes, sizeof(bytes)) == static_cast<ssize_t>(sizeof(bytes))) {
+  }
+  if (dump_signaled_) {
+    dump_signaled_ = 0;
+    handler_.dump();
+  }
+  if (shutdown_signaled_) {
+    ACE_DEBUG((LM_INFO, ACE_TEXT("(%P|%t) Shutdown requested\n")));
+    reactor_.end_reactor_event_loop();
+  }
+  return 0;
+}
+
+int MainLoop::handle_exception(ACE_HANDLE)
+{
+  schedule_scan();
+  return 0;
+}
+
+int MainLoop::handle_timeout(const ACE_Time_Value&, const void* act)
+{
+  if (act != &PERIODIC_SCAN) {
+    pending_timer_ = -1;
+  } else if (pending_timer_ != -1) {
+    // This scan covers the notified changes as well
+    reactor_.cancel_timer(pending_timer_);
+    pending_timer_ = -1;
+  }
+  run_scan();
+  return 0;
+}
+
+void MainLoop::schedule_scan()
+{
+  if (pending_timer_ != -1) {
+    return;
+  }
+
+  // The settle delay, but no sooner after the last scan than it took
+  ACE_Time_Value delay = settle_;
+  const ACE_Time_Value earliest = last_scan_start_ + last_scan_duration_ + last_scan_duration_;
+  const ACE_Time_Value now = monotonic_now();
+  if (earliest > now + delay) {
+    delay = earliest - now;
+  }
+  pending_timer_ = reactor_.schedule_timer(this, 0, delay);
+}
+
+void MainLoop::run_scan()
+{
+  last_scan_start_ = monotonic_now();
+  handler_.scan();
+  last_scan_duration_ = monotonic_now() - last_scan_start_;
+
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  ++scans_;
+}
+
+} // namespace DirShare
@@ -0,0 +1,172 @@
+// MainLoop.h
+// Reactor-driven main loop: directory scans on change notifications and
+// timers, shutdown and trace dumps on signals
+
+#ifndef DIRSHARE_MAIN_LOOP_H
+#define DIRSHARE_MAIN_LOOP_H
+
+#include <ace/Event_Handler.h>
+#include <ace/Reactor.h>
+#include <ace/Pipe.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+
+#include <csignal>
+#include <string>
+
+namespace DirShare {
+
+/**
+ * @class DirectoryWatch
+ * @brief Readable handle that signals changes to the files of a directory
+ *
+ * On Linux an inotify descriptor watching files written and closed, moved
+ * in or out, deleted or touched. Elsewhere open() fails and the directory
+ * is only polled. Changes to files held open (appends without close) are
+ * not reported; the periodic scan finds them.
+ */
+class DirectoryWatch {
+public:
+  DirectoryWatch();
+  ~DirectoryWatch();
+
+  /**
+   * Start watching
+   * @param directory Directory whose files are watched (not recursive)
+   * @return true if notifications are available
+   */
+  bool open(const std::string& directory);
+
+  void close();
+
+  /// Descriptor to register for reading, or ACE_INVALID_HANDLE
+  ACE_HANDLE handle() const { return handle_; }
+
+  /**
+   * Consume the pending notifications
+   * @return Number of changes read
+   */
+  size_t drain();
+
+  /// The directory itself was deleted or moved; nothing more will be notified
+  bool gone() const { return gone_; }
+
+private:
+  ACE_HANDLE handle_;
+  bool gone_;
+
+  DirectoryWatch(const DirectoryWatch&);
+  DirectoryWatch& operator=(const DirectoryWatch&);
+};
+
+/**
+ * @class MainLoopHandler
+ * @brief Work done on the main loop's thread
+ */
+class MainLoopHandler {
+public:
+  virtual ~MainLoopHandler() {}
+
+  /// Detect and publish the changes of the shared directory
+  virtual void scan() = 0;
+
+  /// The dump signal arrived (see MainLoop::open())
+  virtual void dump() {}
+};
+
+/**
+ * @class MainLoop
+ * @brief Runs the directory scans of dirshare from an ACE_Reactor
+ *
+ * A scan runs when the scan interval elapses, and soon after the directory
+ * watch reports a change or another thread calls request_scan(). Changes
+ * arriving in a burst share one scan: it starts after the settle delay, and
+ * no sooner after the previous scan than that scan took, so scanning takes
+ * at most half the loop's time however busy the directory is.
+ *
+ * SIGINT and SIGTERM end run(). Their handler only records the signal and
+ * writes a byte to a pipe the reactor watches, so the loop acts on it from
+ * its own thread, at once; the same holds for the optional dump signal.
+ * shutdown() ends the loop from any thread.
+ */
+class MainLoop : public ACE_Event_Handler {
+public:
+  /**
+   * Constructor
+   * @param handler Receives the scans and dumps (not owned)
+   */
+  explicit MainLoop(MainLoopHandler& handler);
+
+  virtual ~MainLoop();
+
+  /**
+   * Register the timers, the directory watch and the signals
+   * @param directory Shared directory to watch
+   * @param scan_interval Time between scans without notifications
+   * @param settle Delay between a notification and its scan
+   * @param dump_signal Signal calling MainLoopHandler::dump(), or 0
+   * @return true on success (failures are logged)
+   */
+  bool open(const std::string& directory,
+            const ACE_Time_Value& scan_interval,
+            const ACE_Time_Value& settle = ACE_Time_Value(0, 200000),
+            int dump_signal = 0);
+
+  /**
+   * Dispatch events on the calling thread until shutdown
+   * @return 0, or -1 if the reactor failed
+   */
+  int run();
+
+  /// Scan soon (any thread)
+  void request_scan();
+
+  /// Make run() return (any thread)
+  void shutdown();
+
+  /// Whether changes are notified (false: polling only)
+  bool watching() const { return watch_.handle() != ACE_INVALID_HANDLE; }
+
+  /// Scans run so far
+  unsigned long scans() const;
+
+  virtual int handle_input(ACE_HANDLE handle);
+  virtual int handle_timeout(const ACE_Time_Value& now, const void* act);
+  virtual int handle_exception(ACE_HANDLE handle);
+  virtual int handle_signal(int signum, siginfo_t* info = 0, ucontext_t* context = 0);
+
+private:
+  // Scan at once, for the periodic timer and a due notification
+  void run_scan();
+
+  // Arm the one-shot timer of a notified change, unless armed
+  void schedule_scan();
+
+  // Unregister everything registered by open()
+  void close();
+
+  MainLoopHandler& handler_;
+  ACE_Reactor reactor_;
+  DirectoryWatch watch_;
+  ACE_Pipe wakeup_;               // Written by the signal handler
+  int dump_signal_;
+  ACE_Time_Value settle_;
+  ACE_Time_Value last_scan_start_;
+  ACE_Time_Value last_scan_duration_;
+  long periodic_timer_;
+  long pending_timer_;            // One-shot scan timer, or -1
+  bool opened_;
+
+  volatile sig_atomic_t shutdown_signaled_;
+  volatile sig_atomic_t dump_signaled_;
+
+  unsigned long scans_;
+  mutable ACE_Thread_Mutex lock_; // Protects scans_
+
+  MainLoop(const MainLoop&);
+  MainLoop& operator=(const MainLoop&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_MAIN_LOOP_H
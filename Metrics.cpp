@@ -0,0 +1,318 @@
+// Metrics.cpp
+// Implementation of the metrics registry
+
+#include "Metrics.h"
+
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_stdio.h>
+
+namespace DirShare {
+
+namespace {
+
+const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+const size_t QUANTILE_COUNT = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+
+// HELP text: backslash and newline are escaped
+std::string escape_help(const std::string& help)
+{
+  std::string result;
+  for (size_t i = 0; i < help.size(); ++i) {
+    if (help[i] == '\\') {
+      result += "\\\\";
+    } else if (help[i] == '\n') {
+      result += "\\n";
+    } else {
+      result += help[i];
+    }
+  }
+  return result;
+}
+
+std::string format_double(double value)
+{
+  char text[64];
+  ACE_OS::snprintf(text, sizeof(text), "%.9g", value);
+  return text;
+}
+
+std::string format_unsigned(unsigned long value)
+{
+  char text[32];
+  ACE_OS::snprintf(text, sizeof(text), "%lu", value);
+  return text;
+}
+
+std::string format_signed(long value)
+{
+  char text[32];
+  ACE_OS::snprintf(text, sizeof(text), "%ld", value);
+  return text;
+}
+
+// "name{labels}" or "name{labels,extra}"
+std::string series(const std::string& name, const std::string& labels,
+                   const std::string& extra = "")
+{
+  if (labels.empty() && extra.empty()) {
+    return name;
+  }
+  std::string result = name + "{" + labels;
+  if (!labels.empty() && !extra.empty()) {
+    result += ",";
+  }
+  return result + extra + "}";
+}
+
+} // namespace
+
+Histogram::Histogram()
+  : count_(0)
+  , sum_(0)
+{
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+void Histogram::record(uint64_t value)
+{
+  ++buckets_[bucket_index(value)];
+  ++count_;
+  sum_ += static_cast<unsigned long>(value);
+}
+
+void Histogram::record(const ACE_Time_Value& elapsed)
+{
+  const long long usec = static_cast<long long>(elapsed.sec()) * 1000000 + elapsed.usec();
+  record(usec > 0 ? static_cast<uint64_t>(usec) : 0);
+}
+
+size_t Histogram::bucket_index(uint64_t value)
+{
+  const uint64_t max_value = (static_cast<uint64_t>(1) << VALUE_BITS) - 1;
+  if (value > max_value) {
+    value = max_value;
+  }
+  if (value < SUB_BUCKETS) {
+    return static_cast<size_t>(value);
+  }
+
+  // Octave (position of the highest set bit) and the next SUB_BUCKET_BITS bits
+  unsigned int bit = SUB_BUCKET_BITS;
+  while ((value >> (bit + 1)) != 0) {
+    ++bit;
+  }
+  const uint64_t sub = (value >> (bit - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+  return static_cast<size_t>((bit - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub);
+}
+
+uint64_t Histogram::bucket_upper(size_t index)
+{
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  const unsigned int bit = static_cast<unsigned int>(index / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+  const uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+  return ((mantissa + 1) << (bit - SUB_BUCKET_BITS)) - 1;
+}
+
+uint64_t Histogram::quantile(double quantile) const
+{
+  // Buckets are read one by one while values are being recorded, so use
+  // their own total rather than count_
+  unsigned long counts[BUCKETS];
+  unsigned long total = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    counts[i] = buckets_[i].value();
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  unsigned long rank = static_cast<unsigned long>(quantile * total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > total) {
+    rank = total;
+  }
+
+  unsigned long seen = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return bucket_upper(i);
+    }
+  }
+  return bucket_upper(BUCKETS - 1);
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+  for (std::map<std::string, Family>::iterator it = families_.begin();
+       it != families_.end(); ++it) {
+    for (size_t i = 0; i < it->second.entries.size(); ++i) {
+      delete it->second.entries[i].counter;
+      delete it->second.entries[i].gauge;
+      delete it->second.entries[i].histogram;
+    }
+  }
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name,
+                                  const std::string& help,
+                                  const std::string& labels)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  Entry& e = entry(name, help, COUNTER, 1.0, labels);
+  if (!e.counter) {
+    e.counter = new Counter;
+  }
+  return *e.counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name,
+                              const std::string& help,
+                              const std::string& labels)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  Entry& e = entry(name, help, GAUGE, 1.0, labels);
+  if (!e.gauge) {
+    e.gauge = new Gauge;
+  }
+  return *e.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name,
+                                      const std::string& help,
+                                      double unit,
+                                      const std::string& labels)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  Entry& e = entry(name, help, HISTOGRAM, unit, labels);
+  if (!e.histogram) {
+    e.histogram = new Histogram;
+  }
+  return *e.histogram;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::entry(const std::string& name,
+                                               const std::string& help,
+                                               Type type,
+                                               double unit,
+                                               const std::string& labels)
+{
+  std::map<std::string, Family>::iterator it = families_.find(name);
+  if (it == families_.end()) {
+    Family family;
+    family.type = type;
+    family.help = help;
+    family.unit = unit;
+    it = families_.insert(std::make_pair(name, family)).first;
+  }
+
+  std::vector<Entry>& entries = it->second.entries;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].labels == labels) {
+      return entries[i];
+    }
+  }
+
+  Entry e;
+  e.labels = labels;
+  e.counter = 0;
+  e.gauge = 0;
+  e.histogram = 0;
+  entries.push_back(e);
+  return entries.back();
+}
+
+std::string MetricsRegistry::exposition() const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::string out;
+  for (std::map<std::string, Family>::const_iterator it = families_.begin();
+       it != families_.end(); ++it) {
+    const std::string& name = it->first;
+    const Family& family = it->second;
+
+    out += "# HELP " + name + " " + escape_help(family.help) + "\n";
+    out += "# TYPE " + name + " " +
+      (family.type == COUNTER ? "counter" : family.type == GAUGE ? "gauge" : "summary") + "\n";
+
+    for (size_t i = 0; i < family.entries.size(); ++i) {
+      const Entry& e = family.entries[i];
+      if (e.counter) {
+        out += series(name, e.labels) + " " + format_unsigned(e.counter->value()) + "\n";
+      } else if (e.gauge) {
+        out += series(name, e.labels) + " " + format_signed(e.gauge->value()) + "\n";
+      } else if (e.histogram) {
+        for (size_t q = 0; q < QUANTILE_COUNT; ++q) {
+          const std::string quantile = "quantile=\"" + format_double(QUANTILES[q]) + "\"";
+          out += series(name, e.labels, quantile) + " " +
+            format_double(e.histogram->quantile(QUANTILES[q]) * family.unit) + "\n";
+        }
+        out += series(name + "_sum", e.labels) + " " +
+          format_double(e.histogram->sum() * family.unit) + "\n";
+        out += series(name + "_count", e.labels) + " " +
+          format_unsigned(e.histogram->count()) + "\n";
+      }
+    }
+  }
+  return out;
+}
+
+long long MetricsRegistry::total(const std::string& name) const
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::map<std::string, Family>::const_iterator it = families_.find(name);
+  if (it == families_.end()) {
+    return 0;
+  }
+
+  long long sum = 0;
+  for (size_t i = 0; i < it->second.entries.size(); ++i) {
+    const Entry& e = it->second.entries[i];
+    if (e.counter) {
+      sum += static_cast<long long>(e.counter->value());
+    } else if (e.gauge) {
+      sum += e.gauge->value();
+    }
+  }
+  return sum;
+}
+
+TopicCounters::TopicCounters(const std::string& direction, const std::string& topic)
+  : samples_(MetricsRegistry::instance().counter(
+      "dirshare_samples_" + direction + "_total",
+      "Samples " + direction + ", by topic",
+      "topic=\"" + topic + "\""))
+  , bytes_(MetricsRegistry::instance().counter(
+      "dirshare_payload_bytes_" + direction + "_total",
+      "File data bytes " + direction + ", by topic",
+      "topic=\"" + topic + "\""))
+{
+}
+
+Counter& receive_errors(const std::string& kind)
+{
+  return MetricsRegistry::instance().counter(
+    "dirshare_receive_errors_total",
+    "Failures applying received data, by kind",
+    "kind=\"" + kind + "\"");
+}
+
+} // namespace DirShare
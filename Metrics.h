@@ -0,0 +1,236 @@
+// Metrics.h
+// Process-wide counters, gauges and histograms, written in the Prometheus
+// text exposition format (served by MetricsServer)
+
+#ifndef DIRSHARE_METRICS_H
+#define DIRSHARE_METRICS_H
+
+#include <stdint.h>
+
+#include <ace/Atomic_Op.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * @class Counter
+ * @brief Monotonic count (samples, bytes, events)
+ */
+class Counter {
+public:
+  Counter() : value_(0) {}
+
+  void increment(unsigned long n = 1) { value_ += n; }
+
+  unsigned long value() const { return value_.value(); }
+
+private:
+  ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long> value_;
+};
+
+/**
+ * @class Gauge
+ * @brief Value that goes up and down (files, buffered bytes)
+ */
+class Gauge {
+public:
+  Gauge() : value_(0) {}
+
+  void set(long value) { value_ = value; }
+  void add(long n) { value_ += n; }
+  void sub(long n) { value_ -= n; }
+
+  long value() const { return value_.value(); }
+
+private:
+  ACE_Atomic_Op<ACE_Thread_Mutex, long> value_;
+};
+
+/**
+ * @class Histogram
+ * @brief HDR (log-linear) histogram of non-negative integer values
+ *
+ * Values are counted in buckets of 32 per power of two, so a percentile is
+ * reported within about 3% of the recorded value, over 0 to 2^40 - 1
+ * (larger values are counted in the top bucket). Recording is one bucket
+ * index computation and three atomic increments.
+ */
+class Histogram {
+public:
+  enum {
+    SUB_BUCKET_BITS = 5,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+    VALUE_BITS = 40,
+    BUCKETS = (VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+  };
+
+  Histogram();
+
+  /**
+   * Count one value
+   * @param value Value in the histogram's unit (e.g. microseconds)
+   */
+  void record(uint64_t value);
+
+  /**
+   * Count an elapsed time in microseconds
+   * @param elapsed Duration (negative durations count as 0)
+   */
+  void record(const ACE_Time_Value& elapsed);
+
+  unsigned long count() const { return count_.value(); }
+
+  unsigned long sum() const { return sum_.value(); }
+
+  /**
+   * Value below which a fraction of the recorded values fall
+   * @param quantile Fraction in [0, 1]
+   * @return Highest value of the bucket holding the quantile (0 if empty)
+   */
+  uint64_t quantile(double quantile) const;
+
+  /// Bucket counting a value
+  static size_t bucket_index(uint64_t value);
+
+  /// Highest value counted in a bucket
+  static uint64_t bucket_upper(size_t index);
+
+private:
+  ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long> buckets_[BUCKETS];
+  ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long> count_;
+  ACE_Atomic_Op<ACE_Thread_Mutex, unsigned long> sum_;
+};
+
+/**
+ * @class MetricsRegistry
+ * @brief Named metrics of the process
+ *
+ * Metrics are created on first lookup and live as long as the registry;
+ * callers look them up once (typically in a constructor) and keep the
+ * reference, so updates on hot paths never touch the registry or take a
+ * lock. Counters and gauges are atomic integers (ACE_Atomic_Op, lock-free
+ * on platforms with built-in atomics).
+ *
+ * A metric is identified by its name and label set, e.g. name
+ * "dirshare_samples_sent_total" and labels "topic=\"DirShare_FileChunks\"".
+ * A name must always be registered with the same type. Histograms are
+ * exported as Prometheus summaries (quantiles 0.5, 0.9, 0.99 and 0.999,
+ * sum and count), scaled by the unit given at registration so that, e.g.,
+ * durations recorded in microseconds are exported in seconds.
+ */
+class MetricsRegistry {
+public:
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  /// The registry of the process
+  static MetricsRegistry& instance();
+
+  Counter& counter(const std::string& name,
+                   const std::string& help,
+                   const std::string& labels = "");
+
+  Gauge& gauge(const std::string& name,
+               const std::string& help,
+               const std::string& labels = "");
+
+  /**
+   * Look up or create a histogram
+   * @param name Metric name
+   * @param help Description
+   * @param unit Exported value of one recorded unit (1e-6: microseconds as seconds)
+   * @param labels Label set, without braces (empty: none)
+   */
+  Histogram& histogram(const std::string& name,
+                       const std::string& help,
+                       double unit = 1.0,
+                       const std::string& labels = "");
+
+  /**
+   * Write every metric in the Prometheus text format (version 0.0.4)
+   * @return Exposition text
+   */
+  std::string exposition() const;
+
+  /**
+   * Sum of the counters or gauges of a name over all its label sets
+   * @param name Metric name
+   * @return Sum (0 for an unknown name or a histogram)
+   */
+  long long total(const std::string& name) const;
+
+private:
+  enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+  struct Entry {
+    std::string labels;
+    Counter* counter;
+    Gauge* gauge;
+    Histogram* histogram;
+  };
+
+  struct Family {
+    Type type;
+    std::string help;
+    double unit;
+    std::vector<Entry> entries;
+  };
+
+  // Entry of name and labels, created if missing (lock held)
+  Entry& entry(const std::string& name, const std::string& help,
+               Type type, double unit, const std::string& labels);
+
+  std::map<std::string, Family> families_;  // By name (sorted output)
+  mutable ACE_Thread_Mutex lock_;
+
+  MetricsRegistry(const MetricsRegistry&);
+  MetricsRegistry& operator=(const MetricsRegistry&);
+};
+
+/**
+ * Samples and payload bytes written to, or taken from, one topic
+ * Registers dirshare_samples_<direction>_total and
+ * dirshare_payload_bytes_<direction>_total with a topic label
+ */
+class TopicCounters {
+public:
+  /**
+   * @param direction "sent" or "received"
+   * @param topic Topic name
+   */
+  TopicCounters(const std::string& direction, const std::string& topic);
+
+  /**
+   * Count one sample
+   * @param payload_bytes File data carried by the sample
+   */
+  void sample(size_t payload_bytes = 0)
+  {
+    samples_.increment();
+    if (payload_bytes > 0) {
+      bytes_.increment(static_cast<unsigned long>(payload_bytes));
+    }
+  }
+
+private:
+  Counter& samples_;
+  Counter& bytes_;
+};
+
+/**
+ * Counter of failures on the receive path
+ * Registers dirshare_receive_errors_total with a kind label
+ * @param kind "checksum" (verification), "write" (local file operation)
+ *        or "transfer" (invalid sample, incomplete transfer)
+ * @return The counter of that kind
+ */
+Counter& receive_errors(const std::string& kind);
+
+} // namespace DirShare
+
+#endif // DIRSHARE_METRICS_H
@@ -0,0 +1,170 @@
+// MetricsServer.cpp
+// Implementation of the metrics HTTP endpoint
+
+#include "MetricsServer.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_errno.h>
+#include <ace/OS_NS_stdlib.h>
+
+namespace DirShare {
+
+namespace {
+
+// How often the worker checks for stop() while no scraper connects
+const ACE_Time_Value ACCEPT_TIMEOUT(0, 500000);
+
+// Longest wait for a scraper to send its request
+const ACE_Time_Value REQUEST_TIMEOUT(2, 0);
+
+// Requests beyond this are not read further (only the request line matters)
+const size_t MAX_REQUEST_SIZE = 8192;
+
+std::string response(const char* status,
+                     const char* content_type,
+                     const std::string& body)
+{
+  char length[32];
+  ACE_OS::snprintf(length, sizeof(length), "%lu",
+                   static_cast<unsigned long>(body.size()));
+  return std::string("HTTP/1.0 ") + status + "\r\n" +
+    "Content-Type: " + content_type + "\r\n" +
+    "Content-Length: " + length + "\r\n" +
+    "Connection: close\r\n\r\n" + body;
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(MetricsRegistry& registry)
+  : registry_(registry)
+  , running_(false)
+  , stopping_(false)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+  stop();
+}
+
+bool MetricsServer::start(const std::string& address)
+{
+  ACE_INET_Addr listen_addr;
+  const int result = address.find(':') == std::string::npos ?
+    listen_addr.set(static_cast<u_short>(ACE_OS::atoi(address.c_str())), "127.0.0.1") :
+    listen_addr.set(address.c_str());
+  if (result != 0 || listen_addr.get_port_number() == 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Invalid metrics address: %C\n"),
+                     address.c_str()),
+                    false);
+  }
+
+  if (acceptor_.open(listen_addr, 1) != 0) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot listen for metrics on %C: %m\n"),
+                     address.c_str()),
+                    false);
+  }
+
+  if (activate(THR_NEW_LWP | THR_JOINABLE, 1) != 0) {
+    acceptor_.close();
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: MetricsServer::start() - activate failed\n")),
+                    false);
+  }
+
+  running_ = true;
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Serving metrics on http://%C/metrics\n"),
+             address.find(':') == std::string::npos ?
+               ("127.0.0.1:" + address).c_str() : address.c_str()));
+  return true;
+}
+
+void MetricsServer::stop()
+{
+  if (!running_) {
+    return;
+  }
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    stopping_ = true;
+  }
+  wait();
+  acceptor_.close();
+  running_ = false;
+}
+
+int MetricsServer::svc()
+{
+  for (;;) {
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      if (stopping_) {
+        break;
+      }
+    }
+
+    ACE_SOCK_Stream peer;
+    ACE_Time_Value timeout = ACCEPT_TIMEOUT;
+    if (acceptor_.accept(peer, 0, &timeout) != 0) {
+      if (errno != ETIME && errno != EWOULDBLOCK && errno != EINTR) {
+        ACE_ERROR((LM_WARNING,
+                   ACE_TEXT("WARNING: %N:%l: Metrics accept failed: %m\n")));
+      }
+      continue;
+    }
+
+    serve(peer);
+    peer.close();
+  }
+  return 0;
+}
+
+void MetricsServer::serve(ACE_SOCK_Stream& peer)
+{
+  // Read up to the end of the request headers
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.find("\n\n") == std::string::npos &&
+         request.size() < MAX_REQUEST_SIZE) {
+    ACE_Time_Value timeout = REQUEST_TIMEOUT;
+    const ssize_t n = peer.recv(buffer, sizeof(buffer), &timeout);
+    if (n <= 0) {
+      break;
+    }
+    request.append(buffer, static_cast<size_t>(n));
+  }
+
+  // Request line: "GET /metrics HTTP/1.1" (a query string is ignored)
+  const std::string line = request.substr(0, request.find_first_of("\r\n"));
+  const size_t path_start = line.find(' ');
+  const size_t path_end = line.find_first_of(" ?", path_start + 1);
+  const std::string method = line.substr(0, path_start);
+  const std::string path = path_start == std::string::npos ? "" :
+    line.substr(path_start + 1, path_end == std::string::npos ?
+                std::string::npos : path_end - path_start - 1);
+
+  std::string reply;
+  if (method != "GET" && method != "HEAD") {
+    reply = response("405 Method Not Allowed", "text/plain", "Method not allowed\n");
+  } else if (path != "/metrics") {
+    reply = response("404 Not Found", "text/plain", "Not found: use /metrics\n");
+  } else {
+    reply = response("200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                     registry_.exposition());
+    if (method == "HEAD") {
+      reply.erase(reply.find("\r\n\r\n") + 4);
+    }
+  }
+
+  ACE_Time_Value timeout = REQUEST_TIMEOUT;
+  size_t sent = 0;
+  peer.send_n(reply.data(), reply.size(), &timeout, &sent);
+}
+
+} // namespace DirShare
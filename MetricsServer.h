@@ -0,0 +1,66 @@
+// MetricsServer.h
+// Minimal HTTP endpoint serving the metrics registry to Prometheus
+
+#ifndef DIRSHARE_METRICS_SERVER_H
+#define DIRSHARE_METRICS_SERVER_H
+
+#include "Metrics.h"
+
+#include <ace/Task.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/INET_Addr.h>
+#include <ace/SOCK_Acceptor.h>
+#include <ace/SOCK_Stream.h>
+
+#include <string>
+
+namespace DirShare {
+
+/**
+ * @class MetricsServer
+ * @brief Answers "GET /metrics" with the Prometheus text exposition
+ *
+ * One worker thread accepts connections and answers each with a single
+ * HTTP/1.0 response, then closes it; scrapes are rare and small, so there
+ * is no concurrency or keep-alive. Any other path gets 404. The listening
+ * address defaults to the loopback interface, so the metrics are only
+ * visible to the local host unless an address is given.
+ */
+class MetricsServer : public ACE_Task_Base {
+public:
+  /**
+   * Constructor
+   * @param registry Metrics to serve
+   */
+  explicit MetricsServer(MetricsRegistry& registry);
+
+  virtual ~MetricsServer();
+
+  /**
+   * Listen and start the worker thread
+   * @param address "port" (loopback) or "host:port"
+   * @return true on success (failures are logged)
+   */
+  bool start(const std::string& address);
+
+  /**
+   * Stop the worker thread and close the listening socket
+   */
+  void stop();
+
+  virtual int svc();
+
+private:
+  // Read one request and write the response
+  void serve(ACE_SOCK_Stream& peer);
+
+  MetricsRegistry& registry_;
+  ACE_SOCK_Acceptor acceptor_;
+  bool running_;
+  bool stopping_;
+  ACE_Thread_Mutex lock_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_METRICS_SERVER_H
@@ -0,0 +1,214 @@
+// ReedSolomon.cpp
+// GF(2^8) arithmetic and Cauchy Reed-Solomon encode/decode
+
+#include "ReedSolomon.h"
+
+#include <algorithm>
+
+namespace DirShare {
+
+namespace {
+
+// GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D), generator 2
+class GaloisField {
+public:
+  GaloisField()
+  {
+    unsigned x = 1;
+    for (unsigned i = 0; i < 255; ++i) {
+      exp_[i] = static_cast<uint8_t>(x);
+      exp_[i + 255] = static_cast<uint8_t>(x);
+      log_[x] = static_cast<uint8_t>(i);
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= 0x11D;
+      }
+    }
+    log_[0] = 0;
+
+    for (unsigned a = 0; a < 256; ++a) {
+      for (unsigned b = 0; b < 256; ++b) {
+        mul_[a][b] = (a == 0 || b == 0) ? 0 :
+          exp_[log_[a] + log_[b]];
+      }
+    }
+  }
+
+  uint8_t mul(uint8_t a, uint8_t b) const
+  {
+    return mul_[a][b];
+  }
+
+  // a != 0
+  uint8_t inv(uint8_t a) const
+  {
+    return exp_[255 - log_[a]];
+  }
+
+  // dst ^= c * src
+  void mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, size_t length) const
+  {
+    if (c == 0) {
+      return;
+    }
+    const uint8_t* row = mul_[c];
+    for (size_t i = 0; i < length; ++i) {
+      dst[i] ^= row[src[i]];
+    }
+  }
+
+private:
+  uint8_t exp_[510];
+  uint8_t log_[256];
+  uint8_t mul_[256][256];
+};
+
+const GaloisField& field()
+{
+  static const GaloisField gf;
+  return gf;
+}
+
+} // namespace
+
+ReedSolomonCode::ReedSolomonCode(unsigned data_blocks, unsigned repair_blocks)
+  : data_blocks_(data_blocks)
+  , repair_blocks_(repair_blocks)
+{
+  field(); // Build the tables up front rather than on the first decode
+}
+
+bool ReedSolomonCode::valid() const
+{
+  return data_blocks_ >= 1 && repair_blocks_ >= 1 &&
+         data_blocks_ + repair_blocks_ <= MAX_BLOCKS;
+}
+
+unsigned ReedSolomonCode::data_blocks() const
+{
+  return data_blocks_;
+}
+
+unsigned ReedSolomonCode::repair_blocks() const
+{
+  return repair_blocks_;
+}
+
+uint8_t ReedSolomonCode::coefficient(unsigned i, unsigned j) const
+{
+  // x_i = k + i and y_j = j are distinct, so x_i + y_j (XOR) is never 0
+  return field().inv(static_cast<uint8_t>((data_blocks_ + i) ^ j));
+}
+
+void ReedSolomonCode::encode(const std::vector<const uint8_t*>& data,
+                             size_t block_size,
+                             std::vector<std::vector<uint8_t> >& repair) const
+{
+  const GaloisField& gf = field();
+
+  repair.resize(repair_blocks_);
+  for (unsigned i = 0; i < repair_blocks_; ++i) {
+    repair[i].assign(block_size, 0);
+    uint8_t* out = block_size > 0 ? &repair[i][0] : 0;
+    for (unsigned j = 0; j < data_blocks_; ++j) {
+      gf.mul_add(out, data[j], coefficient(i, j), block_size);
+    }
+  }
+}
+
+bool ReedSolomonCode::decode(const std::vector<const uint8_t*>& blocks,
+                             size_t block_size,
+                             std::map<unsigned, std::vector<uint8_t> >& recovered) const
+{
+  const GaloisField& gf = field();
+  const unsigned k = data_blocks_;
+
+  recovered.clear();
+  if (blocks.size() < static_cast<size_t>(k + repair_blocks_)) {
+    return false;
+  }
+
+  // Pick k present blocks, data blocks first
+  std::vector<unsigned> rows;
+  std::vector<unsigned> missing;
+  for (unsigned j = 0; j < k; ++j) {
+    if (blocks[j]) {
+      rows.push_back(j);
+    } else {
+      missing.push_back(j);
+    }
+  }
+  if (missing.empty()) {
+    return true;
+  }
+  for (unsigned i = 0; i < repair_blocks_ && rows.size() < k; ++i) {
+    if (blocks[k + i]) {
+      rows.push_back(k + i);
+    }
+  }
+  if (rows.size() < k) {
+    return false;
+  }
+
+  // Encoding matrix restricted to the chosen rows, inverted by Gauss-Jordan
+  std::vector<uint8_t> a(k * k, 0);
+  std::vector<uint8_t> inv(k * k, 0);
+  for (unsigned r = 0; r < k; ++r) {
+    if (rows[r] < k) {
+      a[r * k + rows[r]] = 1;
+    } else {
+      for (unsigned j = 0; j < k; ++j) {
+        a[r * k + j] = coefficient(rows[r] - k, j);
+      }
+    }
+    inv[r * k + r] = 1;
+  }
+
+  for (unsigned col = 0; col < k; ++col) {
+    unsigned pivot = col;
+    while (pivot < k && a[pivot * k + col] == 0) {
+      ++pivot;
+    }
+    if (pivot == k) {
+      return false; // Cannot happen for a Cauchy code
+    }
+    if (pivot != col) {
+      for (unsigned j = 0; j < k; ++j) {
+        std::swap(a[pivot * k + j], a[col * k + j]);
+        std::swap(inv[pivot * k + j], inv[col * k + j]);
+      }
+    }
+
+    uint8_t scale = gf.inv(a[col * k + col]);
+    for (unsigned j = 0; j < k; ++j) {
+      a[col * k + j] = gf.mul(a[col * k + j], scale);
+      inv[col * k + j] = gf.mul(inv[col * k + j], scale);
+    }
+
+    for (unsigned r = 0; r < k; ++r) {
+      uint8_t factor = a[r * k + col];
+      if (r == col || factor == 0) {
+        continue;
+      }
+      gf.mul_add(&a[r * k], &a[col * k], factor, k);
+      gf.mul_add(&inv[r * k], &inv[col * k], factor, k);
+    }
+  }
+
+  // data[j] = sum over r of inv[j][r] * block[rows[r]]
+  for (size_t n = 0; n < missing.size(); ++n) {
+    unsigned j = missing[n];
+    std::vector<uint8_t>& out = recovered[j];
+    out.assign(block_size, 0);
+    if (block_size == 0) {
+      continue;
+    }
+    for (unsigned r = 0; r < k; ++r) {
+      gf.mul_add(&out[0], blocks[rows[r]], inv[j * k + r], block_size);
+    }
+  }
+
+  return true;
+}
+
+} // namespace DirShare
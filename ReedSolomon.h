@@ -0,0 +1,87 @@
+// ReedSolomon.h
+// Systematic Reed-Solomon erasure code over GF(2^8) used for forward error
+// correction of FileChunks on best-effort links.
+
+#ifndef DIRSHARE_REED_SOLOMON_H
+#define DIRSHARE_REED_SOLOMON_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * @class ReedSolomonCode
+ * @brief (k + m, k) erasure code: k data blocks, m repair blocks
+ *
+ * Repair block i is the sum over data blocks j of C[i][j] * data[j], with
+ * C the Cauchy matrix C[i][j] = 1 / (x_i + y_j), x_i = k + i, y_j = j.
+ * Every square submatrix of [I; C] is invertible, so any k of the k + m
+ * blocks reconstruct the data (maximum distance separable).
+ *
+ * All blocks of a group have the same size; shorter blocks are treated as
+ * zero-padded by the caller.
+ *
+ * Thread Safety: Stateless after construction; const methods may be called
+ * concurrently.
+ */
+class ReedSolomonCode {
+public:
+  /// k + m is limited by the field size
+  static const unsigned MAX_BLOCKS = 255;
+
+  /**
+   * @brief Constructor
+   *
+   * @param data_blocks Data blocks per group (k >= 1)
+   * @param repair_blocks Repair blocks per group (m >= 1, k + m <= MAX_BLOCKS)
+   */
+  ReedSolomonCode(unsigned data_blocks, unsigned repair_blocks);
+
+  /**
+   * @brief Whether the (k, m) parameters are usable
+   *
+   * @return true if 1 <= k, 1 <= m and k + m <= MAX_BLOCKS
+   */
+  bool valid() const;
+
+  unsigned data_blocks() const;
+  unsigned repair_blocks() const;
+
+  /**
+   * @brief Compute the repair blocks of a group
+   *
+   * @param data k pointers to block_size bytes each
+   * @param block_size Bytes per block
+   * @param repair Output: m blocks of block_size bytes
+   */
+  void encode(const std::vector<const uint8_t*>& data,
+              size_t block_size,
+              std::vector<std::vector<uint8_t> >& repair) const;
+
+  /**
+   * @brief Reconstruct the missing data blocks of a group
+   *
+   * @param blocks k + m pointers (data blocks first); 0 for a missing block
+   * @param block_size Bytes per block
+   * @param recovered Output: data block index -> contents, for every
+   *        missing data block
+   * @return true on success, false if fewer than k blocks are present
+   */
+  bool decode(const std::vector<const uint8_t*>& blocks,
+              size_t block_size,
+              std::map<unsigned, std::vector<uint8_t> >& recovered) const;
+
+private:
+  unsigned data_blocks_;
+  unsigned repair_blocks_;
+
+  // Coefficient of data block j in repair block i
+  uint8_t coefficient(unsigned i, unsigned j) const;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_REED_SOLOMON_H
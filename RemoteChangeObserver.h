@@ -0,0 +1,41 @@
+// RemoteChangeObserver.h
+// Callback of the listeners after they apply a change received from a peer
+
+#ifndef DIRSHARE_REMOTE_CHANGE_OBSERVER_H
+#define DIRSHARE_REMOTE_CHANGE_OBSERVER_H
+
+#include "DirShareTypeSupportImpl.h"
+
+#include <string>
+
+namespace DirShare {
+
+/**
+ * @class RemoteChangeObserver
+ * @brief Told about each remote change written to the shared directory
+ *
+ * Called by FileContentListenerImpl and FileChunkListenerImpl once a file
+ * is written (or found to hold the received bytes already), and by
+ * FileEventListenerImpl once a file is deleted. The call is made on the
+ * listener's thread, just before the file's notifications resume, so it
+ * should do no more than record the change (reading the file is fine)
+ * and leave the rest to another thread.
+ */
+class RemoteChangeObserver {
+public:
+  virtual ~RemoteChangeObserver() {}
+
+  /**
+   * A remote change was applied
+   * @param operation CREATE or MODIFY (the file did or did not exist), or DELETE
+   * @param filename Relative path within the shared directory
+   * @param origin Origin stamp the change arrived with
+   */
+  virtual void remote_change_applied(OperationType operation,
+                                     const std::string& filename,
+                                     const ChangeOrigin& origin) = 0;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_REMOTE_CHANGE_OBSERVER_H
@@ -0,0 +1,484 @@
+// Simulator.cpp
+// In-process simulation of many participants sharing a directory, on an
+// in-memory transport and file system driven by a virtual clock
+
+#include "Simulator.h"
+#include "FileEventListenerImpl.h"
+#include "FileContentListenerImpl.h"
+#include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "FileMonitor.h"
+#include "Checksum.h"
+#include "Latency.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_stdio.h>
+
+#include <cstring>
+#include <utility>
+
+namespace DirShare {
+
+namespace {
+
+// Sizes as CDR would encode them, without alignment padding
+const size_t ORIGIN_SIZE = 8 + 8 + 4 + 4 + 4;
+
+size_t string_size(const char* value)
+{
+  return 4 + std::strlen(value) + 1;
+}
+
+size_t sample_size(const FileEvent& event)
+{
+  return string_size(event.filename.in()) + 4 + 8 + 4 +
+         string_size(event.metadata.filename.in()) + 8 + 8 + 4 + 4 +
+         ORIGIN_SIZE;
+}
+
+size_t sample_size(const FileContent& content)
+{
+  return string_size(content.filename.in()) + 4 + content.data.length() +
+         8 + 4 + 8 + 4 + ORIGIN_SIZE;
+}
+
+ACE_Time_Value from_seconds(double seconds)
+{
+  ACE_Time_Value time;
+  time.set(seconds);
+  return time;
+}
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+} // namespace
+
+/**
+ * The state and receive path of one participant
+ * Listeners are created as SyncNode creates them, without writers
+ */
+class Simulator::Peer {
+public:
+  explicit Peer(const std::string& directory)
+    : directory_(directory)
+    , monitor_(directory, change_tracker_)
+    , event_listener_(new FileEventListenerImpl(
+        directory, DDS::DataWriter::_nil(), DDS::DataWriter::_nil(),
+        change_tracker_, content_index_))
+    , content_listener_(new FileContentListenerImpl(
+        directory, change_tracker_, content_index_))
+    , event_ref_(event_listener_)
+    , content_ref_(content_listener_)
+  {
+    monitor_.set_content_index(&content_index_);
+  }
+
+  const std::string& directory() const { return directory_; }
+  FileMonitor& monitor() { return monitor_; }
+  FileChangeTracker& change_tracker() { return change_tracker_; }
+
+  void deliver(const Message& message)
+  {
+    if (message.type == CAPTURE_FILE_EVENT) {
+      event_listener_->process_file_event(message.event);
+    } else {
+      content_listener_->process_file_content(message.content);
+    }
+  }
+
+private:
+  std::string directory_;
+  FileChangeTracker change_tracker_;
+  ContentIndex content_index_;
+  FileMonitor monitor_;
+  FileEventListenerImpl* event_listener_;
+  FileContentListenerImpl* content_listener_;
+
+  // Reference-counted like any listener; these own the objects above
+  DDS::DataReaderListener_var event_ref_;
+  DDS::DataReaderListener_var content_ref_;
+
+  Peer(const Peer&);
+  Peer& operator=(const Peer&);
+};
+
+SimulationConfig::SimulationConfig()
+  : peers(10)
+  , scan_interval(1, 0)
+  , latency(0, 5000)
+  , jitter(0, 2000)
+  , time_limit(600, 0)
+  , seed(1)
+{
+}
+
+SimulationResult::SimulationResult()
+  : deliveries(0)
+  , bytes_delivered(0)
+  , scans(0)
+  , converged(false)
+  , last_action(ACE_Time_Value::zero)
+  , converged_at(ACE_Time_Value::zero)
+  , end_time(ACE_Time_Value::zero)
+  , wall_time(ACE_Time_Value::zero)
+{
+}
+
+Simulator::Simulator(const SimulationConfig& config)
+  : config_(config)
+  , next_order_(0)
+  , next_message_(0)
+  , pending_actions_(0)
+  , random_state_(config.seed)
+  , ran_(false)
+{
+  FileSystem::mount(&file_system_);
+  for (unsigned p = 0; p < config_.peers; ++p) {
+    file_system_.make_directory(directory(p));
+    peers_.push_back(new Peer(directory(p)));
+  }
+  last_delivery_.assign(static_cast<size_t>(config_.peers) * config_.peers,
+                        ACE_Time_Value::zero);
+}
+
+Simulator::~Simulator()
+{
+  for (size_t p = 0; p < peers_.size(); ++p) {
+    delete peers_[p];
+  }
+  for (std::map<unsigned long long, Message*>::iterator it = in_flight_.begin();
+       it != in_flight_.end(); ++it) {
+    delete it->second;
+  }
+  FileSystem::mount(0);
+}
+
+std::string Simulator::directory(unsigned peer) const
+{
+  char path[32];
+  ACE_OS::snprintf(path, sizeof(path), "/peer%u", peer);
+  return path;
+}
+
+void Simulator::write_file(const ACE_Time_Value& at,
+                           unsigned peer,
+                           const std::string& filename,
+                           const std::vector<unsigned char>& data)
+{
+  Action action;
+  action.peer = peer;
+  action.filename = filename;
+  action.data = data;
+  action.remove = false;
+  actions_.push_back(action);
+  ++pending_actions_;
+  schedule(at, Step::ACTION, peer, actions_.size() - 1);
+}
+
+void Simulator::delete_file(const ACE_Time_Value& at, unsigned peer, const std::string& filename)
+{
+  Action action;
+  action.peer = peer;
+  action.filename = filename;
+  action.remove = true;
+  actions_.push_back(action);
+  ++pending_actions_;
+  schedule(at, Step::ACTION, peer, actions_.size() - 1);
+}
+
+void Simulator::schedule(const ACE_Time_Value& at, Step::Kind kind, unsigned peer,
+                         unsigned long long item)
+{
+  Step step;
+  step.at = at;
+  step.order = next_order_++;
+  step.kind = kind;
+  step.peer = peer;
+  step.item = item;
+  steps_.push(step);
+}
+
+double Simulator::random()
+{
+  // 32-bit LCG (Numerical Recipes); deterministic across platforms
+  random_state_ = (random_state_ * 1664525UL + 1013904223UL) & 0xFFFFFFFFUL;
+  return static_cast<double>(random_state_) / 4294967296.0;
+}
+
+bool Simulator::run(SimulationResult& result)
+{
+  if (ran_ || peers_.empty()) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Simulator::run() needs peers and runs once\n")),
+                    false);
+  }
+  ran_ = true;
+  result = SimulationResult();
+
+  // Scripted writes at time 0 were queued first, so they precede the start
+  for (unsigned p = 0; p < peers_.size(); ++p) {
+    schedule(ACE_Time_Value::zero, Step::START, p, 0);
+  }
+
+  const ACE_Time_Value wall_start = monotonic_now();
+  unsigned long long quiet_scans = 0;  // Scans that published nothing, in a row
+  bool idle = false;
+  while (!steps_.empty()) {
+    const Step step = steps_.top();
+    if (step.at > config_.time_limit) {
+      break;
+    }
+    steps_.pop();
+    clock_.advance_to(step.at);
+    file_system_.set_time(static_cast<unsigned long long>(clock_.now().sec()));
+    const unsigned long long changes = file_system_.changes();
+
+    switch (step.kind) {
+    case Step::START: {
+      start_peer(step.peer, result);
+      // Stagger the scans over the period, as independent processes would be
+      const double offset = seconds(config_.scan_interval) * (step.peer + 1) / peers_.size();
+      schedule(clock_.now() + from_seconds(offset), Step::SCAN, step.peer, 0);
+      quiet_scans = 0;
+      break;
+    }
+    case Step::SCAN:
+      ++result.scans;
+      quiet_scans = scan_peer(step.peer, result) ? 0 : quiet_scans + 1;
+      schedule(clock_.now() + config_.scan_interval, Step::SCAN, step.peer, 0);
+      break;
+    case Step::DELIVER:
+      deliver(step.peer, step.item, result);
+      quiet_scans = 0;
+      break;
+    case Step::ACTION:
+      apply(actions_[static_cast<size_t>(step.item)]);
+      --pending_actions_;
+      result.last_action = clock_.now();
+      quiet_scans = 0;
+      break;
+    }
+
+    if (file_system_.changes() != changes) {
+      result.converged_at = clock_.now();
+    }
+    if (pending_actions_ == 0 && in_flight_.empty() && quiet_scans >= peers_.size()) {
+      idle = true;
+      break;
+    }
+  }
+
+  result.end_time = clock_.now();
+  result.wall_time = monotonic_now() - wall_start;
+  result.converged = converged();
+  if (!idle) {
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Simulation stopped at the time limit (%d s), ")
+               ACE_TEXT("%Q samples still in flight\n"),
+               static_cast<int>(config_.time_limit.sec()),
+               static_cast<unsigned long long>(in_flight_.size())));
+  }
+  return true;
+}
+
+void Simulator::start_peer(unsigned peer, SimulationResult& result)
+{
+  const std::vector<FileMetadata> files = peers_[peer]->monitor().get_all_files();
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string path = peers_[peer]->directory() + "/" + files[i].filename.in();
+    std::vector<unsigned char> data;
+    unsigned long long mtime_sec;
+    unsigned long mtime_nsec;
+    if (!file_system_.read_file_stable(path, data, mtime_sec, mtime_nsec)) {
+      continue;
+    }
+
+    Message* message = new Message;
+    message->type = CAPTURE_FILE_CONTENT;
+    FileContent& content = message->content;
+    content.filename = files[i].filename;
+    content.size = data.size();
+    content.checksum = calculate_crc32(data.empty() ? 0 : &data[0], data.size());
+    content.timestamp_sec = mtime_sec;
+    content.timestamp_nsec = mtime_nsec;
+    content.data.length(static_cast<CORBA::ULong>(data.size()));
+    if (!data.empty()) {
+      std::memcpy(content.data.get_buffer(), &data[0], data.size());
+    }
+    content.origin = origin_for_send(0);
+    publish(peer, message, result);
+  }
+}
+
+bool Simulator::scan_peer(unsigned peer, SimulationResult& result)
+{
+  std::vector<std::string> created_files;
+  std::vector<std::string> modified_files;
+  std::vector<std::string> deleted_files;
+  if (!peers_[peer]->monitor().scan_for_changes(created_files, modified_files, deleted_files)) {
+    return false;
+  }
+
+  bool published = false;
+  for (size_t i = 0; i < created_files.size(); ++i) {
+    published = publish_file(peer, CREATE, created_files[i], result) || published;
+  }
+  for (size_t i = 0; i < modified_files.size(); ++i) {
+    published = publish_file(peer, MODIFY, modified_files[i], result) || published;
+  }
+  for (size_t i = 0; i < deleted_files.size(); ++i) {
+    if (!peers_[peer]->change_tracker().is_suppressed(deleted_files[i])) {
+      published = publish_file(peer, DELETE, deleted_files[i], result) || published;
+    }
+  }
+  return published;
+}
+
+bool Simulator::publish_file(unsigned peer, OperationType operation,
+                             const std::string& filename, SimulationResult& result)
+{
+  Message* event_message = new Message;
+  event_message->type = CAPTURE_FILE_EVENT;
+  FileEvent& event = event_message->event;
+  event.filename = filename.c_str();
+  event.operation = operation;
+  event.timestamp_sec = static_cast<CORBA::ULongLong>(clock_.now().sec());
+  event.timestamp_nsec = static_cast<CORBA::ULong>(clock_.now().usec() * 1000);
+  event.metadata.filename = filename.c_str();
+  event.metadata.size = 0;
+  event.metadata.timestamp_sec = 0;
+  event.metadata.timestamp_nsec = 0;
+  event.metadata.checksum = 0;
+  event.origin = origin_for_send(0);
+
+  // Content as read in one stable view, as FilePublisher::load_file() does
+  Message* content_message = 0;
+  if (operation != DELETE) {
+    std::vector<unsigned char> data;
+    unsigned long long mtime_sec;
+    unsigned long mtime_nsec;
+    if (!file_system_.read_file_stable(peers_[peer]->directory() + "/" + filename,
+                                       data, mtime_sec, mtime_nsec)) {
+      delete event_message;
+      return false;
+    }
+    event.metadata.size = data.size();
+    event.metadata.timestamp_sec = mtime_sec;
+    event.metadata.timestamp_nsec = mtime_nsec;
+    event.metadata.checksum = calculate_crc32(data.empty() ? 0 : &data[0], data.size());
+
+    content_message = new Message;
+    content_message->type = CAPTURE_FILE_CONTENT;
+    FileContent& content = content_message->content;
+    content.filename = filename.c_str();
+    content.size = event.metadata.size;
+    content.checksum = event.metadata.checksum;
+    content.timestamp_sec = mtime_sec;
+    content.timestamp_nsec = mtime_nsec;
+    content.data.length(static_cast<CORBA::ULong>(data.size()));
+    if (!data.empty()) {
+      std::memcpy(content.data.get_buffer(), &data[0], data.size());
+    }
+    content.origin = origin_for_send(0);
+  }
+
+  publish(peer, event_message, result);
+  if (content_message) {
+    publish(peer, content_message, result);
+  }
+  return true;
+}
+
+void Simulator::publish(unsigned sender, Message* message, SimulationResult& result)
+{
+  message->size = message->type == CAPTURE_FILE_EVENT ? sample_size(message->event) :
+                                                         sample_size(message->content);
+  message->pending = static_cast<unsigned>(peers_.size() - 1);
+
+  SimulationTotals& totals = result.published[message->type];
+  ++totals.samples;
+  totals.bytes += message->size;
+
+  if (message->pending == 0) {
+    delete message;
+    return;
+  }
+
+  const unsigned long long id = next_message_++;
+  in_flight_[id] = message;
+  for (unsigned receiver = 0; receiver < peers_.size(); ++receiver) {
+    if (receiver == sender) {
+      continue;
+    }
+    // Reliable delivery keeps the order of each sender's samples
+    ACE_Time_Value& last = last_delivery_[static_cast<size_t>(sender) * peers_.size() + receiver];
+    ACE_Time_Value at = clock_.now() + config_.latency +
+                        from_seconds(seconds(config_.jitter) * random());
+    if (at < last) {
+      at = last;
+    }
+    last = at;
+    schedule(at, Step::DELIVER, receiver, id);
+  }
+}
+
+void Simulator::deliver(unsigned peer, unsigned long long message_id, SimulationResult& result)
+{
+  std::map<unsigned long long, Message*>::iterator it = in_flight_.find(message_id);
+  if (it == in_flight_.end()) {
+    return;
+  }
+  Message* message = it->second;
+  peers_[peer]->deliver(*message);
+  ++result.deliveries;
+  result.bytes_delivered += message->size;
+
+  if (--message->pending == 0) {
+    in_flight_.erase(it);
+    delete message;
+  }
+}
+
+void Simulator::apply(const Action& action)
+{
+  const std::string path = directory(action.peer) + "/" + action.filename;
+  const bool ok = action.remove ?
+    file_system_.delete_file(path) :
+    file_system_.write_file(path, action.data.empty() ? 0 : &action.data[0], action.data.size());
+  if (!ok) {
+    ACE_ERROR((LM_WARNING,
+               ACE_TEXT("WARNING: %N:%l: Scripted %C of %C failed\n"),
+               action.remove ? "delete" : "write",
+               path.c_str()));
+  }
+}
+
+bool Simulator::converged()
+{
+  std::vector<std::pair<std::string, unsigned long> > reference;
+  for (unsigned p = 0; p < peers_.size(); ++p) {
+    std::vector<std::string> files;
+    file_system_.list_directory_files(directory(p), files, 0);
+
+    // Listed in name order (the map's order)
+    std::vector<std::pair<std::string, unsigned long> > state;
+    for (size_t i = 0; i < files.size(); ++i) {
+      std::vector<unsigned char> data;
+      file_system_.read_file(directory(p) + "/" + files[i], data);
+      state.push_back(std::make_pair(files[i],
+                                     calculate_crc32(data.empty() ? 0 : &data[0], data.size())));
+    }
+
+    if (p == 0) {
+      reference.swap(state);
+    } else if (state != reference) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace DirShare
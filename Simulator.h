@@ -0,0 +1,215 @@
+// Simulator.h
+// In-process simulation of many participants sharing a directory, on an
+// in-memory transport and file system driven by a virtual clock
+
+#ifndef DIRSHARE_SIMULATOR_H
+#define DIRSHARE_SIMULATOR_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "Capture.h"
+#include "FileSystem.h"
+
+#include <ace/Time_Value.h>
+
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * @class VirtualClock
+ * @brief Simulated time; only moves when the simulator advances it
+ */
+class VirtualClock {
+public:
+  VirtualClock() : now_(ACE_Time_Value::zero) {}
+
+  const ACE_Time_Value& now() const { return now_; }
+
+  /// Move forward to a later time (earlier times are ignored)
+  void advance_to(const ACE_Time_Value& time)
+  {
+    if (time > now_) {
+      now_ = time;
+    }
+  }
+
+private:
+  ACE_Time_Value now_;
+};
+
+/**
+ * Parameters of a simulation
+ */
+struct SimulationConfig {
+  unsigned peers;                // Participants
+  ACE_Time_Value scan_interval;  // Directory scan period of each peer
+  ACE_Time_Value latency;        // One-way delivery delay
+  ACE_Time_Value jitter;         // Extra delay, uniform in [0, jitter)
+  ACE_Time_Value time_limit;     // Virtual time after which the run stops
+  unsigned long seed;            // Seed of the jitter
+
+  SimulationConfig();
+};
+
+/**
+ * Samples of one type published during a simulation
+ */
+struct SimulationTotals {
+  unsigned long long samples;
+  unsigned long long bytes;      // Approximate CDR size of the samples
+  SimulationTotals() : samples(0), bytes(0) {}
+};
+
+/**
+ * Outcome of a simulation
+ */
+struct SimulationResult {
+  std::map<CaptureRecordType, SimulationTotals> published;
+  unsigned long long deliveries;       // Samples handed to a receiving peer
+  unsigned long long bytes_delivered;
+  unsigned long long scans;
+  bool converged;                      // All directories identical at the end
+  ACE_Time_Value last_action;          // Virtual time of the last scripted change
+  ACE_Time_Value converged_at;         // Virtual time of the last file change by any peer
+  ACE_Time_Value end_time;             // Virtual time the run stopped
+  ACE_Time_Value wall_time;            // Real time the run took
+
+  SimulationResult();
+};
+
+/**
+ * @class Simulator
+ * @brief Runs many participants in one process, deterministically
+ *
+ * Each peer is a directory of a MemoryFileSystem (mounted for the
+ * lifetime of the simulator) with its own FileChangeTracker, ContentIndex,
+ * FileMonitor and receive-path listeners, wired as dirshare wires them but
+ * without DDS: published samples are queued for every other peer with the
+ * configured latency, in order per sender and receiver. Peers start at
+ * time 0 by pushing the files they hold (as SyncNode::start() does), then
+ * scan their directory periodically and publish each change as a FileEvent
+ * followed by its FileContent, as the dirshare main loop does. Contents are
+ * always sent whole, as FileContent.
+ *
+ * The run stops once no change or sample is pending and every peer has
+ * completed a scan with nothing to publish, or at the time limit.
+ */
+class Simulator {
+public:
+  explicit Simulator(const SimulationConfig& config);
+  ~Simulator();
+
+  /// Shared directory of a peer
+  std::string directory(unsigned peer) const;
+
+  MemoryFileSystem& file_system() { return file_system_; }
+  const VirtualClock& clock() const { return clock_; }
+
+  /**
+   * Script a write of a file by a peer's user
+   * Files written at time 0 exist when the peers start
+   * @param at Virtual time of the write
+   * @param peer Peer whose directory is written
+   * @param filename File name
+   * @param data New contents
+   */
+  void write_file(const ACE_Time_Value& at,
+                  unsigned peer,
+                  const std::string& filename,
+                  const std::vector<unsigned char>& data);
+
+  /// Script a deletion of a file by a peer's user
+  void delete_file(const ACE_Time_Value& at, unsigned peer, const std::string& filename);
+
+  /**
+   * Run the simulation (once)
+   * @param result Output: traffic and convergence
+   * @return false if the simulator could not be set up (logged)
+   */
+  bool run(SimulationResult& result);
+
+  /// Whether every peer holds the same files with the same contents
+  bool converged();
+
+private:
+  class Peer;
+
+  // A published sample, shared by its deliveries
+  struct Message {
+    CaptureRecordType type;
+    FileEvent event;
+    FileContent content;
+    size_t size;
+    unsigned pending;   // Deliveries still queued
+  };
+
+  // A scripted change
+  struct Action {
+    unsigned peer;
+    std::string filename;
+    std::vector<unsigned char> data;
+    bool remove;
+  };
+
+  // Something to do at a virtual time
+  struct Step {
+    enum Kind { START, SCAN, DELIVER, ACTION };
+    ACE_Time_Value at;
+    unsigned long long order;   // Ties run in the order they were queued
+    Kind kind;
+    unsigned peer;
+    unsigned long long item;    // Message or action
+  };
+
+  struct Later {
+    bool operator()(const Step& a, const Step& b) const
+    {
+      return a.at != b.at ? a.at > b.at : a.order > b.order;
+    }
+  };
+
+  void schedule(const ACE_Time_Value& at, Step::Kind kind, unsigned peer,
+                unsigned long long item);
+
+  // Queue a sample for every peer but the sender
+  void publish(unsigned sender, Message* message, SimulationResult& result);
+
+  void start_peer(unsigned peer, SimulationResult& result);
+
+  // Scan a peer's directory and publish its changes; false if nothing changed
+  bool scan_peer(unsigned peer, SimulationResult& result);
+
+  bool publish_file(unsigned peer, OperationType operation,
+                    const std::string& filename, SimulationResult& result);
+
+  void deliver(unsigned peer, unsigned long long message_id, SimulationResult& result);
+
+  void apply(const Action& action);
+
+  // Uniform in [0, 1)
+  double random();
+
+  SimulationConfig config_;
+  MemoryFileSystem file_system_;
+  VirtualClock clock_;
+  std::vector<Peer*> peers_;
+  std::priority_queue<Step, std::vector<Step>, Later> steps_;
+  std::map<unsigned long long, Message*> in_flight_;
+  std::vector<Action> actions_;
+  std::vector<ACE_Time_Value> last_delivery_;  // Per sender and receiver
+  unsigned long long next_order_;
+  unsigned long long next_message_;
+  size_t pending_actions_;
+  unsigned long random_state_;
+  bool ran_;
+
+  Simulator(const Simulator&);
+  Simulator& operator=(const Simulator&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_SIMULATOR_H
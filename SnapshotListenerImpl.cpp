@@ -1,6 +1,12 @@
 #include "SnapshotListenerImpl.h"
+#include "SwarmDownloader.h"
+#include "SyncFilter.h"
+#include "IgnoreMatcher.h"
 #include "FileUtils.h"
 #include "Checksum.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Log.h"
 
 #include <ace/Log_Msg.h>
 
@@ -15,6 +21,10 @@ SnapshotListenerImpl::SnapshotListenerImpl(
   : shared_dir_(shared_dir)
   , content_writer_(DDS::DataWriter::_duplicate(content_writer))
   , chunk_writer_(DDS::DataWriter::_duplicate(chunk_writer))
+  , swarm_downloader_(0)
+  , sync_filter_(0)
+  , ignore_(0)
+  , received_("received", "DirShare_DirectorySnapshot")
 {
 }
 
@@ -22,6 +32,21 @@ SnapshotListenerImpl::~SnapshotListenerImpl()
 {
 }
 
+void SnapshotListenerImpl::set_swarm_downloader(SwarmDownloader* downloader)
+{
+  swarm_downloader_ = downloader;
+}
+
+void SnapshotListenerImpl::set_sync_filter(const SyncFilter* filter)
+{
+  sync_filter_ = filter;
+}
+
+void SnapshotListenerImpl::set_ignore_matcher(const IgnoreMatcher* ignore)
+{
+  ignore_ = ignore;
+}
+
 void SnapshotListenerImpl::on_requested_deadline_missed(
   DDS::DataReader_ptr,
   const DDS::RequestedDeadlineMissedStatus&)
@@ -77,12 +102,6 @@ void SnapshotListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 
   if (status == DDS::RETCODE_OK) {
     if (info.valid_data) {
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) Received DirectorySnapshot from participant %C\n")
-                 ACE_TEXT("  File count: %u\n"),
-                 snapshot.participant_id.in(),
-                 snapshot.file_count));
-
       process_snapshot(snapshot);
     }
   } else if (status != DDS::RETCODE_NO_DATA) {
@@ -95,10 +114,20 @@ void SnapshotListenerImpl::on_data_available(DDS::DataReader_ptr reader)
 
 void SnapshotListenerImpl::process_snapshot(const DirectorySnapshot& snapshot)
 {
+  TraceSpan span("receive", "process_snapshot", snapshot.participant_id.in());
+  SampleCapture::instance().record(snapshot);
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Received DirectorySnapshot from participant %C\n")
+             ACE_TEXT("  File count: %u\n"),
+             snapshot.participant_id.in(),
+             snapshot.file_count));
+  received_.sample();
+
   // Build set of local files
   std::set<std::string> local_files;
   std::vector<std::string> files;
-  list_directory_files(shared_dir_, files);
+  list_directory_files(shared_dir_, files, ignore_);
 
   for (size_t i = 0; i < files.size(); ++i) {
     local_files.insert(files[i]);
@@ -109,40 +138,52 @@ void SnapshotListenerImpl::process_snapshot(const DirectorySnapshot& snapshot)
     const FileMetadata& metadata = snapshot.files[i];
     std::string filename = metadata.filename.in();
 
+    // Not subscribed to by this participant (selective sync)
+    if (sync_filter_ && !sync_filter_->matches(filename, metadata.size)) {
+      continue;
+    }
+
+    // Ignored locally (.dirshareignore)
+    if (ignore_ && ignore_->ignored(filename)) {
+      continue;
+    }
+
+    // Every peer listing this content can serve chunks of it
+    if (swarm_downloader_) {
+      swarm_downloader_->add_source(snapshot.participant_id.in(), metadata);
+    }
+
     // Check if we have this file locally
     if (local_files.find(filename) == local_files.end()) {
       // File missing locally - request it
-      ACE_DEBUG((LM_INFO,
-                 ACE_TEXT("(%P|%t) File missing locally: %C (size: %Q bytes)\n"),
-                 filename.c_str(),
-                 metadata.size));
+      DIRSHARE_INFO_EVERY(filename.c_str(),
+                          ("File missing locally: %s (size: %llu bytes)\n",
+                           filename.c_str(),
+                           static_cast<unsigned long long>(metadata.size)));
 
       request_file(metadata);
     } else {
       // File exists - could check if our version is older
       // For now, skip files that exist locally
-      ACE_DEBUG((LM_DEBUG,
-                 ACE_TEXT("(%P|%t) File already exists locally: %C\n"),
-                 filename.c_str()));
+      DIRSHARE_DEBUG_EVERY(filename.c_str(),
+                           ("File already exists locally: %s\n", filename.c_str()));
     }
   }
 }
 
 void SnapshotListenerImpl::request_file(const FileMetadata& metadata)
 {
-  // In initial implementation, we'll trigger a file transfer request
-  // This is a placeholder - the actual mechanism would involve:
-  // 1. Sending a FileEvent request (future enhancement)
-  // 2. Or relying on the remote side to publish FileContent/FileChunks
-  //    for files in their snapshot (which is the current approach)
+  if (!swarm_downloader_) {
+    // Files are pushed by their owner after it starts; nothing to pull
+    DIRSHARE_INFO_EVERY(metadata.filename.in(),
+                        ("Waiting for %s to be pushed by its owner\n", metadata.filename.in()));
+    return;
+  }
 
-  ACE_DEBUG((LM_INFO,
-             ACE_TEXT("(%P|%t) Requesting file: %C from remote participant\n"),
-             metadata.filename.in()));
+  DIRSHARE_INFO_EVERY(metadata.filename.in(),
+                      ("Requesting file: %s from the peers holding it\n", metadata.filename.in()));
 
-  // Note: In the current architecture, files are pushed automatically
-  // by the remote participant after snapshot exchange. This function
-  // is a placeholder for future pull-based transfer enhancement.
+  swarm_downloader_->request_file(metadata);
 }
 
 } // namespace DirShare
@@ -2,6 +2,7 @@
 #define DIRSHARE_SNAPSHOT_LISTENER_IMPL_H
 
 #include "DirShareTypeSupportImpl.h"
+#include "Metrics.h"
 
 #include <dds/DCPS/LocalObject.h>
 #include <dds/DdsDcpsSubscriptionC.h>
@@ -10,6 +11,10 @@
 
 namespace DirShare {
 
+class IgnoreMatcher;
+class SwarmDownloader;
+class SyncFilter;
+
 class SnapshotListenerImpl
   : public virtual OpenDDS::DCPS::LocalObject<DDS::DataReaderListener>
 {
@@ -47,13 +52,46 @@ public:
     DDS::DataReader_ptr reader,
     const DDS::SampleLostStatus& status);
 
+  /**
+   * Pull missing files from the peers that advertise them (optional)
+   * Without a downloader, files are only received when their owner pushes
+   * them. Must be set before the reader is created
+   * @param downloader Swarm downloader, or 0 to disable (not owned)
+   */
+  void set_swarm_downloader(SwarmDownloader* downloader);
+
+  /**
+   * Ignore snapshot entries this participant does not subscribe to
+   * A snapshot lists every file in one sample, so the DDS content filter
+   * of the per-file topics cannot drop them. Must be set before the
+   * reader is created
+   * @param filter Selective sync filter, or 0 for all files (not owned)
+   */
+  void set_sync_filter(const SyncFilter* filter);
+
+  /**
+   * Skip snapshot entries matched by the local ignore patterns
+   * Must be set before the reader is created
+   * @param ignore Compiled ignore patterns, or 0 for none (not owned)
+   */
+  void set_ignore_matcher(const IgnoreMatcher* ignore);
+
+  /**
+   * Compare a received snapshot with the local directory
+   * Called for each valid sample taken by on_data_available(), and
+   * directly by dirshare-replay
+   * @param snapshot Received snapshot
+   */
+  void process_snapshot(const DirectorySnapshot& snapshot);
+
 private:
   std::string shared_dir_;
   DDS::DataWriter_var content_writer_;
   DDS::DataWriter_var chunk_writer_;
-
-  // Process a received directory snapshot
-  void process_snapshot(const DirectorySnapshot& snapshot);
+  SwarmDownloader* swarm_downloader_;
+  const SyncFilter* sync_filter_;
+  const IgnoreMatcher* ignore_;
+  TopicCounters received_;
 
   // Request a file from remote participant
   void request_file(const FileMetadata& metadata);
@@ -0,0 +1,347 @@
+// Stats.cpp
+// Implementation of participant statistics and the fleet view
+
+#include "Stats.h"
+#include "Latency.h"
+#include "Metrics.h"
+
+#include <dds/DCPS/Marked_Default_Qos.h>
+
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+namespace DirShare {
+
+namespace {
+
+// Totals of the process from the metrics registry
+unsigned long long registry_total(const std::string& name)
+{
+  const long long total = MetricsRegistry::instance().total(name);
+  return total > 0 ? static_cast<unsigned long long>(total) : 0;
+}
+
+ACE_Time_Value sample_time(unsigned long long sec, unsigned long nsec)
+{
+  return ACE_Time_Value(static_cast<time_t>(sec), static_cast<suseconds_t>(nsec / 1000));
+}
+
+double rate(unsigned long long previous, unsigned long long current, double seconds)
+{
+  if (seconds <= 0.0 || current < previous) {
+    return 0.0;
+  }
+  return static_cast<double>(current - previous) / seconds;
+}
+
+} // namespace
+
+uint64_t file_digest(const std::string& filename, uint32_t checksum)
+{
+  // FNV-1a over the name and the checksum, then a 64-bit finalizer so that
+  // similar names spread over all bits before they are summed
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < filename.size(); ++i) {
+    hash ^= static_cast<unsigned char>(filename[i]);
+    hash *= 1099511628211ULL;
+  }
+  hash *= 1099511628211ULL;  // A NUL separator (names cannot contain NUL)
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    hash ^= (checksum >> shift) & 0xFF;
+    hash *= 1099511628211ULL;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+DirectorySummary::DirectorySummary()
+  : file_count(0)
+  , total_bytes(0)
+  , digest(0)
+{
+}
+
+void DirectorySummary::add(const std::string& filename,
+                           unsigned long long size,
+                           uint32_t checksum)
+{
+  ++file_count;
+  total_bytes += size;
+  digest += file_digest(filename, checksum);
+}
+
+void DirectorySummary::remove(const std::string& filename,
+                              unsigned long long size,
+                              uint32_t checksum)
+{
+  --file_count;
+  total_bytes -= size;
+  digest -= file_digest(filename, checksum);
+}
+
+void collect_participant_stats(const std::string& participant_id,
+                               const DirectorySummary& directory,
+                               ParticipantStats& stats)
+{
+  char host[256];
+  if (ACE_OS::hostname(host, sizeof(host)) != 0) {
+    host[0] = '\0';
+  }
+
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  stats.participant_id = participant_id.c_str();
+  stats.hostname = host;
+  stats.time_sec = static_cast<CORBA::ULongLong>(now.sec());
+  stats.time_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
+  stats.origin = local_origin();
+  stats.last_sequence = last_local_sequence();
+
+  stats.file_count = static_cast<CORBA::ULong>(directory.file_count);
+  stats.total_bytes = directory.total_bytes;
+  stats.directory_digest = directory.digest;
+  stats.digest_changed_sec = static_cast<CORBA::ULongLong>(directory.digest_changed.sec());
+  stats.digest_changed_nsec = static_cast<CORBA::ULong>(directory.digest_changed.usec() * 1000);
+  stats.local_change_sec = static_cast<CORBA::ULongLong>(directory.local_change.sec());
+  stats.local_change_nsec = static_cast<CORBA::ULong>(directory.local_change.usec() * 1000);
+
+  stats.bytes_in_flight = registry_total("dirshare_reassembly_buffer_bytes");
+  stats.backlog = static_cast<CORBA::ULong>(
+    registry_total("dirshare_transfers_active") +
+    registry_total("dirshare_chunk_requests_queued"));
+  stats.bytes_sent = registry_total("dirshare_payload_bytes_sent_total");
+  stats.bytes_received = registry_total("dirshare_payload_bytes_received_total");
+
+  stats.checksum_errors = static_cast<CORBA::ULong>(receive_errors("checksum").value());
+  stats.write_errors = static_cast<CORBA::ULong>(receive_errors("write").value());
+  stats.transfer_errors = static_cast<CORBA::ULong>(receive_errors("transfer").value());
+
+  AppliedOrigins::instance().progress(stats.applied);
+}
+
+FleetView::Node::Node()
+  : send_rate(0.0)
+  , receive_rate(0.0)
+{
+}
+
+void FleetView::update(const ParticipantStats& stats, const ACE_Time_Value& now)
+{
+  Node& node = nodes_[stats.participant_id.in()];
+
+  if (node.received != ACE_Time_Value::zero) {
+    const double seconds =
+      static_cast<double>(stats.time_sec) - static_cast<double>(node.stats.time_sec) +
+      (static_cast<double>(stats.time_nsec) - static_cast<double>(node.stats.time_nsec)) / 1e9;
+    node.send_rate = rate(node.stats.bytes_sent, stats.bytes_sent, seconds);
+    node.receive_rate = rate(node.stats.bytes_received, stats.bytes_received, seconds);
+  }
+
+  node.stats = stats;
+  node.received = now;
+}
+
+void FleetView::remove(const std::string& participant_id)
+{
+  nodes_.erase(participant_id);
+}
+
+size_t FleetView::expire(const ACE_Time_Value& now, const ACE_Time_Value& timeout)
+{
+  size_t removed = 0;
+  for (NodeMap::iterator it = nodes_.begin(); it != nodes_.end();) {
+    if (now - it->second.received > timeout) {
+      nodes_.erase(it++);
+      ++removed;
+    } else {
+      ++it;
+    }
+  }
+  return removed;
+}
+
+bool FleetView::converged() const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  const CORBA::ULongLong digest = nodes_.begin()->second.stats.directory_digest;
+  for (NodeMap::const_iterator it = nodes_.begin(); it != nodes_.end(); ++it) {
+    if (it->second.stats.directory_digest != digest) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FleetView::Convergence::Convergence()
+  : converged(false)
+  , digests(0)
+{
+}
+
+ACE_Time_Value FleetView::Convergence::time_to_converge() const
+{
+  // A change that leaves the digest as it was (a touch) settles at once
+  if (!converged || settled < last_change) {
+    return ACE_Time_Value::zero;
+  }
+  return settled - last_change;
+}
+
+FleetView::Convergence FleetView::convergence() const
+{
+  Convergence result;
+  std::map<CORBA::ULongLong, bool> digests;
+  for (NodeMap::const_iterator it = nodes_.begin(); it != nodes_.end(); ++it) {
+    const ParticipantStats& stats = it->second.stats;
+    digests[stats.directory_digest] = true;
+
+    const ACE_Time_Value changed =
+      sample_time(stats.digest_changed_sec, stats.digest_changed_nsec);
+    if (changed > result.settled) {
+      result.settled = changed;
+    }
+    const ACE_Time_Value local = sample_time(stats.local_change_sec, stats.local_change_nsec);
+    if (local > result.last_change) {
+      result.last_change = local;
+    }
+  }
+  result.digests = digests.size();
+  result.converged = result.digests == 1;
+  return result;
+}
+
+unsigned long FleetView::lag(const std::string& participant_id) const
+{
+  NodeMap::const_iterator self = nodes_.find(participant_id);
+  if (self == nodes_.end()) {
+    return 0;
+  }
+
+  // Newest change of each origin in view (the nodes of a relay share one)
+  std::map<uint32_t, uint32_t> newest;
+  for (NodeMap::const_iterator it = nodes_.begin(); it != nodes_.end(); ++it) {
+    const ParticipantStats& stats = it->second.stats;
+    if (stats.origin == 0 || stats.origin == self->second.stats.origin) {
+      continue;
+    }
+    uint32_t& sequence = newest[stats.origin];
+    if (stats.last_sequence > sequence) {
+      sequence = stats.last_sequence;
+    }
+  }
+
+  const OriginProgressSeq& applied = self->second.stats.applied;
+  unsigned long lag = 0;
+  for (std::map<uint32_t, uint32_t>::const_iterator it = newest.begin();
+       it != newest.end(); ++it) {
+    uint32_t done = 0;
+    for (CORBA::ULong i = 0; i < applied.length(); ++i) {
+      if (applied[i].origin == it->first) {
+        done = applied[i].last_sequence;
+        break;
+      }
+    }
+    if (it->second > done) {
+      lag += it->second - done;
+    }
+  }
+  return lag;
+}
+
+ParticipantStatsDataReader_ptr create_stats_reader(DDS::DomainParticipant_ptr participant)
+{
+  ParticipantStatsTypeSupport_var ts_stats = new ParticipantStatsTypeSupportImpl;
+
+  if (ts_stats->register_type(participant, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type ParticipantStats failed!\n")),
+                    ParticipantStatsDataReader::_nil());
+  }
+
+  CORBA::String_var type_name_stats = ts_stats->get_type_name();
+
+  // Same QoS as the participants' topic (see SyncNode::init())
+  DDS::TopicQos topic_qos_stats;
+  participant->get_default_topic_qos(topic_qos_stats);
+  topic_qos_stats.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_stats.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
+  topic_qos_stats.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_stats.history.depth = 1;
+
+  DDS::Topic_var topic_stats =
+    participant->create_topic("DirShare_Stats",
+                              type_name_stats,
+                              topic_qos_stats,
+                              0,
+                              OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_stats) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic Stats failed!\n")),
+                    ParticipantStatsDataReader::_nil());
+  }
+
+  DDS::Subscriber_var subscriber =
+    participant->create_subscriber(SUBSCRIBER_QOS_DEFAULT,
+                                   0,
+                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!subscriber) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_subscriber failed!\n")),
+                    ParticipantStatsDataReader::_nil());
+  }
+
+  DDS::DataReaderQos reader_qos;
+  subscriber->get_default_datareader_qos(reader_qos);
+  subscriber->copy_from_topic_qos(reader_qos, topic_qos_stats);
+
+  DDS::DataReader_var reader =
+    subscriber->create_datareader(topic_stats,
+                                  reader_qos,
+                                  0,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader ParticipantStats failed!\n")),
+                    ParticipantStatsDataReader::_nil());
+  }
+
+  return ParticipantStatsDataReader::_narrow(reader);
+}
+
+void take_stats(ParticipantStatsDataReader_ptr reader, FleetView& view)
+{
+  ParticipantStats stats;
+  DDS::SampleInfo info;
+
+  DDS::ReturnCode_t status;
+  while ((status = reader->take_next_sample(stats, info)) == DDS::RETCODE_OK) {
+    if (info.valid_data) {
+      view.update(stats, ACE_OS::gettimeofday());
+    } else if (info.instance_state != DDS::ALIVE_INSTANCE_STATE) {
+      // The participant left (or was lost)
+      ParticipantStats key;
+      if (reader->get_key_value(key, info.instance_handle) == DDS::RETCODE_OK) {
+        view.remove(key.participant_id.in());
+      }
+    }
+  }
+
+  if (status != DDS::RETCODE_NO_DATA) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: take_next_sample failed: %d\n"),
+               status));
+  }
+}
+
+} // namespace DirShare
@@ -0,0 +1,157 @@
+// Stats.h
+// Participant statistics published on DirShare_Stats, and the view of the
+// fleet that dirshare-top builds from them
+
+#ifndef DIRSHARE_STATS_H
+#define DIRSHARE_STATS_H
+
+#include "DirShareTypeSupportImpl.h"
+
+#include <ace/Time_Value.h>
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+namespace DirShare {
+
+/**
+ * Contribution of one file to a directory digest
+ * @param filename Relative path
+ * @param checksum CRC32 of the content
+ * @return 64-bit hash of the pair
+ */
+uint64_t file_digest(const std::string& filename, uint32_t checksum);
+
+/**
+ * Files of a directory, summarized
+ * The digest is the sum (mod 2^64) of file_digest() over the files, so it
+ * does not depend on their order, equal file sets give equal digests, and
+ * a change to one file updates it without visiting the others.
+ */
+struct DirectorySummary {
+  unsigned long file_count;
+  unsigned long long total_bytes;
+  uint64_t digest;
+  ACE_Time_Value digest_changed;  // Wall clock of the last digest change
+  ACE_Time_Value local_change;    // Wall clock of the last local change
+
+  DirectorySummary();
+
+  /// Count one file
+  void add(const std::string& filename, unsigned long long size, uint32_t checksum);
+
+  /// Uncount a file previously added with the same values
+  void remove(const std::string& filename, unsigned long long size, uint32_t checksum);
+};
+
+/**
+ * Fill a stats sample describing this process
+ * Totals come from the MetricsRegistry, applied changes from
+ * AppliedOrigins.
+ * @param participant_id Key of the sample
+ * @param directory Shared directory at the last scan
+ * @param stats Output: sample to publish
+ */
+void collect_participant_stats(const std::string& participant_id,
+                               const DirectorySummary& directory,
+                               ParticipantStats& stats);
+
+/**
+ * @class FleetView
+ * @brief Latest stats of every participant, with rates and convergence
+ *
+ * Fed by a DirShare_Stats reader. Rates are computed from the totals of a
+ * participant's last two samples.
+ */
+class FleetView {
+public:
+  struct Node {
+    ParticipantStats stats;   // Latest sample
+    ACE_Time_Value received;  // When it was taken (local clock)
+    double send_rate;         // Bytes/s between the last two samples
+    double receive_rate;
+    Node();
+  };
+
+  typedef std::map<std::string, Node> NodeMap;  // By participant id
+
+  /**
+   * Convergence of the participants in view
+   * The times are the participants' wall clocks at the scans that saw
+   * them, so they are as precise as the scan interval (and clock skew
+   * between hosts).
+   */
+  struct Convergence {
+    bool converged;               // See converged()
+    size_t digests;               // Distinct directory digests in view
+    ACE_Time_Value last_change;   // Newest local change of any participant
+    ACE_Time_Value settled;       // Newest digest change of any participant
+    Convergence();
+
+    /// Time from the last change to convergence (0 if not converged)
+    ACE_Time_Value time_to_converge() const;
+  };
+
+  /**
+   * Take a sample
+   * @param stats Sample
+   * @param now Local time of reception
+   */
+  void update(const ParticipantStats& stats, const ACE_Time_Value& now);
+
+  /// Forget a participant (its writer is gone)
+  void remove(const std::string& participant_id);
+
+  /**
+   * Forget participants whose last sample is older than timeout
+   * @return Number of participants removed
+   */
+  size_t expire(const ACE_Time_Value& now, const ACE_Time_Value& timeout);
+
+  const NodeMap& nodes() const { return nodes_; }
+
+  /// Every participant in view reports the same directory digest
+  bool converged() const;
+
+  /**
+   * Convergence details
+   * Once converged, the last participant to reach the common digest did
+   * so at settled, last_change after the change that started it all.
+   */
+  Convergence convergence() const;
+
+  /**
+   * Changes detected by other participants in view that are newer than
+   * the last one a participant applied from them
+   * Changes the participant never receives (selective sync, ignored
+   * files) or does not apply (older than its copy) count until a newer
+   * change of the same origin is applied.
+   * @param participant_id Participant
+   * @return Number of changes (0 for an unknown participant)
+   */
+  unsigned long lag(const std::string& participant_id) const;
+
+private:
+  NodeMap nodes_;
+};
+
+/**
+ * Join DirShare_Stats as a reader, for monitors that are not participants
+ * (dirshare-top, dirshare-bench); the QoS matches the participants' writers
+ * @param participant Domain participant of the monitor
+ * @return Reader, or nil on error (logged)
+ */
+ParticipantStatsDataReader_ptr create_stats_reader(DDS::DomainParticipant_ptr participant);
+
+/**
+ * Apply every available sample of a stats reader to a view
+ * Participants whose instance is no longer alive are removed.
+ * @param reader Reader from create_stats_reader()
+ * @param view View to update
+ */
+void take_stats(ParticipantStatsDataReader_ptr reader, FleetView& view);
+
+} // namespace DirShare
+
+#endif // DIRSHARE_STATS_H
@@ -0,0 +1,318 @@
+// SwarmDownloader.cpp
+// Implementation of the multi-source file download
+
+#include "SwarmDownloader.h"
+#include "Latency.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Guard_T.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <vector>
+
+namespace DirShare {
+
+namespace {
+
+// Files downloaded at the same time; the rest wait in the queue
+const size_t MAX_ACTIVE_DOWNLOADS = 4;
+
+// Worker wakeup interval for request timeouts
+const ACE_Time_Value TICK_INTERVAL(1, 0);
+
+} // namespace
+
+SwarmDownloader::SwarmDownloader(const std::string& participant_id,
+                                 FileChunkListenerImpl& chunk_listener,
+                                 FileChangeTracker& change_tracker,
+                                 ContentIndex& content_index,
+                                 DDS::DataWriter_ptr request_writer,
+                                 uint32_t chunk_size)
+  : participant_id_(participant_id)
+  , chunk_listener_(chunk_listener)
+  , change_tracker_(change_tracker)
+  , content_index_(content_index)
+  , request_writer_(ChunkRequestDataWriter::_narrow(request_writer))
+  , chunk_size_(chunk_size)
+  , first_session_id_(0)
+  , next_session_id_(0)
+  , stopping_(false)
+  , wakeup_(lock_)
+  , requests_sent_("sent", "DirShare_ChunkRequests")
+  , retransmit_requests_(MetricsRegistry::instance().counter(
+      "dirshare_chunk_retransmit_requests_total",
+      "Chunk request batches that timed out and were requested again"))
+{
+  // Same scheme as FilePublisher: random high bits, counter in the low bits
+  ACE_Time_Value now = ACE_OS::gettimeofday();
+  uint32_t salt = static_cast<uint32_t>(now.usec()) * 2654435761U ^
+                  static_cast<uint32_t>(now.sec()) ^
+                  (static_cast<uint32_t>(ACE_OS::getpid()) << 16) ^ 0x5A5A5A5AU;
+  first_session_id_ = static_cast<uint64_t>(salt) << 32;
+  next_session_id_ = first_session_id_;
+}
+
+SwarmDownloader::~SwarmDownloader()
+{
+}
+
+void SwarmDownloader::session_range(uint64_t& first, uint64_t& last) const
+{
+  first = first_session_id_;
+  last = first_session_id_ | 0xFFFFFFFFULL;
+}
+
+bool SwarmDownloader::start()
+{
+  if (activate(THR_NEW_LWP | THR_JOINABLE, 1) != 0) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: SwarmDownloader::start() - activate failed\n")));
+    return false;
+  }
+  return true;
+}
+
+void SwarmDownloader::stop()
+{
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    stopping_ = true;
+    wakeup_.broadcast();
+  }
+  wait();
+}
+
+SwarmDownloader::ContentKey SwarmDownloader::content_key(const FileMetadata& metadata)
+{
+  return ContentKey(metadata.filename.in(),
+                    std::make_pair(static_cast<unsigned long long>(metadata.size),
+                                   static_cast<unsigned long>(metadata.checksum)));
+}
+
+void SwarmDownloader::add_source(const std::string& participant_id,
+                                 const FileMetadata& metadata)
+{
+  if (participant_id == participant_id_) {
+    return;
+  }
+
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  const ContentKey key = content_key(metadata);
+  if (!sources_[key].insert(participant_id).second) {
+    return;
+  }
+
+  for (std::map<uint64_t, Download>::iterator it = downloads_.begin();
+       it != downloads_.end(); ++it) {
+    if (content_key(it->second.metadata) == key) {
+      std::map<std::string, double>::const_iterator known = throughput_.find(participant_id);
+      it->second.scheduler.add_source(participant_id,
+                                      known == throughput_.end() ? 0.0 : known->second);
+      send_requests(it->first, it->second);
+    }
+  }
+}
+
+void SwarmDownloader::request_file(const FileMetadata& metadata)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  const std::string filename = metadata.filename.in();
+  if (!pending_files_.insert(filename).second) {
+    return; // Already queued or downloading
+  }
+
+  queue_.push_back(metadata);
+  wakeup_.signal();
+}
+
+void SwarmDownloader::chunk_received(uint64_t session_id, uint32_t chunk_id)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::map<uint64_t, Download>::iterator it = downloads_.find(session_id);
+  if (it == downloads_.end()) {
+    return;
+  }
+
+  it->second.scheduler.chunk_received(chunk_id, ACE_OS::gettimeofday());
+  send_requests(it->first, it->second);
+}
+
+void SwarmDownloader::session_closed(uint64_t session_id)
+{
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+  std::map<uint64_t, Download>::iterator it = downloads_.find(session_id);
+  if (it == downloads_.end()) {
+    return;
+  }
+
+  // Keep the throughput estimates for the next download
+  Download& download = it->second;
+  const std::set<std::string>& sources = sources_[content_key(download.metadata)];
+  for (std::set<std::string>::const_iterator source = sources.begin();
+       source != sources.end(); ++source) {
+    double throughput = download.scheduler.throughput(*source);
+    if (throughput > 0.0) {
+      throughput_[*source] = throughput;
+    }
+  }
+
+  DIRSHARE_INFO(("Swarm download of %s ended (%s)\n",
+                 download.metadata.filename.in(),
+                 download.scheduler.complete() ? "complete" : "incomplete"));
+
+  pending_files_.erase(download.metadata.filename.in());
+  downloads_.erase(it);
+  wakeup_.signal(); // Room for a queued file
+}
+
+int SwarmDownloader::svc()
+{
+  for (;;) {
+    std::vector<uint64_t> stalled;
+    std::vector<FileMetadata> starting;
+    {
+      ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+      if (stopping_) {
+        return 0;
+      }
+
+      // Withdraw overdue requests and hand their chunks out again
+      for (std::map<uint64_t, Download>::iterator it = downloads_.begin();
+           it != downloads_.end(); ++it) {
+        send_requests(it->first, it->second);
+        if (it->second.scheduler.stalled()) {
+          stalled.push_back(it->first);
+        }
+      }
+
+      while (downloads_.size() + starting.size() < MAX_ACTIVE_DOWNLOADS && !queue_.empty()) {
+        starting.push_back(queue_.front());
+        queue_.pop_front();
+      }
+    }
+
+    // Outside the lock: the listener calls back into session_closed()
+    for (size_t i = 0; i < stalled.size(); ++i) {
+      ACE_ERROR((LM_WARNING,
+                 ACE_TEXT("WARNING: %N:%l: No peer can serve session %Q, giving up\n"),
+                 stalled[i]));
+      chunk_listener_.abort_transfer(stalled[i]);
+    }
+    for (size_t i = 0; i < starting.size(); ++i) {
+      start_download(starting[i]);
+    }
+
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    if (!stopping_ && (queue_.empty() || downloads_.size() >= MAX_ACTIVE_DOWNLOADS)) {
+      ACE_Time_Value deadline = ACE_OS::gettimeofday() + TICK_INTERVAL;
+      wakeup_.wait(&deadline);
+    }
+  }
+}
+
+void SwarmDownloader::start_download(const FileMetadata& metadata)
+{
+  const std::string filename = metadata.filename.in();
+
+  TransferOpen open;
+  open.filename = metadata.filename;
+  open.file_size = metadata.size;
+  open.file_checksum = metadata.checksum;
+  open.chunk_size = chunk_size_;
+  open.total_chunks = static_cast<CORBA::ULong>(
+    (metadata.size + chunk_size_ - 1) / chunk_size_);
+  open.timestamp_sec = metadata.timestamp_sec;
+  open.timestamp_nsec = metadata.timestamp_nsec;
+  open.holes.length(0);
+  open.fec_data_chunks = 0;
+  open.fec_repair_chunks = 0;
+  open.origin = origin_for_send(0);
+
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+
+    // Arrived some other way while queued. A local copy still waiting
+    // for its transfer only matched a CRC32, so pull it anyway.
+    if (content_index_.contains(filename, metadata.size, metadata.checksum) &&
+        !content_index_.unverified(filename)) {
+      pending_files_.erase(filename);
+      return;
+    }
+
+    open.session_id = next_session_id_++;
+    Download& download = downloads_.insert(std::make_pair(
+      static_cast<uint64_t>(open.session_id),
+      Download(metadata, open.total_chunks, chunk_size_))).first->second;
+
+    const std::set<std::string>& sources = sources_[content_key(metadata)];
+    for (std::set<std::string>::const_iterator source = sources.begin();
+         source != sources.end(); ++source) {
+      std::map<std::string, double>::const_iterator known = throughput_.find(*source);
+      download.scheduler.add_source(*source, known == throughput_.end() ? 0.0 : known->second);
+    }
+
+    DIRSHARE_INFO(("Swarm download of %s: %llu bytes from %u peer(s), session %llu\n",
+                   filename.c_str(),
+                   static_cast<unsigned long long>(metadata.size),
+                   static_cast<unsigned int>(sources.size()),
+                   static_cast<unsigned long long>(open.session_id)));
+  }
+
+  // The written file must not be published back as a local change
+  change_tracker_.suppress_notifications(filename);
+
+  if (!chunk_listener_.open_pull_transfer(open)) {
+    DIRSHARE_INFO(("%s is already being pushed, not pulling it\n", filename.c_str()));
+    change_tracker_.resume_notifications(filename);
+
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    downloads_.erase(open.session_id);
+    pending_files_.erase(filename);
+    return;
+  }
+
+  // An empty file completes (and is closed) on open
+  ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+  std::map<uint64_t, Download>::iterator it = downloads_.find(open.session_id);
+  if (it != downloads_.end()) {
+    send_requests(it->first, it->second);
+  }
+}
+
+void SwarmDownloader::send_requests(uint64_t session_id, Download& download)
+{
+  std::vector<ChunkBatch> batches;
+  const uint32_t timeouts = download.scheduler.timeouts();
+  download.scheduler.schedule(ACE_OS::gettimeofday(), batches);
+  retransmit_requests_.increment(download.scheduler.timeouts() - timeouts);
+
+  for (size_t i = 0; i < batches.size(); ++i) {
+    ChunkRequest request;
+    request.source_id = batches[i].source_id.c_str();
+    request.session_id = session_id;
+    request.filename = download.metadata.filename;
+    request.file_size = download.metadata.size;
+    request.file_checksum = download.metadata.checksum;
+    request.chunk_size = chunk_size_;
+    request.first_chunk = batches[i].first_chunk;
+    request.count = batches[i].count;
+
+    DDS::ReturnCode_t ret = request_writer_->write(request, DDS::HANDLE_NIL);
+    if (ret != DDS::RETCODE_OK) {
+      // The batch times out and is handed out again
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: write ChunkRequest failed: %d\n"),
+                 ret));
+    } else {
+      requests_sent_.sample();
+    }
+  }
+}
+
+} // namespace DirShare
@@ -0,0 +1,149 @@
+// SwarmDownloader.h
+// Pulls missing files from every peer that advertises the same content
+
+#ifndef DIRSHARE_SWARM_DOWNLOADER_H
+#define DIRSHARE_SWARM_DOWNLOADER_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "FileChunkListenerImpl.h"
+#include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "SwarmScheduler.h"
+#include "Metrics.h"
+
+#include <ace/Task.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Condition_Thread_Mutex.h>
+
+#include <string>
+#include <map>
+#include <set>
+#include <deque>
+
+namespace DirShare {
+
+/**
+ * @class SwarmDownloader
+ * @brief Multi-source pull of files a joining participant is missing
+ *
+ * Peers advertise their files in DirectorySnapshots. Every peer listing
+ * the same (filename, size, checksum) is a source for that content. A
+ * missing file is fetched as a pulled session of the chunk listener:
+ * ChunkRequests for runs of chunks are spread across the sources by a
+ * SwarmScheduler, and the peers answer on the ChunkReplies topic under the
+ * session id chosen here. Session ids come from a range owned by this
+ * participant (see session_range()) so the reply reader can filter on it.
+ *
+ * A worker thread starts queued downloads (a few at a time), withdraws
+ * overdue requests and gives up on files that no source can serve.
+ *
+ * Lock order: FileChunkListenerImpl, then SwarmDownloader. The listener
+ * calls the ChunkReceiptObserver methods with its lock held, so the
+ * downloader never calls the listener while holding its own lock.
+ */
+class SwarmDownloader : public ACE_Task_Base, public ChunkReceiptObserver {
+public:
+  /**
+   * Constructor
+   * @param participant_id Id of this participant (never used as a source)
+   * @param chunk_listener Reassembles the pulled sessions
+   * @param change_tracker Suppresses local notifications for files being written
+   * @param content_index Local content index (files already held, and not awaiting
+   *                      verification, are skipped)
+   * @param request_writer DataWriter for the ChunkRequests topic
+   * @param chunk_size Chunk size of pulled sessions
+   */
+  SwarmDownloader(const std::string& participant_id,
+                  FileChunkListenerImpl& chunk_listener,
+                  FileChangeTracker& change_tracker,
+                  ContentIndex& content_index,
+                  DDS::DataWriter_ptr request_writer,
+                  uint32_t chunk_size);
+
+  virtual ~SwarmDownloader();
+
+  /**
+   * Session ids used for pulled sessions (inclusive range)
+   * @param first Output: lowest session id
+   * @param last Output: highest session id
+   */
+  void session_range(uint64_t& first, uint64_t& last) const;
+
+  /**
+   * Start the worker thread
+   * @return true on success
+   */
+  bool start();
+
+  /**
+   * Stop the worker thread; unfinished downloads are left to the listener
+   */
+  void stop();
+
+  /**
+   * Record that a peer holds some content
+   * Active downloads of the same content start using the peer at once
+   * @param participant_id Advertising peer
+   * @param metadata Advertised file
+   */
+  void add_source(const std::string& participant_id, const FileMetadata& metadata);
+
+  /**
+   * Queue a download of a missing file from its advertised sources
+   * @param metadata File to fetch
+   */
+  void request_file(const FileMetadata& metadata);
+
+  // ChunkReceiptObserver
+  virtual void chunk_received(uint64_t session_id, uint32_t chunk_id);
+  virtual void session_closed(uint64_t session_id);
+
+  virtual int svc();
+
+private:
+  // (filename, (size, checksum))
+  typedef std::pair<std::string, std::pair<unsigned long long, unsigned long> > ContentKey;
+
+  struct Download {
+    FileMetadata metadata;
+    SwarmScheduler scheduler;
+
+    Download(const FileMetadata& file, uint32_t total_chunks, uint32_t chunk_size)
+      : metadata(file)
+      , scheduler(total_chunks, chunk_size)
+    {
+    }
+  };
+
+  static ContentKey content_key(const FileMetadata& metadata);
+
+  // Open the pulled session of a queued file and send its first requests
+  void start_download(const FileMetadata& metadata);
+
+  // Send the requests the scheduler plans now (lock held)
+  void send_requests(uint64_t session_id, Download& download);
+
+  std::string participant_id_;
+  FileChunkListenerImpl& chunk_listener_;
+  FileChangeTracker& change_tracker_;
+  ContentIndex& content_index_;
+  ChunkRequestDataWriter_var request_writer_;
+  uint32_t chunk_size_;
+  uint64_t first_session_id_;
+  uint64_t next_session_id_;
+
+  std::map<ContentKey, std::set<std::string> > sources_;
+  std::map<uint64_t, Download> downloads_;     // Keyed by session id
+  std::set<std::string> pending_files_;        // Queued or downloading
+  std::deque<FileMetadata> queue_;
+  std::map<std::string, double> throughput_;   // Last estimate per source
+  bool stopping_;
+  ACE_Thread_Mutex lock_;
+  ACE_Condition_Thread_Mutex wakeup_;
+  TopicCounters requests_sent_;
+  Counter& retransmit_requests_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_SWARM_DOWNLOADER_H
@@ -0,0 +1,303 @@
+// SwarmScheduler.cpp
+// Implementation of the multi-source chunk request planner
+
+#include "SwarmScheduler.h"
+
+#include <algorithm>
+
+namespace DirShare {
+
+namespace {
+
+// Bytes asked for in one request (rounded to whole chunks)
+const uint64_t TARGET_BATCH_BYTES = 4 * 1024 * 1024;
+const uint32_t MAX_BATCH_CHUNKS = 64;
+
+// Requests in flight per source, so it never waits for the next one
+const unsigned int MAX_BATCHES_PER_SOURCE = 2;
+
+// Assumed throughput (bytes/second) before any source has been measured
+const double DEFAULT_THROUGHPUT = 1024.0 * 1024.0;
+
+// Weight of the newest sample in the throughput average
+const double THROUGHPUT_WEIGHT = 0.3;
+
+// A batch is withdrawn after this multiple of its expected time
+const double TIMEOUT_FACTOR = 4.0;
+const ACE_Time_Value MIN_REQUEST_TIMEOUT(5, 0);
+
+// Consecutive timeouts after which a source is no longer used
+const unsigned int MAX_SOURCE_FAILURES = 3;
+
+double to_seconds(const ACE_Time_Value& time)
+{
+  return time.sec() + time.usec() / 1000000.0;
+}
+
+} // namespace
+
+SwarmScheduler::SwarmScheduler(uint32_t total_chunks, uint32_t chunk_size)
+  : total_chunks_(total_chunks)
+  , chunk_size_(chunk_size)
+  , batch_chunks_(1)
+  , received_(0)
+  , next_missing_(0)
+  , chunk_state_(total_chunks, CHUNK_MISSING)
+  , chunk_request_(total_chunks, 0)
+  , next_request_id_(0)
+  , timeouts_(0)
+{
+  if (chunk_size_ > 0) {
+    uint64_t chunks = TARGET_BATCH_BYTES / chunk_size_;
+    batch_chunks_ = static_cast<uint32_t>(
+      std::max<uint64_t>(1, std::min<uint64_t>(chunks, MAX_BATCH_CHUNKS)));
+  }
+}
+
+SwarmScheduler::~SwarmScheduler()
+{
+}
+
+void SwarmScheduler::add_source(const std::string& source_id, double throughput)
+{
+  std::map<std::string, Source>::iterator it = sources_.find(source_id);
+  if (it != sources_.end()) {
+    // Advertised again: give it another chance
+    it->second.usable = true;
+    it->second.failures = 0;
+    if (it->second.throughput == 0.0) {
+      it->second.throughput = throughput;
+    }
+    return;
+  }
+
+  Source source;
+  source.throughput = throughput;
+  source.batches = 0;
+  source.queued_chunks = 0;
+  source.failures = 0;
+  source.usable = true;
+  source.last_completion = ACE_Time_Value::zero;
+  source.chunks_received = 0;
+  sources_[source_id] = source;
+}
+
+void SwarmScheduler::remove_source(const std::string& source_id)
+{
+  std::map<std::string, Source>::iterator source = sources_.find(source_id);
+  if (source == sources_.end()) {
+    return;
+  }
+  source->second.usable = false;
+
+  std::map<uint32_t, Request>::iterator it = requests_.begin();
+  while (it != requests_.end()) {
+    if (it->second.source_id == source_id) {
+      withdraw(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SwarmScheduler::chunk_received(uint32_t chunk_id, const ACE_Time_Value& now)
+{
+  if (chunk_id >= total_chunks_ || chunk_state_[chunk_id] == CHUNK_RECEIVED) {
+    return;
+  }
+
+  if (chunk_state_[chunk_id] == CHUNK_REQUESTED) {
+    std::map<uint32_t, Request>::iterator it = requests_.find(chunk_request_[chunk_id]);
+    if (it != requests_.end()) {
+      Request& request = it->second;
+      Source& source = sources_[request.source_id];
+      --request.remaining;
+      --source.queued_chunks;
+      ++source.chunks_received;
+
+      if (request.remaining == 0) {
+        // Time the batch spent at the head of the source's queue
+        ACE_Time_Value start = std::max(request.sent, source.last_completion);
+        double seconds = std::max(to_seconds(now - start), 0.001);
+        double sample = static_cast<double>(request.count) * chunk_size_ / seconds;
+        source.throughput = source.throughput == 0.0 ? sample :
+          (1.0 - THROUGHPUT_WEIGHT) * source.throughput + THROUGHPUT_WEIGHT * sample;
+        source.last_completion = now;
+        source.failures = 0;
+        --source.batches;
+        requests_.erase(it);
+      }
+    }
+  }
+
+  // Chunks also arrive after their batch was withdrawn; they still count
+  chunk_state_[chunk_id] = CHUNK_RECEIVED;
+  ++received_;
+}
+
+void SwarmScheduler::schedule(const ACE_Time_Value& now, std::vector<ChunkBatch>& batches)
+{
+  // Withdraw overdue batches
+  std::map<uint32_t, Request>::iterator it = requests_.begin();
+  while (it != requests_.end()) {
+    if (now < it->second.deadline) {
+      ++it;
+      continue;
+    }
+    Source& source = sources_[it->second.source_id];
+    source.throughput /= 2.0;
+    ++timeouts_;
+    if (++source.failures >= MAX_SOURCE_FAILURES) {
+      source.usable = false;
+    }
+    withdraw(it++);
+  }
+
+  // Requests of sources that are no longer usable
+  it = requests_.begin();
+  while (it != requests_.end()) {
+    if (!sources_[it->second.source_id].usable) {
+      withdraw(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  // Hand out missing chunks while some source has room
+  for (;;) {
+    while (next_missing_ < total_chunks_ && chunk_state_[next_missing_] != CHUNK_MISSING) {
+      ++next_missing_;
+    }
+    if (next_missing_ >= total_chunks_) {
+      break;
+    }
+
+    uint32_t count = 1;
+    while (count < batch_chunks_ && next_missing_ + count < total_chunks_ &&
+           chunk_state_[next_missing_ + count] == CHUNK_MISSING) {
+      ++count;
+    }
+
+    std::string source_id;
+    Source* source = pick_source(count, source_id);
+    if (!source) {
+      break;
+    }
+
+    double seconds = TIMEOUT_FACTOR *
+      static_cast<double>(source->queued_chunks + count) * chunk_size_ / estimate(*source);
+    ACE_Time_Value timeout(static_cast<time_t>(seconds),
+                           static_cast<suseconds_t>((seconds - static_cast<time_t>(seconds)) * 1000000));
+
+    const uint32_t request_id = next_request_id_++;
+    Request& request = requests_[request_id];
+    request.source_id = source_id;
+    request.first_chunk = next_missing_;
+    request.count = count;
+    request.remaining = count;
+    request.sent = now;
+    request.deadline = now + std::max(timeout, MIN_REQUEST_TIMEOUT);
+
+    for (uint32_t c = next_missing_; c < next_missing_ + count; ++c) {
+      chunk_state_[c] = CHUNK_REQUESTED;
+      chunk_request_[c] = request_id;
+    }
+    ++source->batches;
+    source->queued_chunks += count;
+
+    ChunkBatch batch;
+    batch.source_id = source_id;
+    batch.first_chunk = next_missing_;
+    batch.count = count;
+    batches.push_back(batch);
+  }
+}
+
+bool SwarmScheduler::complete() const
+{
+  return received_ == total_chunks_;
+}
+
+bool SwarmScheduler::stalled() const
+{
+  if (complete()) {
+    return false;
+  }
+  for (std::map<std::string, Source>::const_iterator it = sources_.begin();
+       it != sources_.end(); ++it) {
+    if (it->second.usable) {
+      return false;
+    }
+  }
+  return true;
+}
+
+double SwarmScheduler::throughput(const std::string& source_id) const
+{
+  std::map<std::string, Source>::const_iterator it = sources_.find(source_id);
+  return it == sources_.end() ? 0.0 : it->second.throughput;
+}
+
+uint32_t SwarmScheduler::chunks_from(const std::string& source_id) const
+{
+  std::map<std::string, Source>::const_iterator it = sources_.find(source_id);
+  return it == sources_.end() ? 0 : it->second.chunks_received;
+}
+
+double SwarmScheduler::estimate(const Source& source) const
+{
+  if (source.throughput > 0.0) {
+    return source.throughput;
+  }
+
+  // Unmeasured: as fast as the best measured source
+  double best = 0.0;
+  for (std::map<std::string, Source>::const_iterator it = sources_.begin();
+       it != sources_.end(); ++it) {
+    if (it->second.usable) {
+      best = std::max(best, it->second.throughput);
+    }
+  }
+  return best > 0.0 ? best : DEFAULT_THROUGHPUT;
+}
+
+SwarmScheduler::Source* SwarmScheduler::pick_source(uint32_t count, std::string& source_id)
+{
+  Source* best = 0;
+  double best_finish = 0.0;
+
+  for (std::map<std::string, Source>::iterator it = sources_.begin();
+       it != sources_.end(); ++it) {
+    Source& source = it->second;
+    if (!source.usable || source.batches >= MAX_BATCHES_PER_SOURCE) {
+      continue;
+    }
+    double finish = static_cast<double>(source.queued_chunks + count) / estimate(source);
+    if (!best || finish < best_finish) {
+      best = &source;
+      best_finish = finish;
+      source_id = it->first;
+    }
+  }
+  return best;
+}
+
+void SwarmScheduler::withdraw(std::map<uint32_t, Request>::iterator it)
+{
+  const uint32_t request_id = it->first;
+  const Request& request = it->second;
+
+  for (uint32_t c = request.first_chunk; c < request.first_chunk + request.count; ++c) {
+    if (chunk_state_[c] == CHUNK_REQUESTED && chunk_request_[c] == request_id) {
+      chunk_state_[c] = CHUNK_MISSING;
+      next_missing_ = std::min(next_missing_, c);
+    }
+  }
+
+  Source& source = sources_[request.source_id];
+  --source.batches;
+  source.queued_chunks -= request.remaining;
+  requests_.erase(it);
+}
+
+} // namespace DirShare
@@ -0,0 +1,168 @@
+// SwarmScheduler.h
+// Spreads the chunk requests of one pulled transfer across every peer that
+// holds the same content, in proportion to the throughput seen from each.
+
+#ifndef DIRSHARE_SWARM_SCHEDULER_H
+#define DIRSHARE_SWARM_SCHEDULER_H
+
+#include <stdint.h>
+#include <ace/Time_Value.h>
+
+#include <string>
+#include <map>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * A run of chunks to request from one source
+ */
+struct ChunkBatch {
+  std::string source_id;  // Participant to send the request to
+  uint32_t first_chunk;
+  uint32_t count;
+};
+
+/**
+ * @class SwarmScheduler
+ * @brief Request planner for one file pulled from several sources
+ *
+ * Missing chunks are handed out in contiguous batches. Each source may
+ * have a small number of batches in flight (so it never idles waiting for
+ * the next request); a new batch goes to the source expected to finish it
+ * first, given its queued work and its throughput estimate. Fast sources
+ * drain their queue sooner and so are handed more batches.
+ *
+ * Throughput is estimated per source from completed batches (EWMA of bytes
+ * over the time the batch was at the head of the source's queue). Sources
+ * without a sample are assumed to be as fast as the best known one, so
+ * every source gets tried.
+ *
+ * A batch that takes much longer than expected is withdrawn and its
+ * missing chunks are handed out again; a source that times out repeatedly
+ * is no longer used.
+ *
+ * Thread Safety: Not thread-safe; owned by SwarmDownloader under its lock.
+ */
+class SwarmScheduler {
+public:
+  /**
+   * @brief Constructor
+   *
+   * @param total_chunks Number of chunks in the file
+   * @param chunk_size Chunk size in bytes
+   */
+  SwarmScheduler(uint32_t total_chunks, uint32_t chunk_size);
+  ~SwarmScheduler();
+
+  /**
+   * @brief Add a peer that holds the content
+   *
+   * @param source_id Participant id of the peer
+   * @param throughput Known throughput in bytes/second, or 0 if unknown
+   */
+  void add_source(const std::string& source_id, double throughput);
+
+  /**
+   * @brief Stop using a peer; its outstanding chunks are handed out again
+   *
+   * @param source_id Participant id of the peer
+   */
+  void remove_source(const std::string& source_id);
+
+  /**
+   * @brief Record the arrival of a chunk
+   *
+   * @param chunk_id Chunk index
+   * @param now Arrival time
+   */
+  void chunk_received(uint32_t chunk_id, const ACE_Time_Value& now);
+
+  /**
+   * @brief Withdraw overdue batches and plan new requests
+   *
+   * @param now Current time
+   * @param batches Output: requests to send (appended)
+   */
+  void schedule(const ACE_Time_Value& now, std::vector<ChunkBatch>& batches);
+
+  /**
+   * @brief Whether every chunk has been received
+   */
+  bool complete() const;
+
+  /**
+   * @brief Whether chunks are missing but no usable source is left
+   */
+  bool stalled() const;
+
+  /**
+   * @brief Throughput estimate of a source
+   *
+   * @param source_id Participant id of the peer
+   * @return Bytes/second, or 0 if unknown
+   */
+  double throughput(const std::string& source_id) const;
+
+  /**
+   * @brief Number of chunks received in batches requested from a source
+   *
+   * @param source_id Participant id of the peer
+   * @return Chunk count
+   */
+  uint32_t chunks_from(const std::string& source_id) const;
+
+  /**
+   * @brief Number of batches withdrawn because they were overdue
+   *
+   * Their missing chunks are requested again
+   */
+  uint32_t timeouts() const { return timeouts_; }
+
+private:
+  enum ChunkState { CHUNK_MISSING, CHUNK_REQUESTED, CHUNK_RECEIVED };
+
+  struct Source {
+    double throughput;               // Bytes/second (0: no sample yet)
+    unsigned int batches;            // Batches in flight
+    uint32_t queued_chunks;          // Chunks of those batches still missing
+    unsigned int failures;           // Consecutive timeouts
+    bool usable;
+    ACE_Time_Value last_completion;  // When its previous batch finished
+    uint32_t chunks_received;
+  };
+
+  struct Request {
+    std::string source_id;
+    uint32_t first_chunk;
+    uint32_t count;
+    uint32_t remaining;
+    ACE_Time_Value sent;
+    ACE_Time_Value deadline;
+  };
+
+  // Assumed throughput of a source without samples
+  double estimate(const Source& source) const;
+
+  // Pick the source expected to finish a batch of the given size first
+  Source* pick_source(uint32_t count, std::string& source_id);
+
+  // Return a request's missing chunks to the pool
+  void withdraw(std::map<uint32_t, Request>::iterator it);
+
+  uint32_t total_chunks_;
+  uint32_t chunk_size_;
+  uint32_t batch_chunks_;             // Chunks per request
+  uint32_t received_;
+  uint32_t next_missing_;             // No missing chunk below this index
+  std::vector<uint8_t> chunk_state_;
+  std::vector<uint32_t> chunk_request_; // Request id of each requested chunk
+  std::map<std::string, Source> sources_;
+  std::map<uint32_t, Request> requests_;
+  uint32_t next_request_id_;
+  uint32_t timeouts_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_SWARM_SCHEDULER_H
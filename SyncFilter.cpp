@@ -0,0 +1,136 @@
+// SyncFilter.cpp
+// Implementation of the selective sync filter
+
+#include "SyncFilter.h"
+
+#include <ace/OS_NS_stdio.h>
+
+namespace DirShare {
+
+SyncFilter::SyncFilter()
+  : max_size_(0)
+{
+}
+
+SyncFilter::~SyncFilter()
+{
+}
+
+bool SyncFilter::add_pattern(const std::string& pattern)
+{
+  // A quote would end the filter parameter
+  if (pattern.empty() || pattern.find('\'') != std::string::npos) {
+    return false;
+  }
+  patterns_.push_back(pattern);
+  return true;
+}
+
+void SyncFilter::set_max_size(unsigned long long max_size)
+{
+  max_size_ = max_size;
+}
+
+bool SyncFilter::active() const
+{
+  return !patterns_.empty() || max_size_ > 0;
+}
+
+bool SyncFilter::matches(const std::string& filename, unsigned long long size) const
+{
+  if (max_size_ > 0 && size > max_size_) {
+    return false;
+  }
+  if (patterns_.empty()) {
+    return true;
+  }
+  for (size_t i = 0; i < patterns_.size(); ++i) {
+    if (glob_match(patterns_[i], filename)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string SyncFilter::expression(const std::string& filename_field,
+                                   const std::string& size_field,
+                                   DDS::StringSeq& parameters) const
+{
+  std::string result;
+  parameters.length(0);
+  CORBA::ULong next = 0;
+  char index[16];
+
+  if (!patterns_.empty()) {
+    result += "(";
+    for (size_t i = 0; i < patterns_.size(); ++i) {
+      ACE_OS::snprintf(index, sizeof(index), "%%%u", static_cast<unsigned>(next));
+      if (i > 0) {
+        result += " OR ";
+      }
+      result += filename_field + " LIKE " + index;
+      parameters.length(next + 1);
+      parameters[next++] = ("'" + like_pattern(patterns_[i]) + "'").c_str();
+    }
+    result += ")";
+  }
+
+  if (max_size_ > 0) {
+    ACE_OS::snprintf(index, sizeof(index), "%%%u", static_cast<unsigned>(next));
+    if (!result.empty()) {
+      result += " AND ";
+    }
+    result += size_field + " <= " + index;
+
+    char limit[32];
+    ACE_OS::snprintf(limit, sizeof(limit), "%llu", max_size_);
+    parameters.length(next + 1);
+    parameters[next++] = limit;
+  }
+
+  return result;
+}
+
+bool SyncFilter::glob_match(const std::string& pattern, const std::string& text)
+{
+  // Iterative match; on a mismatch, let the last '*' absorb one more character
+  size_t p = 0;
+  size_t t = 0;
+  size_t star = std::string::npos;
+  size_t star_text = 0;
+
+  while (t < text.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+      ++p;
+      ++t;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      star_text = t;
+    } else if (star != std::string::npos) {
+      p = star + 1;
+      t = ++star_text;
+    } else {
+      return false;
+    }
+  }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    ++p;
+  }
+  return p == pattern.size();
+}
+
+std::string SyncFilter::like_pattern(const std::string& pattern)
+{
+  std::string result = pattern;
+  for (size_t i = 0; i < result.size(); ++i) {
+    if (result[i] == '*') {
+      result[i] = '%';
+    } else if (result[i] == '?') {
+      result[i] = '_';
+    }
+  }
+  return result;
+}
+
+} // namespace DirShare
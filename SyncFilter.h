@@ -0,0 +1,97 @@
+// SyncFilter.h
+// Per-participant subscription filter for selective sync: which files of
+// the share this participant wants to receive
+
+#ifndef DIRSHARE_SYNC_FILTER_H
+#define DIRSHARE_SYNC_FILTER_H
+
+#include <dds/DdsDcpsCoreC.h>
+
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * @class SyncFilter
+ * @brief Filename globs and a size limit for the files to receive
+ *
+ * A file is wanted if its name matches any of the patterns (all files if
+ * there are none) and its size is at most the limit (no limit if 0).
+ * Patterns are shell globs: '*' matches any run of characters, '?' one
+ * character.
+ *
+ * The filter is applied twice. The readers of the per-file topics are
+ * created on ContentFilteredTopics built from expression(), so writers that
+ * support it never send unwanted samples. Snapshot entries are checked with
+ * matches(), because a DirectorySnapshot lists every file in one sample.
+ * The filter grammar has no escape for the LIKE wildcards '%' and '_', so
+ * a literal '%' or '_' in a pattern is a wildcard to the DDS filter: it
+ * can let through a few files that matches() rejects, never the other way
+ * round. The listeners of the per-file topics check matches() again.
+ */
+class SyncFilter {
+public:
+  SyncFilter();
+  ~SyncFilter();
+
+  /**
+   * Add a filename pattern
+   * @param pattern Shell glob (must not contain a single quote)
+   * @return false if the pattern is empty or cannot be quoted in a filter
+   */
+  bool add_pattern(const std::string& pattern);
+
+  /**
+   * Set the largest file size to receive
+   * @param max_size Size limit in bytes (0: no limit)
+   */
+  void set_max_size(unsigned long long max_size);
+
+  /**
+   * @return true if any pattern or size limit is set
+   */
+  bool active() const;
+
+  /**
+   * Check whether a file is wanted
+   * @param filename Relative file path within shared directory
+   * @param size File size in bytes
+   * @return true if the file passes the filter
+   */
+  bool matches(const std::string& filename, unsigned long long size) const;
+
+  /**
+   * Build a content filter expression for a topic
+   * @param filename_field Name of the topic's filename member
+   * @param size_field Name of the topic's file size member
+   * @param parameters Output: values of the %n parameters of the expression
+   * @return Filter expression, e.g. "(filename LIKE %0) AND size <= %1"
+   */
+  std::string expression(const std::string& filename_field,
+                         const std::string& size_field,
+                         DDS::StringSeq& parameters) const;
+
+  /**
+   * Shell glob match ('*' and '?')
+   * @param pattern Glob pattern
+   * @param text Text to match
+   * @return true if text matches the whole pattern
+   */
+  static bool glob_match(const std::string& pattern, const std::string& text);
+
+  /**
+   * SQL LIKE form of a glob ('*' -> '%', '?' -> '_')
+   * @param pattern Glob pattern
+   * @return LIKE pattern
+   */
+  static std::string like_pattern(const std::string& pattern);
+
+private:
+  std::vector<std::string> patterns_;
+  unsigned long long max_size_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_SYNC_FILTER_H
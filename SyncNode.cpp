@@ -0,0 +1,1057 @@
+// SyncNode.cpp
+// Implementation of the per-domain DDS side of the shared directory
+
+#include "SyncNode.h"
+#include "SyncFilter.h"
+#include "FileUtils.h"
+#include "Trace.h"
+#include "SnapshotListenerImpl.h"
+#include "FileContentListenerImpl.h"
+#include "FileChunkListenerImpl.h"
+#include "TransferOpenListenerImpl.h"
+#include "FecChunkListenerImpl.h"
+#include "FileEventListenerImpl.h"
+#include "ChunkRequestListenerImpl.h"
+#include "ChunkServer.h"
+#include "SwarmDownloader.h"
+
+#include <dds/DCPS/Marked_Default_Qos.h>
+#include <dds/DCPS/Service_Participant.h>
+#include <dds/DCPS/WaitSet.h>
+#include <dds/DCPS/transport/framework/TransportRegistry.h>
+
+#include <ace/Log_Msg.h>
+#include <ace/UUID.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_stdio.h>
+
+namespace DirShare {
+
+SyncNodeOptions::SyncNodeOptions()
+  : chunk_size(DEFAULT_CHUNK_SIZE)
+  , chunk_threshold(DEFAULT_CHUNK_THRESHOLD)
+  , auto_tune_chunks(false)
+  , fec_data_chunks(0)
+  , fec_repair_chunks(0)
+  , swarm(false)
+  , filter(0)
+  , ignore(0)
+{
+}
+
+SyncNode::SyncNode(DDS::DomainParticipantFactory_ptr dpf,
+                   DDS::DomainId_t domain_id,
+                   const std::string& shared_directory,
+                   FileChangeTracker& change_tracker,
+                   ContentIndex& content_index,
+                   const SyncNodeOptions& options)
+  : dpf_(DDS::DomainParticipantFactory::_duplicate(dpf))
+  , domain_id_(domain_id)
+  , shared_directory_(shared_directory)
+  , change_tracker_(change_tracker)
+  , content_index_(content_index)
+  , options_(options)
+  , chunk_listener_(0)
+  , file_publisher_(0)
+  , chunk_tuner_(options.chunk_size, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE)
+  , chunk_server_(0)
+  , swarm_downloader_(0)
+  , remote_change_observer_(0)
+  , started_(false)
+  , events_sent_("sent", "DirShare_FileEvents")
+  , snapshots_sent_("sent", "DirShare_DirectorySnapshot")
+  , stats_sent_("sent", "DirShare_Stats")
+{
+  // Unique participant ID (advertised in snapshots, and the address of
+  // chunk requests for this node)
+  ACE_Utils::UUID uuid;
+  ACE_Utils::UUID_GENERATOR::instance()->generate_UUID(uuid);
+  participant_id_ = uuid.to_string()->c_str();
+}
+
+SyncNode::~SyncNode()
+{
+  shutdown();
+}
+
+void SyncNode::set_remote_change_observer(RemoteChangeObserver* observer)
+{
+  remote_change_observer_ = observer;
+}
+
+bool SyncNode::init()
+{
+  // Create DomainParticipant
+  participant_ =
+    dpf_->create_participant(domain_id_,
+                             PARTICIPANT_QOS_DEFAULT,
+                             0,
+                             OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!participant_) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_participant failed!\n")),
+                    false);
+  }
+
+  // A participant of its own transport config, if the configuration file
+  // defines one (two participants in a process must not share an instance)
+  if (!options_.transport_config.empty()) {
+    OpenDDS::DCPS::TransportConfig_rch config =
+      TheTransportRegistry->get_config(options_.transport_config);
+    if (config) {
+      TheTransportRegistry->bind_config(config, participant_.in());
+      ACE_DEBUG((LM_INFO,
+                 ACE_TEXT("(%P|%t) Domain %d uses transport config: %C\n"),
+                 domain_id_,
+                 options_.transport_config.c_str()));
+    }
+  }
+
+  // Register TypeSupport for FileEvent
+  FileEventTypeSupport_var ts_event = new FileEventTypeSupportImpl;
+
+  if (ts_event->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type FileEvent failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for FileContent
+  FileContentTypeSupport_var ts_content = new FileContentTypeSupportImpl;
+
+  if (ts_content->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type FileContent failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for FileChunk
+  FileChunkTypeSupport_var ts_chunk = new FileChunkTypeSupportImpl;
+
+  if (ts_chunk->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type FileChunk failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for TransferOpen
+  TransferOpenTypeSupport_var ts_open = new TransferOpenTypeSupportImpl;
+
+  if (ts_open->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type TransferOpen failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for FecChunk
+  FecChunkTypeSupport_var ts_fec = new FecChunkTypeSupportImpl;
+
+  if (ts_fec->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type FecChunk failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for ChunkRequest
+  ChunkRequestTypeSupport_var ts_request = new ChunkRequestTypeSupportImpl;
+
+  if (ts_request->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type ChunkRequest failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for DirectorySnapshot
+  DirectorySnapshotTypeSupport_var ts_snapshot = new DirectorySnapshotTypeSupportImpl;
+
+  if (ts_snapshot->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type DirectorySnapshot failed!\n")),
+                    false);
+  }
+
+  // Register TypeSupport for ParticipantStats
+  ParticipantStatsTypeSupport_var ts_stats = new ParticipantStatsTypeSupportImpl;
+
+  if (ts_stats->register_type(participant_, "") != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: register_type ParticipantStats failed!\n")),
+                    false);
+  }
+
+  // Get type names
+  CORBA::String_var type_name_event = ts_event->get_type_name();
+  CORBA::String_var type_name_content = ts_content->get_type_name();
+  CORBA::String_var type_name_chunk = ts_chunk->get_type_name();
+  CORBA::String_var type_name_open = ts_open->get_type_name();
+  CORBA::String_var type_name_fec = ts_fec->get_type_name();
+  CORBA::String_var type_name_request = ts_request->get_type_name();
+  CORBA::String_var type_name_snapshot = ts_snapshot->get_type_name();
+  CORBA::String_var type_name_stats = ts_stats->get_type_name();
+
+  // Set QoS for RELIABLE and TRANSIENT_LOCAL for FileEvents topic
+  DDS::TopicQos topic_qos_events;
+  participant_->get_default_topic_qos(topic_qos_events);
+  topic_qos_events.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_events.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
+  topic_qos_events.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_events.history.depth = 100;
+
+  // Create FileEvents Topic
+  DDS::Topic_var topic_events =
+    participant_->create_topic("DirShare_FileEvents",
+                               type_name_event,
+                               topic_qos_events,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_events) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic FileEvents failed!\n")),
+                    false);
+  }
+
+  // Set QoS for RELIABLE and VOLATILE for FileContent topic
+  DDS::TopicQos topic_qos_content;
+  participant_->get_default_topic_qos(topic_qos_content);
+  topic_qos_content.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_content.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
+  topic_qos_content.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_content.history.depth = 1;
+
+  // Create FileContent Topic
+  DDS::Topic_var topic_content =
+    participant_->create_topic("DirShare_FileContent",
+                               type_name_content,
+                               topic_qos_content,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_content) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic FileContent failed!\n")),
+                    false);
+  }
+
+  // Set QoS for RELIABLE and VOLATILE with KEEP_ALL for FileChunks topic
+  DDS::TopicQos topic_qos_chunks;
+  participant_->get_default_topic_qos(topic_qos_chunks);
+  topic_qos_chunks.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_chunks.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
+  topic_qos_chunks.history.kind = DDS::KEEP_ALL_HISTORY_QOS;
+  topic_qos_chunks.resource_limits.max_samples = 1000;
+  // One instance per in-flight transfer; instances are disposed and
+  // unregistered when a transfer ends, so this bounds concurrent transfers
+  topic_qos_chunks.resource_limits.max_instances = 100;
+  topic_qos_chunks.resource_limits.max_samples_per_instance = 1000;
+
+  // Create FileChunks Topic
+  DDS::Topic_var topic_chunks =
+    participant_->create_topic("DirShare_FileChunks",
+                               type_name_chunk,
+                               topic_qos_chunks,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_chunks) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic FileChunks failed!\n")),
+                    false);
+  }
+
+  // Set QoS for RELIABLE and VOLATILE for TransferOpen topic
+  // One instance per session, same bound as the FileChunks topic
+  DDS::TopicQos topic_qos_open;
+  participant_->get_default_topic_qos(topic_qos_open);
+  topic_qos_open.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_open.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
+  topic_qos_open.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_open.history.depth = 1;
+  topic_qos_open.resource_limits.max_instances = 100;
+
+  // Create TransferOpen Topic
+  DDS::Topic_var topic_open =
+    participant_->create_topic("DirShare_TransferOpen",
+                               type_name_open,
+                               topic_qos_open,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_open) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic TransferOpen failed!\n")),
+                    false);
+  }
+
+  // Set QoS for BEST_EFFORT and VOLATILE with KEEP_ALL for FecChunks topic
+  // Losses are repaired from the FEC repair chunks instead of by
+  // retransmission
+  DDS::TopicQos topic_qos_fec;
+  participant_->get_default_topic_qos(topic_qos_fec);
+  topic_qos_fec.reliability.kind = DDS::BEST_EFFORT_RELIABILITY_QOS;
+  topic_qos_fec.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
+  topic_qos_fec.history.kind = DDS::KEEP_ALL_HISTORY_QOS;
+  topic_qos_fec.resource_limits.max_samples = 1000;
+  topic_qos_fec.resource_limits.max_instances = 100;
+  topic_qos_fec.resource_limits.max_samples_per_instance = 1000;
+
+  // Create FecChunks Topic
+  DDS::Topic_var topic_fec =
+    participant_->create_topic("DirShare_FecChunks",
+                               type_name_fec,
+                               topic_qos_fec,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_fec) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic FecChunks failed!\n")),
+                    false);
+  }
+
+  // Set QoS for RELIABLE and VOLATILE with KEEP_ALL for ChunkRequests topic
+  DDS::TopicQos topic_qos_requests;
+  participant_->get_default_topic_qos(topic_qos_requests);
+  topic_qos_requests.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_requests.durability.kind = DDS::VOLATILE_DURABILITY_QOS;
+  topic_qos_requests.history.kind = DDS::KEEP_ALL_HISTORY_QOS;
+
+  // Create ChunkRequests Topic
+  DDS::Topic_var topic_requests =
+    participant_->create_topic("DirShare_ChunkRequests",
+                               type_name_request,
+                               topic_qos_requests,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_requests) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic ChunkRequests failed!\n")),
+                    false);
+  }
+
+  // Create ChunkReplies Topic (FileChunks of pulled sessions, same QoS
+  // as the FileChunks topic)
+  DDS::Topic_var topic_replies =
+    participant_->create_topic("DirShare_ChunkReplies",
+                               type_name_chunk,
+                               topic_qos_chunks,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_replies) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic ChunkReplies failed!\n")),
+                    false);
+  }
+
+  // Set QoS for RELIABLE and TRANSIENT_LOCAL for DirectorySnapshot topic
+  DDS::TopicQos topic_qos_snapshot;
+  participant_->get_default_topic_qos(topic_qos_snapshot);
+  topic_qos_snapshot.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_snapshot.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
+  topic_qos_snapshot.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_snapshot.history.depth = 1;
+
+  // Create DirectorySnapshot Topic
+  DDS::Topic_var topic_snapshot =
+    participant_->create_topic("DirShare_DirectorySnapshot",
+                               type_name_snapshot,
+                               topic_qos_snapshot,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_snapshot) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic DirectorySnapshot failed!\n")),
+                    false);
+  }
+
+  // Statistics: the latest sample of each participant, kept for monitors
+  // that join later
+  DDS::TopicQos topic_qos_stats;
+  participant_->get_default_topic_qos(topic_qos_stats);
+  topic_qos_stats.reliability.kind = DDS::RELIABLE_RELIABILITY_QOS;
+  topic_qos_stats.durability.kind = DDS::TRANSIENT_LOCAL_DURABILITY_QOS;
+  topic_qos_stats.history.kind = DDS::KEEP_LAST_HISTORY_QOS;
+  topic_qos_stats.history.depth = 1;
+
+  DDS::Topic_var topic_stats =
+    participant_->create_topic("DirShare_Stats",
+                               type_name_stats,
+                               topic_qos_stats,
+                               0,
+                               OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!topic_stats) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_topic Stats failed!\n")),
+                    false);
+  }
+
+  // Create Publisher
+  publisher_ =
+    participant_->create_publisher(PUBLISHER_QOS_DEFAULT,
+                                   0,
+                                   OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!publisher_) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_publisher failed!\n")),
+                    false);
+  }
+
+  // Create Subscriber
+  DDS::Subscriber_var subscriber =
+    participant_->create_subscriber(SUBSCRIBER_QOS_DEFAULT,
+                                    0,
+                                    OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!subscriber) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_subscriber failed!\n")),
+                    false);
+  }
+
+  // Bulk data (FileContent, TransferOpen, FileChunks, FecChunks) gets its
+  // own publisher and subscriber. If the configuration file defines the
+  // bulk transport config (see rtps_multicast.ini), they are bound to it,
+  // e.g. to fan chunks out over reliable multicast instead of unicasting a
+  // copy to every reader
+  DDS::Publisher_var bulk_publisher = publisher_;
+  DDS::Subscriber_var bulk_subscriber = subscriber;
+
+  OpenDDS::DCPS::TransportConfig_rch bulk_config;
+  if (!options_.bulk_transport_config.empty()) {
+    bulk_config = TheTransportRegistry->get_config(options_.bulk_transport_config);
+  }
+  if (bulk_config) {
+    bulk_publisher =
+      participant_->create_publisher(PUBLISHER_QOS_DEFAULT,
+                                     0,
+                                     OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+    bulk_subscriber =
+      participant_->create_subscriber(SUBSCRIBER_QOS_DEFAULT,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+    if (!bulk_publisher || !bulk_subscriber) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: create bulk publisher/subscriber failed!\n")),
+                      false);
+    }
+
+    // Must be bound before any DataWriter/DataReader is created
+    TheTransportRegistry->bind_config(bulk_config, bulk_publisher.in());
+    TheTransportRegistry->bind_config(bulk_config, bulk_subscriber.in());
+
+    ACE_DEBUG((LM_INFO,
+               ACE_TEXT("(%P|%t) Bulk data uses transport config: %C\n"),
+               options_.bulk_transport_config.c_str()));
+  }
+
+  // Create WaitSet for synchronization
+  waitset_ = new DDS::WaitSet;
+
+  // Attach StatusCondition for Publisher to detect publication matched
+  condition_ = publisher_->get_statuscondition();
+  condition_->set_enabled_statuses(DDS::PUBLICATION_MATCHED_STATUS);
+  waitset_->attach_condition(condition_);
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) DDS infrastructure initialized successfully\n")
+             ACE_TEXT("  Domain ID: %d\n")
+             ACE_TEXT("  Topics created: FileEvents, FileContent, FileChunks, TransferOpen, FecChunks,\n")
+             ACE_TEXT("                  ChunkRequests, ChunkReplies, DirectorySnapshot, Stats\n"),
+             domain_id_));
+
+  // Create DataWriters for publishing
+  DDS::DataWriter_var event_writer =
+    publisher_->create_datawriter(topic_events,
+                                  DATAWRITER_QOS_DEFAULT,
+                                  0,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!event_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter FileEvent failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriter_var snapshot_writer =
+    publisher_->create_datawriter(topic_snapshot,
+                                  DATAWRITER_QOS_DEFAULT,
+                                  0,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!snapshot_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter DirectorySnapshot failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriterQos stats_writer_qos;
+  publisher_->get_default_datawriter_qos(stats_writer_qos);
+  publisher_->copy_from_topic_qos(stats_writer_qos, topic_qos_stats);
+
+  DDS::DataWriter_var stats_writer =
+    publisher_->create_datawriter(topic_stats,
+                                  stats_writer_qos,
+                                  0,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!stats_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter ParticipantStats failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriter_var content_writer =
+    bulk_publisher->create_datawriter(topic_content,
+                                      DATAWRITER_QOS_DEFAULT,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!content_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter FileContent failed!\n")),
+                    false);
+  }
+
+  // The default DataWriter QoS keeps one sample per instance; a transfer
+  // writes all of its chunks to one instance and must keep them all
+  DDS::DataWriterQos chunk_writer_qos;
+  bulk_publisher->get_default_datawriter_qos(chunk_writer_qos);
+  bulk_publisher->copy_from_topic_qos(chunk_writer_qos, topic_qos_chunks);
+
+  DDS::DataWriter_var chunk_writer =
+    bulk_publisher->create_datawriter(topic_chunks,
+                                      chunk_writer_qos,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!chunk_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter FileChunk failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriter_var open_writer =
+    bulk_publisher->create_datawriter(topic_open,
+                                      DATAWRITER_QOS_DEFAULT,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!open_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter TransferOpen failed!\n")),
+                    false);
+  }
+
+  // The default DataWriter QoS is reliable; FEC chunks must not be
+  DDS::DataWriterQos fec_writer_qos;
+  bulk_publisher->get_default_datawriter_qos(fec_writer_qos);
+  bulk_publisher->copy_from_topic_qos(fec_writer_qos, topic_qos_fec);
+
+  DDS::DataWriter_var fec_writer =
+    bulk_publisher->create_datawriter(topic_fec,
+                                      fec_writer_qos,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!fec_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter FecChunk failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriter_var request_writer =
+    publisher_->create_datawriter(topic_requests,
+                                  DATAWRITER_QOS_DEFAULT,
+                                  0,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!request_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter ChunkRequest failed!\n")),
+                    false);
+  }
+
+  DDS::DataWriter_var reply_writer =
+    bulk_publisher->create_datawriter(topic_replies,
+                                      chunk_writer_qos,
+                                      0,
+                                      OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!reply_writer) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datawriter ChunkReplies failed!\n")),
+                    false);
+  }
+
+  // Narrow to typed writers
+  event_writer_ = FileEventDataWriter::_narrow(event_writer);
+  snapshot_writer_ = DirectorySnapshotDataWriter::_narrow(snapshot_writer);
+  stats_writer_ = ParticipantStatsDataWriter::_narrow(stats_writer);
+
+  // Create listeners for receiving data
+  FileEventListenerImpl* event_listener_impl =
+    new FileEventListenerImpl(shared_directory_, content_writer, chunk_writer,
+                              change_tracker_, content_index_);
+  DDS::DataReaderListener_var event_listener = event_listener_impl;
+  SnapshotListenerImpl* snapshot_listener_impl =
+    new SnapshotListenerImpl(shared_directory_, content_writer, chunk_writer);
+  DDS::DataReaderListener_var snapshot_listener = snapshot_listener_impl;
+  FileContentListenerImpl* content_listener_impl =
+    new FileContentListenerImpl(shared_directory_, change_tracker_, content_index_);
+  DDS::DataReaderListener_var content_listener = content_listener_impl;
+  chunk_listener_ =
+    new FileChunkListenerImpl(shared_directory_, change_tracker_, content_index_);
+  DDS::DataReaderListener_var chunk_listener = chunk_listener_;
+  DDS::DataReaderListener_var open_listener =
+    new TransferOpenListenerImpl(*chunk_listener_);
+  DDS::DataReaderListener_var fec_listener =
+    new FecChunkListenerImpl(*chunk_listener_);
+
+  // Serve chunk requests from peers for files held here
+  chunk_server_ = new ChunkServer(shared_directory_, content_index_, reply_writer);
+  DDS::DataReaderListener_var request_listener =
+    new ChunkRequestListenerImpl(*chunk_server_);
+
+  // Pull missing files from every peer holding them (--swarm)
+  if (options_.swarm) {
+    swarm_downloader_ = new SwarmDownloader(participant_id_, *chunk_listener_,
+                                            change_tracker_, content_index_,
+                                            request_writer, options_.chunk_size);
+    chunk_listener_->set_observer(swarm_downloader_);
+    snapshot_listener_impl->set_swarm_downloader(swarm_downloader_);
+  }
+  event_listener_impl->set_sync_filter(options_.filter);
+  snapshot_listener_impl->set_sync_filter(options_.filter);
+  content_listener_impl->set_sync_filter(options_.filter);
+  chunk_listener_->set_sync_filter(options_.filter);
+
+  // Nothing matched by .dirshareignore is accepted from peers
+  event_listener_impl->set_ignore_matcher(options_.ignore);
+  snapshot_listener_impl->set_ignore_matcher(options_.ignore);
+  content_listener_impl->set_ignore_matcher(options_.ignore);
+  chunk_listener_->set_ignore_matcher(options_.ignore);
+
+  // Remote changes applied here are reported (DirShare wakes its main loop)
+  event_listener_impl->set_remote_change_observer(remote_change_observer_);
+  content_listener_impl->set_remote_change_observer(remote_change_observer_);
+  chunk_listener_->set_remote_change_observer(remote_change_observer_);
+
+  // Per-file topics are read through the sync filter (--include, --max-size)
+  DDS::TopicDescription_var events_selected =
+    reader_topic(topic_events, "filename", "metadata.size");
+  DDS::TopicDescription_var content_selected =
+    reader_topic(topic_content, "filename", "size");
+  DDS::TopicDescription_var chunks_selected =
+    reader_topic(topic_chunks, "filename", "file_size");
+  DDS::TopicDescription_var open_selected =
+    reader_topic(topic_open, "filename", "file_size");
+  DDS::TopicDescription_var fec_selected =
+    reader_topic(topic_fec, "filename", "file_size");
+
+  if (!events_selected || !content_selected || !chunks_selected ||
+      !open_selected || !fec_selected) {
+    return false;
+  }
+
+  // Create DataReaders with listeners
+  DDS::DataReader_var event_reader =
+    subscriber->create_datareader(events_selected,
+                                  DATAREADER_QOS_DEFAULT,
+                                  event_listener,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!event_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader FileEvent failed!\n")),
+                    false);
+  }
+
+  DDS::DataReader_var snapshot_reader =
+    subscriber->create_datareader(topic_snapshot,
+                                  DATAREADER_QOS_DEFAULT,
+                                  snapshot_listener,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!snapshot_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader DirectorySnapshot failed!\n")),
+                    false);
+  }
+
+  DDS::DataReader_var content_reader =
+    bulk_subscriber->create_datareader(content_selected,
+                                       DATAREADER_QOS_DEFAULT,
+                                       content_listener,
+                                       OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!content_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader FileContent failed!\n")),
+                    false);
+  }
+
+  // Keep every chunk of a transfer until the listener has taken it
+  DDS::DataReaderQos chunk_reader_qos;
+  bulk_subscriber->get_default_datareader_qos(chunk_reader_qos);
+  bulk_subscriber->copy_from_topic_qos(chunk_reader_qos, topic_qos_chunks);
+
+  DDS::DataReader_var chunk_reader =
+    bulk_subscriber->create_datareader(chunks_selected,
+                                       chunk_reader_qos,
+                                       chunk_listener,
+                                       OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!chunk_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader FileChunk failed!\n")),
+                    false);
+  }
+
+  DDS::DataReader_var open_reader =
+    bulk_subscriber->create_datareader(open_selected,
+                                       DATAREADER_QOS_DEFAULT,
+                                       open_listener,
+                                       OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!open_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader TransferOpen failed!\n")),
+                    false);
+  }
+
+  // Keep every FEC chunk until the listener has taken it
+  DDS::DataReaderQos fec_reader_qos;
+  bulk_subscriber->get_default_datareader_qos(fec_reader_qos);
+  bulk_subscriber->copy_from_topic_qos(fec_reader_qos, topic_qos_fec);
+
+  DDS::DataReader_var fec_reader =
+    bulk_subscriber->create_datareader(fec_selected,
+                                       fec_reader_qos,
+                                       fec_listener,
+                                       OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!fec_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader FecChunk failed!\n")),
+                    false);
+  }
+
+  // Only requests addressed to this node are delivered
+  DDS::StringSeq request_params;
+  request_params.length(1);
+  request_params[0] = ("'" + participant_id_ + "'").c_str();
+
+  DDS::ContentFilteredTopic_var requests_for_me =
+    participant_->create_contentfilteredtopic("DirShare_ChunkRequests_Local",
+                                              topic_requests,
+                                              "source_id = %0",
+                                              request_params);
+
+  if (!requests_for_me) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_contentfilteredtopic ChunkRequests failed!\n")),
+                    false);
+  }
+
+  DDS::DataReader_var request_reader =
+    subscriber->create_datareader(requests_for_me,
+                                  DATAREADER_QOS_DEFAULT,
+                                  request_listener,
+                                  OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+  if (!request_reader) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_datareader ChunkRequest failed!\n")),
+                    false);
+  }
+
+  // Replies to this node's requests, by session id range
+  if (swarm_downloader_) {
+    uint64_t first_session = 0;
+    uint64_t last_session = 0;
+    swarm_downloader_->session_range(first_session, last_session);
+
+    char first_text[32];
+    char last_text[32];
+    ACE_OS::snprintf(first_text, sizeof(first_text), "%llu",
+                     static_cast<unsigned long long>(first_session));
+    ACE_OS::snprintf(last_text, sizeof(last_text), "%llu",
+                     static_cast<unsigned long long>(last_session));
+
+    DDS::StringSeq reply_params;
+    reply_params.length(2);
+    reply_params[0] = first_text;
+    reply_params[1] = last_text;
+
+    DDS::ContentFilteredTopic_var replies_for_me =
+      participant_->create_contentfilteredtopic("DirShare_ChunkReplies_Local",
+                                                topic_replies,
+                                                "session_id >= %0 AND session_id <= %1",
+                                                reply_params);
+
+    if (!replies_for_me) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: create_contentfilteredtopic ChunkReplies failed!\n")),
+                      false);
+    }
+
+    DDS::DataReader_var reply_reader =
+      bulk_subscriber->create_datareader(replies_for_me,
+                                         chunk_reader_qos,
+                                         chunk_listener,
+                                         OpenDDS::DCPS::DEFAULT_STATUS_MASK);
+
+    if (!reply_reader) {
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("ERROR: %N:%l: create_datareader ChunkReplies failed!\n")),
+                      false);
+    }
+  }
+
+  // Create FilePublisher for sending file content (snapshot, CREATE, MODIFY)
+  file_publisher_ = new FilePublisher(shared_directory_, content_writer,
+                                      open_writer, chunk_writer, fec_writer);
+  file_publisher_->set_chunk_size(options_.chunk_size);
+  file_publisher_->set_chunk_threshold(options_.chunk_threshold);
+  file_publisher_->set_fec(options_.fec_data_chunks, options_.fec_repair_chunks);
+  if (options_.auto_tune_chunks) {
+    file_publisher_->set_chunk_tuner(&chunk_tuner_);
+  }
+
+  return true;
+}
+
+DDS::TopicDescription_ptr SyncNode::reader_topic(DDS::Topic_ptr topic,
+                                                 const std::string& filename_field,
+                                                 const std::string& size_field)
+{
+  if (!options_.filter || !options_.filter->active()) {
+    return DDS::TopicDescription::_duplicate(topic);
+  }
+
+  DDS::StringSeq parameters;
+  const std::string expression =
+    options_.filter->expression(filename_field, size_field, parameters);
+  CORBA::String_var topic_name = topic->get_name();
+  const std::string name = std::string(topic_name.in()) + "_Selected";
+
+  DDS::ContentFilteredTopic_var selected =
+    participant_->create_contentfilteredtopic(name.c_str(),
+                                              topic,
+                                              expression.c_str(),
+                                              parameters);
+
+  if (!selected) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: create_contentfilteredtopic %C failed!\n"),
+                     name.c_str()),
+                    DDS::TopicDescription::_nil());
+  }
+
+  ACE_DEBUG((LM_DEBUG,
+             ACE_TEXT("(%P|%t) Reading %C where %C\n"),
+             topic_name.in(),
+             expression.c_str()));
+  return selected._retn();
+}
+
+bool SyncNode::wait_for_discovery(const DDS::Duration_t& timeout)
+{
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Waiting for participant discovery in domain %d...\n"),
+             domain_id_));
+
+  DDS::ConditionSeq conditions;
+  DDS::ReturnCode_t ret = waitset_->wait(conditions, timeout);
+
+  if (ret == DDS::RETCODE_TIMEOUT) {
+    ACE_DEBUG((LM_INFO,
+               ACE_TEXT("(%P|%t) No other participants discovered yet, continuing...\n")));
+  } else if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: WaitSet wait failed: %d\n"),
+                     ret),
+                    false);
+  }
+  return true;
+}
+
+bool SyncNode::start(const std::vector<FileMetadata>& files)
+{
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Publishing initial directory snapshot in domain %d...\n"),
+             domain_id_));
+
+  DirectorySnapshot snapshot;
+  snapshot.participant_id = participant_id_.c_str();
+  snapshot.files.length(static_cast<CORBA::ULong>(files.size()));
+  for (size_t i = 0; i < files.size(); ++i) {
+    snapshot.files[static_cast<CORBA::ULong>(i)] = files[i];
+  }
+
+  // Set timestamp
+  ACE_Time_Value now = ACE_OS::gettimeofday();
+  snapshot.snapshot_time_sec = static_cast<CORBA::ULongLong>(now.sec());
+  snapshot.snapshot_time_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
+  snapshot.file_count = static_cast<CORBA::ULong>(files.size());
+
+  // Publish snapshot
+  DDS::ReturnCode_t ret = snapshot_writer_->write(snapshot, DDS::HANDLE_NIL);
+  if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: write DirectorySnapshot failed: %d\n"),
+                     ret),
+                    false);
+  }
+  snapshots_sent_.sample();
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Initial snapshot published: %u files\n"),
+             snapshot.file_count));
+
+  // The content index is populated now, so requests can be checked
+  if (!chunk_server_->start()) {
+    return false;
+  }
+  if (swarm_downloader_ && !swarm_downloader_->start()) {
+    chunk_server_->stop();
+    return false;
+  }
+  started_ = true;
+
+  // Publish initial file contents
+  TraceSpan span("send", "publish_snapshot_files");
+  for (size_t i = 0; i < files.size(); ++i) {
+    FileMetadata metadata = files[i];
+
+    FileImage image;
+    if (!file_publisher_->load_file(metadata, image)) {
+      continue;
+    }
+
+    file_publisher_->publish_file(metadata, image);
+  }
+
+  return true;
+}
+
+bool SyncNode::load_file(FileMetadata& metadata, FileImage& image)
+{
+  return file_publisher_->load_file(metadata, image);
+}
+
+bool SyncNode::publish_change(OperationType operation,
+                              const FileMetadata& metadata,
+                              const FileImage* image,
+                              const LocalChange* change)
+{
+  const char* operation_name =
+    operation == CREATE ? "CREATE" : (operation == MODIFY ? "MODIFY" : "DELETE");
+  TraceSpan span("send", "publish_change", metadata.filename.in());
+
+  FileEvent event;
+  event.filename = metadata.filename;
+  event.operation = operation;
+  ACE_Time_Value now = ACE_OS::gettimeofday();
+  event.timestamp_sec = static_cast<CORBA::ULongLong>(now.sec());
+  event.timestamp_nsec = static_cast<CORBA::ULong>(now.usec() * 1000);
+
+  if (operation == DELETE) {
+    // For DELETE, metadata is not applicable (file no longer exists)
+    // Set metadata fields to zero/empty
+    event.metadata.filename = metadata.filename;
+    event.metadata.size = 0;
+    event.metadata.timestamp_sec = 0;
+    event.metadata.timestamp_nsec = 0;
+    event.metadata.checksum = 0;
+  } else {
+    event.metadata = metadata;
+  }
+  event.origin = origin_for_send(change);
+
+  DDS::ReturnCode_t ret = event_writer_->write(event, DDS::HANDLE_NIL);
+  if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Failed to publish FileEvent(%C): %d\n"),
+                     operation_name,
+                     ret),
+                    false);
+  }
+  events_sent_.sample();
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Published FileEvent(%C) for: %C\n"),
+             operation_name,
+             metadata.filename.in()));
+
+  // Publish file content
+  if (image) {
+    file_publisher_->publish_file(metadata, *image, change);
+  }
+  return true;
+}
+
+void SyncNode::expire_transfers()
+{
+  if (chunk_listener_) {
+    chunk_listener_->expire_transfers(monotonic_now());
+  }
+}
+
+bool SyncNode::publish_stats(const DirectorySummary& directory)
+{
+  ParticipantStats stats;
+  collect_participant_stats(participant_id_, directory, stats);
+
+  DDS::ReturnCode_t ret = stats_writer_->write(stats, DDS::HANDLE_NIL);
+  if (ret != DDS::RETCODE_OK) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: write ParticipantStats failed: %d\n"),
+                     ret),
+                    false);
+  }
+  stats_sent_.sample();
+  return true;
+}
+
+void SyncNode::shutdown()
+{
+  if (!participant_) {
+    return;
+  }
+
+  if (waitset_ && condition_) {
+    waitset_->detach_condition(condition_);
+  }
+
+  if (swarm_downloader_) {
+    chunk_listener_->set_observer(0);
+    if (started_) {
+      swarm_downloader_->stop();
+    }
+  }
+  if (chunk_server_ && started_) {
+    chunk_server_->stop();
+  }
+  started_ = false;
+
+  participant_->delete_contained_entities();
+  dpf_->delete_participant(participant_);
+  participant_ = DDS::DomainParticipant::_nil();
+
+  delete swarm_downloader_;
+  swarm_downloader_ = 0;
+  delete chunk_server_;
+  chunk_server_ = 0;
+  delete file_publisher_;
+  file_publisher_ = 0;
+}
+
+} // namespace DirShare
@@ -0,0 +1,200 @@
+// SyncNode.h
+// The DDS side of a shared directory in one domain: topics, readers,
+// writers, listeners and the send path
+
+#ifndef DIRSHARE_SYNC_NODE_H
+#define DIRSHARE_SYNC_NODE_H
+
+#include "DirShareTypeSupportImpl.h"
+#include "FilePublisher.h"
+#include "FileChangeTracker.h"
+#include "ContentIndex.h"
+#include "ChunkSizeTuner.h"
+#include "Metrics.h"
+#include "Latency.h"
+#include "Stats.h"
+#include "RemoteChangeObserver.h"
+
+#include <dds/DdsDcpsDomainC.h>
+#include <dds/DdsDcpsInfrastructureC.h>
+
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+class FileChunkListenerImpl;
+class SyncFilter;
+class IgnoreMatcher;
+class ChunkServer;
+class SwarmDownloader;
+
+/**
+ * Transfer settings of a SyncNode (from the command line)
+ */
+struct SyncNodeOptions {
+  uint32_t chunk_size;
+  uint64_t chunk_threshold;
+  bool auto_tune_chunks;
+  uint16_t fec_data_chunks;    // 0: FEC off
+  uint16_t fec_repair_chunks;
+  bool swarm;                  // Pull missing files from all holders
+  const SyncFilter* filter;    // Files to receive (not owned; 0: all)
+  const IgnoreMatcher* ignore; // Files never accepted (not owned; 0: none)
+
+  // Transport configs bound to the participant and to the bulk data
+  // publisher/subscriber when the configuration file defines them
+  std::string transport_config;
+  std::string bulk_transport_config;
+
+  SyncNodeOptions();
+};
+
+/**
+ * @class SyncNode
+ * @brief One DomainParticipant sharing the local directory
+ *
+ * Owns the participant and everything created in it. Remote changes are
+ * applied to the shared directory by the node's listeners; local changes
+ * found by the caller's FileMonitor are published with publish_change().
+ *
+ * A plain participant runs one node. A relay runs two over the same
+ * directory, FileChangeTracker and ContentIndex: an upstream node in the
+ * domain of its parent and a downstream node in a domain of its own. A
+ * change applied by one node is reported to its RemoteChangeObserver,
+ * which the caller uses to publish it through the other node, and never
+ * back to the domain it came from. The directory is
+ * the relay's content cache: downstream peers join from the downstream
+ * node's snapshot and chunk server without reaching the upstream domain.
+ */
+class SyncNode {
+public:
+  /**
+   * Constructor
+   * @param dpf Participant factory
+   * @param domain_id Domain to join
+   * @param shared_directory Path to the shared directory
+   * @param change_tracker Loop prevention shared by all nodes of the directory
+   * @param content_index Local content index shared by all nodes of the directory
+   * @param options Transfer settings
+   */
+  SyncNode(DDS::DomainParticipantFactory_ptr dpf,
+           DDS::DomainId_t domain_id,
+           const std::string& shared_directory,
+           FileChangeTracker& change_tracker,
+           ContentIndex& content_index,
+           const SyncNodeOptions& options);
+
+  ~SyncNode();
+
+  /**
+   * Report the remote changes applied by this node's listeners
+   * Must be called before init()
+   * @param observer Observer, or 0 for none (not owned)
+   */
+  void set_remote_change_observer(RemoteChangeObserver* observer);
+
+  /**
+   * Create the participant, topics, writers, listeners and readers
+   * @return true on success (failures are logged)
+   */
+  bool init();
+
+  /**
+   * Wait until a peer's reader matches one of this node's writers
+   * @param timeout Longest wait
+   * @return false only if the wait itself failed
+   */
+  bool wait_for_discovery(const DDS::Duration_t& timeout);
+
+  /**
+   * Publish the snapshot of the directory, start the worker threads and
+   * push the contents of the listed files
+   * @param files Every local file (FileMonitor::get_all_files())
+   * @return true on success
+   */
+  bool start(const std::vector<FileMetadata>& files);
+
+  /**
+   * Read a stable view of a file before announcing it, so that the event
+   * metadata matches the bytes that are sent
+   * @param metadata File to read; updated if the file changed meanwhile
+   * @param image Output: file contents
+   * @return true on success
+   */
+  bool load_file(FileMetadata& metadata, FileImage& image);
+
+  /**
+   * Publish a local change: a FileEvent, then (CREATE, MODIFY) the content
+   * @param operation CREATE, MODIFY or DELETE
+   * @param metadata File metadata (only the filename is used for DELETE)
+   * @param image File contents from load_file(), or 0 for DELETE
+   * @param change Origin stamp of the change, or 0 to send it untraced
+   * @return true if the event was published
+   */
+  bool publish_change(OperationType operation,
+                      const FileMetadata& metadata,
+                      const FileImage* image,
+                      const LocalChange* change = 0);
+
+  /**
+   * Discard the FEC transfers that can no longer complete (call
+   * periodically; see FileChunkListenerImpl::expire_transfers())
+   */
+  void expire_transfers();
+
+  /**
+   * Publish this participant's statistics on DirShare_Stats
+   * @param directory Shared directory at the last scan
+   * @return true on success
+   */
+  bool publish_stats(const DirectorySummary& directory);
+
+  /**
+   * Stop the worker threads and delete the participant
+   */
+  void shutdown();
+
+  DDS::DomainId_t domain_id() const { return domain_id_; }
+
+  /// Id advertised in this node's snapshots (and addressed by chunk requests)
+  const std::string& participant_id() const { return participant_id_; }
+
+private:
+  // Topic to read a per-file topic through: a ContentFilteredTopic when a
+  // sync filter is set, else the topic itself (nil on error)
+  DDS::TopicDescription_ptr reader_topic(DDS::Topic_ptr topic,
+                                         const std::string& filename_field,
+                                         const std::string& size_field);
+
+  DDS::DomainParticipantFactory_var dpf_;
+  DDS::DomainId_t domain_id_;
+  std::string shared_directory_;
+  FileChangeTracker& change_tracker_;
+  ContentIndex& content_index_;
+  SyncNodeOptions options_;
+  std::string participant_id_;
+
+  DDS::DomainParticipant_var participant_;
+  DDS::Publisher_var publisher_;
+  DDS::WaitSet_var waitset_;
+  DDS::StatusCondition_var condition_;
+  FileEventDataWriter_var event_writer_;
+  DirectorySnapshotDataWriter_var snapshot_writer_;
+  ParticipantStatsDataWriter_var stats_writer_;
+
+  FileChunkListenerImpl* chunk_listener_;  // Owned by its reader
+  FilePublisher* file_publisher_;          // Owned
+  ChunkSizeTuner chunk_tuner_;
+  ChunkServer* chunk_server_;              // Owned
+  SwarmDownloader* swarm_downloader_;      // Owned
+  RemoteChangeObserver* remote_change_observer_;  // Not owned
+  bool started_;
+  TopicCounters events_sent_;
+  TopicCounters snapshots_sent_;
+  TopicCounters stats_sent_;
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_SYNC_NODE_H
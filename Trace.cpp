@@ -0,0 +1,213 @@
+// Trace.cpp
+// Implementation of span tracing
+
+#include "Trace.h"
+#include "Latency.h"
+
+#include <ace/Guard_T.h>
+#include <ace/Log_Msg.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_string.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <fstream>
+
+namespace DirShare {
+
+namespace {
+
+long long to_usec(const ACE_Time_Value& value)
+{
+  return static_cast<long long>(value.sec()) * 1000000 + value.usec();
+}
+
+// JSON string contents: quotes, backslashes and control characters escaped
+std::string escape_json(const char* text)
+{
+  std::string result;
+  for (const char* p = text; *p; ++p) {
+    const unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char escaped[8];
+      ACE_OS::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+      result += escaped;
+    } else {
+      result += static_cast<char>(c);
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+Tracer::Tracer()
+  : enabled_(false)
+  , events_per_thread_(DEFAULT_EVENTS_PER_THREAD)
+{
+}
+
+Tracer::~Tracer()
+{
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    delete buffers_[i];
+  }
+}
+
+Tracer& Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::enable(size_t events_per_thread)
+{
+  events_per_thread_ = events_per_thread > 0 ? events_per_thread : 1;
+  epoch_ = monotonic_now();
+  enabled_ = true;
+}
+
+TraceBuffer* Tracer::thread_buffer()
+{
+  // The slot is created by the first access from each thread
+  ThreadSlot* slot = slot_;
+  if (!slot) {
+    return 0;
+  }
+  if (!slot->buffer) {
+    TraceBuffer* buffer = new TraceBuffer;
+    buffer->events.resize(events_per_thread_);
+    buffer->next = 0;
+    buffer->wrapped = false;
+
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    buffer->thread_index = static_cast<unsigned long>(buffers_.size() + 1);
+    buffers_.push_back(buffer);
+    slot->buffer = buffer;
+  }
+  return slot->buffer;
+}
+
+void Tracer::record(const char* category, const char* name, const char* detail,
+                    const ACE_Time_Value& start, const ACE_Time_Value& end)
+{
+  TraceBuffer* buffer = thread_buffer();
+  if (!buffer) {
+    return;
+  }
+
+  ACE_Guard<ACE_Thread_Mutex> guard(buffer->lock);
+  TraceEvent& event = buffer->events[buffer->next];
+  event.category = category;
+  event.name = name;
+  event.start_usec = to_usec(start - epoch_);
+  event.duration_usec = to_usec(end - start);
+  if (detail) {
+    ACE_OS::strncpy(event.detail, detail, sizeof(event.detail) - 1);
+    event.detail[sizeof(event.detail) - 1] = '\0';
+  } else {
+    event.detail[0] = '\0';
+  }
+
+  if (++buffer->next == buffer->events.size()) {
+    buffer->next = 0;
+    buffer->wrapped = true;
+  }
+}
+
+std::string Tracer::chrome_trace()
+{
+  std::vector<TraceBuffer*> buffers;
+  {
+    ACE_Guard<ACE_Thread_Mutex> guard(lock_);
+    buffers = buffers_;
+  }
+
+  const long pid = static_cast<long>(ACE_OS::getpid());
+  char line[512];
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  ACE_OS::snprintf(line, sizeof(line),
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":0,"
+                   "\"args\":{\"name\":\"dirshare\"}}",
+                   pid);
+  out += line;
+
+  for (size_t b = 0; b < buffers.size(); ++b) {
+    TraceBuffer& buffer = *buffers[b];
+    ACE_Guard<ACE_Thread_Mutex> guard(buffer.lock);
+
+    ACE_OS::snprintf(line, sizeof(line),
+                     ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%lu,"
+                     "\"args\":{\"name\":\"thread %lu\"}}",
+                     pid, buffer.thread_index, buffer.thread_index);
+    out += line;
+
+    // Oldest first
+    const size_t count = buffer.wrapped ? buffer.events.size() : buffer.next;
+    const size_t first = buffer.wrapped ? buffer.next : 0;
+    for (size_t i = 0; i < count; ++i) {
+      const TraceEvent& event = buffer.events[(first + i) % buffer.events.size()];
+      ACE_OS::snprintf(line, sizeof(line),
+                       ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+                       "\"pid\":%ld,\"tid\":%lu",
+                       event.name, event.category, event.start_usec, event.duration_usec,
+                       pid, buffer.thread_index);
+      out += line;
+      if (event.detail[0]) {
+        out += ",\"args\":{\"detail\":\"" + escape_json(event.detail) + "\"}";
+      }
+      out += "}";
+    }
+  }
+
+  out += "\n]}\n";
+  return out;
+}
+
+bool Tracer::write_chrome_trace(const std::string& path)
+{
+  const std::string trace = chrome_trace();
+
+  std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot write trace file: %C\n"),
+                     path.c_str()),
+                    false);
+  }
+  file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+  if (!file) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Failed to write trace file: %C\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  ACE_DEBUG((LM_INFO,
+             ACE_TEXT("(%P|%t) Trace written to %C\n"),
+             path.c_str()));
+  return true;
+}
+
+TraceSpan::TraceSpan(const char* category, const char* name, const char* detail)
+  : category_(category)
+  , name_(name)
+  , detail_(detail)
+  , active_(Tracer::instance().enabled())
+{
+  if (active_) {
+    start_ = monotonic_now();
+  }
+}
+
+TraceSpan::~TraceSpan()
+{
+  if (active_) {
+    Tracer::instance().record(category_, name_, detail_, start_, monotonic_now());
+  }
+}
+
+} // namespace DirShare
@@ -0,0 +1,143 @@
+// Trace.h
+// Span tracing of the scan, send and receive pipelines, written as a
+// Chrome trace (chrome://tracing, Perfetto)
+
+#ifndef DIRSHARE_TRACE_H
+#define DIRSHARE_TRACE_H
+
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+#include <ace/TSS_T.h>
+
+#include <string>
+#include <vector>
+
+namespace DirShare {
+
+/**
+ * One completed span
+ */
+struct TraceEvent {
+  const char* category;  // Pipeline ("scan", "send", "receive"); a literal
+  const char* name;      // Stage; a literal
+  long long start_usec;  // Monotonic, relative to Tracer::enable()
+  long long duration_usec;
+  char detail[48];       // Usually the file name (truncated)
+};
+
+/**
+ * Spans recorded by one thread, oldest overwritten first
+ */
+struct TraceBuffer {
+  std::vector<TraceEvent> events;  // Ring of fixed capacity
+  size_t next;                     // Slot of the next event
+  bool wrapped;                    // Every slot has been written
+  unsigned long thread_index;      // Chrome trace tid
+  ACE_Thread_Mutex lock;           // Taken by the owning thread and by dumps
+};
+
+/**
+ * @class Tracer
+ * @brief Process-wide span recorder (off by default)
+ *
+ * While disabled, a TraceSpan costs one test of a flag. Once enabled, each
+ * thread records its spans into a ring buffer of its own, so threads never
+ * contend; a dump briefly locks each buffer in turn. The buffers keep the
+ * most recent spans of every thread and are never cleared, so a dump is a
+ * window over the last events_per_thread spans of each thread.
+ */
+class Tracer {
+public:
+  enum { DEFAULT_EVENTS_PER_THREAD = 16384 };
+
+  /// The tracer of the process
+  static Tracer& instance();
+
+  /**
+   * Start recording; call before the threads to trace are started
+   * @param events_per_thread Ring buffer capacity of each thread
+   */
+  void enable(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+
+  bool enabled() const { return enabled_; }
+
+  /**
+   * Record a completed span on the calling thread's buffer
+   * @param category Pipeline name (literal)
+   * @param name Stage name (literal)
+   * @param detail Extra text shown with the span, or 0
+   * @param start Monotonic start time
+   * @param end Monotonic end time
+   */
+  void record(const char* category, const char* name, const char* detail,
+              const ACE_Time_Value& start, const ACE_Time_Value& end);
+
+  /**
+   * The recorded spans in the Chrome trace event format (JSON)
+   * @return Trace document
+   */
+  std::string chrome_trace();
+
+  /**
+   * Write chrome_trace() to a file
+   * @param path Output file (replaced)
+   * @return true on success (failures are logged)
+   */
+  bool write_chrome_trace(const std::string& path);
+
+private:
+  struct ThreadSlot {
+    TraceBuffer* buffer;
+    ThreadSlot() : buffer(0) {}
+  };
+
+  Tracer();
+  ~Tracer();
+
+  // Buffer of the calling thread, created on first use
+  TraceBuffer* thread_buffer();
+
+  bool enabled_;
+  size_t events_per_thread_;
+  ACE_Time_Value epoch_;
+  ACE_TSS<ThreadSlot> slot_;
+  std::vector<TraceBuffer*> buffers_;  // Owned; kept after their thread exits
+  ACE_Thread_Mutex lock_;              // Protects buffers_
+
+  Tracer(const Tracer&);
+  Tracer& operator=(const Tracer&);
+};
+
+/// File name part of a path, as span detail
+inline const char* trace_detail(const std::string& path)
+{
+  return path.c_str() + path.rfind('/') + 1;
+}
+
+/**
+ * @class TraceSpan
+ * @brief Records the lifetime of a scope as a span
+ *
+ *   TraceSpan span("scan", "calculate_file_crc32", filename.c_str());
+ *
+ * detail must outlive the span.
+ */
+class TraceSpan {
+public:
+  TraceSpan(const char* category, const char* name, const char* detail = 0);
+  ~TraceSpan();
+
+private:
+  const char* category_;
+  const char* name_;
+  const char* detail_;
+  bool active_;
+  ACE_Time_Value start_;
+
+  TraceSpan(const TraceSpan&);
+  TraceSpan& operator=(const TraceSpan&);
+};
+
+} // namespace DirShare
+
+#endif // DIRSHARE_TRACE_H
@@ -0,0 +1,103 @@
+#include "TransferOpenListenerImpl.h"
+#include "FileChunkListenerImpl.h"
+#include "Log.h"
+
+#include <ace/Log_Msg.h>
+
+namespace DirShare {
+
+TransferOpenListenerImpl::TransferOpenListenerImpl(FileChunkListenerImpl& chunk_listener)
+  : chunk_listener_(chunk_listener)
+  , received_("received", "DirShare_TransferOpen")
+{
+}
+
+TransferOpenListenerImpl::~TransferOpenListenerImpl()
+{
+}
+
+void TransferOpenListenerImpl::on_requested_deadline_missed(
+  DDS::DataReader_ptr,
+  const DDS::RequestedDeadlineMissedStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_requested_incompatible_qos(
+  DDS::DataReader_ptr,
+  const DDS::RequestedIncompatibleQosStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_sample_rejected(
+  DDS::DataReader_ptr,
+  const DDS::SampleRejectedStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_liveliness_changed(
+  DDS::DataReader_ptr,
+  const DDS::LivelinessChangedStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_subscription_matched(
+  DDS::DataReader_ptr,
+  const DDS::SubscriptionMatchedStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_sample_lost(
+  DDS::DataReader_ptr,
+  const DDS::SampleLostStatus&)
+{
+}
+
+void TransferOpenListenerImpl::on_data_available(DDS::DataReader_ptr reader)
+{
+  TransferOpenDataReader_var open_reader =
+    TransferOpenDataReader::_narrow(reader);
+
+  if (!open_reader) {
+    ACE_ERROR((LM_ERROR,
+               ACE_TEXT("ERROR: %N:%l: TransferOpenListenerImpl::on_data_available() - ")
+               ACE_TEXT("failed to narrow DataReader!\n")));
+    return;
+  }
+
+  for (;;) {
+    TransferOpen open;
+    DDS::SampleInfo info;
+
+    DDS::ReturnCode_t status = open_reader->take_next_sample(open, info);
+
+    if (status == DDS::RETCODE_NO_DATA) {
+      break;
+    }
+
+    if (status != DDS::RETCODE_OK) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: TransferOpenListenerImpl::on_data_available() - ")
+                 ACE_TEXT("take_next_sample failed: %d\n"),
+                 status));
+      break;
+    }
+
+    if (info.valid_data) {
+      DIRSHARE_DEBUG(("Received TransferOpen: %s session %llu\n",
+                      open.filename.in(),
+                      static_cast<unsigned long long>(open.session_id)));
+
+      received_.sample();
+      chunk_listener_.open_transfer(open);
+    } else if (info.instance_state == DDS::NOT_ALIVE_DISPOSED_INSTANCE_STATE) {
+      // Session end is signalled on the chunk instance; this only matters
+      // for FEC sessions, whose chunk instance is best-effort
+      TransferOpen key;
+      if (open_reader->get_key_value(key, info.instance_handle) == DDS::RETCODE_OK) {
+        chunk_listener_.transfer_open_disposed(key.session_id);
+      }
+    }
+  }
+}
+
+} // namespace DirShare
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""
+multicast_fanout.py - Sender cost of a bulk transfer versus receiver count.
+
+Starts one sending and N receiving DirShare participants on this host,
+drops a file into the sender's directory and waits until every receiver
+holds an identical copy. For each N it reports:
+
+- completion time (file written -> last receiver has a matching copy)
+- sender CPU time (user + system, from /proc/<pid>/stat)
+- bytes transmitted on the interface per payload byte (/proc/net/dev)
+
+Run once with rtps.ini (unicast to every reader) and once with
+rtps_multicast.ini (bulk topics over reliable multicast) to compare:
+
+    python3 bench/multicast_fanout.py --config rtps.ini --receivers 1,2,4,8
+    python3 bench/multicast_fanout.py --config rtps_multicast.ini --receivers 1,2,4,8
+
+With unicast the wire bytes grow about linearly with N; with multicast
+they should stay close to the single-receiver figure plus NACK repairs.
+The interface counters include every process on the host, so run on an
+otherwise idle machine. Multicast over loopback needs:
+
+    sudo ip link set lo multicast on
+    sudo ip route add 239.0.0.0/8 dev lo
+
+Feature: multicast fan-out for bulk data (SC-006)
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+from typing import List, Optional
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+DIRSHARE_ROOT = os.path.dirname(BENCH_DIR)
+
+DISCOVERY_WAIT = 5      # Seconds for all participants to discover each other
+POLL_INTERVAL = 0.2     # Seconds between receiver checks
+CLK_TCK = os.sysconf('SC_CLK_TCK')
+
+
+def interface_tx_bytes(interface: str) -> int:
+    """Bytes transmitted so far on a network interface."""
+    with open('/proc/net/dev') as f:
+        for line in f:
+            name, _, counters = line.partition(':')
+            if name.strip() == interface:
+                return int(counters.split()[8])
+    raise RuntimeError(f"Interface not found in /proc/net/dev: {interface}")
+
+
+def process_cpu_seconds(pid: int) -> float:
+    """User + system CPU time consumed by a process."""
+    with open(f'/proc/{pid}/stat') as f:
+        # Fields after the parenthesized command name; utime and stime are
+        # fields 14 and 15 of the full line
+        fields = f.read().rpartition(')')[2].split()
+    return (int(fields[11]) + int(fields[12])) / CLK_TCK
+
+
+def file_crc32(path: str) -> Optional[int]:
+    """CRC32 of a file, or None if it cannot be read."""
+    crc = 0
+    try:
+        with open(path, 'rb') as f:
+            while True:
+                block = f.read(1 << 20)
+                if not block:
+                    return crc
+                crc = zlib.crc32(block, crc)
+    except OSError:
+        return None
+
+
+def start_participant(dirshare: str, config: str, directory: str,
+                      log_path: str, extra_args: List[str]) -> subprocess.Popen:
+    """Start one DirShare participant with output captured to a log file."""
+    log = open(log_path, 'w')
+    cmd = [dirshare, '-DCPSConfigFile', config] + extra_args + [directory]
+    return subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT,
+                            cwd=DIRSHARE_ROOT)
+
+
+def run_once(dirshare: str, config: str, receivers: int, size_mb: int,
+             interface: str, timeout: float, extra_args: List[str]) -> dict:
+    """Measure one transfer to the given number of receivers."""
+    work = tempfile.mkdtemp(prefix='dirshare_fanout_')
+    processes = []
+    try:
+        sender_dir = os.path.join(work, 'sender')
+        os.makedirs(sender_dir)
+        receiver_dirs = []
+        for i in range(receivers):
+            path = os.path.join(work, f'receiver_{i}')
+            os.makedirs(path)
+            receiver_dirs.append(path)
+
+        sender = start_participant(dirshare, config, sender_dir,
+                                   os.path.join(work, 'sender.log'), extra_args)
+        processes.append(sender)
+        for i, path in enumerate(receiver_dirs):
+            processes.append(start_participant(
+                dirshare, config, path, os.path.join(work, f'receiver_{i}.log'),
+                extra_args))
+
+        time.sleep(DISCOVERY_WAIT)
+        for p in processes:
+            if p.poll() is not None:
+                raise RuntimeError(f"Participant exited early (logs in {work})")
+
+        # Write the payload outside the shared directory, then move it in so
+        # the sender never sees a partial file
+        payload = os.path.join(work, 'payload.bin')
+        with open(payload, 'wb') as f:
+            f.write(os.urandom(size_mb * 1024 * 1024))
+        expected_crc = file_crc32(payload)
+        payload_bytes = os.path.getsize(payload)
+
+        tx_before = interface_tx_bytes(interface)
+        cpu_before = process_cpu_seconds(sender.pid)
+        start = time.monotonic()
+        os.rename(payload, os.path.join(sender_dir, 'payload.bin'))
+
+        pending = set(receiver_dirs)
+        while pending and time.monotonic() - start < timeout:
+            for path in list(pending):
+                copy = os.path.join(path, 'payload.bin')
+                if (os.path.exists(copy) and os.path.getsize(copy) == payload_bytes
+                        and file_crc32(copy) == expected_crc):
+                    pending.discard(path)
+            time.sleep(POLL_INTERVAL)
+
+        elapsed = time.monotonic() - start
+        cpu = process_cpu_seconds(sender.pid) - cpu_before
+        wire = interface_tx_bytes(interface) - tx_before
+
+        return {
+            'receivers': receivers,
+            'completed': receivers - len(pending),
+            'seconds': elapsed,
+            'sender_cpu': cpu,
+            'wire_ratio': wire / payload_bytes,
+            'logs': work,
+        }
+    finally:
+        for p in processes:
+            p.terminate()
+        for p in processes:
+            try:
+                p.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                p.kill()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--config', default='rtps_multicast.ini',
+                        help='DDS configuration file (default: rtps_multicast.ini)')
+    parser.add_argument('--receivers', default='1,2,4,8',
+                        help='Comma-separated receiver counts (default: 1,2,4,8)')
+    parser.add_argument('--size', type=int, default=50,
+                        help='Payload size in MB (default: 50)')
+    parser.add_argument('--interface', default='lo',
+                        help='Interface whose tx counter is sampled (default: lo)')
+    parser.add_argument('--timeout', type=float, default=300.0,
+                        help='Seconds to wait for each transfer (default: 300)')
+    parser.add_argument('--keep-logs', action='store_true',
+                        help='Keep participant directories and logs')
+    parser.add_argument('dirshare_args', nargs='*',
+                        help='Extra DirShare options after "--" (e.g. -- -F 16:2)')
+    args = parser.parse_args()
+
+    dirshare = os.path.join(DIRSHARE_ROOT, 'dirshare')
+    config = os.path.join(DIRSHARE_ROOT, args.config)
+    if not os.access(dirshare, os.X_OK):
+        print(f"ERROR: DirShare executable not found at {dirshare}", file=sys.stderr)
+        return 1
+    if not os.path.exists(config):
+        print(f"ERROR: Configuration file not found: {config}", file=sys.stderr)
+        return 1
+
+    counts = [int(n) for n in args.receivers.split(',')]
+    print(f"config={args.config} size={args.size}MB interface={args.interface}")
+    print(f"{'receivers':>9} {'done':>5} {'seconds':>8} {'sender_cpu':>10} {'wire/payload':>12}")
+
+    status = 0
+    for n in counts:
+        result = run_once(dirshare, config, n, args.size, args.interface,
+                          args.timeout, args.dirshare_args)
+        print(f"{result['receivers']:>9} {result['completed']:>5} "
+              f"{result['seconds']:>8.2f} {result['sender_cpu']:>10.2f} "
+              f"{result['wire_ratio']:>12.2f}")
+        if result['completed'] != n:
+            print(f"  incomplete transfer, logs kept in {result['logs']}")
+            status = 1
+        elif not args.keep_logs:
+            shutil.rmtree(result['logs'], ignore_errors=True)
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+relay_fanout.py - Propagation time versus participant count, flat or relayed.
+
+Starts one origin and N leaf DirShare participants on this host, drops a
+file into the origin's directory and measures how long it takes until
+every leaf holds an identical copy. Two topologies are compared per N:
+
+- flat:  the origin and all leaves share one domain
+- relay: the origin shares its domain with ceil(N / fanout) relays
+         (--relay); each relay serves up to --fanout leaves in a domain
+         of its own
+
+In the flat topology discovery and the origin's uplink grow with N; in
+the relay topology no domain holds more than fanout + 1 participants, so
+propagation time should stay flat from 10 to 100 leaves (at the cost of
+about one poll interval per relay level):
+
+    python3 bench/relay_fanout.py --leaves 10,25,50,100 --fanout 10
+
+Feature: relay participants for hierarchical fan-out
+"""
+
+import argparse
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from typing import List
+
+from multicast_fanout import DIRSHARE_ROOT, file_crc32, start_participant
+
+UPSTREAM_DOMAIN = 42
+POLL_INTERVAL = 0.2     # Seconds between leaf checks
+SIZE_KB = 256           # Payload size (below the chunk threshold)
+
+
+def run_once(dirshare: str, leaves: int, fanout: int, relayed: bool,
+             settle: float, timeout: float, extra_args: List[str]) -> dict:
+    """Measure one propagation from the origin to every leaf."""
+    work = tempfile.mkdtemp(prefix='dirshare_relay_')
+    rtps = os.path.join(DIRSHARE_ROOT, 'rtps.ini')
+    rtps_relay = os.path.join(DIRSHARE_ROOT, 'rtps_relay.ini')
+    processes = []
+    try:
+        origin_dir = os.path.join(work, 'origin')
+        os.makedirs(origin_dir)
+        processes.append(start_participant(
+            dirshare, rtps, origin_dir, os.path.join(work, 'origin.log'),
+            ['-d', str(UPSTREAM_DOMAIN)] + extra_args))
+
+        relays = math.ceil(leaves / fanout) if relayed else 0
+        for r in range(relays):
+            path = os.path.join(work, f'relay_{r}')
+            os.makedirs(path)
+            processes.append(start_participant(
+                dirshare, rtps_relay, path, os.path.join(work, f'relay_{r}.log'),
+                ['-d', str(UPSTREAM_DOMAIN), '--relay', str(UPSTREAM_DOMAIN + 1 + r)]
+                + extra_args))
+
+        leaf_dirs = []
+        for i in range(leaves):
+            path = os.path.join(work, f'leaf_{i}')
+            os.makedirs(path)
+            leaf_dirs.append(path)
+            domain = UPSTREAM_DOMAIN + 1 + i // fanout if relayed else UPSTREAM_DOMAIN
+            processes.append(start_participant(
+                dirshare, rtps, path, os.path.join(work, f'leaf_{i}.log'),
+                ['-d', str(domain)] + extra_args))
+
+        time.sleep(settle)
+
+        payload = os.path.join(work, 'payload.bin')
+        with open(payload, 'wb') as f:
+            f.write(os.urandom(SIZE_KB * 1024))
+        expected_crc = file_crc32(payload)
+
+        start = time.monotonic()
+        shutil.copy2(payload, os.path.join(origin_dir, 'payload.bin'))
+
+        pending = set(leaf_dirs)
+        while pending and time.monotonic() - start < timeout:
+            for p in processes:
+                if p.poll() is not None:
+                    raise RuntimeError(f"Participant exited early (logs in {work})")
+            for path in list(pending):
+                if file_crc32(os.path.join(path, 'payload.bin')) == expected_crc:
+                    pending.discard(path)
+            if pending:
+                time.sleep(POLL_INTERVAL)
+
+        return {
+            'completed': not pending,
+            'seconds': time.monotonic() - start,
+            'logs': work,
+        }
+    finally:
+        for p in processes:
+            p.terminate()
+        for p in processes:
+            try:
+                p.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                p.kill()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--leaves', default='10,25,50,100',
+                        help='Comma-separated leaf counts (default: 10,25,50,100)')
+    parser.add_argument('--fanout', type=int, default=10,
+                        help='Leaves per relay (default: 10)')
+    parser.add_argument('--settle', type=float, default=35.0,
+                        help='Seconds for startup and discovery (default: 35)')
+    parser.add_argument('--timeout', type=float, default=120.0,
+                        help='Seconds to wait for each propagation (default: 120)')
+    parser.add_argument('--keep-logs', action='store_true',
+                        help='Keep participant directories and logs')
+    parser.add_argument('dirshare_args', nargs='*',
+                        help='Extra DirShare options after "--"')
+    args = parser.parse_args()
+
+    dirshare = os.path.join(DIRSHARE_ROOT, 'dirshare')
+    if not os.access(dirshare, os.X_OK):
+        print(f"ERROR: DirShare executable not found at {dirshare}", file=sys.stderr)
+        return 1
+
+    counts = [int(n) for n in args.leaves.split(',')]
+    print(f"fanout={args.fanout} size={SIZE_KB}KB")
+    print(f"{'leaves':>6} {'flat_s':>8} {'relay_s':>8}")
+
+    status = 0
+    for n in counts:
+        seconds = []
+        for relayed in (False, True):
+            result = run_once(dirshare, n, args.fanout, relayed, args.settle,
+                              args.timeout, args.dirshare_args)
+            seconds.append(f"{result['seconds']:>8.2f}" if result['completed']
+                           else f"{'timeout':>8}")
+            if not result['completed']:
+                print(f"  incomplete propagation, logs kept in {result['logs']}")
+                status = 1
+            elif not args.keep_logs:
+                shutil.rmtree(result['logs'], ignore_errors=True)
+        print(f"{n:>6} {seconds[0]} {seconds[1]}")
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+swarm_join.py - Join time of a fully replicated share versus seeder count.
+
+Starts N seeding DirShare participants that hold identical copies of a
+file, lets them settle, then starts one joining participant with --swarm
+and measures how long it takes to hold a matching copy. With swarm
+download the joiner requests chunks from every seeder, so join time
+should fall roughly in proportion to N:
+
+    python3 bench/swarm_join.py --seeders 1,2,4 --size 200
+
+Seeders are started together and push the file to each other at startup
+(receivers holding identical content skip the write); --settle must cover
+that exchange so it does not overlap the measured join.
+
+Feature: swarm-style multi-source download
+"""
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from typing import List
+
+from multicast_fanout import DIRSHARE_ROOT, file_crc32, start_participant
+
+DISCOVERY_WAIT = 5      # Seconds for all participants to discover each other
+POLL_INTERVAL = 0.2     # Seconds between joiner checks
+
+
+def run_once(dirshare: str, config: str, seeders: int, size_mb: int,
+             settle: float, timeout: float, extra_args: List[str]) -> dict:
+    """Measure one join against the given number of seeders."""
+    work = tempfile.mkdtemp(prefix='dirshare_swarm_')
+    processes = []
+    try:
+        payload = os.path.join(work, 'payload.bin')
+        with open(payload, 'wb') as f:
+            f.write(os.urandom(size_mb * 1024 * 1024))
+        expected_crc = file_crc32(payload)
+        payload_bytes = os.path.getsize(payload)
+
+        # Identical content and timestamp in every seeder
+        for i in range(seeders):
+            path = os.path.join(work, f'seeder_{i}')
+            os.makedirs(path)
+            shutil.copy2(payload, os.path.join(path, 'payload.bin'))
+            processes.append(start_participant(
+                dirshare, config, path, os.path.join(work, f'seeder_{i}.log'),
+                extra_args))
+
+        time.sleep(DISCOVERY_WAIT + settle)
+
+        joiner_dir = os.path.join(work, 'joiner')
+        os.makedirs(joiner_dir)
+        start = time.monotonic()
+        processes.append(start_participant(
+            dirshare, config, joiner_dir, os.path.join(work, 'joiner.log'),
+            ['--swarm'] + extra_args))
+
+        copy = os.path.join(joiner_dir, 'payload.bin')
+        done = False
+        while not done and time.monotonic() - start < timeout:
+            for p in processes:
+                if p.poll() is not None:
+                    raise RuntimeError(f"Participant exited early (logs in {work})")
+            done = (os.path.exists(copy) and os.path.getsize(copy) == payload_bytes
+                    and file_crc32(copy) == expected_crc)
+            if not done:
+                time.sleep(POLL_INTERVAL)
+
+        return {
+            'seeders': seeders,
+            'completed': done,
+            'seconds': time.monotonic() - start,
+            'logs': work,
+        }
+    finally:
+        for p in processes:
+            p.terminate()
+        for p in processes:
+            try:
+                p.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                p.kill()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--config', default='rtps.ini',
+                        help='DDS configuration file (default: rtps.ini)')
+    parser.add_argument('--seeders', default='1,2,4',
+                        help='Comma-separated seeder counts (default: 1,2,4)')
+    parser.add_argument('--size', type=int, default=100,
+                        help='Payload size in MB (default: 100)')
+    parser.add_argument('--settle', type=float, default=10.0,
+                        help='Seconds for the seeders\' startup exchange (default: 10)')
+    parser.add_argument('--timeout', type=float, default=300.0,
+                        help='Seconds to wait for each join (default: 300)')
+    parser.add_argument('--keep-logs', action='store_true',
+                        help='Keep participant directories and logs')
+    parser.add_argument('dirshare_args', nargs='*',
+                        help='Extra DirShare options after "--" (e.g. -- -c 4M)')
+    args = parser.parse_args()
+
+    dirshare = os.path.join(DIRSHARE_ROOT, 'dirshare')
+    config = os.path.join(DIRSHARE_ROOT, args.config)
+    if not os.access(dirshare, os.X_OK):
+        print(f"ERROR: DirShare executable not found at {dirshare}", file=sys.stderr)
+        return 1
+    if not os.path.exists(config):
+        print(f"ERROR: Configuration file not found: {config}", file=sys.stderr)
+        return 1
+
+    counts = [int(n) for n in args.seeders.split(',')]
+    print(f"config={args.config} size={args.size}MB")
+    print(f"{'seeders':>7} {'done':>5} {'seconds':>8} {'speedup':>8}")
+
+    status = 0
+    baseline = None
+    for n in counts:
+        result = run_once(dirshare, config, n, args.size, args.settle,
+                          args.timeout, args.dirshare_args)
+        if baseline is None and result['completed']:
+            baseline = result['seconds']
+        speedup = baseline / result['seconds'] if baseline else 0.0
+        print(f"{result['seeders']:>7} {str(result['completed']):>5} "
+              f"{result['seconds']:>8.2f} {speedup:>8.2f}")
+        if not result['completed']:
+            print(f"  incomplete join, logs kept in {result['logs']}")
+            status = 1
+        elif not args.keep_logs:
+            shutil.rmtree(result['logs'], ignore_errors=True)
+
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,60 @@
+// ChecksumBench.cpp
+// CRC32 over memory buffers and files
+
+#include "Microbench.h"
+#include "../Checksum.h"
+#include "../FileUtils.h"
+
+#include <sstream>
+#include <vector>
+
+namespace {
+
+using DirShare::Microbench::State;
+
+// calculate_crc32 over a buffer of arg bytes
+void crc32(State& state)
+{
+  const size_t size = static_cast<size_t>(state.arg());
+  std::vector<unsigned char> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<unsigned char>(i * 31);
+  }
+
+  unsigned long checksum = 0;
+  while (state.keep_running()) {
+    checksum ^= DirShare::calculate_crc32(&data[0], size);
+  }
+  if (checksum == 1) {
+    state.skip_with_error("unreachable");  // Keeps the loop from being optimized out
+  }
+  state.set_bytes_processed(static_cast<unsigned long long>(size) * state.iterations());
+}
+DIRSHARE_MICROBENCH(crc32)->range(64, 16 << 20, 16);
+
+// calculate_file_crc32 of a file of arg bytes (in the page cache)
+void file_crc32(State& state)
+{
+  const size_t size = static_cast<size_t>(state.arg());
+  std::ostringstream path;
+  path << DirShare::Microbench::scratch_directory() << "/crc_" << size << ".dat";
+
+  std::vector<unsigned char> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<unsigned char>(i * 17);
+  }
+  if (!DirShare::write_file(path.str(), &data[0], size)) {
+    state.skip_with_error("cannot write " + path.str());
+  }
+
+  unsigned long checksum = 0;
+  while (state.keep_running()) {
+    if (!DirShare::calculate_file_crc32(path.str().c_str(), checksum)) {
+      state.skip_with_error("cannot read " + path.str());
+    }
+  }
+  state.set_bytes_processed(static_cast<unsigned long long>(size) * state.iterations());
+}
+DIRSHARE_MICROBENCH(file_crc32)->arg(4 << 10)->arg(1 << 20)->arg(64 << 20);
+
+} // namespace
@@ -0,0 +1,84 @@
+// FileChangeTrackerBench.cpp
+// FileChangeTracker lookups and updates from concurrent threads
+
+#include "Microbench.h"
+#include "../FileChangeTracker.h"
+
+#include <ace/OS_NS_stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using DirShare::Microbench::State;
+
+// Paths suppressed while the lookups run, as during a large incoming sync
+const size_t SUPPRESSED = 1000;
+
+std::vector<std::string> make_names(const char* prefix, size_t count)
+{
+  std::vector<std::string> names;
+  char name[64];
+  for (size_t i = 0; i < count; ++i) {
+    ACE_OS::snprintf(name, sizeof(name), "%s/file_%06lu.dat", prefix, static_cast<unsigned long>(i));
+    names.push_back(name);
+  }
+  return names;
+}
+
+// Shared by the threads of a run, filled before any benchmark starts since
+// the threads of a run do not wait for each other
+struct SuppressedTracker {
+  SuppressedTracker()
+  {
+    const std::vector<std::string> names = make_names("remote", SUPPRESSED);
+    for (size_t i = 0; i < names.size(); ++i) {
+      tracker.suppress_notifications(names[i]);
+    }
+  }
+  DirShare::FileChangeTracker tracker;
+};
+SuppressedTracker g_suppressed;
+DirShare::FileChangeTracker& g_tracker = g_suppressed.tracker;
+
+// is_suppressed, half hits and half misses, as the monitor checks every
+// file of every scan
+void tracker_is_suppressed(State& state)
+{
+  const std::vector<std::string> suppressed = make_names("remote", SUPPRESSED);
+  const std::vector<std::string> local = make_names("local", SUPPRESSED);
+
+  size_t hits = 0;
+  size_t i = static_cast<size_t>(state.thread_index()) * 97;
+  while (state.keep_running()) {
+    const std::vector<std::string>& names = (i & 1) ? local : suppressed;
+    hits += g_tracker.is_suppressed(names[(i / 2) % SUPPRESSED]) ? 1 : 0;
+    ++i;
+  }
+  if (hits > state.iterations()) {
+    state.skip_with_error("unreachable");  // Keeps the loop from being optimized out
+  }
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(tracker_is_suppressed)->threads(1)->threads(2)->threads(4)->threads(8);
+
+// suppress_notifications and resume_notifications of each thread's own
+// paths, as receive threads applying files do
+void tracker_suppress_resume(State& state)
+{
+  char prefix[32];
+  ACE_OS::snprintf(prefix, sizeof(prefix), "thread_%d", state.thread_index());
+  const std::vector<std::string> names = make_names(prefix, 64);
+
+  size_t i = 0;
+  while (state.keep_running()) {
+    const std::string& name = names[i++ % names.size()];
+    g_tracker.suppress_notifications(name);
+    g_tracker.resume_notifications(name);
+  }
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(tracker_suppress_resume)->threads(1)->threads(2)->threads(4)->threads(8);
+
+} // namespace
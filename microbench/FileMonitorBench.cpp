@@ -0,0 +1,81 @@
+// FileMonitorBench.cpp
+// FileMonitor::scan_for_changes over large directories, quiet and churning
+
+#include "Microbench.h"
+#include "../FileMonitor.h"
+#include "../FileChangeTracker.h"
+#include "../FileUtils.h"
+
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_string.h>
+
+#include <vector>
+
+namespace {
+
+using DirShare::Microbench::State;
+
+const size_t FILE_SIZE = 64;
+
+// Percent of the files rewritten before each churning scan
+const size_t CHURN_PERCENT = 1;
+
+// Scan of a directory of arg files where nothing changes
+void scan_quiet(State& state)
+{
+  const size_t count = static_cast<size_t>(state.arg());
+  const std::string directory = DirShare::Microbench::file_corpus(count, FILE_SIZE);
+
+  DirShare::FileChangeTracker tracker;
+  DirShare::FileMonitor monitor(directory, tracker);
+  std::vector<std::string> created, modified, deleted;
+  monitor.scan_for_changes(created, modified, deleted);  // Baseline
+
+  while (state.keep_running()) {
+    monitor.scan_for_changes(created, modified, deleted);
+  }
+  if (!modified.empty()) {
+    state.skip_with_error("changes found in a quiet directory");
+  }
+  state.set_items_processed(static_cast<unsigned long long>(count) * state.iterations());
+}
+DIRSHARE_MICROBENCH(scan_quiet)->arg(1000)->arg(10000)->arg(100000);
+
+// Scan of a directory of arg files after rewriting 1% of them
+void scan_churning(State& state)
+{
+  const size_t count = static_cast<size_t>(state.arg());
+  const std::string directory = DirShare::Microbench::file_corpus(count, FILE_SIZE);
+  const size_t churn = count * CHURN_PERCENT / 100 > 0 ? count * CHURN_PERCENT / 100 : 1;
+
+  DirShare::FileChangeTracker tracker;
+  DirShare::FileMonitor monitor(directory, tracker);
+  std::vector<std::string> created, modified, deleted;
+  monitor.scan_for_changes(created, modified, deleted);  // Baseline
+
+  // Each rewrite stamps the round into the content, so it always changes
+  // the checksum whatever the timestamp resolution
+  std::vector<unsigned char> data(FILE_SIZE, 0x3C);
+  char name[32];
+  size_t next = 0;
+  unsigned long round = 0;
+  while (state.keep_running()) {
+    state.pause_timing();
+    ++round;
+    ACE_OS::memcpy(&data[0], &round, sizeof(round));
+    for (size_t i = 0; i < churn; ++i, next = (next + 1) % count) {
+      ACE_OS::snprintf(name, sizeof(name), "/f%06lu.dat", static_cast<unsigned long>(next));
+      DirShare::write_file(directory + name, &data[0], FILE_SIZE);
+    }
+    state.resume_timing();
+
+    monitor.scan_for_changes(created, modified, deleted);
+  }
+  if (modified.size() != churn) {
+    state.skip_with_error("rewritten files not all detected");
+  }
+  state.set_items_processed(static_cast<unsigned long long>(count) * state.iterations());
+}
+DIRSHARE_MICROBENCH(scan_churning)->arg(1000)->arg(10000)->arg(100000);
+
+} // namespace
@@ -0,0 +1,73 @@
+// FileUtilsBench.cpp
+// Whole-file reads and writes, and directory listing
+
+#include "Microbench.h"
+#include "../FileUtils.h"
+
+#include <sstream>
+#include <vector>
+
+namespace {
+
+using DirShare::Microbench::State;
+
+std::string scratch_file(const char* prefix, long size)
+{
+  std::ostringstream path;
+  path << DirShare::Microbench::scratch_directory() << '/' << prefix << '_' << size << ".dat";
+  return path.str();
+}
+
+// read_file of a file of arg bytes (in the page cache)
+void read_file(State& state)
+{
+  const size_t size = static_cast<size_t>(state.arg());
+  const std::string path = scratch_file("read", state.arg());
+  std::vector<unsigned char> data(size, 0x5A);
+  if (!DirShare::write_file(path, &data[0], size)) {
+    state.skip_with_error("cannot write " + path);
+  }
+
+  while (state.keep_running()) {
+    if (!DirShare::read_file(path, data)) {
+      state.skip_with_error("cannot read " + path);
+    }
+  }
+  state.set_bytes_processed(static_cast<unsigned long long>(size) * state.iterations());
+}
+DIRSHARE_MICROBENCH(read_file)->arg(4 << 10)->arg(1 << 20)->arg(16 << 20);
+
+// write_file of arg bytes over the same file
+void write_file(State& state)
+{
+  const size_t size = static_cast<size_t>(state.arg());
+  const std::string path = scratch_file("write", state.arg());
+  const std::vector<unsigned char> data(size, 0xA5);
+
+  while (state.keep_running()) {
+    if (!DirShare::write_file(path, &data[0], size)) {
+      state.skip_with_error("cannot write " + path);
+    }
+  }
+  state.set_bytes_processed(static_cast<unsigned long long>(size) * state.iterations());
+}
+DIRSHARE_MICROBENCH(write_file)->arg(4 << 10)->arg(1 << 20)->arg(16 << 20);
+
+// list_directory_files of a directory of arg files
+void list_directory_files(State& state)
+{
+  const std::string directory =
+    DirShare::Microbench::file_corpus(static_cast<size_t>(state.arg()), 64);
+
+  std::vector<std::string> files;
+  while (state.keep_running()) {
+    files.clear();
+    if (!DirShare::list_directory_files(directory, files)) {
+      state.skip_with_error("cannot list " + directory);
+    }
+  }
+  state.set_items_processed(static_cast<unsigned long long>(files.size()) * state.iterations());
+}
+DIRSHARE_MICROBENCH(list_directory_files)->arg(1000)->arg(10000)->arg(100000);
+
+} // namespace
@@ -0,0 +1,119 @@
+// LogBench.cpp
+// Cost of a per-chunk log statement: synchronous ACE_DEBUG against AsyncLog
+
+#include "Microbench.h"
+#include "../Log.h"
+
+#include <ace/Log_Msg.h>
+
+#include <ostream>
+#include <streambuf>
+
+namespace {
+
+using DirShare::Microbench::State;
+
+// Stream that formats nothing and keeps nothing
+class NullBuffer : public std::streambuf {
+protected:
+  virtual int overflow(int c) { return c; }
+  virtual std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+void discard(ACE_Log_Priority, const char*)
+{
+}
+
+// Writer thread and output shared by the runs; the statements below are
+// INFO so that they are measured whatever DIRSHARE_LOG_LEVEL is
+struct AsyncLogRunning {
+  AsyncLogRunning()
+  {
+    DirShare::AsyncLog::instance().output(discard);
+    DirShare::AsyncLog::instance().start();
+  }
+  ~AsyncLogRunning()
+  {
+    DirShare::AsyncLog::instance().stop();
+  }
+};
+AsyncLogRunning g_async_log;
+
+const char* const FILENAME = "videos/holiday_2024.mp4";
+
+// The former "Reassembly progress" line: ACE_Log_Msg formatting and a
+// write per message (to a discarding stream rather than stderr)
+void log_ace_debug(State& state)
+{
+  NullBuffer buffer;
+  std::ostream stream(&buffer);
+  ACE_Log_Msg* const log = ACE_LOG_MSG;
+  std::ostream* saved_stream = log->msg_ostream();
+  const unsigned long saved_flags = log->flags();
+  log->msg_ostream(&stream, 0);
+  log->set_flags(ACE_Log_Msg::OSTREAM);
+  log->clr_flags(ACE_Log_Msg::STDERR);
+
+  unsigned int chunk = 0;
+  while (state.keep_running()) {
+    ACE_DEBUG((LM_INFO,
+               ACE_TEXT("(%P|%t) Reassembly progress for %C: %u/%u chunks received\n"),
+               FILENAME, ++chunk, 100000u));
+  }
+
+  log->msg_ostream(saved_stream, 0);
+  log->clr_flags(ACE_Log_Msg::OSTREAM);
+  log->set_flags(saved_flags);
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(log_ace_debug);
+
+// The same line queued for the writer thread; the buffers are drained
+// outside the timing before they fill, or this would time dropping
+void log_async(State& state)
+{
+  unsigned int chunk = 0;
+  while (state.keep_running()) {
+    DIRSHARE_INFO(("Reassembly progress for %s: %u/%u chunks received\n",
+                   FILENAME, ++chunk, 100000u));
+    if (chunk % (DirShare::AsyncLog::DEFAULT_RECORDS_PER_THREAD / 2) == 0) {
+      state.pause_timing();
+      DirShare::AsyncLog::instance().flush();
+      state.resume_timing();
+    }
+  }
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(log_async)->threads(1)->threads(4);
+
+// The line as the receive path issues it: one per file per second, the
+// rest held back by the rate limiter
+void log_rate_limited(State& state)
+{
+  unsigned int chunk = 0;
+  while (state.keep_running()) {
+    DIRSHARE_INFO_EVERY(FILENAME, ("Reassembly progress for %s: %u/%u chunks received\n",
+                                   FILENAME, ++chunk, 100000u));
+  }
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(log_rate_limited)->threads(1)->threads(4);
+
+// A statement whose priority ACE_Log_Msg has disabled
+void log_disabled(State& state)
+{
+  const unsigned long mask = ACE_LOG_MSG->priority_mask(ACE_Log_Msg::PROCESS);
+  ACE_LOG_MSG->priority_mask(mask & ~LM_INFO, ACE_Log_Msg::PROCESS);
+
+  unsigned int chunk = 0;
+  while (state.keep_running()) {
+    DIRSHARE_INFO(("Reassembly progress for %s: %u/%u chunks received\n",
+                   FILENAME, ++chunk, 100000u));
+  }
+
+  ACE_LOG_MSG->priority_mask(mask, ACE_Log_Msg::PROCESS);
+  state.set_items_processed(state.iterations());
+}
+DIRSHARE_MICROBENCH(log_disabled);
+
+} // namespace
@@ -0,0 +1,622 @@
+// Microbench.cpp
+// Runner of the DirShare microbenchmarks: iteration scaling, threads,
+// console and JSON reports, and comparison against a baseline
+
+#include "Microbench.h"
+#include "../FileUtils.h"
+
+#include <ace/Log_Msg.h>
+#include <ace/Get_Opt.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Dirent.h>
+#include <ace/High_Res_Timer.h>
+#include <ace/Task.h>
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_stdlib.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <ace/OS_NS_sys_time.h>
+#include <ace/OS_NS_unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace DirShare {
+namespace Microbench {
+
+namespace {
+
+const double DEFAULT_MIN_TIME_SEC = 0.5;
+const double DEFAULT_TOLERANCE_PERCENT = 10.0;
+const unsigned long MAX_ITERATIONS = 1000000000ul;
+
+ACE_Time_Value monotonic_now()
+{
+  return ACE_High_Res_Timer::gettimeofday_hr();
+}
+
+double seconds(const ACE_Time_Value& time)
+{
+  return static_cast<double>(time.sec()) + static_cast<double>(time.usec()) / 1e6;
+}
+
+// Result of one variant
+struct Result {
+  std::string name;
+  unsigned long iterations;
+  double ns_per_iteration;   // Median over the repetitions
+  double bytes_per_second;
+  double items_per_second;
+  std::string error;
+};
+
+/**
+ * Runs the function of a benchmark in several threads, one State each
+ */
+class ThreadRun : public ACE_Task_Base {
+public:
+  ThreadRun(Function function, std::vector<State>& states)
+    : function_(function)
+    , states_(states)
+    , next_(0)
+  {
+  }
+
+  int svc()
+  {
+    const long index = next_++;
+    function_(states_[static_cast<size_t>(index)]);
+    return 0;
+  }
+
+private:
+  Function function_;
+  std::vector<State>& states_;
+  ACE_Atomic_Op<ACE_Thread_Mutex, long> next_;
+};
+
+// Timed loop of a variant with a given iteration count
+struct Sample {
+  double seconds;       // Mean over the threads
+  unsigned long long bytes;
+  unsigned long long items;
+  std::string error;
+};
+
+Sample run_once(const Benchmark& benchmark, long arg, int threads, unsigned long iterations)
+{
+  std::vector<State> states;
+  for (int t = 0; t < threads; ++t) {
+    states.push_back(State(iterations, arg, threads, t));
+  }
+
+  if (threads == 1) {
+    benchmark.function()(states[0]);
+  } else {
+    ThreadRun run(benchmark.function(), states);
+    run.activate(THR_NEW_LWP | THR_JOINABLE, threads);
+    run.wait();
+  }
+
+  Sample sample;
+  sample.seconds = 0.0;
+  sample.bytes = 0;
+  sample.items = 0;
+  for (size_t t = 0; t < states.size(); ++t) {
+    sample.seconds += seconds(states[t].elapsed()) / static_cast<double>(threads);
+    sample.bytes += states[t].bytes_processed();
+    sample.items += states[t].items_processed();
+    if (!states[t].error().empty()) {
+      sample.error = states[t].error();
+    }
+  }
+  return sample;
+}
+
+std::string variant_name(const Benchmark& benchmark, long arg, bool has_arg, int threads, bool has_threads)
+{
+  std::ostringstream name;
+  name << benchmark.name();
+  if (has_arg) {
+    name << '/' << arg;
+  }
+  if (has_threads) {
+    name << "/threads:" << threads;
+  }
+  return name.str();
+}
+
+/**
+ * Measure a variant
+ * The iteration count grows until one run lasts min_time, as Google
+ * Benchmark does; that run is then repeated and the median reported.
+ */
+Result measure(const Benchmark& benchmark, const std::string& name, long arg, int threads,
+               double min_time, int repetitions)
+{
+  Result result;
+  result.name = name;
+  result.iterations = 1;
+  result.ns_per_iteration = 0.0;
+  result.bytes_per_second = 0.0;
+  result.items_per_second = 0.0;
+
+  Sample sample;
+  for (;;) {
+    sample = run_once(benchmark, arg, threads, result.iterations);
+    if (!sample.error.empty()) {
+      result.error = sample.error;
+      return result;
+    }
+    if (sample.seconds >= min_time || result.iterations >= MAX_ITERATIONS) {
+      break;
+    }
+    // Aim 40% past min_time, growing at most tenfold from short runs
+    double multiplier = min_time * 1.4 / std::max(sample.seconds, 1e-9);
+    if (sample.seconds / min_time <= 0.1) {
+      multiplier = std::min(multiplier, 10.0);
+    }
+    const double next = static_cast<double>(result.iterations) * multiplier;
+    result.iterations = static_cast<unsigned long>(
+      std::min(static_cast<double>(MAX_ITERATIONS), std::max(next, result.iterations + 1.0)));
+  }
+
+  std::vector<Sample> samples(1, sample);
+  for (int r = 1; r < repetitions; ++r) {
+    samples.push_back(run_once(benchmark, arg, threads, result.iterations));
+  }
+  std::vector<double> times;
+  for (size_t r = 0; r < samples.size(); ++r) {
+    times.push_back(samples[r].seconds);
+  }
+  std::sort(times.begin(), times.end());
+  const double median = times[times.size() / 2];
+
+  const double elapsed = std::max(median, 1e-12);
+  result.ns_per_iteration = median * 1e9 / static_cast<double>(result.iterations);
+  result.bytes_per_second = static_cast<double>(sample.bytes) / elapsed;
+  result.items_per_second = static_cast<double>(sample.items) / elapsed;
+  return result;
+}
+
+// 1536 -> "1.5 K"
+std::string format_rate(double value, const char* unit)
+{
+  static const char* const PREFIXES[] = { "", "k", "M", "G", "T" };
+  size_t prefix = 0;
+  while (value >= 1000.0 && prefix + 1 < sizeof(PREFIXES) / sizeof(PREFIXES[0])) {
+    value /= 1000.0;
+    ++prefix;
+  }
+  char text[32];
+  ACE_OS::snprintf(text, sizeof(text), "%.1f %s%s/s", value, PREFIXES[prefix], unit);
+  return text;
+}
+
+std::string format_time(double ns)
+{
+  char text[32];
+  if (ns < 1e3) {
+    ACE_OS::snprintf(text, sizeof(text), "%.1f ns", ns);
+  } else if (ns < 1e6) {
+    ACE_OS::snprintf(text, sizeof(text), "%.2f us", ns / 1e3);
+  } else if (ns < 1e9) {
+    ACE_OS::snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+  } else {
+    ACE_OS::snprintf(text, sizeof(text), "%.2f s", ns / 1e9);
+  }
+  return text;
+}
+
+std::string console_line(const Result& result)
+{
+  char line[256];
+  if (!result.error.empty()) {
+    ACE_OS::snprintf(line, sizeof(line), "%-48s ERROR: %s\n",
+                     result.name.c_str(), result.error.c_str());
+    return line;
+  }
+
+  std::string throughput;
+  if (result.bytes_per_second > 0.0) {
+    throughput = format_rate(result.bytes_per_second, "B");
+  }
+  if (result.items_per_second > 0.0) {
+    throughput += (throughput.empty() ? "" : "  ") + format_rate(result.items_per_second, "items");
+  }
+  ACE_OS::snprintf(line, sizeof(line), "%-48s %12s %12lu  %s\n",
+                   result.name.c_str(), format_time(result.ns_per_iteration).c_str(),
+                   result.iterations, throughput.c_str());
+  return line;
+}
+
+// One benchmark per line, so that baselines can be read back line by line
+std::string json_report(const std::vector<Result>& results)
+{
+  char host[256];
+  if (ACE_OS::hostname(host, sizeof(host)) != 0) {
+    host[0] = '\0';
+  }
+
+  std::ostringstream out;
+  out << "{\n"
+      << "  \"context\": {\"date\": " << ACE_OS::gettimeofday().sec()
+      << ", \"host_name\": \"" << host << "\"},\n"
+      << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    char line[512];
+    ACE_OS::snprintf(line, sizeof(line),
+                     "    {\"name\": \"%s\", \"iterations\": %lu, \"real_time\": %.3f, "
+                     "\"time_unit\": \"ns\", \"bytes_per_second\": %.1f, "
+                     "\"items_per_second\": %.1f%s%s%s}%s\n",
+                     result.name.c_str(), result.iterations, result.ns_per_iteration,
+                     result.bytes_per_second, result.items_per_second,
+                     result.error.empty() ? "" : ", \"error_message\": \"",
+                     result.error.c_str(),
+                     result.error.empty() ? "" : "\"",
+                     i + 1 < results.size() ? "," : "");
+    out << line;
+  }
+  out << "  ]\n}\n";
+  return out.str();
+}
+
+// name -> real_time (ns) of a report written by json_report()
+bool read_baseline(const std::string& path, std::map<std::string, double>& baseline)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    ACE_ERROR_RETURN((LM_ERROR,
+                     ACE_TEXT("ERROR: %N:%l: Cannot read baseline %C\n"),
+                     path.c_str()),
+                    false);
+  }
+
+  static const std::string NAME = "\"name\": \"";
+  static const std::string TIME = "\"real_time\": ";
+  std::string line;
+  while (std::getline(in, line)) {
+    const std::string::size_type name = line.find(NAME);
+    const std::string::size_type time = line.find(TIME);
+    if (name == std::string::npos || time == std::string::npos) {
+      continue;
+    }
+    const std::string::size_type begin = name + NAME.size();
+    const std::string::size_type end = line.find('"', begin);
+    baseline[line.substr(begin, end - begin)] =
+      ACE_OS::strtod(line.c_str() + time + TIME.size(), 0);
+  }
+  return true;
+}
+
+/**
+ * Compare results to a baseline
+ * @return Number of variants slower than the baseline by more than the
+ *         tolerance
+ */
+size_t compare(const std::vector<Result>& results,
+               const std::map<std::string, double>& baseline,
+               double tolerance_percent)
+{
+  size_t regressions = 0;
+  std::cout << "\nComparison with the baseline (tolerance " << tolerance_percent << "%)\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    std::map<std::string, double>::const_iterator it = baseline.find(result.name);
+    if (it == baseline.end() || it->second <= 0.0 || !result.error.empty()) {
+      continue;
+    }
+    const double change = (result.ns_per_iteration / it->second - 1.0) * 100.0;
+    const bool regressed = change > tolerance_percent;
+    if (regressed) {
+      ++regressions;
+    }
+    char line[256];
+    ACE_OS::snprintf(line, sizeof(line), "%-48s %12s -> %12s %+7.1f%%%s\n",
+                     result.name.c_str(), format_time(it->second).c_str(),
+                     format_time(result.ns_per_iteration).c_str(), change,
+                     regressed ? "  REGRESSION" : "");
+    std::cout << line;
+  }
+  return regressions;
+}
+
+void remove_tree(const std::string& directory)
+{
+  std::vector<std::string> entries;
+  {
+    ACE_Dirent dir(directory.c_str());
+    for (ACE_DIRENT* entry = dir.read(); entry != 0; entry = dir.read()) {
+      const std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        entries.push_back(name);
+      }
+    }
+  }
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const std::string path = directory + "/" + entries[i];
+    if (is_directory(path)) {
+      remove_tree(path);
+    } else {
+      ACE_OS::unlink(path.c_str());
+    }
+  }
+  ACE_OS::rmdir(directory.c_str());
+}
+
+bool g_scratch_created = false;
+
+} // namespace
+
+State::State(unsigned long iterations, long arg, int threads, int thread_index)
+  : iterations_(iterations)
+  , done_(0)
+  , arg_(arg)
+  , threads_(threads)
+  , thread_index_(thread_index)
+  , running_(false)
+  , bytes_(0)
+  , items_(0)
+{
+}
+
+bool State::keep_running()
+{
+  if (done_ == 0 && !running_) {
+    running_ = true;
+    started_ = monotonic_now();
+  }
+  if (done_ < iterations_ && error_.empty()) {
+    ++done_;
+    return true;
+  }
+  pause_timing();
+  return false;
+}
+
+void State::pause_timing()
+{
+  if (running_) {
+    elapsed_ += monotonic_now() - started_;
+    running_ = false;
+  }
+}
+
+void State::resume_timing()
+{
+  if (!running_) {
+    running_ = true;
+    started_ = monotonic_now();
+  }
+}
+
+Benchmark::Benchmark(const std::string& name, Function function)
+  : name_(name)
+  , function_(function)
+{
+}
+
+Benchmark* Benchmark::arg(long value)
+{
+  args_.push_back(value);
+  return this;
+}
+
+Benchmark* Benchmark::range(long low, long high, long multiplier)
+{
+  for (long value = low; value < high; value *= multiplier) {
+    args_.push_back(value);
+  }
+  args_.push_back(high);
+  return this;
+}
+
+Benchmark* Benchmark::threads(int count)
+{
+  threads_.push_back(count);
+  return this;
+}
+
+std::vector<Benchmark*>& benchmarks()
+{
+  static std::vector<Benchmark*> registered;
+  return registered;
+}
+
+Benchmark* register_benchmark(const char* name, Function function)
+{
+  Benchmark* benchmark = new Benchmark(name, function);
+  benchmarks().push_back(benchmark);
+  return benchmark;
+}
+
+const std::string& scratch_directory()
+{
+  static std::string path;
+  if (path.empty()) {
+    const char* tmp = ACE_OS::getenv("TMPDIR");
+    std::ostringstream name;
+    name << (tmp && *tmp ? tmp : "/tmp") << "/dirshare-microbench." << ACE_OS::getpid();
+    path = name.str();
+    ACE_OS::mkdir(path.c_str());
+    g_scratch_created = true;
+  }
+  return path;
+}
+
+std::string file_corpus(size_t files, size_t file_size)
+{
+  std::ostringstream path;
+  path << scratch_directory() << "/corpus_" << files << "x" << file_size;
+  if (is_directory(path.str())) {
+    return path.str();
+  }
+
+  ACE_OS::mkdir(path.str().c_str());
+  std::vector<unsigned char> data(file_size);
+  char name[32];
+  for (size_t i = 0; i < files; ++i) {
+    for (size_t b = 0; b < file_size; ++b) {
+      data[b] = static_cast<unsigned char>((i * 131 + b * 7) & 0xFF);
+    }
+    ACE_OS::snprintf(name, sizeof(name), "/f%06lu.dat", static_cast<unsigned long>(i));
+    write_file(path.str() + name, data.empty() ? 0 : &data[0], data.size());
+  }
+  return path.str();
+}
+
+} // namespace Microbench
+} // namespace DirShare
+
+int ACE_TMAIN(int argc, ACE_TCHAR* argv[])
+{
+  using namespace DirShare::Microbench;
+
+  std::string filter;
+  std::string json;
+  std::string baseline_path;
+  double min_time = DEFAULT_MIN_TIME_SEC;
+  double tolerance = DEFAULT_TOLERANCE_PERCENT;
+  long repetitions = 1;
+  bool list = false;
+
+  ACE_Get_Opt get_opts(argc, argv, ACE_TEXT("hf:m:r:j:b:t:l"));
+  get_opts.long_option(ACE_TEXT("help"), 'h', ACE_Get_Opt::NO_ARG);
+  get_opts.long_option(ACE_TEXT("filter"), 'f', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("min-time"), 'm', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("repetitions"), 'r', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("json"), 'j', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("baseline"), 'b', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("tolerance"), 't', ACE_Get_Opt::ARG_REQUIRED);
+  get_opts.long_option(ACE_TEXT("list"), 'l', ACE_Get_Opt::NO_ARG);
+
+  int c;
+  while ((c = get_opts()) != -1) {
+    switch (c) {
+    case 'f':
+      filter = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+      break;
+    case 'm':
+      min_time = ACE_OS::strtod(ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()), 0);
+      if (min_time <= 0.0) {
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("ERROR: %N:%l: Invalid minimum time: %s\n"),
+                         get_opts.opt_arg()),
+                        1);
+      }
+      break;
+    case 'r':
+      repetitions = ACE_OS::strtol(ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()), 0, 10);
+      if (repetitions < 1 || repetitions > 100) {
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("ERROR: %N:%l: Invalid repetition count: %s\n"),
+                         get_opts.opt_arg()),
+                        1);
+      }
+      break;
+    case 'j':
+      json = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+      break;
+    case 'b':
+      baseline_path = ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg());
+      break;
+    case 't':
+      tolerance = ACE_OS::strtod(ACE_TEXT_ALWAYS_CHAR(get_opts.opt_arg()), 0);
+      if (tolerance <= 0.0) {
+        ACE_ERROR_RETURN((LM_ERROR,
+                         ACE_TEXT("ERROR: %N:%l: Invalid tolerance: %s\n"),
+                         get_opts.opt_arg()),
+                        1);
+      }
+      break;
+    case 'l':
+      list = true;
+      break;
+    case 'h':
+    default:
+      ACE_ERROR_RETURN((LM_ERROR,
+                       ACE_TEXT("Usage: %C [options]\n")
+                       ACE_TEXT("Options:\n")
+                       ACE_TEXT("  -h, --help              Show this help message\n")
+                       ACE_TEXT("  -f, --filter <text>     Only run benchmarks whose name contains text\n")
+                       ACE_TEXT("  -l, --list              List the benchmarks without running them\n")
+                       ACE_TEXT("  -m, --min-time <sec>    Minimum duration of a measurement (default 0.5)\n")
+                       ACE_TEXT("  -r, --repetitions <n>   Repeat each measurement, report the median (default 1)\n")
+                       ACE_TEXT("  -j, --json <file>       Write the results as JSON (usable as a baseline)\n")
+                       ACE_TEXT("  -b, --baseline <file>   Compare with a previous --json report; exit 2 when a\n")
+                       ACE_TEXT("                          benchmark is slower by more than the tolerance\n")
+                       ACE_TEXT("  -t, --tolerance <pct>   Allowed slowdown against the baseline (default 10)\n"),
+                       argv[0]),
+                      1);
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_path.empty() && !read_baseline(baseline_path, baseline)) {
+    return 1;
+  }
+
+  char header[256];
+  ACE_OS::snprintf(header, sizeof(header), "%-48s %12s %12s  %s\n",
+                   "Benchmark", "Time", "Iterations", "Throughput");
+  if (!list) {
+    std::cout << header << std::string(96, '-') << "\n";
+  }
+
+  std::vector<Result> results;
+  const std::vector<Benchmark*>& registered = benchmarks();
+  for (size_t b = 0; b < registered.size(); ++b) {
+    const Benchmark& benchmark = *registered[b];
+    const bool has_args = !benchmark.args().empty();
+    const bool has_threads = !benchmark.thread_counts().empty();
+    const std::vector<long> args = has_args ? benchmark.args() : std::vector<long>(1, 0);
+    const std::vector<int> threads =
+      has_threads ? benchmark.thread_counts() : std::vector<int>(1, 1);
+
+    for (size_t a = 0; a < args.size(); ++a) {
+      for (size_t t = 0; t < threads.size(); ++t) {
+        const std::string name = variant_name(benchmark, args[a], has_args, threads[t], has_threads);
+        if (!filter.empty() && name.find(filter) == std::string::npos) {
+          continue;
+        }
+        if (list) {
+          std::cout << name << "\n";
+          continue;
+        }
+        results.push_back(measure(benchmark, name, args[a], threads[t], min_time,
+                                  static_cast<int>(repetitions)));
+        std::cout << console_line(results.back()) << std::flush;
+      }
+    }
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (!results[i].error.empty()) {
+      status = 1;
+    }
+  }
+
+  if (!json.empty()) {
+    std::ofstream out(json.c_str(), std::ios::trunc);
+    out << json_report(results);
+    if (!out) {
+      ACE_ERROR((LM_ERROR,
+                 ACE_TEXT("ERROR: %N:%l: Cannot write %C\n"),
+                 json.c_str()));
+      status = 1;
+    }
+  }
+
+  if (!baseline.empty() && compare(results, baseline, tolerance) > 0 && status == 0) {
+    status = 2;
+  }
+
+  if (g_scratch_created) {
+    remove_tree(scratch_directory());
+  }
+  return status;
+}
@@ -0,0 +1,136 @@
+// Microbench.h
+// Minimal microbenchmark harness in the style of Google Benchmark:
+// registered functions time a loop, the runner scales the iteration count,
+// and results are compared against a saved baseline
+
+#ifndef DIRSHARE_MICROBENCH_H
+#define DIRSHARE_MICROBENCH_H
+
+#include <ace/Time_Value.h>
+
+#include <string>
+#include <vector>
+
+namespace DirShare {
+namespace Microbench {
+
+/**
+ * @class State
+ * @brief Loop control and counters of one benchmark run
+ *
+ * A benchmark does its setup, then runs the measured code in
+ *   while (state.keep_running()) { ... }
+ * Only the loop is timed; pause_timing()/resume_timing() exclude work
+ * inside it (e.g. modifying files between scans).
+ */
+class State {
+public:
+  State(unsigned long iterations, long arg, int threads, int thread_index);
+
+  /// Start the clock on the first call; false once the iterations are done
+  bool keep_running();
+
+  /// Argument of this run (see Benchmark::arg())
+  long arg() const { return arg_; }
+
+  /// Threads running the benchmark, and which one this is (0-based)
+  int threads() const { return threads_; }
+  int thread_index() const { return thread_index_; }
+
+  unsigned long iterations() const { return iterations_; }
+
+  void pause_timing();
+  void resume_timing();
+
+  /// Data handled by the whole run, for the throughput column
+  void set_bytes_processed(unsigned long long bytes) { bytes_ = bytes; }
+  void set_items_processed(unsigned long long items) { items_ = items; }
+
+  /// Abandon the run (the loop ends at the next keep_running())
+  void skip_with_error(const std::string& error) { error_ = error; }
+
+  ACE_Time_Value elapsed() const { return elapsed_; }
+  unsigned long long bytes_processed() const { return bytes_; }
+  unsigned long long items_processed() const { return items_; }
+  const std::string& error() const { return error_; }
+
+private:
+  unsigned long iterations_;
+  unsigned long done_;
+  long arg_;
+  int threads_;
+  int thread_index_;
+  bool running_;
+  ACE_Time_Value started_;
+  ACE_Time_Value elapsed_;
+  unsigned long long bytes_;
+  unsigned long long items_;
+  std::string error_;
+};
+
+typedef void (*Function)(State& state);
+
+/**
+ * @class Benchmark
+ * @brief A registered benchmark and the variants to run
+ *
+ * Each (argument, thread count) pair is one result, named like
+ * "crc32/4096" or "tracker_is_suppressed/threads:4".
+ */
+class Benchmark {
+public:
+  Benchmark(const std::string& name, Function function);
+
+  /// Run once with this argument (repeatable)
+  Benchmark* arg(long value);
+
+  /// Arguments low, low * multiplier, ... up to high (and high itself)
+  Benchmark* range(long low, long high, long multiplier = 8);
+
+  /// Run with this many concurrent threads (repeatable)
+  Benchmark* threads(int count);
+
+  const std::string& name() const { return name_; }
+  Function function() const { return function_; }
+  const std::vector<long>& args() const { return args_; }
+  const std::vector<int>& thread_counts() const { return threads_; }
+
+private:
+  std::string name_;
+  Function function_;
+  std::vector<long> args_;
+  std::vector<int> threads_;
+};
+
+/// Add a benchmark to the suite (see DIRSHARE_MICROBENCH)
+Benchmark* register_benchmark(const char* name, Function function);
+
+/// Every registered benchmark, in registration order
+std::vector<Benchmark*>& benchmarks();
+
+/**
+ * Directory of n files of a given size, created on first use under the
+ * scratch directory and shared by the benchmarks (removed at exit)
+ * Files are named f000000.dat, f000001.dat, ...
+ * @return Path of the directory
+ */
+std::string file_corpus(size_t files, size_t file_size);
+
+/// Private directory for files of the benchmarks (removed at exit)
+const std::string& scratch_directory();
+
+} // namespace Microbench
+} // namespace DirShare
+
+#define DIRSHARE_MICROBENCH_CONCAT(a, b) a##b
+
+/**
+ * Register a benchmark function; variants are chained, e.g.
+ *   DIRSHARE_MICROBENCH(crc32)->range(64, 16 << 20);
+ */
+#define DIRSHARE_MICROBENCH(function)                                       \
+  static DirShare::Microbench::Benchmark* const                             \
+    DIRSHARE_MICROBENCH_CONCAT(microbench_, function) =                     \
+      DirShare::Microbench::register_benchmark(#function, function)
+
+#endif // DIRSHARE_MICROBENCH_H
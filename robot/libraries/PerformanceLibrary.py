@@ -0,0 +1,285 @@
+"""
+PerformanceLibrary - Robot Framework library for DirShare performance tests.
+
+This library measures how long participants take to hold identical copies
+of a source directory, checks each measurement against its service level
+objective (SLO) and appends the results of a suite run to a JSON history
+file for trending:
+- Atomic file creation and modification (staged, then renamed into place)
+- Polling until copies match the source (size, then CRC32)
+- SLO checks that record failures as well as passes
+- History file with one entry per suite run
+
+Feature: 001-dirshare success criteria SC-001, SC-002, SC-003, SC-006
+"""
+
+import json
+import os
+import random
+import shutil
+import socket
+import subprocess
+import tempfile
+import time
+import zlib
+from typing import Dict, List, Optional
+
+
+class PerformanceLibrary:
+    """
+    Robot Framework library for timing DirShare synchronization.
+
+    Measurements accumulate over the suite and are written to the history
+    file by Write Performance History, usually from the suite teardown.
+    """
+
+    ROBOT_LIBRARY_SCOPE = 'SUITE'
+    ROBOT_LIBRARY_VERSION = '1.0'
+
+    POLL_INTERVAL = 0.05    # Seconds between checks of the copies
+    BLOCK_SIZE = 1024 * 1024
+
+    def __init__(self, history_file: str = "results/performance_history.json",
+                 history_limit: int = 500):
+        """
+        Initialize the PerformanceLibrary.
+
+        Args:
+            history_file: JSON file the suite runs are appended to
+            history_limit: Runs kept in the history file (oldest dropped first)
+        """
+        self.history_file = history_file
+        self.history_limit = int(history_limit)
+        self.measurements: List[dict] = []
+        self.started = time.time()
+        self.staging = tempfile.mkdtemp(prefix="dirshare_perf_staging_")
+
+    def _content(self, size: int, seed: int):
+        """Yield reproducible blocks of content, distinct for each seed."""
+        generator = random.Random(seed)
+        remaining = size
+        while remaining > 0:
+            block = min(remaining, self.BLOCK_SIZE)
+            yield generator.getrandbits(8 * block).to_bytes(block, 'little')
+            remaining -= block
+
+    def _checksum(self, filepath: str) -> Optional[int]:
+        """CRC32 of a file as DirShare computes it; None if unreadable."""
+        crc = 0
+        try:
+            with open(filepath, 'rb') as f:
+                while True:
+                    chunk = f.read(self.BLOCK_SIZE)
+                    if not chunk:
+                        break
+                    crc = zlib.crc32(chunk, crc)
+        except OSError:
+            return None
+        return crc & 0xFFFFFFFF
+
+    def get_timestamp(self) -> float:
+        """Return the current time in seconds since the epoch, with fractions."""
+        return time.time()
+
+    def write_file(self, directory: str, filename: str, size: int, seed: int = 0) -> float:
+        """
+        Create or replace a file atomically with reproducible content.
+
+        The content is written to a staging directory and renamed into place,
+        so participants never see a partial file.
+
+        Args:
+            directory: Shared directory of the writing participant
+            filename: Name of the file
+            size: Size in bytes
+            seed: Content seed (a different seed gives different content)
+
+        Returns:
+            Time of the change (seconds since the epoch)
+        """
+        staged = os.path.join(self.staging, filename)
+        with open(staged, 'wb') as f:
+            for block in self._content(int(size), int(seed)):
+                f.write(block)
+        os.replace(staged, os.path.join(directory, filename))
+        return time.time()
+
+    def create_files(self, directory: str, count: int, size: int,
+                     prefix: str = "file", seed: int = 0) -> List[str]:
+        """
+        Create many files with distinct content.
+
+        Args:
+            directory: Directory to create the files in
+            count: Number of files
+            size: Size of each file in bytes
+            prefix: File name prefix (names are <prefix>_00000.dat, ...)
+            seed: Base content seed
+
+        Returns:
+            Names of the created files
+        """
+        names = []
+        for i in range(int(count)):
+            name = f"{prefix}_{i:05d}.dat"
+            self.write_file(directory, name, size, int(seed) + i)
+            names.append(name)
+        print(f"Created {len(names)} files of {size} bytes in {directory}")
+        return names
+
+    def measure_sync(self, source_directory: str, *target_directories: str,
+                     since: Optional[float] = None, timeout: float = 60,
+                     files: Optional[List[str]] = None) -> Optional[float]:
+        """
+        Wait until every target holds the source files, and time it.
+
+        Args:
+            source_directory: Directory holding the reference files
+            target_directories: Directories that must receive copies
+            since: Start of the measurement (default: now)
+            timeout: Seconds to wait, counted from the call
+            files: File names to check (default: every file of the source)
+
+        Returns:
+            Seconds from since until the last copy matched, or None if the
+            copies did not all match within the timeout
+        """
+        start = time.time() if since is None else float(since)
+        if files is None:
+            files = [name for name in os.listdir(source_directory)
+                     if not name.startswith('.') and
+                     os.path.isfile(os.path.join(source_directory, name))]
+
+        expected: Dict[str, tuple] = {}
+        for name in files:
+            path = os.path.join(source_directory, name)
+            expected[name] = (os.path.getsize(path), self._checksum(path))
+
+        pending = {target: set(expected) for target in target_directories}
+        deadline = time.time() + float(timeout)
+        while True:
+            for target, names in pending.items():
+                for name in list(names):
+                    path = os.path.join(target, name)
+                    size, checksum = expected[name]
+                    try:
+                        if os.path.getsize(path) != size:
+                            continue
+                    except OSError:
+                        continue
+                    if self._checksum(path) == checksum:
+                        names.discard(name)
+            if not any(pending.values()):
+                elapsed = time.time() - start
+                print(f"{len(expected)} files copied to {len(pending)} directories "
+                      f"in {elapsed:.3f} s")
+                return elapsed
+            if time.time() >= deadline:
+                missing = sum(len(names) for names in pending.values())
+                print(f"Timed out after {timeout} s: {missing} copies missing or different")
+                return None
+            time.sleep(self.POLL_INTERVAL)
+
+    def summarize_samples(self, samples: List[float]) -> Dict[str, Optional[float]]:
+        """
+        Summarize repeated measurements.
+
+        Args:
+            samples: Measured seconds (None for samples that timed out)
+
+        Returns:
+            Dictionary with p50 and max (None if any sample timed out)
+        """
+        if not samples or any(sample is None for sample in samples):
+            return {'p50': None, 'max': None}
+        ordered = sorted(float(sample) for sample in samples)
+        return {'p50': ordered[(len(ordered) - 1) // 2], 'max': ordered[-1]}
+
+    def check_slo(self, name: str, value: Optional[float], threshold: Optional[float] = None,
+                  unit: str = "s"):
+        """
+        Record a measurement and fail if it exceeds its threshold.
+
+        A measurement that did not complete (None) fails and is recorded as
+        null. Without a threshold the measurement is recorded only.
+
+        Args:
+            name: Measurement name, stable across runs (e.g. initial_sync_100)
+            value: Measured value
+            threshold: Largest acceptable value
+            unit: Unit of value and threshold
+        """
+        value = None if value is None else float(value)
+        threshold = None if threshold in (None, '', 'None') else float(threshold)
+        passed = value is not None and (threshold is None or value <= threshold)
+        self.measurements.append({
+            'name': name,
+            'value': None if value is None else round(value, 3),
+            'unit': unit,
+            'threshold': threshold,
+            'passed': passed,
+        })
+
+        if value is None:
+            raise AssertionError(f"{name}: did not complete")
+        if not passed:
+            raise AssertionError(f"{name}: {value:.3f} {unit} exceeds the SLO of {threshold} {unit}")
+        print(f"{name}: {value:.3f} {unit}" +
+              ("" if threshold is None else f" (SLO {threshold} {unit})"))
+
+    def _git_commit(self) -> Optional[str]:
+        """Commit of the DirShare tree under test, if it is a git checkout."""
+        try:
+            result = subprocess.run(
+                ["git", "rev-parse", "--short", "HEAD"],
+                cwd=os.path.dirname(os.path.abspath(__file__)),
+                capture_output=True, text=True, timeout=5)
+        except (OSError, subprocess.TimeoutExpired):
+            return None
+        if result.returncode != 0:
+            return None
+        return result.stdout.strip() or None
+
+    def write_performance_history(self, **context) -> str:
+        """
+        Append this suite run to the history file.
+
+        Args:
+            context: Extra fields for the run (e.g. impairments=delay=40ms)
+
+        Returns:
+            Path of the history file
+        """
+        shutil.rmtree(self.staging, ignore_errors=True)
+        if not self.measurements:
+            print("No measurements recorded; history not written")
+            return self.history_file
+
+        history = {'runs': []}
+        if os.path.exists(self.history_file):
+            try:
+                with open(self.history_file) as f:
+                    history = json.load(f)
+            except (OSError, ValueError) as e:
+                print(f"Warning: Starting a new history, cannot read {self.history_file}: {e}")
+
+        run = {
+            'timestamp': int(self.started),
+            'hostname': socket.gethostname(),
+            'commit': self._git_commit(),
+            'duration': round(time.time() - self.started, 1),
+        }
+        run.update(context)
+        run['measurements'] = self.measurements
+        history['runs'] = (history.get('runs', []) + [run])[-self.history_limit:]
+
+        directory = os.path.dirname(self.history_file)
+        if directory:
+            os.makedirs(directory, exist_ok=True)
+        staged = self.history_file + ".tmp"
+        with open(staged, 'w') as f:
+            json.dump(history, f, indent=2)
+            f.write("\n")
+        os.replace(staged, self.history_file)
+        print(f"Appended {len(self.measurements)} measurements to {self.history_file}")
+        return self.history_file
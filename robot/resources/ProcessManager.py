@@ -7,6 +7,7 @@ capabilities needed for robustness testing, including:
 - Force kill (SIGKILL)
 - Process monitoring and status checking
 - Restart orchestration
+- Fault injection (dirshare-netem proxy with delay, loss and bandwidth caps)
 
 This complements DirShareLibrary by providing lower-level process management
 for shutdown/restart test scenarios.
@@ -19,6 +20,7 @@ import os
 import subprocess
 import signal
 import time
+import re
 import psutil
 from typing import Dict, Optional, List
 from pathlib import Path
@@ -40,6 +42,7 @@ class ProcessManager:
         self.processes: Dict[str, subprocess.Popen] = {}
         self.process_info: Dict[str, dict] = {}  # Store additional process metadata
         self.dirshare_exe = self._find_dirshare_executable()
+        self.fault_proxy: Optional[subprocess.Popen] = None
 
     def _find_dirshare_executable(self) -> str:
         """
@@ -298,9 +301,76 @@ class ProcessManager:
         process = self.processes[label]
         return process.poll()
 
+    def start_fault_proxy(self, impairments: str = "", port: int = 7600) -> int:
+        """
+        Start dirshare-netem, relaying participants started with rtps_netem.ini.
+
+        Start it before the participants, so discovery goes through it.
+
+        Args:
+            impairments: e.g. "delay=40ms,jitter=10ms,loss=1%,rate=10mbit"
+                         (empty: relay without impairments)
+            port: First of the SPDP, SEDP and data ports (rtps_netem.ini uses 7600)
+
+        Returns:
+            Process ID (PID) of the proxy
+
+        Raises:
+            RuntimeError: If the proxy fails to start
+        """
+        if self.fault_proxy and self.fault_proxy.poll() is None:
+            raise RuntimeError("Fault proxy is already running")
+
+        netem_exe = os.path.join(os.path.dirname(self.dirshare_exe), "dirshare-netem")
+        if not os.access(netem_exe, os.X_OK):
+            raise RuntimeError(f"dirshare-netem not found: {netem_exe}")
+
+        cmd = [netem_exe, "-p", str(port)]
+        if impairments:
+            cmd.append(impairments)
+        print(f"Starting fault proxy: {' '.join(cmd)}")
+
+        self.fault_proxy = subprocess.Popen(
+            cmd,
+            stdout=subprocess.PIPE,
+            stderr=open("dirshare_netem.log", "w"),
+            text=True
+        )
+        time.sleep(0.5)
+        if self.fault_proxy.poll() is not None:
+            raise RuntimeError(f"Fault proxy terminated unexpectedly (exit code: {self.fault_proxy.returncode})")
+        return self.fault_proxy.pid
+
+    def stop_fault_proxy(self) -> Dict[str, int]:
+        """
+        Stop dirshare-netem and return its counters.
+
+        Returns:
+            Dictionary with forwarded, lost and overflowed datagram counts
+            (empty if no proxy was running)
+        """
+        if not self.fault_proxy:
+            return {}
+
+        self.fault_proxy.send_signal(signal.SIGINT)
+        try:
+            output, _ = self.fault_proxy.communicate(timeout=5)
+        except subprocess.TimeoutExpired:
+            self.fault_proxy.kill()
+            output, _ = self.fault_proxy.communicate()
+        self.fault_proxy = None
+
+        counters = {}
+        lines = output.strip().splitlines()
+        if lines:
+            for name, value in re.findall(r"(forwarded|lost|overflowed) (\d+)", lines[-1]):
+                counters[name] = int(value)
+        print(f"Fault proxy stopped: {counters}")
+        return counters
+
     def cleanup_all(self):
         """
-        Stop all managed participant processes.
+        Stop all managed participant processes and the fault proxy.
 
         This is typically called in test teardown to ensure clean state.
         """
@@ -308,6 +378,7 @@ class ProcessManager:
             if self.is_running(label):
                 print(f"Stopping participant {label} during cleanup")
                 self.shutdown_participant(label)
+        self.stop_fault_proxy()
 
 
 # Expose ProcessManager as the library interface for Robot Framework
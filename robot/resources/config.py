@@ -33,6 +33,8 @@ DEFAULT_CONTENT_SEED = 42     # Default seed for content generation
 # DirShare configuration
 DIRSHARE_EXECUTABLE = './dirshare'
 RTPS_CONFIG = 'rtps.ini'
+NETEM_CONFIG = 'rtps_netem.ini'   # Participants behind the dirshare-netem fault proxy
+NETEM_PORT = 7600                 # First port of the proxy, as rtps_netem.ini expects
 
 # Test directory parameters
 TEST_DIR_PREFIX = 'dirshare_robustness_test'
@@ -0,0 +1,193 @@
+#define BOOST_TEST_MODULE AsyncLogTest
+#include <boost/test/included/unit_test.hpp>
+
+// As in a production build: DEBUG statements are compiled out
+#define DIRSHARE_LOG_LEVEL DIRSHARE_LOG_LEVEL_INFO
+#include "../Log.h"
+
+#include <ace/OS_NS_unistd.h>
+#include <ace/Task.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> lines;
+
+// Called with the write lock held, so never concurrently
+void capture(ACE_Log_Priority, const char* text)
+{
+  lines.push_back(text);
+}
+
+int evaluations = 0;
+
+int evaluated()
+{
+  return ++evaluations;
+}
+
+struct CaptureOutput {
+  CaptureOutput()
+  {
+    lines.clear();
+    DirShare::AsyncLog::instance().output(capture);
+    DirShare::AsyncLog::instance().rate_interval(ACE_Time_Value(1, 0));
+  }
+
+  ~CaptureOutput()
+  {
+    DirShare::AsyncLog::instance().stop();
+    DirShare::AsyncLog::instance().output(0);
+  }
+};
+
+// Logs numbered messages from several threads
+class Logger : public ACE_Task_Base {
+public:
+  virtual int svc()
+  {
+    for (int i = 0; i < MESSAGES; ++i) {
+      DIRSHARE_INFO(("message %d\n", i));
+    }
+    return 0;
+  }
+
+  enum { THREADS = 4, MESSAGES = 200 };
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(AsyncLogTestSuite, CaptureOutput)
+
+// Test: Before start() messages are written at once, with pid and thread
+BOOST_AUTO_TEST_CASE(test_synchronous_before_start)
+{
+  DIRSHARE_INFO(("Received %s (%u bytes)\n", "a.txt", 42u));
+
+  BOOST_REQUIRE_EQUAL(lines.size(), 1u);
+  BOOST_CHECK_EQUAL(lines[0].compare(0, 1, "("), 0);
+  BOOST_CHECK(lines[0].find("|") != std::string::npos);
+  BOOST_CHECK(lines[0].find(") Received a.txt (42 bytes)\n") != std::string::npos);
+}
+
+// Test: Statements below the compile-time level do not evaluate their arguments
+BOOST_AUTO_TEST_CASE(test_compiled_out)
+{
+  evaluations = 0;
+  DIRSHARE_DEBUG(("not compiled %d\n", evaluated()));
+  DIRSHARE_DEBUG_EVERY("key", ("not compiled %d\n", evaluated()));
+  BOOST_CHECK_EQUAL(evaluations, 0);
+  BOOST_CHECK(lines.empty());
+}
+
+// Test: A priority disabled in ACE_Log_Msg skips the formatting
+BOOST_AUTO_TEST_CASE(test_runtime_priority_mask)
+{
+  evaluations = 0;
+  const unsigned long mask = ACE_LOG_MSG->priority_mask(0, ACE_Log_Msg::PROCESS);
+  ACE_LOG_MSG->priority_mask(mask & ~LM_INFO, ACE_Log_Msg::PROCESS);
+  DIRSHARE_INFO(("disabled %d\n", evaluated()));
+  ACE_LOG_MSG->priority_mask(mask, ACE_Log_Msg::PROCESS);
+
+  BOOST_CHECK_EQUAL(evaluations, 0);
+  BOOST_CHECK(lines.empty());
+}
+
+// Test: One message per key and interval; the next one counts the others
+BOOST_AUTO_TEST_CASE(test_rate_limit_per_key)
+{
+  DirShare::AsyncLog& log = DirShare::AsyncLog::instance();
+  log.rate_interval(ACE_Time_Value(0, 200000));
+  const unsigned long long limited = log.rate_limited();
+
+  for (unsigned int i = 1; i <= 10; ++i) {
+    DIRSHARE_INFO_EVERY("big.bin", ("progress of big.bin: %u/10\n", i));
+    DIRSHARE_INFO_EVERY("small.txt", ("progress of small.txt: %u/10\n", i));
+  }
+  BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+  BOOST_CHECK(lines[0].find("big.bin: 1/10\n") != std::string::npos);
+  BOOST_CHECK(lines[1].find("small.txt: 1/10\n") != std::string::npos);
+  BOOST_CHECK_EQUAL(log.rate_limited() - limited, 18u);
+
+  ACE_OS::sleep(ACE_Time_Value(0, 250000));
+  DIRSHARE_INFO_EVERY("big.bin", ("progress of big.bin: %u/10\n", 11u));
+  BOOST_REQUIRE_EQUAL(lines.size(), 3u);
+  BOOST_CHECK(lines[2].find("big.bin: 11/10 [9 similar suppressed]\n") != std::string::npos);
+}
+
+// Test: Once started, messages are queued and all written by stop(), in order per thread
+BOOST_AUTO_TEST_CASE(test_asynchronous_writer)
+{
+  DirShare::AsyncLog& log = DirShare::AsyncLog::instance();
+  BOOST_REQUIRE(log.start(ACE_Time_Value(0, 20000), 1024));
+  const unsigned long long written = log.written();
+
+  Logger logger;
+  logger.activate(THR_NEW_LWP | THR_JOINABLE, Logger::THREADS);
+  logger.wait();
+  log.stop();
+
+  BOOST_CHECK_EQUAL(log.written() - written, static_cast<unsigned long long>(Logger::THREADS * Logger::MESSAGES));
+  BOOST_REQUIRE_EQUAL(lines.size(), static_cast<size_t>(Logger::THREADS * Logger::MESSAGES));
+
+  // Each thread's messages appear in the order it logged them
+  std::vector<std::string> prefixes;
+  std::vector<int> next;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const std::string prefix = lines[i].substr(0, lines[i].find(')'));
+    int number = -1;
+    std::sscanf(lines[i].c_str() + prefix.size(), ") message %d", &number);
+    size_t t = 0;
+    while (t < prefixes.size() && prefixes[t] != prefix) {
+      ++t;
+    }
+    if (t == prefixes.size()) {
+      prefixes.push_back(prefix);
+      next.push_back(0);
+    }
+    BOOST_CHECK_EQUAL(number, next[t]);
+    next[t] = number + 1;
+  }
+  BOOST_CHECK_EQUAL(prefixes.size(), static_cast<size_t>(Logger::THREADS));
+}
+
+// Test: Messages logged while stop() runs are all written, queued or not
+BOOST_AUTO_TEST_CASE(test_stop_while_logging)
+{
+  DirShare::AsyncLog& log = DirShare::AsyncLog::instance();
+  BOOST_REQUIRE(log.start(ACE_Time_Value(0, 20000), 1024));
+  const unsigned long long dropped = log.dropped();
+  log.flush();
+  lines.clear();
+
+  Logger logger;
+  logger.activate(THR_NEW_LWP | THR_JOINABLE, Logger::THREADS);
+  log.stop();
+  logger.wait();
+
+  BOOST_CHECK_EQUAL(log.dropped(), dropped);
+  BOOST_CHECK_EQUAL(lines.size(), static_cast<size_t>(Logger::THREADS * Logger::MESSAGES));
+}
+
+// Test: A full thread buffer drops messages rather than blocking
+BOOST_AUTO_TEST_CASE(test_full_buffer_drops)
+{
+  DirShare::AsyncLog& log = DirShare::AsyncLog::instance();
+  BOOST_REQUIRE(log.start(ACE_Time_Value(60, 0), 8));
+  const unsigned long long dropped = log.dropped();
+  log.flush();
+  lines.clear();
+
+  for (int i = 0; i < 20; ++i) {
+    DIRSHARE_INFO(("queued %d\n", i));
+  }
+  log.stop();
+
+  BOOST_CHECK_EQUAL(lines.size() + (log.dropped() - dropped), 20u);
+  BOOST_CHECK(log.dropped() - dropped >= 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
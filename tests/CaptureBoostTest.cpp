@@ -0,0 +1,287 @@
+#define BOOST_TEST_MODULE CaptureTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Capture.h"
+#include "../Checksum.h"
+#include "../FileUtils.h"
+#include "../FileChangeTracker.h"
+#include "../ContentIndex.h"
+#include "../FileContentListenerImpl.h"
+#include <ace/OS_NS_stdio.h>
+#include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const CAPTURE_FILE = "test_capture.dscap";
+
+DirShare::FileContent make_content(const std::string& filename, const std::string& text)
+{
+  DirShare::FileContent content;
+  content.filename = filename.c_str();
+  content.data.length(static_cast<CORBA::ULong>(text.size()));
+  std::memcpy(content.data.get_buffer(), text.data(), text.size());
+  content.size = text.size();
+  content.checksum = DirShare::compute_checksum(
+    reinterpret_cast<const uint8_t*>(text.data()), text.size());
+  content.timestamp_sec = 1700000000;
+  content.timestamp_nsec = 123456789;
+  content.origin.event_id = 0x0000000700000009ULL;
+  content.origin.detect_sec = 1700000001;
+  content.origin.detect_nsec = 5;
+  content.origin.scan_delay_usec = 1500;
+  content.origin.queue_usec = 20;
+  return content;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(CaptureTestSuite)
+
+// Test: Nothing is recorded until the capture is opened
+BOOST_AUTO_TEST_CASE(test_disabled)
+{
+  DirShare::SampleCapture& capture = DirShare::SampleCapture::instance();
+  BOOST_CHECK(!capture.enabled());
+  capture.record(make_content("ignored.txt", "x"));
+  BOOST_CHECK_EQUAL(capture.records(), 0u);
+}
+
+// Test: Every record type reads back with its fields, in order
+BOOST_AUTO_TEST_CASE(test_round_trip)
+{
+  DirShare::SampleCapture& capture = DirShare::SampleCapture::instance();
+  BOOST_REQUIRE(capture.open(CAPTURE_FILE));
+
+  DirShare::FileEvent event;
+  event.filename = "dir/a.txt";
+  event.operation = DirShare::MODIFY;
+  event.timestamp_sec = 1700000000;
+  event.timestamp_nsec = 42;
+  event.metadata.filename = "dir/a.txt";
+  event.metadata.size = 5;
+  event.metadata.checksum = 0xDEADBEEF;
+  event.origin.event_id = 77;
+  capture.record(event);
+
+  capture.record(make_content("dir/a.txt", "hello"));
+
+  DirShare::TransferOpen open;
+  open.session_id = 0x1122334455667788ULL;
+  open.filename = "big.bin";
+  open.file_size = 3 * 1024 * 1024;
+  open.file_checksum = 0xCAFEF00D;
+  open.chunk_size = 1024 * 1024;
+  open.total_chunks = 3;
+  open.timestamp_sec = 1;
+  open.timestamp_nsec = 2;
+  open.holes.length(1);
+  open.holes[0].first_chunk = 1;
+  open.holes[0].count = 1;
+  open.fec_data_chunks = 16;
+  open.fec_repair_chunks = 2;
+  capture.record_open(open, false);
+  capture.record_open(open, true);
+
+  DirShare::FileChunk chunk;
+  chunk.session_id = open.session_id;
+  chunk.filename = "big.bin";
+  chunk.file_size = open.file_size;
+  chunk.offset = 2 * 1024 * 1024;
+  chunk.data.length(3);
+  chunk.data[0] = 1;
+  chunk.data[1] = 2;
+  chunk.data[2] = 3;
+  chunk.chunk_checksum = 99;
+  capture.record(chunk);
+
+  DirShare::FecChunk fec_chunk;
+  fec_chunk.session_id = open.session_id;
+  fec_chunk.filename = "big.bin";
+  fec_chunk.file_size = open.file_size;
+  fec_chunk.group = 4;
+  fec_chunk.index = 17;
+  fec_chunk.data.length(0);
+  fec_chunk.chunk_checksum = 0;
+  capture.record(fec_chunk);
+
+  capture.record_session_end(DirShare::CAPTURE_CHUNKS_ENDED, open.session_id);
+  capture.record_session_end(DirShare::CAPTURE_OPEN_DISPOSED, open.session_id);
+
+  DirShare::DirectorySnapshot snapshot;
+  snapshot.participant_id = "peer-1";
+  snapshot.files.length(2);
+  snapshot.files[0].filename = "a.txt";
+  snapshot.files[0].size = 1;
+  snapshot.files[1].filename = "b.txt";
+  snapshot.files[1].size = 2;
+  snapshot.snapshot_time_sec = 10;
+  snapshot.snapshot_time_nsec = 11;
+  snapshot.file_count = 2;
+  capture.record(snapshot);
+
+  BOOST_CHECK_EQUAL(capture.records(), 9u);
+  capture.close();
+  BOOST_CHECK(!capture.enabled());
+
+  DirShare::CaptureReader reader;
+  BOOST_REQUIRE(reader.open(CAPTURE_FILE));
+  DirShare::CaptureRecord record;
+  unsigned long long last_time = 0;
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_FILE_EVENT);
+  BOOST_CHECK_EQUAL(std::string(record.event.filename.in()), "dir/a.txt");
+  BOOST_CHECK_EQUAL(record.event.operation, DirShare::MODIFY);
+  BOOST_CHECK_EQUAL(record.event.timestamp_nsec, 42u);
+  BOOST_CHECK_EQUAL(record.event.metadata.checksum, 0xDEADBEEFu);
+  BOOST_CHECK_EQUAL(record.event.origin.event_id, 77u);
+  last_time = record.time_usec;
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_FILE_CONTENT);
+  BOOST_CHECK_EQUAL(record.content.data.length(), 5u);
+  BOOST_CHECK(std::memcmp(record.content.data.get_buffer(), "hello", 5) == 0);
+  BOOST_CHECK_EQUAL(record.content.timestamp_nsec, 123456789u);
+  BOOST_CHECK_EQUAL(record.content.origin.event_id, 0x0000000700000009ULL);
+  BOOST_CHECK_EQUAL(record.content.origin.scan_delay_usec, 1500u);
+  BOOST_CHECK(record.time_usec >= last_time);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_TRANSFER_OPEN);
+  BOOST_CHECK_EQUAL(record.open.session_id, 0x1122334455667788ULL);
+  BOOST_CHECK_EQUAL(record.open.total_chunks, 3u);
+  BOOST_REQUIRE_EQUAL(record.open.holes.length(), 1u);
+  BOOST_CHECK_EQUAL(record.open.holes[0].first_chunk, 1u);
+  BOOST_CHECK_EQUAL(record.open.fec_data_chunks, 16);
+  BOOST_CHECK_EQUAL(record.open.fec_repair_chunks, 2);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_PULL_OPEN);
+  BOOST_CHECK_EQUAL(std::string(record.open.filename.in()), "big.bin");
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_FILE_CHUNK);
+  BOOST_CHECK_EQUAL(std::string(record.chunk.filename.in()), "big.bin");
+  BOOST_CHECK_EQUAL(record.chunk.file_size, 3u * 1024 * 1024);
+  BOOST_CHECK_EQUAL(record.chunk.offset, 2u * 1024 * 1024);
+  BOOST_REQUIRE_EQUAL(record.chunk.data.length(), 3u);
+  BOOST_CHECK_EQUAL(record.chunk.data[2], 3);
+  BOOST_CHECK_EQUAL(record.chunk.chunk_checksum, 99u);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_FEC_CHUNK);
+  BOOST_CHECK_EQUAL(std::string(record.fec_chunk.filename.in()), "big.bin");
+  BOOST_CHECK_EQUAL(record.fec_chunk.group, 4u);
+  BOOST_CHECK_EQUAL(record.fec_chunk.index, 17);
+  BOOST_CHECK_EQUAL(record.fec_chunk.data.length(), 0u);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_CHUNKS_ENDED);
+  BOOST_CHECK_EQUAL(record.session_id, 0x1122334455667788ULL);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_OPEN_DISPOSED);
+
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(record.type, DirShare::CAPTURE_DIRECTORY_SNAPSHOT);
+  BOOST_CHECK_EQUAL(std::string(record.snapshot.participant_id.in()), "peer-1");
+  BOOST_REQUIRE_EQUAL(record.snapshot.files.length(), 2u);
+  BOOST_CHECK_EQUAL(std::string(record.snapshot.files[1].filename.in()), "b.txt");
+  BOOST_CHECK_EQUAL(record.snapshot.file_count, 2u);
+
+  BOOST_CHECK_EQUAL(reader.next(record), 0);
+
+  ACE_OS::unlink(CAPTURE_FILE);
+}
+
+// Test: A record cut short ends the capture after the complete ones
+BOOST_AUTO_TEST_CASE(test_truncated)
+{
+  DirShare::SampleCapture& capture = DirShare::SampleCapture::instance();
+  BOOST_REQUIRE(capture.open(CAPTURE_FILE));
+  capture.record(make_content("a.txt", "first"));
+  capture.record(make_content("b.txt", "second record"));
+  capture.close();
+
+  std::vector<unsigned char> data;
+  BOOST_REQUIRE(DirShare::read_file(CAPTURE_FILE, data));
+  BOOST_REQUIRE(DirShare::write_file(CAPTURE_FILE, &data[0], data.size() - 4));
+
+  DirShare::CaptureReader reader;
+  BOOST_REQUIRE(reader.open(CAPTURE_FILE));
+  DirShare::CaptureRecord record;
+  BOOST_CHECK_EQUAL(reader.next(record), 1);
+  BOOST_CHECK_EQUAL(std::string(record.content.filename.in()), "a.txt");
+  BOOST_CHECK_EQUAL(reader.next(record), 0);
+
+  ACE_OS::unlink(CAPTURE_FILE);
+}
+
+// Test: Files other than captures are rejected, as are malformed records
+BOOST_AUTO_TEST_CASE(test_invalid)
+{
+  const unsigned char text[] = "not a capture file at all";
+  BOOST_REQUIRE(DirShare::write_file(CAPTURE_FILE, text, sizeof(text)));
+  DirShare::CaptureReader reader;
+  BOOST_CHECK(!reader.open(CAPTURE_FILE));
+
+  // A snapshot claiming more entries than its payload holds
+  DirShare::SampleCapture& capture = DirShare::SampleCapture::instance();
+  BOOST_REQUIRE(capture.open(CAPTURE_FILE));
+  DirShare::DirectorySnapshot snapshot;
+  snapshot.participant_id = "p";
+  snapshot.files.length(0);
+  capture.record(snapshot);
+  capture.close();
+
+  std::vector<unsigned char> data;
+  BOOST_REQUIRE(DirShare::read_file(CAPTURE_FILE, data));
+  // Header (24) + record header (13) + participant id (4 + 1): file count
+  data[24 + 13 + 5] = 0xFF;
+  BOOST_REQUIRE(DirShare::write_file(CAPTURE_FILE, &data[0], data.size()));
+
+  DirShare::CaptureReader bad_reader;
+  BOOST_REQUIRE(bad_reader.open(CAPTURE_FILE));
+  DirShare::CaptureRecord record;
+  BOOST_CHECK_EQUAL(bad_reader.next(record), -1);
+
+  ACE_OS::unlink(CAPTURE_FILE);
+}
+
+// Test: A recorded FileContent replayed into the listener writes the file
+BOOST_AUTO_TEST_CASE(test_replay_content)
+{
+  const std::string directory = "test_capture_replay";
+  ACE_OS::mkdir(directory.c_str());
+
+  DirShare::SampleCapture& capture = DirShare::SampleCapture::instance();
+  BOOST_REQUIRE(capture.open(CAPTURE_FILE));
+  capture.record(make_content("replayed.txt", "replayed content"));
+  capture.close();
+
+  DirShare::FileChangeTracker tracker;
+  DirShare::ContentIndex index;
+  DirShare::FileContentListenerImpl* listener =
+    new DirShare::FileContentListenerImpl(directory, tracker, index);
+  DDS::DataReaderListener_var owner = listener;
+
+  DirShare::CaptureReader reader;
+  BOOST_REQUIRE(reader.open(CAPTURE_FILE));
+  DirShare::CaptureRecord record;
+  BOOST_REQUIRE_EQUAL(reader.next(record), 1);
+  listener->process_file_content(record.content);
+
+  std::vector<unsigned char> data;
+  BOOST_REQUIRE(DirShare::read_file(directory + "/replayed.txt", data));
+  BOOST_CHECK_EQUAL(std::string(data.begin(), data.end()), "replayed content");
+
+  ACE_OS::unlink((directory + "/replayed.txt").c_str());
+  ACE_OS::rmdir(directory.c_str());
+  ACE_OS::unlink(CAPTURE_FILE);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <ace/OS_NS_unistd.h>
 #include <fstream>
 #include <cstring>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(ChecksumTestSuite)
 
@@ -122,4 +123,24 @@ BOOST_AUTO_TEST_CASE(test_crc32_incremental_edge_cases)
   BOOST_CHECK_EQUAL(full_crc, inc_crc);
 }
 
+// Test: zero runs (sparse file holes) match the byte-wise CRC
+BOOST_AUTO_TEST_CASE(test_crc32_zeros)
+{
+  const size_t lengths[] = { 0, 1, 7, 4096, 100000 };
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+    std::vector<unsigned char> data(lengths[i] + 3, 0);
+    data[0] = 'a';
+    data[data.size() - 2] = 'b';
+    data[data.size() - 1] = 'c';
+    unsigned long expected = DirShare::calculate_crc32(&data[0], data.size());
+
+    unsigned long crc = 0xFFFFFFFF;
+    crc = DirShare::calculate_crc32_incremental(&data[0], 1, crc);
+    crc = DirShare::calculate_crc32_zeros(lengths[i], crc);
+    crc = DirShare::calculate_crc32_incremental(&data[data.size() - 2], 2, crc);
+
+    BOOST_CHECK_EQUAL(expected, DirShare::finalize_crc32(crc));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
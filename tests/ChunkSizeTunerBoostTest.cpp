@@ -0,0 +1,104 @@
+#define BOOST_TEST_MODULE ChunkSizeTunerTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../ChunkSizeTuner.h"
+#include <ace/Time_Value.h>
+
+namespace {
+
+const uint32_t KB = 1024;
+const uint32_t MB = 1024 * 1024;
+
+// Feed one full window of writes with the given throughput (bytes/sec)
+void feed_window(DirShare::ChunkSizeTuner& tuner, double throughput, bool blocked)
+{
+  const uint32_t size = tuner.chunk_size();
+  const long usec = static_cast<long>(size / throughput * 1000000.0);
+  for (int i = 0; i < 16; ++i) {
+    tuner.record_write(size, size, ACE_Time_Value(usec / 1000000, usec % 1000000), blocked);
+  }
+}
+
+// Simulated link: fixed 10ms pacing per chunk on a 200MB/s path whose
+// reliable history overflows (writes block) above 4MB chunks
+double link_throughput(uint32_t size)
+{
+  double seconds = 0.010 + size / (200.0 * MB);
+  return size / seconds;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(ChunkSizeTunerTestSuite)
+
+// Test: Sizes are powers of two within bounds
+BOOST_AUTO_TEST_CASE(test_initial_size_clamped)
+{
+  DirShare::ChunkSizeTuner tuner(1000 * KB, 64 * KB, 4 * MB);
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 1 * MB);
+
+  DirShare::ChunkSizeTuner small(1 * KB, 64 * KB, 4 * MB);
+  BOOST_CHECK_EQUAL(small.chunk_size(), 64 * KB);
+
+  DirShare::ChunkSizeTuner large(64 * MB, 64 * KB, 4 * MB);
+  BOOST_CHECK_EQUAL(large.chunk_size(), 4 * MB);
+  BOOST_CHECK_EQUAL(large.adjustments(), 0u);
+}
+
+// Test: Blocked writes halve the chunk size
+BOOST_AUTO_TEST_CASE(test_blocked_writes_shrink)
+{
+  DirShare::ChunkSizeTuner tuner(1 * MB, 64 * KB, 16 * MB);
+
+  feed_window(tuner, 50.0 * MB, true);
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 512 * KB);
+
+  feed_window(tuner, 50.0 * MB, true);
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 256 * KB);
+  BOOST_CHECK_EQUAL(tuner.adjustments(), 2u);
+}
+
+// Test: Writes from a transfer that started with the old size are ignored
+BOOST_AUTO_TEST_CASE(test_stale_writes_ignored)
+{
+  DirShare::ChunkSizeTuner tuner(1 * MB, 64 * KB, 16 * MB);
+
+  for (int i = 0; i < 100; ++i) {
+    tuner.record_write(2 * MB, 2 * MB, ACE_Time_Value(1, 0), true);
+  }
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 1 * MB);
+  BOOST_CHECK_EQUAL(tuner.adjustments(), 0u);
+}
+
+// Test: Steady throughput holds the size
+BOOST_AUTO_TEST_CASE(test_steady_throughput_holds)
+{
+  DirShare::ChunkSizeTuner tuner(1 * MB, 64 * KB, 16 * MB);
+
+  feed_window(tuner, 80.0 * MB, false); // First window probes upward
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 2 * MB);
+
+  for (int i = 0; i < 5; ++i) {
+    feed_window(tuner, 80.0 * MB, false);
+  }
+  BOOST_CHECK_EQUAL(tuner.chunk_size(), 2 * MB);
+}
+
+// Test: Tuner climbs toward the best size on a simulated link and stays
+// out of the region where writes block
+BOOST_AUTO_TEST_CASE(test_converges_on_simulated_link)
+{
+  DirShare::ChunkSizeTuner tuner(64 * KB, 16 * KB, 16 * MB);
+
+  for (int i = 0; i < 40; ++i) {
+    uint32_t size = tuner.chunk_size();
+    bool blocked = size > 4 * MB;
+    double throughput = link_throughput(size) * (blocked ? 0.3 : 1.0);
+    feed_window(tuner, throughput, blocked);
+  }
+
+  BOOST_CHECK(tuner.chunk_size() >= 1 * MB);
+  BOOST_CHECK(tuner.chunk_size() <= 4 * MB);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
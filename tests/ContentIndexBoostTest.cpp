@@ -0,0 +1,133 @@
+#define BOOST_TEST_MODULE ContentIndexTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../ContentIndex.h"
+#include "../FileMonitor.h"
+#include "../FileChangeTracker.h"
+#include "../FileUtils.h"
+#include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <fstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(ContentIndexTestSuite)
+
+// Test: Lookup by content finds files under other names
+BOOST_AUTO_TEST_CASE(test_find_by_content)
+{
+  DirShare::ContentIndex index;
+  index.update("a.bin", 1000, 0x12345678);
+  index.update("b.bin", 2000, 0xCAFEBABE);
+
+  std::string found;
+  BOOST_CHECK(index.find(1000, 0x12345678, "copy.bin", found));
+  BOOST_CHECK_EQUAL(found, "a.bin");
+
+  // Size is part of the key, not just the checksum
+  BOOST_CHECK(!index.find(1001, 0x12345678, "copy.bin", found));
+
+  // The transfer target itself is not a source
+  BOOST_CHECK(!index.find(1000, 0x12345678, "a.bin", found));
+
+  BOOST_CHECK_EQUAL(index.size(), 2u);
+}
+
+// Test: Updates move a file between content buckets
+BOOST_AUTO_TEST_CASE(test_update_and_remove)
+{
+  DirShare::ContentIndex index;
+  std::string found;
+
+  index.update("a.bin", 1000, 0x11111111);
+  BOOST_CHECK(index.contains("a.bin", 1000, 0x11111111));
+
+  index.update("a.bin", 1500, 0x22222222);
+  BOOST_CHECK(!index.contains("a.bin", 1000, 0x11111111));
+  BOOST_CHECK(!index.find(1000, 0x11111111, "", found));
+  BOOST_CHECK(index.find(1500, 0x22222222, "", found));
+
+  index.remove("a.bin");
+  BOOST_CHECK(!index.find(1500, 0x22222222, "", found));
+  BOOST_CHECK_EQUAL(index.size(), 0u);
+
+  // Removing an unknown file is harmless
+  index.remove("missing.bin");
+}
+
+// Test: Duplicate content under several names
+BOOST_AUTO_TEST_CASE(test_duplicate_content)
+{
+  DirShare::ContentIndex index;
+  std::string found;
+
+  index.update("a.bin", 4096, 0xABCDEF01);
+  index.update("b.bin", 4096, 0xABCDEF01);
+
+  BOOST_CHECK(index.find(4096, 0xABCDEF01, "a.bin", found));
+  BOOST_CHECK_EQUAL(found, "b.bin");
+
+  index.remove("b.bin");
+  BOOST_CHECK(index.find(4096, 0xABCDEF01, "c.bin", found));
+  BOOST_CHECK_EQUAL(found, "a.bin");
+}
+
+// Test: A local copy awaiting its transfer is not offered as a clone source
+BOOST_AUTO_TEST_CASE(test_unverified_copy)
+{
+  DirShare::ContentIndex index;
+  std::string found;
+
+  index.update("a.bin", 4096, 0xABCDEF01);
+  index.update("b.bin", 4096, 0xABCDEF01);
+  index.mark_unverified("b.bin");
+
+  BOOST_CHECK(index.unverified("b.bin"));
+  BOOST_CHECK(!index.unverified("a.bin"));
+  BOOST_CHECK(index.contains("b.bin", 4096, 0xABCDEF01));
+  BOOST_CHECK(!index.find(4096, 0xABCDEF01, "a.bin", found));
+
+  // A scan's update does not confirm it; the listener does
+  index.update("b.bin", 4096, 0xABCDEF01);
+  BOOST_CHECK(index.unverified("b.bin"));
+  index.verified("b.bin");
+  BOOST_CHECK(!index.unverified("b.bin"));
+  BOOST_CHECK(index.find(4096, 0xABCDEF01, "a.bin", found));
+  BOOST_CHECK_EQUAL(found, "b.bin");
+
+  index.mark_unverified("b.bin");
+  index.remove("b.bin");
+  BOOST_CHECK(!index.unverified("b.bin"));
+}
+
+// Test: FileMonitor keeps the index in step with the directory
+BOOST_AUTO_TEST_CASE(test_monitor_maintains_index)
+{
+  const char* test_dir = "test_content_index_dir";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileChangeTracker change_tracker;
+  DirShare::ContentIndex index;
+  DirShare::FileMonitor monitor(test_dir, change_tracker, true);
+  monitor.set_content_index(&index);
+
+  std::string file_path = std::string(test_dir) + "/data.txt";
+  {
+    std::ofstream file(file_path.c_str());
+    file << "indexed content";
+  }
+
+  std::vector<std::string> created, modified, deleted;
+  BOOST_REQUIRE(monitor.scan_for_changes(created, modified, deleted));
+
+  DirShare::FileMetadata metadata;
+  BOOST_REQUIRE(monitor.get_file_metadata("data.txt", metadata));
+  BOOST_CHECK(index.contains("data.txt", metadata.size, metadata.checksum));
+
+  ACE_OS::unlink(file_path.c_str());
+  BOOST_REQUIRE(monitor.scan_for_changes(created, modified, deleted));
+  BOOST_CHECK_EQUAL(index.size(), 0u);
+
+  ACE_OS::rmdir(test_dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,224 @@
+#define BOOST_TEST_MODULE FaultInjectionTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../FaultInjection.h"
+#include "../Latency.h"
+#include <ace/INET_Addr.h>
+#include <ace/SOCK_Dgram.h>
+#include <string>
+
+namespace {
+
+// Base port of the proxy in the loopback test
+const unsigned short PROXY_PORT = 27600;
+
+double ms(const ACE_Time_Value& value)
+{
+  return static_cast<double>(value.sec()) * 1e3 + static_cast<double>(value.usec()) / 1e3;
+}
+
+// Receive one datagram within a second; empty if none arrives
+std::string receive(ACE_SOCK_Dgram& socket)
+{
+  char buffer[256];
+  ACE_INET_Addr from;
+  ACE_Time_Value timeout(1, 0);
+  const ssize_t size = socket.recv(buffer, sizeof(buffer), from, 0, &timeout);
+  return size > 0 ? std::string(buffer, static_cast<size_t>(size)) : std::string();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(FaultInjectionTestSuite)
+
+// Test: Specifications parse with their units; malformed ones are rejected
+BOOST_AUTO_TEST_CASE(test_parse_impairment)
+{
+  DirShare::NetworkImpairment impairment;
+  BOOST_REQUIRE(DirShare::parse_impairment(
+    "delay=40ms,jitter=500us,loss=1.5%,reorder=0.02,rate=10mbit,limit=50,seed=7",
+    impairment));
+  BOOST_CHECK_CLOSE(ms(impairment.delay), 40.0, 0.01);
+  BOOST_CHECK_CLOSE(ms(impairment.jitter), 0.5, 0.01);
+  BOOST_CHECK_CLOSE(impairment.loss, 0.015, 0.01);
+  BOOST_CHECK_CLOSE(impairment.reorder, 0.02, 0.01);
+  BOOST_CHECK_EQUAL(impairment.rate_bps, 10000000ULL);
+  BOOST_CHECK_EQUAL(impairment.limit, 50u);
+  BOOST_CHECK_EQUAL(impairment.seed, 7ul);
+
+  // Printed form parses back to the same impairments
+  DirShare::NetworkImpairment reparsed;
+  BOOST_REQUIRE(DirShare::parse_impairment(DirShare::impairment_string(impairment), reparsed));
+  BOOST_CHECK(reparsed.delay == impairment.delay);
+  BOOST_CHECK_CLOSE(reparsed.loss, impairment.loss, 0.01);
+  BOOST_CHECK_EQUAL(reparsed.rate_bps, impairment.rate_bps);
+
+  BOOST_CHECK(DirShare::parse_impairment("", impairment));
+  BOOST_CHECK(impairment.delay == ACE_Time_Value::zero);
+  BOOST_CHECK_EQUAL(impairment.loss, 0.0);
+  BOOST_CHECK(DirShare::parse_impairment("delay=1s", impairment));
+  BOOST_CHECK_EQUAL(impairment.delay.sec(), 1);
+
+  BOOST_CHECK(!DirShare::parse_impairment("delay=fast", impairment));
+  BOOST_CHECK(!DirShare::parse_impairment("delay=10min", impairment));
+  BOOST_CHECK(!DirShare::parse_impairment("loss=150%", impairment));
+  BOOST_CHECK(!DirShare::parse_impairment("rate=5mbps", impairment));
+  BOOST_CHECK(!DirShare::parse_impairment("duplicate=1%", impairment));
+  BOOST_CHECK(!DirShare::parse_impairment("loss", impairment));
+}
+
+// Test: About the configured fraction of datagrams is lost
+BOOST_AUTO_TEST_CASE(test_loss_rate)
+{
+  DirShare::NetworkImpairment impairment;
+  impairment.loss = 0.1;
+  impairment.limit = 0;
+  DirShare::ImpairmentRandom random(3);
+  DirShare::ImpairedLink link;
+
+  const ACE_Time_Value now(100, 0);
+  int lost = 0;
+  for (int i = 0; i < 10000; ++i) {
+    ACE_Time_Value at;
+    if (link.admit(impairment, now, 100, random, at) == DirShare::ImpairedLink::LOST) {
+      ++lost;
+    } else {
+      link.sent();
+    }
+  }
+  BOOST_CHECK(lost > 800 && lost < 1200);
+}
+
+// Test: Delivery is delayed by the delay plus up to the jitter
+BOOST_AUTO_TEST_CASE(test_delay_and_jitter)
+{
+  DirShare::NetworkImpairment impairment;
+  impairment.delay = ACE_Time_Value(0, 20000);
+  impairment.jitter = ACE_Time_Value(0, 10000);
+  DirShare::ImpairmentRandom random(5);
+  DirShare::ImpairedLink link;
+
+  const ACE_Time_Value now(100, 0);
+  double shortest = 1e9;
+  double longest = 0;
+  for (int i = 0; i < 200; ++i) {
+    ACE_Time_Value at;
+    BOOST_REQUIRE_EQUAL(link.admit(impairment, now, 100, random, at),
+                        DirShare::ImpairedLink::DELIVER);
+    link.sent();
+    const double delay = ms(at - now);
+    shortest = delay < shortest ? delay : shortest;
+    longest = delay > longest ? delay : longest;
+  }
+  BOOST_CHECK(shortest >= 20.0);
+  BOOST_CHECK(longest < 30.0);
+  BOOST_CHECK(longest - shortest > 5.0);
+}
+
+// Test: A rate cap spaces datagrams by their serialization time
+BOOST_AUTO_TEST_CASE(test_rate_limit)
+{
+  DirShare::NetworkImpairment impairment;
+  impairment.rate_bps = 1000000;   // 1250 bytes take 10 ms
+  DirShare::ImpairmentRandom random(1);
+  DirShare::ImpairedLink link;
+
+  const ACE_Time_Value now(100, 0);
+  ACE_Time_Value at;
+  for (int i = 1; i <= 10; ++i) {
+    BOOST_REQUIRE_EQUAL(link.admit(impairment, now, 1250, random, at),
+                        DirShare::ImpairedLink::DELIVER);
+    BOOST_CHECK_CLOSE(ms(at - now), 10.0 * i, 0.1);
+  }
+
+  // Once the link has drained, a datagram only waits for itself
+  const ACE_Time_Value later(101, 0);
+  BOOST_REQUIRE_EQUAL(link.admit(impairment, later, 1250, random, at),
+                      DirShare::ImpairedLink::DELIVER);
+  BOOST_CHECK_CLOSE(ms(at - later), 10.0, 0.1);
+}
+
+// Test: Reordered datagrams skip the delay and overtake the others
+BOOST_AUTO_TEST_CASE(test_reorder)
+{
+  DirShare::NetworkImpairment impairment;
+  impairment.delay = ACE_Time_Value(0, 50000);
+  impairment.reorder = 0.25;
+  DirShare::ImpairmentRandom random(9);
+  DirShare::ImpairedLink link;
+
+  const ACE_Time_Value now(100, 0);
+  int reordered = 0;
+  for (int i = 0; i < 1000; ++i) {
+    ACE_Time_Value at;
+    BOOST_REQUIRE_EQUAL(link.admit(impairment, now, 100, random, at),
+                        DirShare::ImpairedLink::DELIVER);
+    link.sent();
+    if (at == now) {
+      ++reordered;
+    } else {
+      BOOST_CHECK_CLOSE(ms(at - now), 50.0, 0.1);
+    }
+  }
+  BOOST_CHECK(reordered > 180 && reordered < 320);
+}
+
+// Test: Datagrams beyond the queue limit are dropped until the link drains
+BOOST_AUTO_TEST_CASE(test_queue_limit)
+{
+  DirShare::NetworkImpairment impairment;
+  impairment.delay = ACE_Time_Value(1, 0);
+  impairment.limit = 5;
+  DirShare::ImpairmentRandom random(1);
+  DirShare::ImpairedLink link;
+
+  const ACE_Time_Value now(100, 0);
+  ACE_Time_Value at;
+  for (int i = 0; i < 5; ++i) {
+    BOOST_CHECK_EQUAL(link.admit(impairment, now, 100, random, at),
+                      DirShare::ImpairedLink::DELIVER);
+  }
+  BOOST_CHECK_EQUAL(link.queued(), 5u);
+  BOOST_CHECK_EQUAL(link.admit(impairment, now, 100, random, at),
+                    DirShare::ImpairedLink::OVERFLOW);
+  link.sent();
+  BOOST_CHECK_EQUAL(link.admit(impairment, now, 100, random, at),
+                    DirShare::ImpairedLink::DELIVER);
+}
+
+// Test: The proxy forwards each datagram to the other senders on its port, delayed
+BOOST_AUTO_TEST_CASE(test_proxy_forwards)
+{
+  DirShare::NetworkImpairment impairment;
+  BOOST_REQUIRE(DirShare::parse_impairment("delay=30ms", impairment));
+  DirShare::FaultProxy proxy;
+  BOOST_REQUIRE(proxy.start("127.0.0.1", PROXY_PORT, impairment));
+
+  ACE_INET_Addr any(0, "127.0.0.1");
+  ACE_SOCK_Dgram alice;
+  ACE_SOCK_Dgram bob;
+  BOOST_REQUIRE_EQUAL(alice.open(any), 0);
+  BOOST_REQUIRE_EQUAL(bob.open(any), 0);
+  ACE_INET_Addr data_port(PROXY_PORT + 2, "127.0.0.1");
+
+  // Nobody else has joined yet: alice's first datagram goes nowhere
+  const std::string hello = "hello";
+  const std::string reply = "reply";
+  alice.send(hello.data(), hello.size(), data_port);
+  bob.send(hello.data(), hello.size(), data_port);
+  BOOST_CHECK_EQUAL(receive(alice), hello);
+
+  const ACE_Time_Value sent = DirShare::monotonic_now();
+  alice.send(reply.data(), reply.size(), data_port);
+  BOOST_CHECK_EQUAL(receive(bob), reply);
+  BOOST_CHECK(ms(DirShare::monotonic_now() - sent) >= 29.0);
+
+  proxy.stop();
+  BOOST_CHECK_EQUAL(proxy.forwarded(), 2u);
+  BOOST_CHECK_EQUAL(proxy.bytes_forwarded(), hello.size() + reply.size());
+  BOOST_CHECK_EQUAL(proxy.lost(), 0u);
+  alice.close();
+  bob.close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
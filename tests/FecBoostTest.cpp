@@ -0,0 +1,303 @@
+#define BOOST_TEST_MODULE FecTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../ReedSolomon.h"
+#include "../Checksum.h"
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace {
+
+// Deterministic pseudo-random source (LCG) so loss patterns are repeatable
+class Random {
+public:
+  explicit Random(uint32_t seed) : state_(seed) {}
+
+  uint32_t next()
+  {
+    state_ = state_ * 1664525U + 1013904223U;
+    return state_ >> 8;
+  }
+
+  // Uniform in [0, 1)
+  double uniform()
+  {
+    return (next() & 0xFFFFFF) / 16777216.0;
+  }
+
+private:
+  uint32_t state_;
+};
+
+// Loss injection: independent losses, or Gilbert-Elliott bursts when
+// burst_length > 1 (mean burst length, same average loss rate)
+class LossyChannel {
+public:
+  LossyChannel(double loss_rate, double burst_length, uint32_t seed)
+    : random_(seed)
+    , bad_(false)
+    , sent_(0)
+    , lost_(0)
+  {
+    leave_bad_ = 1.0 / burst_length;
+    enter_bad_ = loss_rate * leave_bad_ / (1.0 - loss_rate);
+  }
+
+  // true if the sample is delivered
+  bool transmit()
+  {
+    ++sent_;
+    bad_ = bad_ ? random_.uniform() >= leave_bad_ : random_.uniform() < enter_bad_;
+    if (bad_) {
+      ++lost_;
+    }
+    return !bad_;
+  }
+
+  unsigned long sent() const { return sent_; }
+  unsigned long lost() const { return lost_; }
+
+private:
+  Random random_;
+  double enter_bad_;
+  double leave_bad_;
+  bool bad_;
+  unsigned long sent_;
+  unsigned long lost_;
+};
+
+std::vector<uint8_t> make_block(size_t size, uint32_t seed)
+{
+  Random random(seed);
+  std::vector<uint8_t> block(size);
+  for (size_t i = 0; i < size; ++i) {
+    block[i] = static_cast<uint8_t>(random.next());
+  }
+  return block;
+}
+
+struct TransferResult {
+  unsigned long groups;
+  unsigned long groups_recovered;   // Needed repair blocks and decoded
+  unsigned long groups_failed;      // More losses than repair blocks
+  unsigned long chunks_lost;        // Data chunks lost on the channel
+  bool data_intact;                 // Every decoded group matched the source
+};
+
+// Send a file of groups * k chunks through the channel, k data + m repair
+// blocks per group, and reconstruct each group at the receiver
+TransferResult run_transfer(unsigned k, unsigned m, unsigned groups,
+                            size_t chunk_size, LossyChannel& channel)
+{
+  DirShare::ReedSolomonCode code(k, m);
+  TransferResult result = {0, 0, 0, 0, true};
+
+  for (unsigned g = 0; g < groups; ++g) {
+    std::vector<std::vector<uint8_t> > data(k);
+    std::vector<const uint8_t*> data_ptrs(k);
+    for (unsigned j = 0; j < k; ++j) {
+      data[j] = make_block(chunk_size, g * k + j + 1);
+      data_ptrs[j] = &data[j][0];
+    }
+
+    std::vector<std::vector<uint8_t> > repair;
+    code.encode(data_ptrs, chunk_size, repair);
+
+    std::vector<const uint8_t*> received(k + m, static_cast<const uint8_t*>(0));
+    bool any_lost = false;
+    for (unsigned j = 0; j < k; ++j) {
+      if (channel.transmit()) {
+        received[j] = &data[j][0];
+      } else {
+        ++result.chunks_lost;
+        any_lost = true;
+      }
+    }
+    for (unsigned i = 0; i < m; ++i) {
+      if (channel.transmit()) {
+        received[k + i] = &repair[i][0];
+      }
+    }
+
+    ++result.groups;
+    if (!any_lost) {
+      continue;
+    }
+
+    std::map<unsigned, std::vector<uint8_t> > recovered;
+    if (!code.decode(received, chunk_size, recovered)) {
+      ++result.groups_failed;
+      continue;
+    }
+
+    ++result.groups_recovered;
+    for (std::map<unsigned, std::vector<uint8_t> >::const_iterator it = recovered.begin();
+         it != recovered.end(); ++it) {
+      if (it->second != data[it->first]) {
+        result.data_intact = false;
+      }
+    }
+  }
+
+  return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(FecTestSuite)
+
+// Test: Parameter validation
+BOOST_AUTO_TEST_CASE(test_code_parameters)
+{
+  BOOST_CHECK(DirShare::ReedSolomonCode(16, 4).valid());
+  BOOST_CHECK(DirShare::ReedSolomonCode(1, 1).valid());
+  BOOST_CHECK(DirShare::ReedSolomonCode(200, 55).valid());
+  BOOST_CHECK(!DirShare::ReedSolomonCode(0, 4).valid());
+  BOOST_CHECK(!DirShare::ReedSolomonCode(16, 0).valid());
+  BOOST_CHECK(!DirShare::ReedSolomonCode(200, 56).valid());
+}
+
+// Test: Any m erasures among k + m blocks are recovered
+BOOST_AUTO_TEST_CASE(test_recover_any_erasures)
+{
+  const unsigned k = 6;
+  const unsigned m = 3;
+  const size_t size = 257;
+  DirShare::ReedSolomonCode code(k, m);
+
+  std::vector<std::vector<uint8_t> > data(k);
+  std::vector<const uint8_t*> data_ptrs(k);
+  for (unsigned j = 0; j < k; ++j) {
+    data[j] = make_block(size, j + 100);
+    data_ptrs[j] = &data[j][0];
+  }
+  std::vector<std::vector<uint8_t> > repair;
+  code.encode(data_ptrs, size, repair);
+  BOOST_REQUIRE_EQUAL(repair.size(), m);
+
+  // Every erasure pattern of exactly m blocks
+  unsigned patterns = 0;
+  for (unsigned mask = 0; mask < (1u << (k + m)); ++mask) {
+    unsigned erased = 0;
+    for (unsigned b = 0; b < k + m; ++b) {
+      erased += (mask >> b) & 1;
+    }
+    if (erased != m) {
+      continue;
+    }
+
+    std::vector<const uint8_t*> blocks(k + m);
+    for (unsigned b = 0; b < k + m; ++b) {
+      const uint8_t* block = b < k ? &data[b][0] : &repair[b - k][0];
+      blocks[b] = (mask >> b) & 1 ? 0 : block;
+    }
+
+    std::map<unsigned, std::vector<uint8_t> > recovered;
+    BOOST_REQUIRE(code.decode(blocks, size, recovered));
+    for (unsigned j = 0; j < k; ++j) {
+      if ((mask >> j) & 1) {
+        BOOST_REQUIRE(recovered.count(j) == 1);
+        BOOST_CHECK(recovered[j] == data[j]);
+      }
+    }
+    ++patterns;
+  }
+  BOOST_CHECK_EQUAL(patterns, 84u); // C(9, 3)
+}
+
+// Test: More than m erasures are reported, not guessed
+BOOST_AUTO_TEST_CASE(test_too_many_erasures)
+{
+  const unsigned k = 4;
+  const unsigned m = 2;
+  DirShare::ReedSolomonCode code(k, m);
+
+  std::vector<std::vector<uint8_t> > data(k, std::vector<uint8_t>(64, 7));
+  std::vector<const uint8_t*> data_ptrs(k);
+  for (unsigned j = 0; j < k; ++j) {
+    data_ptrs[j] = &data[j][0];
+  }
+  std::vector<std::vector<uint8_t> > repair;
+  code.encode(data_ptrs, 64, repair);
+
+  std::vector<const uint8_t*> blocks(k + m, static_cast<const uint8_t*>(0));
+  blocks[0] = data_ptrs[0];
+  blocks[4] = &repair[0][0];
+  blocks[5] = &repair[1][0];
+
+  std::map<unsigned, std::vector<uint8_t> > recovered;
+  BOOST_CHECK(!code.decode(blocks, 64, recovered));
+}
+
+// Test: Zero-padded short last block survives a round trip (last chunk of
+// a file is shorter than the chunk size)
+BOOST_AUTO_TEST_CASE(test_short_last_block)
+{
+  const unsigned k = 3;
+  const size_t size = 1000;
+  const size_t last_size = 123;
+  DirShare::ReedSolomonCode code(k, 1);
+
+  std::vector<std::vector<uint8_t> > data(k);
+  for (unsigned j = 0; j < k; ++j) {
+    data[j] = make_block(size, j + 7);
+  }
+  std::memset(&data[k - 1][last_size], 0, size - last_size);
+  uint32_t last_crc = DirShare::compute_checksum(&data[k - 1][0], last_size);
+
+  std::vector<const uint8_t*> data_ptrs(k);
+  for (unsigned j = 0; j < k; ++j) {
+    data_ptrs[j] = &data[j][0];
+  }
+  std::vector<std::vector<uint8_t> > repair;
+  code.encode(data_ptrs, size, repair);
+
+  std::vector<const uint8_t*> blocks(k + 1);
+  blocks[0] = data_ptrs[0];
+  blocks[1] = data_ptrs[1];
+  blocks[2] = 0;
+  blocks[3] = &repair[0][0];
+
+  std::map<unsigned, std::vector<uint8_t> > recovered;
+  BOOST_REQUIRE(code.decode(blocks, size, recovered));
+  BOOST_CHECK_EQUAL(DirShare::compute_checksum(&recovered[2][0], last_size), last_crc);
+}
+
+// Loss-injection harness: 2% independent loss (SC-003 "normal network").
+// Without FEC about 2% of chunks would need a retransmission round trip;
+// with (16, 4) every group is reconstructed at the receiver
+BOOST_AUTO_TEST_CASE(test_harness_random_loss)
+{
+  LossyChannel channel(0.02, 1.0, 12345);
+  TransferResult result = run_transfer(16, 4, 128, 1024, channel);
+
+  BOOST_TEST_MESSAGE("2% loss: " << channel.lost() << "/" << channel.sent()
+                     << " samples lost, " << result.chunks_lost << " data chunks, "
+                     << result.groups_recovered << " groups repaired, "
+                     << result.groups_failed << " failed");
+
+  BOOST_CHECK(result.chunks_lost > 0);
+  BOOST_CHECK(result.groups_recovered > 0);
+  BOOST_CHECK_EQUAL(result.groups_failed, 0u);
+  BOOST_CHECK(result.data_intact);
+}
+
+// Loss-injection harness: bursts longer than the repair budget defeat a
+// group; the decoder must fail those groups rather than produce bad data
+BOOST_AUTO_TEST_CASE(test_harness_burst_loss)
+{
+  LossyChannel channel(0.05, 8.0, 777);
+  TransferResult result = run_transfer(16, 4, 128, 1024, channel);
+
+  BOOST_TEST_MESSAGE("5% burst loss: " << channel.lost() << "/" << channel.sent()
+                     << " samples lost, " << result.groups_recovered << " groups repaired, "
+                     << result.groups_failed << " failed");
+
+  BOOST_CHECK(result.groups_failed > 0);
+  BOOST_CHECK(result.groups_recovered > 0);
+  BOOST_CHECK(result.data_intact);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,74 @@
 #include "../FileUtils.h"
 #include "../Checksum.h"
 #include "../DirShareTypeSupportImpl.h"
+#include "../FileChunkListenerImpl.h"
+#include "../FileChangeTracker.h"
+#include "../ContentIndex.h"
+#include "../SyncFilter.h"
+#include "../Latency.h"
 #include <ace/OS_NS_unistd.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <cstring>
+#include <string>
 #include <vector>
 #include <map>
 
+namespace {
+
+// Chunk of a session, with its checksum
+DirShare::FileChunk make_chunk(uint64_t session_id, uint64_t offset, const std::string& data)
+{
+  DirShare::FileChunk chunk;
+  chunk.session_id = session_id;
+  chunk.file_size = 0;
+  chunk.offset = offset;
+  chunk.data.length(static_cast<CORBA::ULong>(data.size()));
+  std::memcpy(chunk.data.get_buffer(), data.data(), data.size());
+  chunk.chunk_checksum = DirShare::compute_checksum(
+    reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  return chunk;
+}
+
+// Header of a session of two 4-byte chunks
+DirShare::TransferOpen make_open(uint64_t session_id, const char* filename, const std::string& data)
+{
+  DirShare::TransferOpen open;
+  open.session_id = session_id;
+  open.filename = filename;
+  open.file_size = data.size();
+  open.file_checksum = DirShare::compute_checksum(
+    reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  open.chunk_size = 4;
+  open.total_chunks = 2;
+  open.timestamp_sec = 1700000000;
+  open.timestamp_nsec = 0;
+  open.fec_data_chunks = 0;
+  open.fec_repair_chunks = 0;
+  open.origin.event_id = 0;
+  open.origin.detect_sec = 0;
+  open.origin.detect_nsec = 0;
+  open.origin.scan_delay_usec = 0;
+  open.origin.queue_usec = 0;
+  return open;
+}
+
+// Data chunk of group 0 of an FEC session
+DirShare::FecChunk make_fec_chunk(uint64_t session_id, unsigned short index, const std::string& data)
+{
+  DirShare::FecChunk chunk;
+  chunk.session_id = session_id;
+  chunk.file_size = 0;
+  chunk.group = 0;
+  chunk.index = index;
+  chunk.data.length(static_cast<CORBA::ULong>(data.size()));
+  std::memcpy(chunk.data.get_buffer(), data.data(), data.size());
+  chunk.chunk_checksum = DirShare::compute_checksum(
+    reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  return chunk;
+}
+
+} // namespace
+
 BOOST_AUTO_TEST_SUITE(FileChunkTestSuite)
 
 // Test: Chunk calculation for 10MB threshold
@@ -158,7 +222,8 @@ BOOST_AUTO_TEST_CASE(test_chunk_checksum_verification)
 
   // Simulate FileChunk
   DirShare::FileChunk chunk;
-  chunk.chunk_id = 0;
+  chunk.session_id = 1;
+  chunk.offset = 0;
   chunk.chunk_checksum = chunk_checksum;
   chunk.data.length(CHUNK_SIZE);
   std::memcpy(chunk.data.get_buffer(), &chunk_data[0], CHUNK_SIZE);
@@ -187,16 +252,22 @@ BOOST_AUTO_TEST_CASE(test_file_checksum_after_reassembly)
   // Compute original file checksum
   uint32_t original_checksum = DirShare::compute_checksum(&original_data[0], file_size);
 
+  // Session header carries the file metadata
+  DirShare::TransferOpen open;
+  open.session_id = 1;
+  open.chunk_size = CHUNK_SIZE;
+  open.total_chunks = total_chunks;
+  open.file_size = file_size;
+  open.file_checksum = original_checksum;
+
   // Simulate chunking
   std::vector<DirShare::FileChunk> chunks;
   for (uint32_t chunk_id = 0; chunk_id < total_chunks; ++chunk_id) {
     DirShare::FileChunk chunk;
-    chunk.chunk_id = chunk_id;
-    chunk.total_chunks = total_chunks;
-    chunk.file_size = file_size;
-    chunk.file_checksum = original_checksum;
+    chunk.session_id = open.session_id;
 
-    uint64_t offset = static_cast<uint64_t>(chunk_id) * CHUNK_SIZE;
+    uint64_t offset = static_cast<uint64_t>(chunk_id) * open.chunk_size;
+    chunk.offset = offset;
     uint32_t this_chunk_size = static_cast<uint32_t>(
       (offset + CHUNK_SIZE > file_size) ? (file_size - offset) : CHUNK_SIZE);
 
@@ -208,17 +279,17 @@ BOOST_AUTO_TEST_CASE(test_file_checksum_after_reassembly)
   }
 
   // Simulate reassembly
-  std::vector<uint8_t> reassembled_data(file_size);
+  std::vector<uint8_t> reassembled_data(open.file_size);
   for (size_t i = 0; i < chunks.size(); ++i) {
-    uint64_t offset = static_cast<uint64_t>(chunks[i].chunk_id) * CHUNK_SIZE;
-    std::memcpy(&reassembled_data[offset],
+    BOOST_CHECK_EQUAL(chunks[i].offset % open.chunk_size, 0u);
+    std::memcpy(&reassembled_data[chunks[i].offset],
                 chunks[i].data.get_buffer(),
                 chunks[i].data.length());
   }
 
   // Verify file checksum after reassembly
   uint32_t reassembled_checksum = DirShare::compute_checksum(&reassembled_data[0], file_size);
-  BOOST_CHECK_EQUAL(reassembled_checksum, original_checksum);
+  BOOST_CHECK_EQUAL(reassembled_checksum, open.file_checksum);
 }
 
 // Test: Last chunk smaller than CHUNK_SIZE
@@ -314,4 +385,122 @@ BOOST_AUTO_TEST_CASE(test_chunk_buffer_management)
   }
 }
 
+// Test: Chunks ahead of their TransferOpen are held until it arrives, or
+// until it is overdue
+BOOST_AUTO_TEST_CASE(test_chunks_wait_for_transfer_open)
+{
+  const char* test_dir = "test_chunk_open_boost";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileChangeTracker change_tracker;
+  DirShare::ContentIndex content_index;
+  DirShare::FileChunkListenerImpl* listener =
+    new DirShare::FileChunkListenerImpl(test_dir, change_tracker, content_index);
+  DDS::DataReaderListener_var listener_ref(listener);
+
+  // Early chunks complete the session once its header arrives
+  listener->process_chunk(make_chunk(1, 0, "abcd"));
+  listener->process_chunk(make_chunk(1, 4, "efgh"));
+  listener->open_transfer(make_open(1, "early.bin", "abcdefgh"));
+  std::vector<unsigned char> data;
+  BOOST_REQUIRE(DirShare::read_file(std::string(test_dir) + "/early.bin", data));
+  BOOST_CHECK_EQUAL(std::string(data.begin(), data.end()), "abcdefgh");
+
+  // However many chunks come first, a late header still completes the
+  // session, even after the chunk instance has ended
+  for (int i = 0; i < 32; ++i) {
+    listener->process_chunk(make_chunk(2, 0, "abcd"));
+  }
+  listener->process_chunk(make_chunk(2, 4, "efgh"));
+  listener->end_transfer(2);
+  listener->open_transfer(make_open(2, "late.bin", "abcdefgh"));
+  BOOST_REQUIRE(DirShare::read_file(std::string(test_dir) + "/late.bin", data));
+  BOOST_CHECK_EQUAL(std::string(data.begin(), data.end()), "abcdefgh");
+
+  // Early chunks are dropped once their header is overdue, but the session
+  // is not closed: chunks sent after a late header are still taken
+  listener->process_chunk(make_chunk(3, 0, "abcd"));
+  listener->expire_transfers(DirShare::monotonic_now() + ACE_Time_Value(60, 0));
+  listener->open_transfer(make_open(3, "expired.bin", "abcdefgh"));
+  BOOST_CHECK(!DirShare::file_exists(std::string(test_dir) + "/expired.bin"));
+  listener->process_chunk(make_chunk(3, 0, "abcd"));
+  listener->process_chunk(make_chunk(3, 4, "efgh"));
+  BOOST_CHECK(DirShare::file_exists(std::string(test_dir) + "/expired.bin"));
+
+  ACE_OS::unlink((std::string(test_dir) + "/late.bin").c_str());
+  ACE_OS::unlink((std::string(test_dir) + "/expired.bin").c_str());
+  ACE_OS::unlink((std::string(test_dir) + "/early.bin").c_str());
+  ACE_OS::rmdir(test_dir);
+}
+
+// Test: An FEC session outlives its TransferOpen dispose for a grace period
+BOOST_AUTO_TEST_CASE(test_fec_grace_after_open_dispose)
+{
+  const char* test_dir = "test_chunk_fec_grace_boost";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileChangeTracker change_tracker;
+  DirShare::ContentIndex content_index;
+  DirShare::FileChunkListenerImpl* listener =
+    new DirShare::FileChunkListenerImpl(test_dir, change_tracker, content_index);
+  DDS::DataReaderListener_var listener_ref(listener);
+
+  // A chunk arriving after the dispose still completes the file
+  DirShare::TransferOpen open = make_open(1, "late.bin", "abcdefgh");
+  open.fec_data_chunks = 2;
+  open.fec_repair_chunks = 1;
+  listener->open_transfer(open);
+  listener->process_fec_chunk(make_fec_chunk(1, 0, "abcd"));
+  listener->transfer_open_disposed(1);
+  listener->expire_transfers(DirShare::monotonic_now());
+  listener->process_fec_chunk(make_fec_chunk(1, 1, "efgh"));
+  std::vector<unsigned char> data;
+  BOOST_REQUIRE(DirShare::read_file(std::string(test_dir) + "/late.bin", data));
+  BOOST_CHECK_EQUAL(std::string(data.begin(), data.end()), "abcdefgh");
+
+  // Once the grace period has passed the session is discarded
+  open = make_open(2, "expired.bin", "abcdefgh");
+  open.fec_data_chunks = 2;
+  open.fec_repair_chunks = 1;
+  listener->open_transfer(open);
+  listener->process_fec_chunk(make_fec_chunk(2, 0, "abcd"));
+  listener->transfer_open_disposed(2);
+  listener->expire_transfers(DirShare::monotonic_now() + ACE_Time_Value(60, 0));
+  listener->process_fec_chunk(make_fec_chunk(2, 1, "efgh"));
+  BOOST_CHECK(!DirShare::file_exists(std::string(test_dir) + "/expired.bin"));
+
+  ACE_OS::unlink((std::string(test_dir) + "/late.bin").c_str());
+  ACE_OS::rmdir(test_dir);
+}
+
+// Test: Transfers the DDS filter let through as a LIKE superset of an
+// include glob are dropped by the exact match
+BOOST_AUTO_TEST_CASE(test_sync_filter_recheck)
+{
+  const char* test_dir = "test_chunk_filter_boost";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileChangeTracker change_tracker;
+  DirShare::ContentIndex content_index;
+  DirShare::SyncFilter filter;
+  BOOST_REQUIRE(filter.add_pattern("data_*.bin"));
+  DirShare::FileChunkListenerImpl* listener =
+    new DirShare::FileChunkListenerImpl(test_dir, change_tracker, content_index);
+  DDS::DataReaderListener_var listener_ref(listener);
+  listener->set_sync_filter(&filter);
+
+  listener->open_transfer(make_open(1, "dataX1.bin", "abcdefgh"));
+  listener->process_chunk(make_chunk(1, 0, "abcd"));
+  listener->process_chunk(make_chunk(1, 4, "efgh"));
+  BOOST_CHECK(!DirShare::file_exists(std::string(test_dir) + "/dataX1.bin"));
+
+  listener->open_transfer(make_open(2, "data_1.bin", "abcdefgh"));
+  listener->process_chunk(make_chunk(2, 0, "abcd"));
+  listener->process_chunk(make_chunk(2, 4, "efgh"));
+  BOOST_CHECK(DirShare::file_exists(std::string(test_dir) + "/data_1.bin"));
+
+  ACE_OS::unlink((std::string(test_dir) + "/data_1.bin").c_str());
+  ACE_OS::rmdir(test_dir);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
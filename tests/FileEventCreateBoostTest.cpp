@@ -291,6 +291,36 @@ BOOST_AUTO_TEST_SUITE_END()
 
 #include "../FileChangeTracker.h"
 #include "../FileMonitor.h"
+#include "../FileContentListenerImpl.h"
+#include "../Checksum.h"
+#include <cstring>
+
+// Records the changes a listener reports, with the suppression seen then
+class RecordingObserver : public DirShare::RemoteChangeObserver {
+public:
+  explicit RecordingObserver(DirShare::FileChangeTracker& tracker)
+    : tracker_(tracker)
+  {
+  }
+
+  virtual void remote_change_applied(DirShare::OperationType operation,
+                                     const std::string& filename,
+                                     const DirShare::ChangeOrigin& origin)
+  {
+    operations.push_back(operation);
+    filenames.push_back(filename);
+    event_ids.push_back(origin.event_id);
+    suppressed.push_back(tracker_.is_suppressed(filename));
+  }
+
+  std::vector<DirShare::OperationType> operations;
+  std::vector<std::string> filenames;
+  std::vector<unsigned long long> event_ids;
+  std::vector<bool> suppressed;
+
+private:
+  DirShare::FileChangeTracker& tracker_;
+};
 
 struct NotificationLoopFixture {
   NotificationLoopFixture()
@@ -359,6 +389,54 @@ BOOST_AUTO_TEST_CASE(test_content_arrival_resumes_notifications)
   BOOST_CHECK(!change_tracker.is_suppressed(filename));
 }
 
+// Test: The content listener reports each applied change before resuming notifications
+BOOST_AUTO_TEST_CASE(test_content_listener_reports_applied_change)
+{
+  std::string filename = "reported_file.txt";
+  const char text[] = "content from a peer";
+
+  DirShare::ContentIndex index;
+  RecordingObserver observer(change_tracker);
+  DirShare::FileContentListenerImpl* listener =
+    new DirShare::FileContentListenerImpl(test_dir, change_tracker, index);
+  DDS::DataReaderListener_var owner = listener;
+  listener->set_remote_change_observer(&observer);
+
+  DirShare::FileContent content;
+  content.filename = filename.c_str();
+  content.size = sizeof(text) - 1;
+  content.checksum = DirShare::compute_checksum(reinterpret_cast<const uint8_t*>(text), sizeof(text) - 1);
+  content.timestamp_sec = 1700000000ULL;
+  content.timestamp_nsec = 0;
+  content.origin.event_id = 42;
+  content.data.length(static_cast<CORBA::ULong>(sizeof(text) - 1));
+  std::memcpy(content.data.get_buffer(), text, sizeof(text) - 1);
+
+  change_tracker.suppress_notifications(filename);
+  listener->process_file_content(content);
+
+  // A newer version of the same file is a MODIFY
+  content.timestamp_sec += 10;
+  content.origin.event_id = 43;
+  change_tracker.suppress_notifications(filename);
+  listener->process_file_content(content);
+
+  // An older one is not applied, so not reported
+  content.timestamp_sec -= 20;
+  change_tracker.suppress_notifications(filename);
+  listener->process_file_content(content);
+
+  BOOST_REQUIRE_EQUAL(observer.operations.size(), 2u);
+  BOOST_CHECK(observer.operations[0] == DirShare::CREATE);
+  BOOST_CHECK(observer.operations[1] == DirShare::MODIFY);
+  BOOST_CHECK_EQUAL(observer.filenames[1], filename);
+  BOOST_CHECK_EQUAL(observer.event_ids[0], 42u);
+  BOOST_CHECK_EQUAL(observer.event_ids[1], 43u);
+  BOOST_CHECK(observer.suppressed[0]);
+  BOOST_CHECK(observer.suppressed[1]);
+  BOOST_CHECK(!change_tracker.is_suppressed(filename));
+}
+
 // Test: FileMonitor respects suppression flag
 BOOST_AUTO_TEST_CASE(test_file_monitor_respects_suppression)
 {
@@ -4,6 +4,7 @@
 #include "../FileMonitor.h"
 #include "../FileChangeTracker.h"
 #include "../FileUtils.h"
+#include "../Checksum.h"
 #include <ace/OS_NS_unistd.h>
 #include <ace/OS_NS_sys_stat.h>
 #include <fstream>
@@ -289,4 +290,85 @@ BOOST_AUTO_TEST_CASE(test_rapid_scans)
   cleanup_directory(test_dir);
 }
 
+// Test: The directory summary follows the scans
+BOOST_AUTO_TEST_CASE(test_summary_incremental)
+{
+  const char* test_dir = "test_monitor_summary_boost";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileMonitor monitor(test_dir, change_tracker);
+  std::ofstream((std::string(test_dir) + "/a.txt").c_str()) << "alpha";
+  std::ofstream((std::string(test_dir) + "/b.txt").c_str()) << "beta";
+
+  std::vector<std::string> created, modified, deleted;
+  monitor.scan_for_changes(created, modified, deleted);
+
+  DirShare::DirectorySummary summary;
+  monitor.summarize(summary);
+  BOOST_CHECK_EQUAL(summary.file_count, 2ul);
+  BOOST_CHECK_EQUAL(summary.total_bytes, 9ull);
+  BOOST_CHECK(summary.digest_changed != ACE_Time_Value::zero);
+  BOOST_CHECK(summary.local_change != ACE_Time_Value::zero);
+
+  // Modify one file and delete the other: the summary matches a fresh count
+  std::ofstream((std::string(test_dir) + "/a.txt").c_str(), std::ios::trunc) << "alpha two";
+  ACE_OS::unlink((std::string(test_dir) + "/b.txt").c_str());
+  monitor.scan_for_changes(created, modified, deleted);
+  monitor.summarize(summary);
+
+  unsigned long checksum = 0;
+  BOOST_REQUIRE(DirShare::calculate_file_crc32((std::string(test_dir) + "/a.txt").c_str(), checksum));
+  DirShare::DirectorySummary expected;
+  expected.add("a.txt", 9, static_cast<uint32_t>(checksum));
+  BOOST_CHECK_EQUAL(summary.file_count, 1ul);
+  BOOST_CHECK_EQUAL(summary.total_bytes, 9ull);
+  BOOST_CHECK_EQUAL(summary.digest, expected.digest);
+
+  // A quiet scan leaves the change times alone
+  const ACE_Time_Value changed = summary.digest_changed;
+  monitor.scan_for_changes(created, modified, deleted);
+  monitor.summarize(summary);
+  BOOST_CHECK(summary.digest_changed == changed);
+
+  cleanup_directory(test_dir);
+}
+
+// Test: A change recorded as applied from a peer is not reported by later scans
+BOOST_AUTO_TEST_CASE(test_record_remote_change)
+{
+  const char* test_dir = "test_monitor_remote_boost";
+  ACE_OS::mkdir(test_dir);
+
+  DirShare::FileMonitor monitor(test_dir, change_tracker);
+  std::ofstream((std::string(test_dir) + "/old.txt").c_str()) << "old";
+
+  std::vector<std::string> created, modified, deleted;
+  monitor.scan_for_changes(created, modified, deleted);
+  BOOST_CHECK_EQUAL(created.size(), 1u);
+
+  // A peer creates one file and deletes the other, after any scan could
+  // have seen the writes under suppression
+  std::ofstream((std::string(test_dir) + "/new.txt").c_str()) << "remote";
+  ACE_OS::unlink((std::string(test_dir) + "/old.txt").c_str());
+
+  DirShare::FileMetadata metadata;
+  BOOST_CHECK(monitor.record_remote_change("new.txt", metadata));
+  BOOST_CHECK_EQUAL(std::string(metadata.filename.in()), "new.txt");
+  BOOST_CHECK_EQUAL(metadata.size, 6ull);
+  BOOST_CHECK(!monitor.record_remote_change("old.txt", metadata));
+
+  monitor.scan_for_changes(created, modified, deleted);
+  BOOST_CHECK_EQUAL(created.size(), 0u);
+  BOOST_CHECK_EQUAL(modified.size(), 0u);
+  BOOST_CHECK_EQUAL(deleted.size(), 0u);
+
+  // The summary includes the peer's file
+  DirShare::DirectorySummary summary;
+  monitor.summarize(summary);
+  BOOST_CHECK_EQUAL(summary.file_count, 1ul);
+  BOOST_CHECK_EQUAL(summary.total_bytes, 6ull);
+
+  cleanup_directory(test_dir);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
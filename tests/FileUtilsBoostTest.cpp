@@ -2,8 +2,10 @@
 #include <boost/test/included/unit_test.hpp>
 
 #include "../FileUtils.h"
+#include "../Checksum.h"
 #include <ace/OS_NS_unistd.h>
 #include <ace/OS_NS_sys_stat.h>
+#include <cstring>
 #include <fstream>
 #include <vector>
 
@@ -287,4 +289,212 @@ BOOST_AUTO_TEST_CASE(test_large_file)
   ACE_OS::unlink(test_file);
 }
 
+
+// Test: Stable read returns full content and matching mtime
+BOOST_AUTO_TEST_CASE(test_read_file_stable)
+{
+  const char* test_file = "test_read_stable_boost.bin";
+
+  std::vector<unsigned char> data(256 * 1024);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (unsigned char)((i * 7) % 256);
+  }
+  BOOST_REQUIRE(DirShare::write_file(test_file, data.data(), data.size()));
+
+  std::vector<unsigned char> read_data;
+  unsigned long long mtime_sec = 0;
+  unsigned long mtime_nsec = 1;
+  BOOST_REQUIRE(DirShare::read_file_stable(test_file, read_data, mtime_sec, mtime_nsec));
+  BOOST_CHECK(read_data == data);
+
+  // Timestamp must agree with get_file_mtime() for metadata comparisons
+  unsigned long long expected_sec;
+  unsigned long expected_nsec;
+  BOOST_REQUIRE(DirShare::get_file_mtime(test_file, expected_sec, expected_nsec));
+  BOOST_CHECK_EQUAL(mtime_sec, expected_sec);
+  BOOST_CHECK_EQUAL(mtime_nsec, expected_nsec);
+
+  // Cleanup
+  ACE_OS::unlink(test_file);
+}
+
+// Test: Stable read of empty and nonexistent files
+BOOST_AUTO_TEST_CASE(test_read_file_stable_edge_cases)
+{
+  const char* test_file = "test_read_stable_empty_boost.bin";
+  std::vector<unsigned char> read_data(10);
+  unsigned long long mtime_sec;
+  unsigned long mtime_nsec;
+
+  BOOST_CHECK(!DirShare::read_file_stable("nonexistent_stable_boost.bin",
+                                          read_data, mtime_sec, mtime_nsec));
+
+  BOOST_REQUIRE(DirShare::write_file(test_file, 0, 0));
+  BOOST_REQUIRE(DirShare::read_file_stable(test_file, read_data, mtime_sec, mtime_nsec));
+  BOOST_CHECK(read_data.empty());
+
+  // Cleanup
+  ACE_OS::unlink(test_file);
+}
+
+
+// Test: Clone a file under another name
+BOOST_AUTO_TEST_CASE(test_clone_file)
+{
+  const char* source_file = "test_clone_source_boost.bin";
+  const char* dest_file = "test_clone_dest_boost.bin";
+
+  std::vector<unsigned char> data(3 * 1024 * 1024 + 17);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (unsigned char)((i * 31) % 251);
+  }
+  BOOST_REQUIRE(DirShare::write_file(source_file, data.data(), data.size()));
+
+  // Existing destination content is replaced, not appended to
+  const unsigned char stale[] = "stale destination content";
+  BOOST_REQUIRE(DirShare::write_file(dest_file, stale, sizeof(stale)));
+
+  BOOST_REQUIRE(DirShare::clone_file(source_file, dest_file));
+
+  std::vector<unsigned char> read_data;
+  BOOST_REQUIRE(DirShare::read_file(dest_file, read_data));
+  BOOST_CHECK(read_data == data);
+
+  // Missing source fails and leaves the destination and no temporary file
+  BOOST_CHECK(!DirShare::clone_file("nonexistent_clone_boost.bin", dest_file));
+  BOOST_REQUIRE(DirShare::read_file(dest_file, read_data));
+  BOOST_CHECK(read_data == data);
+  BOOST_CHECK(!DirShare::file_exists(std::string(dest_file) + DirShare::TEMP_FILE_SUFFIX));
+
+  // Cleanup
+  ACE_OS::unlink(source_file);
+  ACE_OS::unlink(dest_file);
+}
+
+// Test: A file matches an image only if every byte does, holes included
+BOOST_AUTO_TEST_CASE(test_file_matches_image)
+{
+  const char* test_file = "test_matches_image_boost.bin";
+
+  std::vector<unsigned char> contents(10000, 0);
+  for (size_t i = 1000; i < 3000; ++i) {
+    contents[i] = (unsigned char)(i % 251 + 1);
+  }
+  BOOST_REQUIRE(DirShare::write_file(test_file, contents.data(), contents.size()));
+
+  std::vector<DirShare::FileExtent> extents(1);
+  extents[0].offset = 1000;
+  extents[0].length = 2000;
+  BOOST_CHECK(DirShare::file_matches_image(test_file, &contents[1000], extents, contents.size()));
+
+  // Whole file as one extent
+  std::vector<DirShare::FileExtent> whole(1);
+  whole[0].offset = 0;
+  whole[0].length = contents.size();
+  BOOST_CHECK(DirShare::file_matches_image(test_file, contents.data(), whole, contents.size()));
+
+  // One byte differs inside an extent, in a hole, or the size differs
+  std::vector<unsigned char> other(contents);
+  other[2999] ^= 0x01;
+  BOOST_CHECK(!DirShare::file_matches_image(test_file, &other[1000], extents, other.size()));
+  other = contents;
+  other[9999] = 1;
+  BOOST_CHECK(!DirShare::file_matches_image(test_file, other.data(), whole, other.size()));
+  BOOST_CHECK(!DirShare::file_matches_image(test_file, contents.data(), whole, contents.size() + 1));
+  BOOST_CHECK(!DirShare::file_matches_image("nonexistent_matches_boost.bin",
+                                            contents.data(), whole, contents.size()));
+
+  ACE_OS::unlink(test_file);
+}
+
+// Test: A sparse file matches its image; data written into a hole does not
+BOOST_AUTO_TEST_CASE(test_sparse_file_matches_image)
+{
+  const char* test_file = "test_matches_sparse_boost.bin";
+  const unsigned long long size = 8 * 1024 * 1024;
+
+  std::vector<unsigned char> data(4096);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (unsigned char)(i % 253 + 1);
+  }
+  std::vector<DirShare::FileExtent> extents(1);
+  extents[0].offset = 1024 * 1024;
+  extents[0].length = data.size();
+  BOOST_REQUIRE(DirShare::write_file_sparse(test_file, data.data(), extents, size));
+  BOOST_CHECK(DirShare::file_matches_image(test_file, data.data(), extents, size));
+
+  // The same bytes somewhere else do not match
+  std::vector<DirShare::FileExtent> moved(extents);
+  moved[0].offset = 4 * 1024 * 1024;
+  BOOST_CHECK(!DirShare::file_matches_image(test_file, data.data(), moved, size));
+
+  ACE_OS::unlink(test_file);
+}
+
+// Test: Sparse files round-trip through extents without materializing holes
+BOOST_AUTO_TEST_CASE(test_sparse_file_extents)
+{
+  const char* test_file = "test_sparse_boost.bin";
+  const unsigned long long size = 8 * 1024 * 1024 + 100;
+
+  // Two data regions; the rest of the file is holes
+  std::vector<DirShare::FileExtent> extents(2);
+  extents[0].offset = 0;
+  extents[0].length = 5000;
+  extents[1].offset = 3 * 1024 * 1024 + 123;
+  extents[1].length = 10000;
+
+  std::vector<unsigned char> data(15000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (unsigned char)(1 + (i * 7) % 250);
+  }
+  std::vector<unsigned char> expected(size, 0);
+  std::memcpy(&expected[0], &data[0], 5000);
+  std::memcpy(&expected[extents[1].offset], &data[5000], 10000);
+
+  // Extents may be given in any order
+  std::vector<DirShare::FileExtent> reversed(extents.rbegin(), extents.rend());
+  std::vector<unsigned char> reversed_data(data.begin() + 5000, data.end());
+  reversed_data.insert(reversed_data.end(), data.begin(), data.begin() + 5000);
+
+  BOOST_CHECK_EQUAL(DirShare::calculate_extents_crc32(&reversed_data[0], reversed, size),
+                    DirShare::calculate_crc32(&expected[0], expected.size()));
+  BOOST_REQUIRE(DirShare::write_file_sparse(test_file, &reversed_data[0], reversed, size));
+
+  std::vector<unsigned char> read_data;
+  BOOST_REQUIRE(DirShare::read_file(test_file, read_data));
+  BOOST_CHECK(read_data == expected);
+
+  // Reading back yields sorted extents that cover every data byte
+  std::vector<unsigned char> extent_data;
+  std::vector<DirShare::FileExtent> read_extents;
+  unsigned long long read_size = 0;
+  unsigned long long mtime_sec;
+  unsigned long mtime_nsec;
+  BOOST_REQUIRE(DirShare::read_file_extents_stable(test_file, extent_data, read_extents,
+                                                   read_size, mtime_sec, mtime_nsec));
+  BOOST_CHECK_EQUAL(read_size, size);
+  BOOST_CHECK(extent_data.size() <= size);
+
+  std::vector<unsigned char> rebuilt(size, 0);
+  size_t pos = 0;
+  for (size_t i = 0; i < read_extents.size(); ++i) {
+    if (i > 0) {
+      BOOST_CHECK(read_extents[i].offset >= read_extents[i - 1].offset + read_extents[i - 1].length);
+    }
+    std::memcpy(&rebuilt[read_extents[i].offset], &extent_data[pos], read_extents[i].length);
+    pos += read_extents[i].length;
+  }
+  BOOST_CHECK(rebuilt == expected);
+
+  unsigned long file_crc = 0;
+  BOOST_REQUIRE(DirShare::calculate_file_crc32(test_file, file_crc));
+  BOOST_CHECK_EQUAL(DirShare::calculate_extents_crc32(extent_data.empty() ? 0 : &extent_data[0],
+                                                      read_extents, read_size),
+                    file_crc);
+
+  // Cleanup
+  ACE_OS::unlink(test_file);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,178 @@
+#define BOOST_TEST_MODULE IgnoreMatcherTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../IgnoreMatcher.h"
+#include "../SyncFilter.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(IgnoreMatcherTestSuite)
+
+// Test: Without patterns nothing is ignored
+BOOST_AUTO_TEST_CASE(test_empty_matcher)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.empty());
+  BOOST_CHECK(!matcher.ignored("anything.o"));
+  BOOST_CHECK(!matcher.ignored(""));
+}
+
+// Test: Comments, blank lines and subdirectory patterns are skipped
+BOOST_AUTO_TEST_CASE(test_skipped_lines)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(!matcher.add_pattern(""));
+  BOOST_CHECK(!matcher.add_pattern("   "));
+  BOOST_CHECK(!matcher.add_pattern("# build outputs"));
+  BOOST_CHECK(!matcher.add_pattern("build/"));
+  BOOST_CHECK(!matcher.add_pattern("docs/notes.txt"));
+  BOOST_CHECK(!matcher.add_pattern("trailing\\"));
+  BOOST_CHECK(matcher.empty());
+
+  BOOST_CHECK(!matcher.ignored("build"));
+  BOOST_CHECK(!matcher.ignored("notes.txt"));
+}
+
+// Test: Each pattern shape (exact, prefix, suffix, general glob)
+BOOST_AUTO_TEST_CASE(test_pattern_shapes)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.add_pattern("Thumbs.db"));
+  BOOST_CHECK(matcher.add_pattern("~$*"));
+  BOOST_CHECK(matcher.add_pattern("*.tmp"));
+  BOOST_CHECK(matcher.add_pattern(".*.sw[a-p]"));
+  BOOST_CHECK(matcher.add_pattern("core.????"));
+  BOOST_CHECK_EQUAL(matcher.size(), 5u);
+
+  BOOST_CHECK(matcher.ignored("Thumbs.db"));
+  BOOST_CHECK(!matcher.ignored("Thumbs.db.bak"));
+  BOOST_CHECK(matcher.ignored("~$report.docx"));
+  BOOST_CHECK(matcher.ignored("~$"));
+  BOOST_CHECK(matcher.ignored("download.tmp"));
+  BOOST_CHECK(matcher.ignored(".tmp"));
+  BOOST_CHECK(!matcher.ignored("download.tmp.part"));
+  BOOST_CHECK(matcher.ignored(".main.c.swp"));
+  BOOST_CHECK(!matcher.ignored(".main.c.swx"));
+  BOOST_CHECK(!matcher.ignored("main.c.swp"));
+  BOOST_CHECK(matcher.ignored("core.1234"));
+  BOOST_CHECK(!matcher.ignored("core.12345"));
+  BOOST_CHECK(!matcher.ignored("notes.txt"));
+}
+
+// Test: Character classes, negated classes and escapes
+BOOST_AUTO_TEST_CASE(test_classes_and_escapes)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.add_pattern("log[0-9]"));
+  BOOST_CHECK(matcher.add_pattern("out[!a-z].bin"));
+  BOOST_CHECK(matcher.add_pattern("\\#draft#"));
+  BOOST_CHECK(matcher.add_pattern("\\!important"));
+  BOOST_CHECK(matcher.add_pattern("literal\\*"));
+  BOOST_CHECK(matcher.add_pattern("open[bracket"));
+
+  BOOST_CHECK(matcher.ignored("log7"));
+  BOOST_CHECK(!matcher.ignored("logx"));
+  BOOST_CHECK(matcher.ignored("out_.bin"));
+  BOOST_CHECK(!matcher.ignored("outq.bin"));
+  BOOST_CHECK(matcher.ignored("#draft#"));
+  BOOST_CHECK(matcher.ignored("!important"));
+  BOOST_CHECK(matcher.ignored("literal*"));
+  BOOST_CHECK(!matcher.ignored("literally"));
+  BOOST_CHECK(matcher.ignored("open[bracket"));
+}
+
+// Test: The last matching pattern decides, across pattern shapes
+BOOST_AUTO_TEST_CASE(test_negation_order)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.add_pattern("*.log"));
+  BOOST_CHECK(matcher.add_pattern("!keep.log"));
+  BOOST_CHECK(matcher.add_pattern("build-*"));
+  BOOST_CHECK(matcher.add_pattern("!build-[0-9]*.zip"));
+  BOOST_CHECK(matcher.add_pattern("build-999.zip"));
+
+  BOOST_CHECK(matcher.ignored("debug.log"));
+  BOOST_CHECK(!matcher.ignored("keep.log"));
+  BOOST_CHECK(matcher.ignored("build-tmp"));
+  BOOST_CHECK(!matcher.ignored("build-42.zip"));
+  BOOST_CHECK(matcher.ignored("build-999.zip"));
+
+  // A later exclusion overrides an earlier re-inclusion
+  BOOST_CHECK(matcher.add_pattern("keep.*"));
+  BOOST_CHECK(matcher.ignored("keep.log"));
+}
+
+// Test: Anchored and "**/" patterns apply to the top of the share
+BOOST_AUTO_TEST_CASE(test_anchors)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.add_pattern("/a.out"));
+  BOOST_CHECK(matcher.add_pattern("**/.DS_Store"));
+  BOOST_CHECK(matcher.add_pattern("*.o   "));
+
+  BOOST_CHECK(matcher.ignored("a.out"));
+  BOOST_CHECK(matcher.ignored(".DS_Store"));
+  BOOST_CHECK(matcher.ignored("main.o"));
+  BOOST_CHECK(!matcher.ignored("main.o   "));
+}
+
+// Test: Loading an ignore file
+BOOST_AUTO_TEST_CASE(test_load_file)
+{
+  const std::string path = "ignore_matcher_test.dirshareignore";
+  {
+    std::ofstream out(path.c_str());
+    out << "# editor files\r\n*~\r\n\n*.tmp\n!wanted.tmp\n";
+  }
+
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(matcher.load_file(path));
+  BOOST_CHECK_EQUAL(matcher.size(), 3u);
+  BOOST_CHECK(matcher.ignored("notes.txt~"));
+  BOOST_CHECK(matcher.ignored("x.tmp"));
+  BOOST_CHECK(!matcher.ignored("wanted.tmp"));
+  BOOST_CHECK(!matcher.ignored("notes.txt"));
+  std::remove(path.c_str());
+
+  DirShare::IgnoreMatcher missing;
+  BOOST_CHECK(!missing.load_file("no_such_dir/.dirshareignore"));
+  BOOST_CHECK(missing.empty());
+}
+
+// Test: Globs with several stars match like a backtracking glob matcher
+BOOST_AUTO_TEST_CASE(test_glob_dfa)
+{
+  const char* const patterns[] = { "a*b*c", "*ab?*", "?*?.o", "x*x*x*", "*.*.*" };
+  const char alphabet[] = "abcx.o";
+
+  std::srand(62);
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); ++i) {
+    DirShare::IgnoreMatcher matcher;
+    BOOST_REQUIRE(matcher.add_pattern(patterns[i]));
+    for (int n = 0; n < 2000; ++n) {
+      std::string name;
+      const int length = std::rand() % 10;
+      for (int c = 0; c < length; ++c) {
+        name += alphabet[std::rand() % (sizeof(alphabet) - 1)];
+      }
+      BOOST_CHECK_MESSAGE(
+        matcher.ignored(name) == DirShare::SyncFilter::glob_match(patterns[i], name),
+        patterns[i] << " on \"" << name << "\"");
+    }
+  }
+}
+
+// Test: A glob whose DFA would be too large is skipped
+BOOST_AUTO_TEST_CASE(test_glob_too_complex)
+{
+  DirShare::IgnoreMatcher matcher;
+  BOOST_CHECK(!matcher.add_pattern("*a??????????????"));
+  BOOST_CHECK(matcher.empty());
+  BOOST_CHECK(matcher.add_pattern("*a???"));
+  BOOST_CHECK(matcher.ignored("xxabcd"));
+  BOOST_CHECK(!matcher.ignored("xxabcde"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
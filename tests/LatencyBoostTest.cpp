@@ -0,0 +1,101 @@
+#define BOOST_TEST_MODULE LatencyTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Latency.h"
+#include <ace/OS_NS_sys_time.h>
+#include <string>
+
+namespace {
+
+DirShare::FileMetadata make_metadata(const ACE_Time_Value& modified)
+{
+  DirShare::FileMetadata metadata;
+  metadata.filename = "traced.txt";
+  metadata.size = 10;
+  metadata.timestamp_sec = static_cast<CORBA::ULongLong>(modified.sec());
+  metadata.timestamp_nsec = static_cast<CORBA::ULong>(modified.usec() * 1000);
+  metadata.checksum = 0;
+  return metadata;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(LatencyTestSuite)
+
+// Test: Event ids are unique per change and share the process prefix
+BOOST_AUTO_TEST_CASE(test_event_ids)
+{
+  const DirShare::FileMetadata metadata = make_metadata(ACE_OS::gettimeofday());
+  const DirShare::LocalChange first = DirShare::stamp_local_change(metadata);
+  const DirShare::LocalChange second = DirShare::stamp_local_change(metadata);
+
+  BOOST_CHECK(first.origin.event_id != 0);
+  BOOST_CHECK(first.origin.event_id != second.origin.event_id);
+  BOOST_CHECK_EQUAL(first.origin.event_id >> 32, second.origin.event_id >> 32);
+  BOOST_CHECK(first.origin.detect_sec > 0);
+}
+
+// Test: Scan delay comes from the modification time (0 without one)
+BOOST_AUTO_TEST_CASE(test_scan_delay)
+{
+  const ACE_Time_Value modified = ACE_OS::gettimeofday() - ACE_Time_Value(2, 0);
+  const DirShare::LocalChange change =
+    DirShare::stamp_local_change(make_metadata(modified));
+  BOOST_CHECK_GE(change.origin.scan_delay_usec, 2000000ul);
+  BOOST_CHECK_LT(change.origin.scan_delay_usec, 3000000ul);
+  BOOST_CHECK_EQUAL(change.origin.queue_usec, 0ul);
+
+  const DirShare::LocalChange deleted =
+    DirShare::stamp_local_change(make_metadata(ACE_Time_Value::zero));
+  BOOST_CHECK_EQUAL(deleted.origin.scan_delay_usec, 0ul);
+}
+
+// Test: The sent origin carries the queue wait; untraced samples are zero
+BOOST_AUTO_TEST_CASE(test_origin_for_send)
+{
+  DirShare::LocalChange change =
+    DirShare::stamp_local_change(make_metadata(ACE_OS::gettimeofday()));
+  change.detected = change.detected - ACE_Time_Value(0, 250000);
+
+  const DirShare::ChangeOrigin sent = DirShare::origin_for_send(&change);
+  BOOST_CHECK_EQUAL(sent.event_id, change.origin.event_id);
+  BOOST_CHECK_EQUAL(sent.detect_sec, change.origin.detect_sec);
+  BOOST_CHECK_GE(sent.queue_usec, 250000ul);
+  BOOST_CHECK_LT(sent.queue_usec, 1250000ul);
+
+  const DirShare::ChangeOrigin untraced = DirShare::origin_for_send(0);
+  BOOST_CHECK_EQUAL(untraced.event_id, 0u);
+  BOOST_CHECK_EQUAL(untraced.queue_usec, 0ul);
+}
+
+// Test: Applied changes are recorded by path and stage; untraced ones are not
+BOOST_AUTO_TEST_CASE(test_recorder)
+{
+  DirShare::LatencyRecorder recorder("test");
+
+  recorder.record("untraced.txt", DirShare::origin_for_send(0), ACE_OS::gettimeofday(),
+                  ACE_Time_Value::zero, ACE_Time_Value::zero);
+  std::string text = DirShare::MetricsRegistry::instance().exposition();
+  BOOST_CHECK(text.find("dirshare_propagation_latency_seconds_count{path=\"test\"} 0\n") !=
+              std::string::npos);
+
+  DirShare::LocalChange change =
+    DirShare::stamp_local_change(make_metadata(ACE_OS::gettimeofday()));
+  change.origin.queue_usec = 1000;
+  recorder.record("traced.txt", change.origin, ACE_OS::gettimeofday(),
+                  ACE_Time_Value(0, 3000), ACE_Time_Value(0, 5000));
+
+  text = DirShare::MetricsRegistry::instance().exposition();
+  BOOST_CHECK(text.find("dirshare_propagation_latency_seconds_count{path=\"test\"} 1\n") !=
+              std::string::npos);
+  BOOST_CHECK(text.find("dirshare_propagation_stage_seconds_count"
+                        "{path=\"test\",stage=\"transfer\"} 1\n") != std::string::npos);
+  BOOST_CHECK(text.find("dirshare_propagation_stage_seconds_sum"
+                        "{path=\"test\",stage=\"queue\"} 0.001\n") != std::string::npos);
+  BOOST_CHECK(text.find("dirshare_propagation_stage_seconds_sum"
+                        "{path=\"test\",stage=\"verify\"} 0.003\n") != std::string::npos);
+  BOOST_CHECK(text.find("dirshare_propagation_stage_seconds_sum"
+                        "{path=\"test\",stage=\"write\"} 0.005\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,243 @@
+#define BOOST_TEST_MODULE MainLoopTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../MainLoop.h"
+#include "../Latency.h"
+#include "../FileUtils.h"
+
+#include <ace/OS_NS_signal.h>
+#include <ace/OS_NS_sys_stat.h>
+#include <ace/OS_NS_unistd.h>
+#include <ace/Task.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const TEST_DIR = "test_main_loop_boost";
+
+// Counts the calls; ends the loop after a given number of scans
+class CountingHandler : public DirShare::MainLoopHandler {
+public:
+  CountingHandler()
+    : loop(0), stop_after(0), scans(0), dumps(0)
+  {
+  }
+
+  virtual void scan()
+  {
+    if (++scans == stop_after && loop) {
+      loop->shutdown();
+    }
+  }
+
+  virtual void dump()
+  {
+    ++dumps;
+  }
+
+  DirShare::MainLoop* loop;
+  int stop_after;
+  int scans;
+  int dumps;
+};
+
+// Acts on the loop from another thread after a delay
+class Delayed : public ACE_Task_Base {
+public:
+  enum Action { REQUEST_SCAN, SHUTDOWN, WRITE_FILE, SIGNAL_TERM, SIGNAL_DUMP };
+
+  Delayed(DirShare::MainLoop& loop, Action action, const ACE_Time_Value& delay)
+    : loop_(loop), action_(action), delay_(delay)
+  {
+    activate(THR_NEW_LWP | THR_JOINABLE, 1);
+  }
+
+  ~Delayed()
+  {
+    wait();
+  }
+
+  virtual int svc()
+  {
+    ACE_OS::sleep(delay_);
+    switch (action_) {
+    case REQUEST_SCAN:
+      loop_.request_scan();
+      break;
+    case SHUTDOWN:
+      loop_.shutdown();
+      break;
+    case WRITE_FILE: {
+      std::ofstream file((std::string(TEST_DIR) + "/written.txt").c_str());
+      file << "content";
+      break;
+    }
+    case SIGNAL_TERM:
+      ACE_OS::kill(ACE_OS::getpid(), SIGTERM);
+      break;
+    case SIGNAL_DUMP:
+      ACE_OS::kill(ACE_OS::getpid(), SIGUSR1);
+      break;
+    }
+    return 0;
+  }
+
+private:
+  DirShare::MainLoop& loop_;
+  Action action_;
+  ACE_Time_Value delay_;
+};
+
+struct MainLoopFixture {
+  MainLoopFixture()
+  {
+    cleanup();
+    ACE_OS::mkdir(TEST_DIR);
+  }
+
+  ~MainLoopFixture()
+  {
+    cleanup();
+  }
+
+  void cleanup()
+  {
+    std::vector<std::string> files;
+    if (DirShare::list_directory_files(TEST_DIR, files)) {
+      for (size_t i = 0; i < files.size(); ++i) {
+        ACE_OS::unlink((std::string(TEST_DIR) + "/" + files[i]).c_str());
+      }
+    }
+    ACE_OS::rmdir(TEST_DIR);
+  }
+};
+
+const ACE_Time_Value LONG_INTERVAL(60, 0);
+const ACE_Time_Value SHORT_SETTLE(0, 10000);
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(MainLoopTestSuite, MainLoopFixture)
+
+// Test: Without notifications the directory is scanned every interval
+BOOST_AUTO_TEST_CASE(test_periodic_scans)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  handler.loop = &loop;
+  handler.stop_after = 3;
+  BOOST_REQUIRE(loop.open(TEST_DIR, ACE_Time_Value(0, 50000), SHORT_SETTLE));
+
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+  const ACE_Time_Value elapsed = DirShare::monotonic_now() - start;
+
+  BOOST_CHECK_EQUAL(handler.scans, 3);
+  BOOST_CHECK_EQUAL(loop.scans(), 3u);
+  BOOST_CHECK(elapsed >= ACE_Time_Value(0, 140000));
+  BOOST_CHECK(elapsed < ACE_Time_Value(5, 0));
+}
+
+// Test: request_scan() from another thread scans well before the interval
+BOOST_AUTO_TEST_CASE(test_request_scan)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  handler.loop = &loop;
+  handler.stop_after = 1;
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, SHORT_SETTLE));
+
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  Delayed request(loop, Delayed::REQUEST_SCAN, ACE_Time_Value(0, 50000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+  const ACE_Time_Value elapsed = DirShare::monotonic_now() - start;
+
+  BOOST_CHECK_EQUAL(handler.scans, 1);
+  BOOST_CHECK(elapsed < ACE_Time_Value(5, 0));
+}
+
+// Test: A burst of requests shares one scan
+BOOST_AUTO_TEST_CASE(test_requests_coalesce)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, ACE_Time_Value(0, 50000)));
+
+  for (int i = 0; i < 10; ++i) {
+    loop.request_scan();
+  }
+  Delayed shutdown(loop, Delayed::SHUTDOWN, ACE_Time_Value(0, 300000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+
+  BOOST_CHECK_EQUAL(handler.scans, 1);
+}
+
+// Test: A file written into the directory is scanned without waiting for the interval
+BOOST_AUTO_TEST_CASE(test_change_notification)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  handler.loop = &loop;
+  handler.stop_after = 1;
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, SHORT_SETTLE));
+#if defined (__linux__)
+  BOOST_REQUIRE(loop.watching());
+
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  Delayed write(loop, Delayed::WRITE_FILE, ACE_Time_Value(0, 50000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+  const ACE_Time_Value elapsed = DirShare::monotonic_now() - start;
+
+  BOOST_CHECK_EQUAL(handler.scans, 1);
+  BOOST_CHECK(elapsed < ACE_Time_Value(5, 0));
+#endif
+}
+
+// Test: shutdown() from another thread ends run() at once
+BOOST_AUTO_TEST_CASE(test_shutdown)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, SHORT_SETTLE));
+
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  Delayed shutdown(loop, Delayed::SHUTDOWN, ACE_Time_Value(0, 50000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+
+  BOOST_CHECK_EQUAL(handler.scans, 0);
+  BOOST_CHECK(DirShare::monotonic_now() - start < ACE_Time_Value(5, 0));
+}
+
+// Test: SIGTERM ends run()
+BOOST_AUTO_TEST_CASE(test_terminate_signal)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, SHORT_SETTLE));
+
+  const ACE_Time_Value start = DirShare::monotonic_now();
+  Delayed terminate(loop, Delayed::SIGNAL_TERM, ACE_Time_Value(0, 50000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+
+  BOOST_CHECK_EQUAL(handler.scans, 0);
+  BOOST_CHECK(DirShare::monotonic_now() - start < ACE_Time_Value(5, 0));
+}
+
+// Test: The dump signal calls dump() on the loop's thread and the loop goes on
+BOOST_AUTO_TEST_CASE(test_dump_signal)
+{
+  CountingHandler handler;
+  DirShare::MainLoop loop(handler);
+  BOOST_REQUIRE(loop.open(TEST_DIR, LONG_INTERVAL, SHORT_SETTLE, SIGUSR1));
+
+  Delayed dump(loop, Delayed::SIGNAL_DUMP, ACE_Time_Value(0, 50000));
+  Delayed shutdown(loop, Delayed::SHUTDOWN, ACE_Time_Value(0, 300000));
+  BOOST_CHECK_EQUAL(loop.run(), 0);
+
+  BOOST_CHECK_EQUAL(handler.dumps, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+#define BOOST_TEST_MODULE MetricsTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Metrics.h"
+#include <string>
+
+using DirShare::Histogram;
+
+BOOST_AUTO_TEST_SUITE(MetricsTestSuite)
+
+// Test: Counters and gauges
+BOOST_AUTO_TEST_CASE(test_counter_and_gauge)
+{
+  DirShare::Counter counter;
+  counter.increment();
+  counter.increment(41);
+  BOOST_CHECK_EQUAL(counter.value(), 42ul);
+
+  DirShare::Gauge gauge;
+  gauge.set(10);
+  gauge.add(5);
+  gauge.sub(20);
+  BOOST_CHECK_EQUAL(gauge.value(), -5l);
+}
+
+// Test: Every value falls in a bucket whose range contains it, within ~3%
+BOOST_AUTO_TEST_CASE(test_bucket_mapping)
+{
+  for (uint64_t value = 0; value < 32; ++value) {
+    BOOST_CHECK_EQUAL(Histogram::bucket_index(value), value);
+    BOOST_CHECK_EQUAL(Histogram::bucket_upper(Histogram::bucket_index(value)), value);
+  }
+
+  const uint64_t samples[] = { 32, 33, 63, 64, 65, 100, 1000, 4095, 4096, 123456,
+                               1000000, 987654321, (1ULL << 39) + 12345 };
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+    const uint64_t value = samples[i];
+    const size_t index = Histogram::bucket_index(value);
+    BOOST_CHECK_LT(index, static_cast<size_t>(Histogram::BUCKETS));
+    const uint64_t upper = Histogram::bucket_upper(index);
+    BOOST_CHECK_GE(upper, value);
+    BOOST_CHECK_LE(upper - value, value / 32);
+    if (index > 0) {
+      BOOST_CHECK_LT(Histogram::bucket_upper(index - 1), value);
+    }
+  }
+
+  // Out of range values land in the top bucket
+  BOOST_CHECK_EQUAL(Histogram::bucket_index(~0ULL),
+                    static_cast<size_t>(Histogram::BUCKETS - 1));
+}
+
+// Test: Quantiles, sum and count
+BOOST_AUTO_TEST_CASE(test_histogram_quantiles)
+{
+  Histogram histogram;
+  BOOST_CHECK_EQUAL(histogram.quantile(0.5), 0u);
+
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.record(value);
+  }
+  BOOST_CHECK_EQUAL(histogram.count(), 1000ul);
+  BOOST_CHECK_EQUAL(histogram.sum(), 500500ul);
+
+  const uint64_t median = histogram.quantile(0.5);
+  BOOST_CHECK_GE(median, 500u);
+  BOOST_CHECK_LE(median, 516u);
+  const uint64_t p99 = histogram.quantile(0.99);
+  BOOST_CHECK_GE(p99, 990u);
+  BOOST_CHECK_LE(p99, 1023u);
+  BOOST_CHECK_EQUAL(histogram.quantile(1.0), 1007u);
+
+  Histogram durations;
+  durations.record(ACE_Time_Value(1, 500));
+  durations.record(ACE_Time_Value(-1, 0));
+  BOOST_CHECK_EQUAL(durations.count(), 2ul);
+  BOOST_CHECK_EQUAL(durations.sum(), 1000500ul);
+}
+
+// Test: Lookups return the same metric; exposition follows the text format
+BOOST_AUTO_TEST_CASE(test_registry_exposition)
+{
+  DirShare::MetricsRegistry registry;
+
+  DirShare::Counter& sent = registry.counter("test_samples_total", "Samples\nsent",
+                                             "topic=\"A\"");
+  BOOST_CHECK_EQUAL(&sent, &registry.counter("test_samples_total", "Samples\nsent",
+                                             "topic=\"A\""));
+  registry.counter("test_samples_total", "Samples\nsent", "topic=\"B\"").increment(7);
+  sent.increment(3);
+
+  registry.gauge("test_buffered_bytes", "Buffered").set(-2);
+
+  Histogram& latency = registry.histogram("test_latency_seconds", "Latency", 1e-6);
+  latency.record(2000);
+  latency.record(4000);
+
+  const std::string text = registry.exposition();
+  BOOST_CHECK(text.find("# HELP test_samples_total Samples\\nsent\n") != std::string::npos);
+  BOOST_CHECK(text.find("# TYPE test_samples_total counter\n") != std::string::npos);
+  BOOST_CHECK(text.find("test_samples_total{topic=\"A\"} 3\n") != std::string::npos);
+  BOOST_CHECK(text.find("test_samples_total{topic=\"B\"} 7\n") != std::string::npos);
+  BOOST_CHECK(text.find("# TYPE test_buffered_bytes gauge\n") != std::string::npos);
+  BOOST_CHECK(text.find("test_buffered_bytes -2\n") != std::string::npos);
+  BOOST_CHECK(text.find("# TYPE test_latency_seconds summary\n") != std::string::npos);
+  BOOST_CHECK(text.find("test_latency_seconds{quantile=\"0.5\"} 0.002") != std::string::npos);
+  BOOST_CHECK(text.find("test_latency_seconds_sum 0.006\n") != std::string::npos);
+  BOOST_CHECK(text.find("test_latency_seconds_count 2\n") != std::string::npos);
+
+  // Families are sorted by name
+  BOOST_CHECK_LT(text.find("test_buffered_bytes"), text.find("test_latency_seconds"));
+  BOOST_CHECK_LT(text.find("test_latency_seconds"), text.find("test_samples_total"));
+}
+
+// Test: Topic counters register per-topic samples and payload bytes
+BOOST_AUTO_TEST_CASE(test_topic_counters)
+{
+  DirShare::TopicCounters counters("sent", "Test_Topic");
+  counters.sample(100);
+  counters.sample();
+
+  const std::string text = DirShare::MetricsRegistry::instance().exposition();
+  BOOST_CHECK(text.find("dirshare_samples_sent_total{topic=\"Test_Topic\"} 2\n") !=
+              std::string::npos);
+  BOOST_CHECK(text.find("dirshare_payload_bytes_sent_total{topic=\"Test_Topic\"} 100\n") !=
+              std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
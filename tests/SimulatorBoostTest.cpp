@@ -0,0 +1,183 @@
+#define BOOST_TEST_MODULE SimulatorTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Simulator.h"
+#include "../FileSystem.h"
+#include "../FileUtils.h"
+#include "../Checksum.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> bytes_of(const std::string& text)
+{
+  return std::vector<unsigned char>(text.begin(), text.end());
+}
+
+std::string read_text(const std::string& path)
+{
+  std::vector<unsigned char> data;
+  if (!DirShare::read_file(path, data)) {
+    return "<missing>";
+  }
+  return std::string(data.begin(), data.end());
+}
+
+DirShare::SimulationConfig small_config(unsigned peers)
+{
+  DirShare::SimulationConfig config;
+  config.peers = peers;
+  config.time_limit = ACE_Time_Value(120, 0);
+  return config;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(SimulatorTestSuite)
+
+// Test: Once mounted, the FileUtils functions work on the memory file system
+BOOST_AUTO_TEST_CASE(test_memory_file_system)
+{
+  DirShare::MemoryFileSystem fs;
+  DirShare::FileSystem::mount(&fs);
+  BOOST_REQUIRE(fs.make_directory("/shared"));
+  fs.set_time(1700000000);
+
+  const std::string text = "in memory";
+  BOOST_CHECK(!DirShare::write_file("/missing/a.txt",
+                                    reinterpret_cast<const unsigned char*>(text.data()),
+                                    text.size()));
+  BOOST_REQUIRE(DirShare::write_file("/shared//a.txt",
+                                     reinterpret_cast<const unsigned char*>(text.data()),
+                                     text.size()));
+  BOOST_CHECK(DirShare::file_exists("/shared/a.txt"));
+  BOOST_CHECK(DirShare::is_directory("/shared/"));
+  BOOST_CHECK_EQUAL(read_text("/shared/a.txt"), text);
+
+  unsigned long long size = 0;
+  BOOST_CHECK(DirShare::get_file_size("/shared/a.txt", size));
+  BOOST_CHECK_EQUAL(size, text.size());
+
+  unsigned long long sec = 0;
+  unsigned long nsec = 1;
+  BOOST_CHECK(DirShare::get_file_mtime("/shared/a.txt", sec, nsec));
+  BOOST_CHECK_EQUAL(sec, 1700000000ULL);
+  BOOST_CHECK_EQUAL(nsec, 0u);
+  BOOST_CHECK(DirShare::set_file_mtime("/shared/a.txt", 1600000000ULL, 500));
+  BOOST_CHECK(DirShare::get_file_mtime("/shared/a.txt", sec, nsec));
+  BOOST_CHECK_EQUAL(sec, 1600000000ULL);
+
+  unsigned long checksum = 0;
+  BOOST_CHECK(DirShare::calculate_file_crc32("/shared/a.txt", checksum));
+  BOOST_CHECK_EQUAL(checksum, DirShare::calculate_crc32(
+    reinterpret_cast<const unsigned char*>(text.data()), text.size()));
+
+  BOOST_CHECK(DirShare::clone_file("/shared/a.txt", "/shared/b.txt"));
+  BOOST_CHECK(fs.make_directory("/shared/sub"));
+  BOOST_CHECK(DirShare::write_file("/shared/sub/c.txt",
+                                   reinterpret_cast<const unsigned char*>(text.data()),
+                                   text.size()));
+  std::vector<std::string> files;
+  BOOST_CHECK(DirShare::list_directory_files("/shared", files));
+  BOOST_REQUIRE_EQUAL(files.size(), 2u);
+  BOOST_CHECK_EQUAL(files[0], "a.txt");
+  BOOST_CHECK_EQUAL(files[1], "b.txt");
+
+  BOOST_CHECK(DirShare::delete_file("/shared/a.txt"));
+  BOOST_CHECK(!DirShare::delete_file("/shared/a.txt"));
+  BOOST_CHECK(!DirShare::file_exists("/shared/a.txt"));
+
+  DirShare::FileSystem::mount(0);
+  BOOST_CHECK(!DirShare::is_directory("/shared"));
+}
+
+// Test: A file written on one peer reaches every other peer
+BOOST_AUTO_TEST_CASE(test_fanout_converges)
+{
+  DirShare::Simulator simulator(small_config(5));
+  simulator.write_file(ACE_Time_Value(1, 0), 0, "a.txt", bytes_of("alpha"));
+  simulator.write_file(ACE_Time_Value(1, 0), 0, "b.txt", bytes_of("beta"));
+
+  DirShare::SimulationResult result;
+  BOOST_REQUIRE(simulator.run(result));
+  BOOST_CHECK(result.converged);
+  BOOST_CHECK(result.converged_at >= result.last_action);
+  BOOST_CHECK(result.end_time < ACE_Time_Value(120, 0));
+  for (unsigned p = 1; p < 5; ++p) {
+    BOOST_CHECK_EQUAL(read_text(simulator.directory(p) + "/a.txt"), "alpha");
+    BOOST_CHECK_EQUAL(read_text(simulator.directory(p) + "/b.txt"), "beta");
+  }
+
+  // Each publication reaches the 4 other peers
+  const DirShare::SimulationTotals& events = result.published[DirShare::CAPTURE_FILE_EVENT];
+  const DirShare::SimulationTotals& contents = result.published[DirShare::CAPTURE_FILE_CONTENT];
+  BOOST_CHECK(events.samples >= 2u);
+  BOOST_CHECK(contents.samples >= 2u);
+  BOOST_CHECK_EQUAL(result.deliveries, (events.samples + contents.samples) * 4);
+  BOOST_CHECK_EQUAL(result.bytes_delivered, (events.bytes + contents.bytes) * 4);
+}
+
+// Test: Files held before the start are pushed to the other peers
+BOOST_AUTO_TEST_CASE(test_initial_files)
+{
+  DirShare::Simulator simulator(small_config(3));
+  simulator.write_file(ACE_Time_Value::zero, 2, "existing.txt", bytes_of("from the start"));
+
+  DirShare::SimulationResult result;
+  BOOST_REQUIRE(simulator.run(result));
+  BOOST_CHECK(result.converged);
+  BOOST_CHECK_EQUAL(read_text(simulator.directory(0) + "/existing.txt"), "from the start");
+}
+
+// Test: Of two modifications seconds apart, the later one wins everywhere
+BOOST_AUTO_TEST_CASE(test_last_writer_wins)
+{
+  DirShare::Simulator simulator(small_config(4));
+  simulator.write_file(ACE_Time_Value::zero, 0, "shared.txt", bytes_of("original"));
+  simulator.write_file(ACE_Time_Value(3, 200000), 1, "shared.txt", bytes_of("first edit"));
+  simulator.write_file(ACE_Time_Value(6, 500000), 3, "shared.txt", bytes_of("second edit"));
+
+  DirShare::SimulationResult result;
+  BOOST_REQUIRE(simulator.run(result));
+  BOOST_CHECK(result.converged);
+  for (unsigned p = 0; p < 4; ++p) {
+    BOOST_CHECK_EQUAL(read_text(simulator.directory(p) + "/shared.txt"), "second edit");
+  }
+}
+
+// Test: A deletion on one peer removes the file everywhere
+BOOST_AUTO_TEST_CASE(test_delete_propagates)
+{
+  DirShare::Simulator simulator(small_config(4));
+  simulator.write_file(ACE_Time_Value::zero, 0, "doomed.txt", bytes_of("x"));
+  simulator.delete_file(ACE_Time_Value(5, 0), 2, "doomed.txt");
+
+  DirShare::SimulationResult result;
+  BOOST_REQUIRE(simulator.run(result));
+  BOOST_CHECK(result.converged);
+  for (unsigned p = 0; p < 4; ++p) {
+    BOOST_CHECK(!DirShare::file_exists(simulator.directory(p) + "/doomed.txt"));
+  }
+}
+
+// Test: Runs with the same seed produce the same traffic and timing
+BOOST_AUTO_TEST_CASE(test_deterministic)
+{
+  DirShare::SimulationResult results[2];
+  for (int run = 0; run < 2; ++run) {
+    DirShare::Simulator simulator(small_config(6));
+    for (unsigned p = 0; p < 6; ++p) {
+      simulator.write_file(ACE_Time_Value(1, p * 150000), p, "shared.txt",
+                           bytes_of(std::string(10 + p, 'a' + static_cast<char>(p))));
+    }
+    BOOST_REQUIRE(simulator.run(results[run]));
+  }
+  BOOST_CHECK_EQUAL(results[0].deliveries, results[1].deliveries);
+  BOOST_CHECK_EQUAL(results[0].bytes_delivered, results[1].bytes_delivered);
+  BOOST_CHECK(results[0].converged_at == results[1].converged_at);
+  BOOST_CHECK(results[0].end_time == results[1].end_time);
+  BOOST_CHECK_EQUAL(results[0].converged, results[1].converged);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
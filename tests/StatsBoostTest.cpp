@@ -0,0 +1,243 @@
+#define BOOST_TEST_MODULE StatsTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Stats.h"
+#include "../Latency.h"
+#include "../Metrics.h"
+#include <ace/OS_NS_sys_time.h>
+#include <string>
+
+namespace {
+
+DirShare::ParticipantStats make_stats(const std::string& id,
+                                      CORBA::ULongLong digest,
+                                      CORBA::ULong origin,
+                                      CORBA::ULong last_sequence)
+{
+  DirShare::ParticipantStats stats;
+  stats.participant_id = id.c_str();
+  stats.hostname = "host";
+  stats.time_sec = 1000;
+  stats.time_nsec = 0;
+  stats.origin = origin;
+  stats.last_sequence = last_sequence;
+  stats.file_count = 0;
+  stats.total_bytes = 0;
+  stats.directory_digest = digest;
+  stats.digest_changed_sec = 0;
+  stats.digest_changed_nsec = 0;
+  stats.local_change_sec = 0;
+  stats.local_change_nsec = 0;
+  stats.bytes_in_flight = 0;
+  stats.backlog = 0;
+  stats.bytes_sent = 0;
+  stats.bytes_received = 0;
+  stats.checksum_errors = 0;
+  stats.write_errors = 0;
+  stats.transfer_errors = 0;
+  return stats;
+}
+
+void set_applied(DirShare::ParticipantStats& stats, CORBA::ULong origin, CORBA::ULong sequence)
+{
+  const CORBA::ULong i = stats.applied.length();
+  stats.applied.length(i + 1);
+  stats.applied[i].origin = origin;
+  stats.applied[i].last_sequence = sequence;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(StatsTestSuite)
+
+// Test: Equal file sets give equal digests whatever the order
+BOOST_AUTO_TEST_CASE(test_digest_order_independent)
+{
+  DirShare::DirectorySummary forward;
+  forward.add("a.txt", 10, 0x1111);
+  forward.add("dir/b.bin", 20, 0x2222);
+  forward.add("c", 30, 0x3333);
+
+  DirShare::DirectorySummary backward;
+  backward.add("c", 30, 0x3333);
+  backward.add("dir/b.bin", 20, 0x2222);
+  backward.add("a.txt", 10, 0x1111);
+
+  BOOST_CHECK_EQUAL(forward.digest, backward.digest);
+  BOOST_CHECK_EQUAL(forward.file_count, 3ul);
+  BOOST_CHECK_EQUAL(forward.total_bytes, 60ull);
+  BOOST_CHECK(DirShare::DirectorySummary().digest == 0);
+}
+
+// Test: Content, name and membership changes change the digest
+BOOST_AUTO_TEST_CASE(test_digest_sensitivity)
+{
+  BOOST_CHECK(DirShare::file_digest("a.txt", 1) != DirShare::file_digest("a.txt", 2));
+  BOOST_CHECK(DirShare::file_digest("a.txt", 1) != DirShare::file_digest("b.txt", 1));
+  BOOST_CHECK(DirShare::file_digest("ab", 0) != DirShare::file_digest("a", 0x62));
+
+  DirShare::DirectorySummary one;
+  one.add("a.txt", 1, 7);
+  DirShare::DirectorySummary two = one;
+  two.add("b.txt", 1, 7);
+  BOOST_CHECK(one.digest != two.digest);
+}
+
+// Test: Removing a file undoes adding it
+BOOST_AUTO_TEST_CASE(test_digest_remove)
+{
+  DirShare::DirectorySummary summary;
+  summary.add("a.txt", 10, 0x1111);
+  const DirShare::DirectorySummary one = summary;
+
+  summary.add("b.txt", 20, 0x2222);
+  summary.remove("b.txt", 20, 0x2222);
+  BOOST_CHECK_EQUAL(summary.digest, one.digest);
+  BOOST_CHECK_EQUAL(summary.file_count, 1ul);
+  BOOST_CHECK_EQUAL(summary.total_bytes, 10ull);
+
+  // Modification: remove the old state, add the new
+  summary.remove("a.txt", 10, 0x1111);
+  summary.add("a.txt", 12, 0x3333);
+  DirShare::DirectorySummary fresh;
+  fresh.add("a.txt", 12, 0x3333);
+  BOOST_CHECK_EQUAL(summary.digest, fresh.digest);
+}
+
+// Test: Convergence means one digest across the view
+BOOST_AUTO_TEST_CASE(test_fleet_converged)
+{
+  DirShare::FleetView view;
+  BOOST_CHECK(!view.converged());
+
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  view.update(make_stats("a", 42, 1, 0), now);
+  view.update(make_stats("b", 42, 2, 0), now);
+  BOOST_CHECK(view.converged());
+
+  view.update(make_stats("c", 43, 3, 0), now);
+  BOOST_CHECK(!view.converged());
+
+  view.remove("c");
+  BOOST_CHECK(view.converged());
+  BOOST_CHECK_EQUAL(view.nodes().size(), 2u);
+}
+
+// Test: Time to convergence runs from the last local change to the last
+// digest change
+BOOST_AUTO_TEST_CASE(test_fleet_convergence_time)
+{
+  DirShare::FleetView view;
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+  BOOST_CHECK(!view.convergence().converged);
+
+  // a changed a file at 100.5; b applied it at 101, c at 102.25
+  DirShare::ParticipantStats a = make_stats("a", 7, 1, 3);
+  a.local_change_sec = 100;
+  a.local_change_nsec = 500000000;
+  a.digest_changed_sec = 100;
+  a.digest_changed_nsec = 500000000;
+  DirShare::ParticipantStats b = make_stats("b", 7, 2, 0);
+  b.local_change_sec = 50;
+  b.digest_changed_sec = 101;
+  DirShare::ParticipantStats c = make_stats("c", 6, 3, 0);
+  c.digest_changed_sec = 90;
+
+  view.update(a, now);
+  view.update(b, now);
+  view.update(c, now);
+
+  DirShare::FleetView::Convergence convergence = view.convergence();
+  BOOST_CHECK(!convergence.converged);
+  BOOST_CHECK_EQUAL(convergence.digests, 2u);
+  BOOST_CHECK(convergence.time_to_converge() == ACE_Time_Value::zero);
+
+  c.directory_digest = 7;
+  c.digest_changed_sec = 102;
+  c.digest_changed_nsec = 250000000;
+  view.update(c, now);
+
+  convergence = view.convergence();
+  BOOST_CHECK(convergence.converged);
+  BOOST_CHECK_EQUAL(convergence.digests, 1u);
+  BOOST_CHECK(convergence.last_change == ACE_Time_Value(100, 500000));
+  BOOST_CHECK(convergence.settled == ACE_Time_Value(102, 250000));
+  BOOST_CHECK(convergence.time_to_converge() == ACE_Time_Value(1, 750000));
+
+  // A change that leaves the content as it was (touch) converges at once
+  a.local_change_sec = 200;
+  view.update(a, now);
+  BOOST_CHECK(view.convergence().time_to_converge() == ACE_Time_Value::zero);
+}
+
+// Test: Lag counts newer changes of other origins not yet applied
+BOOST_AUTO_TEST_CASE(test_fleet_lag)
+{
+  DirShare::FleetView view;
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+
+  DirShare::ParticipantStats a = make_stats("a", 1, 100, 10);
+  DirShare::ParticipantStats b = make_stats("b", 1, 200, 5);
+  DirShare::ParticipantStats c = make_stats("c", 1, 300, 0);
+  set_applied(c, 100, 7);
+
+  view.update(a, now);
+  view.update(b, now);
+  view.update(c, now);
+
+  BOOST_CHECK_EQUAL(view.lag("a"), 5ul);      // Nothing of b applied
+  BOOST_CHECK_EQUAL(view.lag("b"), 10ul);     // Nothing of a applied
+  BOOST_CHECK_EQUAL(view.lag("c"), 3ul + 5);  // 3 of a, 5 of b
+  BOOST_CHECK_EQUAL(view.lag("unknown"), 0ul);
+}
+
+// Test: Rates come from successive totals; silent participants expire
+BOOST_AUTO_TEST_CASE(test_fleet_rates_and_expiry)
+{
+  DirShare::FleetView view;
+  const ACE_Time_Value now = ACE_OS::gettimeofday();
+
+  DirShare::ParticipantStats stats = make_stats("a", 1, 1, 0);
+  view.update(stats, now - ACE_Time_Value(30));
+  stats.time_sec += 2;
+  stats.bytes_sent = 4096;
+  stats.bytes_received = 1024;
+  view.update(stats, now - ACE_Time_Value(20));
+
+  const DirShare::FleetView::Node& node = view.nodes().find("a")->second;
+  BOOST_CHECK_CLOSE(node.send_rate, 2048.0, 0.001);
+  BOOST_CHECK_CLOSE(node.receive_rate, 512.0, 0.001);
+
+  view.update(make_stats("b", 1, 2, 0), now);
+  BOOST_CHECK_EQUAL(view.expire(now, ACE_Time_Value(10)), 1u);
+  BOOST_CHECK(view.nodes().find("a") == view.nodes().end());
+  BOOST_CHECK(view.nodes().find("b") != view.nodes().end());
+}
+
+// Test: The local sample carries the registry totals and applied origins
+BOOST_AUTO_TEST_CASE(test_collect_participant_stats)
+{
+  DirShare::receive_errors("checksum").increment(2);
+  DirShare::TopicCounters sent("sent", "DirShare_FileContent");
+  sent.sample(1000);
+  DirShare::AppliedOrigins::instance().applied((static_cast<uint64_t>(77) << 32) | 9);
+  DirShare::AppliedOrigins::instance().applied((static_cast<uint64_t>(77) << 32) | 4);
+
+  DirShare::DirectorySummary directory;
+  directory.add("a.txt", 5, 1);
+
+  DirShare::ParticipantStats stats;
+  DirShare::collect_participant_stats("self", directory, stats);
+
+  BOOST_CHECK_EQUAL(std::string(stats.participant_id.in()), "self");
+  BOOST_CHECK_EQUAL(stats.file_count, 1u);
+  BOOST_CHECK_EQUAL(stats.directory_digest, directory.digest);
+  BOOST_CHECK_EQUAL(stats.checksum_errors, 2u);
+  BOOST_CHECK_EQUAL(stats.bytes_sent, 1000ull);
+  BOOST_CHECK_EQUAL(stats.origin, DirShare::local_origin());
+  BOOST_REQUIRE_EQUAL(stats.applied.length(), 1u);
+  BOOST_CHECK_EQUAL(stats.applied[0].origin, 77u);
+  BOOST_CHECK_EQUAL(stats.applied[0].last_sequence, 9u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,223 @@
+#define BOOST_TEST_MODULE SwarmSchedulerTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../SwarmScheduler.h"
+#include <ace/Time_Value.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace {
+
+const uint32_t MB = 1024 * 1024;
+
+// Simulated peers: each serves its requests in order at a fixed rate
+class Swarm {
+public:
+  explicit Swarm(DirShare::SwarmScheduler& scheduler)
+    : scheduler_(scheduler)
+    , now_(1000, 0)
+  {
+  }
+
+  void add_peer(const std::string& id, double bytes_per_second)
+  {
+    Peer& peer = peers_[id];
+    peer.rate = bytes_per_second;
+    peer.credit = 0.0;
+    scheduler_.add_source(id, 0.0);
+  }
+
+  // Run in 10ms steps until complete (or the time limit); returns seconds
+  double run(uint32_t chunk_size, double limit_seconds)
+  {
+    const ACE_Time_Value step(0, 10000);
+    double elapsed = 0.0;
+
+    dispatch();
+    while (!scheduler_.complete() && elapsed < limit_seconds) {
+      now_ += step;
+      elapsed += 0.01;
+
+      for (std::map<std::string, Peer>::iterator it = peers_.begin(); it != peers_.end(); ++it) {
+        Peer& peer = it->second;
+        if (peer.queue.empty()) {
+          peer.credit = 0.0;
+          continue;
+        }
+        peer.credit += peer.rate * 0.01;
+        while (!peer.queue.empty() && peer.credit >= chunk_size) {
+          peer.credit -= chunk_size;
+          scheduler_.chunk_received(peer.queue.front(), now_);
+          peer.queue.pop_front();
+        }
+      }
+      dispatch();
+    }
+    return elapsed;
+  }
+
+  // Requests sent to a peer are dropped from now on
+  void silence(const std::string& id)
+  {
+    peers_[id].rate = 0.0;
+  }
+
+  const ACE_Time_Value& now() const { return now_; }
+
+private:
+  struct Peer {
+    double rate;
+    double credit;
+    std::deque<uint32_t> queue;
+  };
+
+  void dispatch()
+  {
+    std::vector<DirShare::ChunkBatch> batches;
+    scheduler_.schedule(now_, batches);
+    for (size_t i = 0; i < batches.size(); ++i) {
+      Peer& peer = peers_[batches[i].source_id];
+      for (uint32_t c = 0; c < batches[i].count; ++c) {
+        peer.queue.push_back(batches[i].first_chunk + c);
+      }
+    }
+  }
+
+  DirShare::SwarmScheduler& scheduler_;
+  std::map<std::string, Peer> peers_;
+  ACE_Time_Value now_;
+};
+
+double join_time(unsigned seeders)
+{
+  DirShare::SwarmScheduler scheduler(200, 1 * MB);
+  Swarm swarm(scheduler);
+  for (unsigned i = 0; i < seeders; ++i) {
+    swarm.add_peer(std::string(1, static_cast<char>('a' + i)), 10.0 * MB);
+  }
+  return swarm.run(1 * MB, 600.0);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(SwarmSchedulerTestSuite)
+
+// Test: A single source is asked for every chunk, in bounded batches
+BOOST_AUTO_TEST_CASE(test_single_source_batches)
+{
+  DirShare::SwarmScheduler scheduler(10, 1 * MB);
+  scheduler.add_source("a", 0.0);
+
+  std::vector<DirShare::ChunkBatch> batches;
+  scheduler.schedule(ACE_Time_Value(1, 0), batches);
+
+  // 4MB batches, two in flight
+  BOOST_REQUIRE_EQUAL(batches.size(), 2u);
+  BOOST_CHECK_EQUAL(batches[0].source_id, "a");
+  BOOST_CHECK_EQUAL(batches[0].first_chunk, 0u);
+  BOOST_CHECK_EQUAL(batches[0].count, 4u);
+  BOOST_CHECK_EQUAL(batches[1].first_chunk, 4u);
+
+  for (uint32_t c = 0; c < 4; ++c) {
+    scheduler.chunk_received(c, ACE_Time_Value(2, 0));
+  }
+  batches.clear();
+  scheduler.schedule(ACE_Time_Value(2, 0), batches);
+  BOOST_REQUIRE_EQUAL(batches.size(), 1u);
+  BOOST_CHECK_EQUAL(batches[0].first_chunk, 8u);
+  BOOST_CHECK_EQUAL(batches[0].count, 2u);
+  BOOST_CHECK_CLOSE(scheduler.throughput("a"), 4.0 * MB, 1.0);
+
+  for (uint32_t c = 4; c < 10; ++c) {
+    scheduler.chunk_received(c, ACE_Time_Value(3, 0));
+  }
+  BOOST_CHECK(scheduler.complete());
+  BOOST_CHECK_EQUAL(scheduler.chunks_from("a"), 10u);
+}
+
+// Test: Requests follow observed throughput
+BOOST_AUTO_TEST_CASE(test_fast_source_serves_more)
+{
+  DirShare::SwarmScheduler scheduler(400, 256 * 1024);
+  Swarm swarm(scheduler);
+  swarm.add_peer("fast", 30.0 * MB);
+  swarm.add_peer("slow", 10.0 * MB);
+
+  swarm.run(256 * 1024, 600.0);
+  BOOST_REQUIRE(scheduler.complete());
+
+  double fast_share = static_cast<double>(scheduler.chunks_from("fast")) / 400.0;
+  BOOST_CHECK(fast_share > 0.65);
+  BOOST_CHECK(fast_share < 0.85);
+  BOOST_CHECK(scheduler.throughput("fast") > scheduler.throughput("slow"));
+}
+
+// Test: Join time falls roughly in proportion to the number of seeders
+BOOST_AUTO_TEST_CASE(test_join_time_scales_with_seeders)
+{
+  double one = join_time(1);
+  double two = join_time(2);
+  double four = join_time(4);
+
+  BOOST_CHECK_CLOSE(one, 20.0, 5.0);
+  BOOST_CHECK(two < one * 0.6);
+  BOOST_CHECK(four < one * 0.35);
+}
+
+// Test: Chunks of an unresponsive source are handed to the others, and the
+// source is dropped after repeated timeouts
+BOOST_AUTO_TEST_CASE(test_unresponsive_source_reassigned)
+{
+  DirShare::SwarmScheduler scheduler(100, 1 * MB);
+  Swarm swarm(scheduler);
+  swarm.add_peer("good", 10.0 * MB);
+  swarm.add_peer("dead", 10.0 * MB);
+  swarm.silence("dead");
+
+  swarm.run(1 * MB, 600.0);
+  BOOST_REQUIRE(scheduler.complete());
+  BOOST_CHECK_EQUAL(scheduler.chunks_from("good"), 100u);
+  BOOST_CHECK_EQUAL(scheduler.chunks_from("dead"), 0u);
+}
+
+// Test: No usable source left
+BOOST_AUTO_TEST_CASE(test_stalled_without_sources)
+{
+  DirShare::SwarmScheduler scheduler(8, 1 * MB);
+  BOOST_CHECK(scheduler.stalled());
+
+  scheduler.add_source("a", 0.0);
+  BOOST_CHECK(!scheduler.stalled());
+
+  std::vector<DirShare::ChunkBatch> batches;
+  scheduler.schedule(ACE_Time_Value(1, 0), batches);
+  BOOST_CHECK_EQUAL(batches.size(), 2u);
+
+  scheduler.remove_source("a");
+  BOOST_CHECK(scheduler.stalled());
+
+  // Withdrawn chunks go to a new source
+  scheduler.add_source("b", 0.0);
+  batches.clear();
+  scheduler.schedule(ACE_Time_Value(2, 0), batches);
+  BOOST_REQUIRE_EQUAL(batches.size(), 2u);
+  BOOST_CHECK_EQUAL(batches[0].source_id, "b");
+  BOOST_CHECK_EQUAL(batches[0].first_chunk, 0u);
+}
+
+// Test: An empty file is complete without requests
+BOOST_AUTO_TEST_CASE(test_empty_file)
+{
+  DirShare::SwarmScheduler scheduler(0, 1 * MB);
+  scheduler.add_source("a", 0.0);
+
+  std::vector<DirShare::ChunkBatch> batches;
+  scheduler.schedule(ACE_Time_Value(1, 0), batches);
+  BOOST_CHECK(batches.empty());
+  BOOST_CHECK(scheduler.complete());
+  BOOST_CHECK(!scheduler.stalled());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,111 @@
+#define BOOST_TEST_MODULE SyncFilterTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../SyncFilter.h"
+#include <string>
+
+BOOST_AUTO_TEST_SUITE(SyncFilterTestSuite)
+
+// Test: Shell glob matching
+BOOST_AUTO_TEST_CASE(test_glob_match)
+{
+  using DirShare::SyncFilter;
+
+  BOOST_CHECK(SyncFilter::glob_match("*.txt", "notes.txt"));
+  BOOST_CHECK(SyncFilter::glob_match("*.txt", ".txt"));
+  BOOST_CHECK(!SyncFilter::glob_match("*.txt", "notes.txt.bak"));
+  BOOST_CHECK(SyncFilter::glob_match("report_??.csv", "report_01.csv"));
+  BOOST_CHECK(!SyncFilter::glob_match("report_??.csv", "report_1.csv"));
+  BOOST_CHECK(SyncFilter::glob_match("a*b*c", "aXXbYYbZc"));
+  BOOST_CHECK(!SyncFilter::glob_match("a*b*c", "aXXbYY"));
+  BOOST_CHECK(SyncFilter::glob_match("*", ""));
+  BOOST_CHECK(SyncFilter::glob_match("exact.bin", "exact.bin"));
+  BOOST_CHECK(!SyncFilter::glob_match("exact.bin", "exact.bi"));
+}
+
+// Test: Without patterns or a size limit every file passes
+BOOST_AUTO_TEST_CASE(test_inactive_filter)
+{
+  DirShare::SyncFilter filter;
+  BOOST_CHECK(!filter.active());
+  BOOST_CHECK(filter.matches("anything.bin", 1ULL << 40));
+}
+
+// Test: A file passes if any pattern matches and it is within the limit
+BOOST_AUTO_TEST_CASE(test_patterns_and_size)
+{
+  DirShare::SyncFilter filter;
+  BOOST_CHECK(filter.add_pattern("*.txt"));
+  BOOST_CHECK(filter.add_pattern("docs-*"));
+  filter.set_max_size(1024);
+  BOOST_CHECK(filter.active());
+
+  BOOST_CHECK(filter.matches("a.txt", 100));
+  BOOST_CHECK(filter.matches("docs-index.html", 1024));
+  BOOST_CHECK(!filter.matches("a.txt", 1025));
+  BOOST_CHECK(!filter.matches("image.png", 10));
+}
+
+// Test: Patterns that cannot be quoted in a filter are rejected
+BOOST_AUTO_TEST_CASE(test_invalid_patterns)
+{
+  DirShare::SyncFilter filter;
+  BOOST_CHECK(!filter.add_pattern(""));
+  BOOST_CHECK(!filter.add_pattern("it's*"));
+  BOOST_CHECK(!filter.active());
+}
+
+// Test: LIKE wildcards cannot be escaped in a filter; the DDS filter of a
+// pattern holding them is a superset of matches()
+BOOST_AUTO_TEST_CASE(test_like_wildcards_superset)
+{
+  DirShare::SyncFilter filter;
+  BOOST_CHECK(filter.add_pattern("data_2024/*.csv"));
+  BOOST_CHECK(filter.add_pattern("100%.txt"));
+
+  DDS::StringSeq parameters;
+  filter.expression("filename", "size", parameters);
+  BOOST_REQUIRE_EQUAL(parameters.length(), 2u);
+  BOOST_CHECK_EQUAL(std::string(parameters[0]), "'data_2024/%.csv'");
+  BOOST_CHECK_EQUAL(std::string(parameters[1]), "'100%.txt'");
+
+  // matches() takes them literally
+  BOOST_CHECK(filter.matches("data_2024/a.csv", 1));
+  BOOST_CHECK(!filter.matches("dataX2024/a.csv", 1));
+  BOOST_CHECK(filter.matches("100%.txt", 1));
+  BOOST_CHECK(!filter.matches("100 percent.txt", 1));
+}
+
+// Test: Content filter expression and parameters
+BOOST_AUTO_TEST_CASE(test_expression)
+{
+  DirShare::SyncFilter filter;
+  filter.add_pattern("*.txt");
+  filter.add_pattern("data-?.bin");
+  filter.set_max_size(4096);
+
+  DDS::StringSeq parameters;
+  std::string expression = filter.expression("filename", "metadata.size", parameters);
+
+  BOOST_CHECK_EQUAL(expression,
+                    "(filename LIKE %0 OR filename LIKE %1) AND metadata.size <= %2");
+  BOOST_REQUIRE_EQUAL(parameters.length(), 3u);
+  BOOST_CHECK_EQUAL(std::string(parameters[0]), "'%.txt'");
+  BOOST_CHECK_EQUAL(std::string(parameters[1]), "'data-_.bin'");
+  BOOST_CHECK_EQUAL(std::string(parameters[2]), "4096");
+}
+
+// Test: Size limit alone
+BOOST_AUTO_TEST_CASE(test_expression_size_only)
+{
+  DirShare::SyncFilter filter;
+  filter.set_max_size(10);
+
+  DDS::StringSeq parameters;
+  BOOST_CHECK_EQUAL(filter.expression("filename", "file_size", parameters),
+                    "file_size <= %0");
+  BOOST_REQUIRE_EQUAL(parameters.length(), 1u);
+  BOOST_CHECK_EQUAL(std::string(parameters[0]), "10");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
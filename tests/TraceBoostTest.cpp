@@ -0,0 +1,71 @@
+#define BOOST_TEST_MODULE TraceTest
+#include <boost/test/included/unit_test.hpp>
+
+#include "../Trace.h"
+#include <string>
+
+namespace {
+
+size_t count_of(const std::string& text, const std::string& needle)
+{
+  size_t count = 0;
+  for (size_t pos = text.find(needle); pos != std::string::npos;
+       pos = text.find(needle, pos + needle.size())) {
+    ++count;
+  }
+  return count;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(TraceTestSuite)
+
+// Test: Spans are not recorded while the tracer is disabled
+// (must run first: the tracer cannot be disabled once enabled)
+BOOST_AUTO_TEST_CASE(test_disabled)
+{
+  BOOST_CHECK(!DirShare::Tracer::instance().enabled());
+  {
+    DirShare::TraceSpan span("scan", "disabled_span");
+  }
+  const std::string trace = DirShare::Tracer::instance().chrome_trace();
+  BOOST_CHECK(trace.find("disabled_span") == std::string::npos);
+  BOOST_CHECK(trace.find("\"traceEvents\":[") != std::string::npos);
+}
+
+// Test: Spans are written as complete events with category and detail
+BOOST_AUTO_TEST_CASE(test_spans)
+{
+  DirShare::Tracer::instance().enable(8);
+  {
+    DirShare::TraceSpan span("send", "load_file", DirShare::trace_detail("dir/a.txt"));
+  }
+  const std::string trace = DirShare::Tracer::instance().chrome_trace();
+  BOOST_CHECK(trace.find("\"name\":\"load_file\",\"cat\":\"send\",\"ph\":\"X\"") !=
+              std::string::npos);
+  BOOST_CHECK(trace.find("\"args\":{\"detail\":\"a.txt\"}") != std::string::npos);
+  BOOST_CHECK(trace.find("\"name\":\"thread_name\"") != std::string::npos);
+}
+
+// Test: A full ring keeps the most recent spans
+BOOST_AUTO_TEST_CASE(test_ring_wrap)
+{
+  for (int i = 0; i < 20; ++i) {
+    DirShare::TraceSpan span("receive", i < 10 ? "old_span" : "new_span");
+  }
+  const std::string trace = DirShare::Tracer::instance().chrome_trace();
+  BOOST_CHECK_EQUAL(count_of(trace, "\"old_span\""), 0u);
+  BOOST_CHECK_EQUAL(count_of(trace, "\"new_span\""), 8u);
+}
+
+// Test: Details are escaped as JSON strings
+BOOST_AUTO_TEST_CASE(test_escaping)
+{
+  {
+    DirShare::TraceSpan span("scan", "escaped", "say \"hi\"\\\n");
+  }
+  const std::string trace = DirShare::Tracer::instance().chrome_trace();
+  BOOST_CHECK(trace.find("\"detail\":\"say \\\"hi\\\"\\\\\\u000a\"") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
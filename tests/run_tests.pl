@@ -84,6 +84,25 @@ print "${YELLOW}--- Phase 8: User Story 6 (Metadata Preservation) Tests ---${NC}
 # Run Phase 8 Boost.Test suites (US6 - Metadata Transfer and Preservation)
 $status |= run_test("MetadataPreservationBoostTest", "MetadataPreservationBoostTest");
 
+print "${YELLOW}--- Performance: Transfer and Scaling Tests ---${NC}\n\n";
+
+# Run performance feature Boost.Test suites
+$status |= run_test("ContentIndexBoostTest", "ContentIndexBoostTest");
+$status |= run_test("ChunkSizeTunerBoostTest", "ChunkSizeTunerBoostTest");
+$status |= run_test("FecBoostTest", "FecBoostTest");
+$status |= run_test("SwarmSchedulerBoostTest", "SwarmSchedulerBoostTest");
+$status |= run_test("SyncFilterBoostTest", "SyncFilterBoostTest");
+$status |= run_test("IgnoreMatcherBoostTest", "IgnoreMatcherBoostTest");
+$status |= run_test("MetricsBoostTest", "MetricsBoostTest");
+$status |= run_test("LatencyBoostTest", "LatencyBoostTest");
+$status |= run_test("TraceBoostTest", "TraceBoostTest");
+$status |= run_test("StatsBoostTest", "StatsBoostTest");
+$status |= run_test("CaptureBoostTest", "CaptureBoostTest");
+$status |= run_test("SimulatorBoostTest", "SimulatorBoostTest");
+$status |= run_test("FaultInjectionBoostTest", "FaultInjectionBoostTest");
+$status |= run_test("AsyncLogBoostTest", "AsyncLogBoostTest");
+$status |= run_test("MainLoopBoostTest", "MainLoopBoostTest");
+
 # Summary
 print "╔══════════════════════════════════════════════╗\n";
 print "║              Test Summary                    ║\n";